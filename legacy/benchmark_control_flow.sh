@@ -0,0 +1,62 @@
+#!/bin/bash
+
+# Control Flow Benchmark Script
+# Runs nested for loops with builtin bodies in myshell and other shells
+
+set -e
+
+# Colors for output
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m'
+
+# Configuration
+SHELL_BINARY="${SHELL_BINARY:-./myshell}"
+DEPTH="${1:-5}"
+SCRIPT_FILE="/tmp/myshell_control_flow_$$.sh"
+
+trap 'rm -f "$SCRIPT_FILE"' EXIT
+
+# Generate DEPTH nested loops over 10 items (10^DEPTH iterations)
+generate_script() {
+    local indent=""
+    for ((d = 0; d < DEPTH; d++)); do
+        echo "${indent}for v$d in 0 1 2 3 4 5 6 7 8 9; do"
+        indent="$indent  "
+    done
+    echo "${indent}case \$v0 in 9) continue;; esac"
+    echo "${indent}if true; then :; else false; fi"
+    for ((d = DEPTH - 1; d >= 0; d--)); do
+        indent="${indent%  }"
+        echo "${indent}done"
+    done
+    echo "echo done"
+}
+
+# Time one run of the script, prints milliseconds
+time_shell() {
+    local shell="$1"
+    local start end
+    start=$(date +%s%N)
+    "$shell" "$SCRIPT_FILE" >/dev/null
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+}
+
+if [ ! -x "$SHELL_BINARY" ]; then
+    echo "Shell binary not found: $SHELL_BINARY (run 'make' first)"
+    exit 1
+fi
+
+generate_script > "$SCRIPT_FILE"
+
+echo -e "${BLUE}Control flow benchmark: $DEPTH nested loops, $((10 ** DEPTH)) iterations${NC}"
+
+for shell in "$SHELL_BINARY" dash bash; do
+    if [ "$shell" != "$SHELL_BINARY" ] && ! command -v "$shell" >/dev/null 2>&1; then
+        echo -e "${YELLOW}  $shell: not installed, skipped${NC}"
+        continue
+    fi
+    printf "  %-12s ${GREEN}%6s ms${NC}\n" "$shell" "$(time_shell "$shell")"
+done
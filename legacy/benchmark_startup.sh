@@ -0,0 +1,44 @@
+#!/bin/bash
+
+# Startup Benchmark Script
+# Measures the cost of `myshell -c true` against other shells
+
+set -e
+
+# Colors for output
+GREEN='\033[0;32m'
+YELLOW='\033[1;33m'
+BLUE='\033[0;34m'
+NC='\033[0m'
+
+# Configuration
+SHELL_BINARY="${SHELL_BINARY:-./myshell}"
+ITERATIONS="${1:-1000}"
+COMMAND="${2:-true}"
+
+# Function to time N invocations of a shell, prints microseconds per run
+time_shell() {
+    local shell="$1"
+    local start end
+    start=$(date +%s%N)
+    for ((i = 0; i < ITERATIONS; i++)); do
+        "$shell" -c "$COMMAND" >/dev/null
+    done
+    end=$(date +%s%N)
+    echo $(( (end - start) / ITERATIONS / 1000 ))
+}
+
+if [ ! -x "$SHELL_BINARY" ]; then
+    echo "Shell binary not found: $SHELL_BINARY (run 'make' first)"
+    exit 1
+fi
+
+echo -e "${BLUE}Startup benchmark: $ITERATIONS x -c '$COMMAND'${NC}"
+
+for shell in "$SHELL_BINARY" dash sh bash; do
+    if [ "$shell" != "$SHELL_BINARY" ] && ! command -v "$shell" >/dev/null 2>&1; then
+        echo -e "${YELLOW}  $shell: not installed, skipped${NC}"
+        continue
+    fi
+    printf "  %-12s ${GREEN}%6s us/run${NC}\n" "$shell" "$(time_shell "$shell")"
+done
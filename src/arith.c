@@ -0,0 +1,984 @@
+#include "shell.h"
+
+#include <limits.h>
+#include <stdint.h>
+
+/* 编译结果缓存的项数（直接映射，2的幂） */
+#define ARITH_CACHE_SIZE 64
+
+/* 变量值本身是表达式（如a=b）时递归求值的最大深度 */
+#define ARITH_MAX_RECURSION 16
+
+/* 表达式节点的运算 */
+typedef enum {
+    ARITH_NUM,          /* 常量 */
+    ARITH_VAR,          /* 变量（assignable为0时来自$name，只读） */
+    ARITH_NEG, ARITH_POS, ARITH_NOT, ARITH_BNOT,
+    ARITH_PREINC, ARITH_PREDEC, ARITH_POSTINC, ARITH_POSTDEC,
+    ARITH_MUL, ARITH_DIV, ARITH_MOD, ARITH_POW,
+    ARITH_ADD, ARITH_SUB, ARITH_SHL, ARITH_SHR,
+    ARITH_LT, ARITH_LE, ARITH_GT, ARITH_GE, ARITH_EQ, ARITH_NE,
+    ARITH_BAND, ARITH_BXOR, ARITH_BOR, ARITH_LAND, ARITH_LOR,
+    ARITH_COND,         /* a ? b : c */
+    ARITH_ASSIGN,       /* name op= value，op为ARITH_NUM时是普通赋值 */
+    ARITH_COMMA
+} arith_op_t;
+
+/* 表达式节点（子节点用下标引用，整个表达式只有一块节点数组） */
+typedef struct {
+    arith_op_t op;
+    arith_op_t assign_op;   /* ARITH_ASSIGN的复合运算 */
+    long long value;        /* ARITH_NUM的值 */
+    const char *name;       /* ARITH_VAR/ARITH_ASSIGN的变量名 */
+    int assignable;
+    int a, b, c;
+} arith_node_t;
+
+/* 编译后的表达式 */
+typedef struct {
+    arith_node_t *nodes;
+    int count;
+    int capacity;
+    int root;
+    char *names;            /* 变量名存储区（每个名字以'\0'结尾） */
+    size_t names_used;
+} arith_expr_t;
+
+/* 词法单元 */
+typedef enum {
+    ATOK_NUM, ATOK_NAME, ATOK_OP, ATOK_ASSIGN, ATOK_LPAREN, ATOK_RPAREN,
+    ATOK_QUESTION, ATOK_COLON, ATOK_END, ATOK_ERROR
+} arith_token_t;
+
+/* 编译状态 */
+typedef struct {
+    const char *text;
+    const char *pos;
+    arith_token_t type;
+    const char *token_start;
+    arith_op_t op;          /* ATOK_OP/ATOK_ASSIGN的运算 */
+    long long value;        /* ATOK_NUM的值 */
+    const char *name;       /* ATOK_NAME的名字（已复制到names） */
+    int assignable;
+    arith_expr_t *expr;
+    int error;
+} arith_parser_t;
+
+/* 运算符文本（长的在前，保证最长匹配） */
+static const struct {
+    const char *text;
+    arith_token_t type;
+    arith_op_t op;
+} arith_operators[] = {
+    { "<<=", ATOK_ASSIGN, ARITH_SHL }, { ">>=", ATOK_ASSIGN, ARITH_SHR },
+    { "**", ATOK_OP, ARITH_POW },
+    { "<<", ATOK_OP, ARITH_SHL }, { ">>", ATOK_OP, ARITH_SHR },
+    { "<=", ATOK_OP, ARITH_LE }, { ">=", ATOK_OP, ARITH_GE },
+    { "==", ATOK_OP, ARITH_EQ }, { "!=", ATOK_OP, ARITH_NE },
+    { "&&", ATOK_OP, ARITH_LAND }, { "||", ATOK_OP, ARITH_LOR },
+    { "++", ATOK_OP, ARITH_PREINC }, { "--", ATOK_OP, ARITH_PREDEC },
+    { "+=", ATOK_ASSIGN, ARITH_ADD }, { "-=", ATOK_ASSIGN, ARITH_SUB },
+    { "*=", ATOK_ASSIGN, ARITH_MUL }, { "/=", ATOK_ASSIGN, ARITH_DIV },
+    { "%=", ATOK_ASSIGN, ARITH_MOD }, { "&=", ATOK_ASSIGN, ARITH_BAND },
+    { "^=", ATOK_ASSIGN, ARITH_BXOR }, { "|=", ATOK_ASSIGN, ARITH_BOR },
+    { "=", ATOK_ASSIGN, ARITH_NUM },
+    { "+", ATOK_OP, ARITH_ADD }, { "-", ATOK_OP, ARITH_SUB },
+    { "*", ATOK_OP, ARITH_MUL }, { "/", ATOK_OP, ARITH_DIV },
+    { "%", ATOK_OP, ARITH_MOD }, { "<", ATOK_OP, ARITH_LT },
+    { ">", ATOK_OP, ARITH_GT }, { "&", ATOK_OP, ARITH_BAND },
+    { "^", ATOK_OP, ARITH_BXOR }, { "|", ATOK_OP, ARITH_BOR },
+    { "!", ATOK_OP, ARITH_NOT }, { "~", ATOK_OP, ARITH_BNOT },
+    { ",", ATOK_OP, ARITH_COMMA },
+    { NULL, ATOK_END, ARITH_NUM }
+};
+
+/**
+ * 二元运算符的优先级（数值越大结合越紧），不是二元运算符时返回0
+ */
+static int binary_precedence(arith_op_t op) {
+    switch (op) {
+        case ARITH_LOR: return 4;
+        case ARITH_LAND: return 5;
+        case ARITH_BOR: return 6;
+        case ARITH_BXOR: return 7;
+        case ARITH_BAND: return 8;
+        case ARITH_EQ: case ARITH_NE: return 9;
+        case ARITH_LT: case ARITH_LE: case ARITH_GT: case ARITH_GE: return 10;
+        case ARITH_SHL: case ARITH_SHR: return 11;
+        case ARITH_ADD: case ARITH_SUB: return 12;
+        case ARITH_MUL: case ARITH_DIV: case ARITH_MOD: return 13;
+        case ARITH_POW: return 14;
+        default: return 0;
+    }
+}
+
+/**
+ * 报告表达式错误（只报告第一个）
+ */
+static void arith_error(const char *text, const char *reason, const char *token) {
+    char error_msg[512];
+    if (token != NULL && token[0] != '\0') {
+        snprintf(error_msg, sizeof(error_msg), "%s: %s (error token is \"%s\")", text, reason, token);
+    } else {
+        snprintf(error_msg, sizeof(error_msg), "%s: %s", text, reason);
+    }
+    print_error(error_msg);
+}
+
+/**
+ * 解析整数常量：十进制、0开头的八进制、0x十六进制和base#digits（base为2..64）
+ * 返回0表示成功，*end指向常量之后的位置
+ */
+static int parse_number(const char *s, long long *value, const char **end) {
+    unsigned long long result = 0;
+    int base = 10;
+    const char *p = s;
+    
+    /* base#digits */
+    const char *hash = p;
+    while (isdigit((unsigned char)*hash)) {
+        hash++;
+    }
+    if (*hash == '#' && hash > p) {
+        base = (int)strtol(p, NULL, 10);
+        if (base < 2 || base > 64) {
+            return -1;
+        }
+        p = hash + 1;
+    } else if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        base = 16;
+        p += 2;
+    } else if (p[0] == '0') {
+        base = 8;
+    }
+    
+    const char *digits = p;
+    for (;; p++) {
+        int digit;
+        char c = *p;
+        if (isdigit((unsigned char)c)) {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'z') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'Z') {
+            digit = (base <= 36) ? c - 'A' + 10 : c - 'A' + 36;
+        } else if (c == '@' && base > 36) {
+            digit = 62;
+        } else if (c == '_' && base > 36) {
+            digit = 63;
+        } else {
+            break;
+        }
+        if (digit >= base) {
+            return -1;
+        }
+        result = result * (unsigned long long)base + (unsigned long long)digit;
+    }
+    if (p == digits && base != 8) {
+        return -1;
+    }
+    if (isalnum((unsigned char)*p) || *p == '_') {
+        return -1;
+    }
+    
+    *value = (long long)result;
+    *end = p;
+    return 0;
+}
+
+/**
+ * 把变量名复制到表达式的名字存储区
+ */
+static const char* store_name(arith_parser_t *ap, const char *start, size_t len) {
+    char *name = ap->expr->names + ap->expr->names_used;
+    memcpy(name, start, len);
+    name[len] = '\0';
+    ap->expr->names_used += len + 1;
+    return name;
+}
+
+/**
+ * 读取下一个词法单元
+ */
+static void arith_next(arith_parser_t *ap) {
+    const char *p = ap->pos;
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+        p++;
+    }
+    ap->token_start = p;
+    
+    if (*p == '\0') {
+        ap->type = ATOK_END;
+        ap->pos = p;
+        return;
+    }
+    
+    if (isdigit((unsigned char)*p)) {
+        const char *end;
+        if (parse_number(p, &ap->value, &end) != 0) {
+            ap->type = ATOK_ERROR;
+            return;
+        }
+        ap->type = ATOK_NUM;
+        ap->pos = end;
+        return;
+    }
+    
+    /* 变量：name、$name、${name}、$1、$#，以及$(...) */
+    if (isalpha((unsigned char)*p) || *p == '_' || *p == '$') {
+        const char *start = p;
+        ap->assignable = (*p != '$');
+        if (*p == '$') {
+            p++;
+            if (*p == '{') {
+                const char *close = strchr(p, '}');
+                if (close == NULL) {
+                    ap->type = ATOK_ERROR;
+                    return;
+                }
+                /* ${name}和${name[i]}直接读取，其他形式（如${#a[@]}）整个保存，求值时展开 */
+                size_t len = strspn(p + 1, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_");
+                int simple = (p + 1 + len == close || (p[1 + len] == '[' && close[-1] == ']'));
+                ap->name = simple ? store_name(ap, p + 1, (size_t)(close - p - 1))
+                                  : store_name(ap, p - 1, (size_t)(close - p + 2));
+                ap->type = ATOK_NAME;
+                ap->pos = close + 1;
+                return;
+            }
+            if (*p == '(') {
+                /* 命令替换$(...)整个保存，求值时展开 */
+                int depth = 0;
+                const char *close = p;
+                for (; *close != '\0'; close++) {
+                    if (*close == '(') {
+                        depth++;
+                    } else if (*close == ')' && --depth == 0) {
+                        break;
+                    }
+                }
+                if (*close == '\0') {
+                    ap->type = ATOK_ERROR;
+                    return;
+                }
+                ap->name = store_name(ap, p - 1, (size_t)(close - p + 2));
+                ap->type = ATOK_NAME;
+                ap->pos = close + 1;
+                return;
+            }
+            start = p;
+            if (isdigit((unsigned char)*p) || (*p != '\0' && strchr("#?$!", *p) != NULL)) {
+                p++;
+            } else {
+                while (isalnum((unsigned char)*p) || *p == '_') {
+                    p++;
+                }
+            }
+            if (p == start) {
+                ap->type = ATOK_ERROR;
+                return;
+            }
+        } else {
+            while (isalnum((unsigned char)*p) || *p == '_') {
+                p++;
+            }
+            if (*p == '[') {
+                /* 数组元素a[i]：下标原样保存在名字中，求值时再计算 */
+                int depth = 0;
+                do {
+                    depth += (*p == '[') - (*p == ']');
+                    p++;
+                } while (depth > 0 && *p != '\0');
+                if (depth > 0) {
+                    ap->type = ATOK_ERROR;
+                    return;
+                }
+            }
+        }
+        ap->name = store_name(ap, start, (size_t)(p - start));
+        ap->type = ATOK_NAME;
+        ap->pos = p;
+        return;
+    }
+    
+    switch (*p) {
+        case '(': ap->type = ATOK_LPAREN; ap->pos = p + 1; return;
+        case ')': ap->type = ATOK_RPAREN; ap->pos = p + 1; return;
+        case '?': ap->type = ATOK_QUESTION; ap->pos = p + 1; return;
+        case ':': ap->type = ATOK_COLON; ap->pos = p + 1; return;
+        default: break;
+    }
+    
+    for (int i = 0; arith_operators[i].text != NULL; i++) {
+        size_t len = strlen(arith_operators[i].text);
+        if (strncmp(p, arith_operators[i].text, len) == 0) {
+            ap->type = arith_operators[i].type;
+            ap->op = arith_operators[i].op;
+            ap->pos = p + len;
+            return;
+        }
+    }
+    
+    ap->type = ATOK_ERROR;
+}
+
+/**
+ * 报告语法错误
+ */
+static void arith_syntax_error(arith_parser_t *ap, const char *reason) {
+    if (!ap->error) {
+        arith_error(ap->text, reason, ap->token_start);
+    }
+    ap->error = 1;
+}
+
+/**
+ * 分配一个节点，返回其下标（失败返回-1）
+ */
+static int new_arith_node(arith_parser_t *ap, arith_op_t op, int a, int b) {
+    arith_expr_t *expr = ap->expr;
+    if (expr->count == expr->capacity) {
+        int new_capacity = expr->capacity ? expr->capacity * 2 : 16;
+        arith_node_t *nodes = safe_realloc(expr->nodes, (size_t)new_capacity * sizeof(arith_node_t),
+                                           "new_arith_node: nodes");
+        if (nodes == NULL) {
+            ap->error = 1;
+            return -1;
+        }
+        expr->nodes = nodes;
+        expr->capacity = new_capacity;
+    }
+    
+    arith_node_t *node = &expr->nodes[expr->count];
+    memset(node, 0, sizeof(*node));
+    node->op = op;
+    node->a = a;
+    node->b = b;
+    node->c = -1;
+    return expr->count++;
+}
+
+/**
+ * 新建常量节点
+ */
+static int new_constant(arith_parser_t *ap, long long value) {
+    int index = new_arith_node(ap, ARITH_NUM, -1, -1);
+    if (index >= 0) {
+        ap->expr->nodes[index].value = value;
+    }
+    return index;
+}
+
+/**
+ * 节点是否为常量
+ */
+static int is_constant(arith_parser_t *ap, int index) {
+    return index >= 0 && ap->expr->nodes[index].op == ARITH_NUM;
+}
+
+/**
+ * 对两个值执行二元运算
+ * 返回0表示成功，除以0时返回-1
+ */
+static int apply_binary(arith_op_t op, long long x, long long y, long long *result) {
+    /* 用无符号运算避免有符号溢出的未定义行为（结果按64位回绕） */
+    unsigned long long ux = (unsigned long long)x;
+    unsigned long long uy = (unsigned long long)y;
+    
+    switch (op) {
+        case ARITH_ADD: *result = (long long)(ux + uy); return 0;
+        case ARITH_SUB: *result = (long long)(ux - uy); return 0;
+        case ARITH_MUL: *result = (long long)(ux * uy); return 0;
+        case ARITH_DIV:
+        case ARITH_MOD:
+            if (y == 0) {
+                return -1;
+            }
+            if (x == LLONG_MIN && y == -1) {
+                *result = (op == ARITH_DIV) ? LLONG_MIN : 0;
+                return 0;
+            }
+            *result = (op == ARITH_DIV) ? x / y : x % y;
+            return 0;
+        case ARITH_POW: {
+            if (y < 0) {
+                return -2;
+            }
+            unsigned long long base = ux;
+            unsigned long long acc = 1;
+            while (y > 0) {
+                if (y & 1) {
+                    acc *= base;
+                }
+                base *= base;
+                y >>= 1;
+            }
+            *result = (long long)acc;
+            return 0;
+        }
+        case ARITH_SHL: *result = (long long)(ux << (uy & 63)); return 0;
+        case ARITH_SHR: *result = x >> (uy & 63); return 0;
+        case ARITH_LT: *result = x < y; return 0;
+        case ARITH_LE: *result = x <= y; return 0;
+        case ARITH_GT: *result = x > y; return 0;
+        case ARITH_GE: *result = x >= y; return 0;
+        case ARITH_EQ: *result = x == y; return 0;
+        case ARITH_NE: *result = x != y; return 0;
+        case ARITH_BAND: *result = x & y; return 0;
+        case ARITH_BXOR: *result = x ^ y; return 0;
+        case ARITH_BOR: *result = x | y; return 0;
+        case ARITH_LAND: *result = x && y; return 0;
+        case ARITH_LOR: *result = x || y; return 0;
+        default: *result = 0; return 0;
+    }
+}
+
+/**
+ * 对一个值执行一元运算
+ */
+static long long apply_unary(arith_op_t op, long long x) {
+    switch (op) {
+        case ARITH_NEG: return (long long)(0ULL - (unsigned long long)x);
+        case ARITH_NOT: return !x;
+        case ARITH_BNOT: return ~x;
+        default: return x;
+    }
+}
+
+/**
+ * 新建二元运算节点；两侧都是常量时在编译期折叠
+ * （除以0不折叠，留到求值时报错）
+ */
+static int make_binary(arith_parser_t *ap, arith_op_t op, int left, int right) {
+    if (left < 0 || right < 0) {
+        return -1;
+    }
+    
+    if (is_constant(ap, left)) {
+        long long x = ap->expr->nodes[left].value;
+        /* 0 && ... 和 1 || ...：右侧不会被求值 */
+        if ((op == ARITH_LAND && x == 0) || (op == ARITH_LOR && x != 0)) {
+            ap->expr->nodes[left].value = (x != 0);
+            return left;
+        }
+        long long result;
+        if (is_constant(ap, right) && apply_binary(op, x, ap->expr->nodes[right].value, &result) == 0) {
+            ap->expr->nodes[left].value = result;
+            return left;
+        }
+    }
+    return new_arith_node(ap, op, left, right);
+}
+
+static int parse_comma(arith_parser_t *ap);
+static int parse_assignment(arith_parser_t *ap);
+
+/**
+ * primary := 常量 | 变量 | '(' 表达式 ')'
+ */
+static int parse_primary(arith_parser_t *ap) {
+    if (ap->type == ATOK_NUM) {
+        long long value = ap->value;
+        arith_next(ap);
+        return new_constant(ap, value);
+    }
+    
+    if (ap->type == ATOK_NAME) {
+        int index = new_arith_node(ap, ARITH_VAR, -1, -1);
+        if (index >= 0) {
+            ap->expr->nodes[index].name = ap->name;
+            ap->expr->nodes[index].assignable = ap->assignable;
+        }
+        arith_next(ap);
+        return index;
+    }
+    
+    if (ap->type == ATOK_LPAREN) {
+        arith_next(ap);
+        int inner = parse_comma(ap);
+        if (inner < 0) {
+            return -1;
+        }
+        if (ap->type != ATOK_RPAREN) {
+            arith_syntax_error(ap, "missing `)'");
+            return -1;
+        }
+        arith_next(ap);
+        return inner;
+    }
+    
+    arith_syntax_error(ap, "syntax error: operand expected");
+    return -1;
+}
+
+/**
+ * postfix := primary ['++' | '--']
+ */
+static int parse_postfix(arith_parser_t *ap) {
+    int operand = parse_primary(ap);
+    if (operand >= 0 && ap->type == ATOK_OP && (ap->op == ARITH_PREINC || ap->op == ARITH_PREDEC) &&
+        ap->expr->nodes[operand].op == ARITH_VAR) {
+        arith_op_t op = (ap->op == ARITH_PREINC) ? ARITH_POSTINC : ARITH_POSTDEC;
+        arith_next(ap);
+        return new_arith_node(ap, op, operand, -1);
+    }
+    return operand;
+}
+
+/**
+ * unary := ('+' | '-' | '!' | '~' | '++' | '--') unary | postfix
+ */
+static int parse_unary(arith_parser_t *ap) {
+    if (ap->type != ATOK_OP) {
+        return parse_postfix(ap);
+    }
+    
+    arith_op_t op;
+    switch (ap->op) {
+        case ARITH_ADD: op = ARITH_POS; break;
+        case ARITH_SUB: op = ARITH_NEG; break;
+        case ARITH_NOT: op = ARITH_NOT; break;
+        case ARITH_BNOT: op = ARITH_BNOT; break;
+        case ARITH_PREINC: op = ARITH_PREINC; break;
+        case ARITH_PREDEC: op = ARITH_PREDEC; break;
+        default:
+            return parse_postfix(ap);
+    }
+    arith_next(ap);
+    
+    int operand = parse_unary(ap);
+    if (operand < 0) {
+        return -1;
+    }
+    
+    if (op == ARITH_PREINC || op == ARITH_PREDEC) {
+        if (ap->expr->nodes[operand].op != ARITH_VAR) {
+            arith_syntax_error(ap, "syntax error: variable expected for ++/--");
+            return -1;
+        }
+        return new_arith_node(ap, op, operand, -1);
+    }
+    if (is_constant(ap, operand)) {
+        ap->expr->nodes[operand].value = apply_unary(op, ap->expr->nodes[operand].value);
+        return operand;
+    }
+    return new_arith_node(ap, op, operand, -1);
+}
+
+/**
+ * 二元运算（优先级爬升）：**为右结合，其余为左结合
+ */
+static int parse_binary(arith_parser_t *ap, int min_precedence) {
+    int left = parse_unary(ap);
+    
+    while (left >= 0 && ap->type == ATOK_OP) {
+        arith_op_t op = ap->op;
+        int precedence = binary_precedence(op);
+        if (precedence == 0 || precedence < min_precedence) {
+            break;
+        }
+        arith_next(ap);
+        
+        int right = parse_binary(ap, (op == ARITH_POW) ? precedence : precedence + 1);
+        left = make_binary(ap, op, left, right);
+    }
+    return left;
+}
+
+/**
+ * conditional := binary ['?' expression ':' conditional]
+ */
+static int parse_conditional(arith_parser_t *ap) {
+    int condition = parse_binary(ap, 4);
+    if (condition < 0 || ap->type != ATOK_QUESTION) {
+        return condition;
+    }
+    arith_next(ap);
+    
+    int when_true = parse_comma(ap);
+    if (when_true < 0) {
+        return -1;
+    }
+    if (ap->type != ATOK_COLON) {
+        arith_syntax_error(ap, "syntax error: `:' expected for conditional expression");
+        return -1;
+    }
+    arith_next(ap);
+    
+    int when_false = parse_conditional(ap);
+    if (when_false < 0) {
+        return -1;
+    }
+    
+    if (is_constant(ap, condition)) {
+        return ap->expr->nodes[condition].value ? when_true : when_false;
+    }
+    int index = new_arith_node(ap, ARITH_COND, condition, when_true);
+    if (index >= 0) {
+        ap->expr->nodes[index].c = when_false;
+    }
+    return index;
+}
+
+/**
+ * assignment := conditional [赋值运算符 assignment]（右结合）
+ */
+static int parse_assignment(arith_parser_t *ap) {
+    int target = parse_conditional(ap);
+    if (target < 0 || ap->type != ATOK_ASSIGN) {
+        return target;
+    }
+    
+    arith_node_t *node = &ap->expr->nodes[target];
+    if (node->op != ARITH_VAR || !node->assignable) {
+        arith_syntax_error(ap, "attempted assignment to non-variable");
+        return -1;
+    }
+    const char *name = node->name;
+    arith_op_t assign_op = ap->op;
+    arith_next(ap);
+    
+    int value = parse_assignment(ap);
+    if (value < 0) {
+        return -1;
+    }
+    int index = new_arith_node(ap, ARITH_ASSIGN, value, -1);
+    if (index >= 0) {
+        ap->expr->nodes[index].name = name;
+        ap->expr->nodes[index].assign_op = assign_op;
+    }
+    return index;
+}
+
+/**
+ * expression := assignment (',' assignment)*
+ */
+static int parse_comma(arith_parser_t *ap) {
+    int left = parse_assignment(ap);
+    while (left >= 0 && ap->type == ATOK_OP && ap->op == ARITH_COMMA) {
+        arith_next(ap);
+        int right = parse_assignment(ap);
+        if (right < 0) {
+            return -1;
+        }
+        /* 左侧为常量时没有副作用，直接丢弃 */
+        left = is_constant(ap, left) ? right : new_arith_node(ap, ARITH_COMMA, left, right);
+    }
+    return left;
+}
+
+/**
+ * 释放编译后的表达式
+ */
+static void free_arith_expr(arith_expr_t *expr) {
+    if (expr != NULL) {
+        free(expr->nodes);
+        free(expr->names);
+        free(expr);
+    }
+}
+
+/**
+ * 编译表达式：解析成节点数组并折叠常量子表达式
+ * 有语法错误时报告错误并返回NULL
+ */
+static arith_expr_t* compile_arith(const char *text) {
+    arith_expr_t *expr = safe_malloc(sizeof(arith_expr_t), "compile_arith: expression");
+    if (expr == NULL) {
+        return NULL;
+    }
+    memset(expr, 0, sizeof(*expr));
+    
+    /* 名字总长度不超过表达式长度，每个名字再加一个'\0' */
+    expr->names = safe_malloc(strlen(text) * 2 + 2, "compile_arith: names");
+    if (expr->names == NULL) {
+        free(expr);
+        return NULL;
+    }
+    
+    arith_parser_t ap;
+    memset(&ap, 0, sizeof(ap));
+    ap.text = text;
+    ap.pos = text;
+    ap.expr = expr;
+    arith_next(&ap);
+    
+    if (ap.type == ATOK_END) {
+        /* 空表达式的值为0 */
+        expr->root = new_constant(&ap, 0);
+    } else {
+        expr->root = parse_comma(&ap);
+        if (expr->root >= 0 && ap.type != ATOK_END) {
+            arith_syntax_error(&ap, (ap.type == ATOK_ERROR) ? "syntax error: invalid arithmetic operator"
+                                                             : "syntax error in expression");
+        }
+    }
+    
+    if (ap.error || expr->root < 0) {
+        if (!ap.error) {
+            arith_syntax_error(&ap, "syntax error in expression");
+        }
+        free_arith_expr(expr);
+        return NULL;
+    }
+    return expr;
+}
+
+/* 求值状态 */
+typedef struct {
+    const char *text;
+    arith_expr_t *expr;
+    int depth;
+    int error;
+} arith_eval_t;
+
+static int evaluate_text(const char *text, int depth, long long *result);
+
+/**
+ * 变量值的数值：未设置或为空时为0；值不是数字时按表达式递归求值（如a=b、b=3）
+ */
+static long long text_value(arith_eval_t *ev, const char *name, const char *value) {
+    if (value == NULL) {
+        return 0;
+    }
+    while (*value == ' ' || *value == '\t') {
+        value++;
+    }
+    if (*value == '\0') {
+        return 0;
+    }
+    
+    int negative = 0;
+    const char *p = value;
+    if (*p == '-' || *p == '+') {
+        negative = (*p == '-');
+        p++;
+    }
+    long long number;
+    const char *end;
+    if (isdigit((unsigned char)*p) && parse_number(p, &number, &end) == 0) {
+        while (*end == ' ' || *end == '\t') {
+            end++;
+        }
+        if (*end == '\0') {
+            return negative ? (long long)(0ULL - (unsigned long long)number) : number;
+        }
+    }
+    
+    if (ev->depth >= ARITH_MAX_RECURSION) {
+        arith_error(ev->text, "expression recursion level exceeded", name);
+        ev->error = 1;
+        return 0;
+    }
+    long long result;
+    if (evaluate_text(value, ev->depth + 1, &result) != 0) {
+        ev->error = 1;
+        return 0;
+    }
+    return result;
+}
+
+/**
+ * 读取变量的值：name、a[i]，或者整个保存的${...}（先展开）
+ */
+static long long variable_value(arith_eval_t *ev, const char *name) {
+    if (name[0] == '$') {
+        char *expanded = expand_single_word(name);
+        if (expanded == NULL) {
+            ev->error = 1;
+            return 0;
+        }
+        long long result = text_value(ev, name, expanded);
+        TRACKED_FREE(expanded);
+        return result;
+    }
+    
+    char scratch[PARAM_SCRATCH_SIZE];
+    const char *value = NULL;
+    if (strchr(name, '[') != NULL) {
+        int failed = 0;
+        value = get_subscripted_var(name, &failed);
+        if (failed) {
+            ev->error = 1;
+            return 0;
+        }
+    } else {
+        value = get_shell_param(name, scratch);
+    }
+    return text_value(ev, name, value);
+}
+
+/**
+ * 把值赋给变量
+ */
+static void assign_variable(arith_eval_t *ev, const char *name, long long value) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%lld", value);
+    int result = (strchr(name, '[') != NULL) ? set_subscripted_var(name, buffer) : set_env_var((char *)name, buffer);
+    if (result != 0) {
+        ev->error = 1;
+    }
+}
+
+/**
+ * 求节点的值
+ */
+static long long eval_node(arith_eval_t *ev, int index) {
+    if (ev->error) {
+        return 0;
+    }
+    
+    arith_node_t *node = &ev->expr->nodes[index];
+    long long x, y, result;
+    
+    switch (node->op) {
+        case ARITH_NUM:
+            return node->value;
+        case ARITH_VAR:
+            return variable_value(ev, node->name);
+        case ARITH_NEG:
+        case ARITH_POS:
+        case ARITH_NOT:
+        case ARITH_BNOT:
+            return apply_unary(node->op, eval_node(ev, node->a));
+        case ARITH_PREINC:
+        case ARITH_PREDEC:
+        case ARITH_POSTINC:
+        case ARITH_POSTDEC: {
+            const char *name = ev->expr->nodes[node->a].name;
+            if (!ev->expr->nodes[node->a].assignable) {
+                arith_error(ev->text, "attempted assignment to non-variable", name);
+                ev->error = 1;
+                return 0;
+            }
+            x = variable_value(ev, name);
+            int increment = (node->op == ARITH_PREINC || node->op == ARITH_POSTINC);
+            y = (long long)((unsigned long long)x + (increment ? 1ULL : ~0ULL));
+            assign_variable(ev, name, y);
+            return (node->op == ARITH_PREINC || node->op == ARITH_PREDEC) ? y : x;
+        }
+        case ARITH_LAND:
+            return eval_node(ev, node->a) ? eval_node(ev, node->b) != 0 : 0;
+        case ARITH_LOR:
+            return eval_node(ev, node->a) ? 1 : eval_node(ev, node->b) != 0;
+        case ARITH_COND:
+            return eval_node(ev, node->a) ? eval_node(ev, node->b) : eval_node(ev, node->c);
+        case ARITH_COMMA:
+            eval_node(ev, node->a);
+            return eval_node(ev, node->b);
+        case ARITH_ASSIGN:
+            y = eval_node(ev, node->a);
+            if (node->assign_op != ARITH_NUM) {
+                x = variable_value(ev, node->name);
+                int rc = apply_binary(node->assign_op, x, y, &result);
+                if (rc != 0) {
+                    arith_error(ev->text, rc == -1 ? "division by 0" : "exponent less than 0", NULL);
+                    ev->error = 1;
+                    return 0;
+                }
+                y = result;
+            }
+            if (!ev->error) {
+                assign_variable(ev, node->name, y);
+            }
+            return y;
+        default: {
+            x = eval_node(ev, node->a);
+            y = eval_node(ev, node->b);
+            int rc = apply_binary(node->op, x, y, &result);
+            if (rc != 0 && !ev->error) {
+                arith_error(ev->text, rc == -1 ? "division by 0" : "exponent less than 0", NULL);
+                ev->error = 1;
+                return 0;
+            }
+            return result;
+        }
+    }
+}
+
+/* 编译结果缓存：循环中反复求值的表达式只编译一次 */
+static struct {
+    uint64_t hash;
+    char *text;
+    arith_expr_t *expr;
+} g_arith_cache[ARITH_CACHE_SIZE];
+
+/**
+ * 查找或编译表达式
+ */
+static arith_expr_t* get_compiled(const char *text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)text; *p; p++) {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    
+    size_t slot = hash & (ARITH_CACHE_SIZE - 1);
+    if (g_arith_cache[slot].text != NULL && g_arith_cache[slot].hash == hash &&
+        strcmp(g_arith_cache[slot].text, text) == 0) {
+        return g_arith_cache[slot].expr;
+    }
+    
+    arith_expr_t *expr = compile_arith(text);
+    if (expr == NULL) {
+        return NULL;
+    }
+    
+    char *key = safe_malloc(strlen(text) + 1, "get_compiled: key");
+    if (key == NULL) {
+        free_arith_expr(expr);
+        return NULL;
+    }
+    strcpy(key, text);
+    
+    free(g_arith_cache[slot].text);
+    free_arith_expr(g_arith_cache[slot].expr);
+    g_arith_cache[slot].hash = hash;
+    g_arith_cache[slot].text = key;
+    g_arith_cache[slot].expr = expr;
+    return expr;
+}
+
+/**
+ * 编译（或取缓存）并求值
+ */
+static int evaluate_text(const char *text, int depth, long long *result) {
+    /* 递归求值（变量值是表达式）时外层表达式仍在使用缓存项，不能替换缓存 */
+    arith_expr_t *expr = (depth == 0) ? get_compiled(text) : compile_arith(text);
+    if (expr == NULL) {
+        return -1;
+    }
+    
+    arith_eval_t ev = { text, expr, depth, 0 };
+    *result = eval_node(&ev, expr->root);
+    if (depth > 0) {
+        free_arith_expr(expr);
+    }
+    return ev.error ? -1 : 0;
+}
+
+/**
+ * 计算算术表达式（$(( ))、(( ))和let）
+ * 64位有符号整数运算，支持C语言的全部运算符及优先级、赋值运算符和自增自减；
+ * 变量通过环境变量表读写。编译结果按表达式文本缓存，常量子表达式在编译时折叠
+ * 返回0表示成功，出错时报告错误并返回-1
+ */
+int arith_evaluate(const char *expression, long long *result) {
+    if (expression == NULL || result == NULL) {
+        handle_error(ERROR_INVALID_ARGUMENT, "arith_evaluate: invalid argument");
+        return -1;
+    }
+    *result = 0;
+    return evaluate_text(expression, 0, result);
+}
+
+/**
+ * 清空算术表达式的编译缓存
+ */
+void clear_arith_cache(void) {
+    for (size_t i = 0; i < ARITH_CACHE_SIZE; i++) {
+        free(g_arith_cache[i].text);
+        free_arith_expr(g_arith_cache[i].expr);
+        g_arith_cache[i].text = NULL;
+        g_arith_cache[i].expr = NULL;
+    }
+}
@@ -0,0 +1,606 @@
+#include "shell.h"
+
+#include <stdint.h>
+
+/* 稠密表示中允许的空洞：下标超过 已设置元素数×4+ARRAY_SPARSE_SLACK 时改用稀疏表示 */
+#define ARRAY_SPARSE_SLACK 64
+
+/* 关联数组键的驻留表的初始槽数（2的幂） */
+#define INTERN_INITIAL_SLOTS 64
+
+/* 驻留的键：同样的键在所有关联数组中只保存一份，查找时比较指针 */
+typedef struct {
+    uint64_t hash;
+    unsigned int refcount;
+    size_t len;
+    char text[];
+} interned_key_t;
+
+/* 稀疏下标数组的元素（按下标排序） */
+typedef struct {
+    long long index;
+    char *value;
+} sparse_element_t;
+
+/* 关联数组的元素（按插入顺序保存，删除后key为NULL） */
+typedef struct {
+    interned_key_t *key;
+    char *value;
+} map_entry_t;
+
+/* 散列槽中的特殊值：空槽和已删除的槽，其余为entries的下标 */
+#define SLOT_EMPTY   (-1)
+#define SLOT_DELETED (-2)
+
+struct shell_array {
+    int associative;
+    int sparse;
+    size_t count;               /* 已设置的元素个数 */
+    
+    /* 下标数组（稠密）：values[0, length)，未设置的位置为NULL */
+    char **values;
+    size_t length;
+    size_t capacity;
+    
+    /* 下标数组（稀疏）：elements[0, count)按下标排序 */
+    sparse_element_t *elements;
+    size_t element_capacity;
+    
+    /* 关联数组：紧凑的元素数组 + 开放寻址（线性探测）的散列槽 */
+    map_entry_t *entries;
+    size_t entry_count;         /* 包括已删除的元素 */
+    size_t entry_capacity;
+    int32_t *slots;
+    size_t slot_count;          /* 2的幂 */
+};
+
+/* 键的驻留表：开放寻址，槽中保存interned_key_t指针 */
+static struct {
+    interned_key_t **slots;
+    size_t slot_count;
+    size_t used;                /* 包括已删除的槽 */
+} g_interned = { NULL, 0, 0 };
+
+/* 驻留表中已删除的槽 */
+static interned_key_t g_deleted_key;
+
+/**
+ * FNV-1a散列
+ */
+static uint64_t hash_key(const char *text, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * 复制元素的值
+ */
+static char* copy_value(const char *value) {
+    size_t len = strlen(value);
+    char *copy = safe_malloc(len + 1, "array: value");
+    if (copy != NULL) {
+        memcpy(copy, value, len + 1);
+    }
+    return copy;
+}
+
+/**
+ * 在驻留表中查找键，返回槽的位置；键不存在时返回可插入的槽
+ */
+static size_t intern_slot(const char *text, size_t len, uint64_t hash) {
+    size_t mask = g_interned.slot_count - 1;
+    size_t slot = hash & mask;
+    size_t insert = (size_t)-1;
+    for (;;) {
+        interned_key_t *key = g_interned.slots[slot];
+        if (key == NULL) {
+            return (insert != (size_t)-1) ? insert : slot;
+        }
+        if (key == &g_deleted_key) {
+            if (insert == (size_t)-1) {
+                insert = slot;
+            }
+        } else if (key->hash == hash && key->len == len && memcmp(key->text, text, len) == 0) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/**
+ * 按需扩大驻留表（装载因子不超过0.5，包括已删除的槽）
+ */
+static int intern_reserve(void) {
+    if (g_interned.slots != NULL && (g_interned.used + 1) * 2 <= g_interned.slot_count) {
+        return 0;
+    }
+    
+    size_t live = 0;
+    for (size_t i = 0; i < g_interned.slot_count; i++) {
+        live += (g_interned.slots[i] != NULL && g_interned.slots[i] != &g_deleted_key);
+    }
+    size_t new_count = INTERN_INITIAL_SLOTS;
+    while ((live + 1) * 4 > new_count) {
+        new_count *= 2;
+    }
+    
+    interned_key_t **new_slots = calloc(new_count, sizeof(interned_key_t*));
+    if (new_slots == NULL) {
+        handle_memory_error("intern_reserve: key table", new_count * sizeof(interned_key_t*));
+        return -1;
+    }
+    interned_key_t **old_slots = g_interned.slots;
+    size_t old_count = g_interned.slot_count;
+    g_interned.slots = new_slots;
+    g_interned.slot_count = new_count;
+    g_interned.used = 0;
+    for (size_t i = 0; i < old_count; i++) {
+        interned_key_t *key = old_slots[i];
+        if (key != NULL && key != &g_deleted_key) {
+            g_interned.slots[intern_slot(key->text, key->len, key->hash)] = key;
+            g_interned.used++;
+        }
+    }
+    free(old_slots);
+    return 0;
+}
+
+/**
+ * 查找已驻留的键（不创建）；键从未被任何关联数组使用过时返回NULL
+ */
+static interned_key_t* lookup_key(const char *text) {
+    if (g_interned.slots == NULL) {
+        return NULL;
+    }
+    size_t len = strlen(text);
+    interned_key_t *key = g_interned.slots[intern_slot(text, len, hash_key(text, len))];
+    return (key != NULL && key != &g_deleted_key) ? key : NULL;
+}
+
+/**
+ * 驻留一个键并增加其引用计数
+ */
+static interned_key_t* intern_key(const char *text) {
+    if (intern_reserve() != 0) {
+        return NULL;
+    }
+    
+    size_t len = strlen(text);
+    uint64_t hash = hash_key(text, len);
+    size_t slot = intern_slot(text, len, hash);
+    interned_key_t *key = g_interned.slots[slot];
+    if (key != NULL && key != &g_deleted_key) {
+        key->refcount++;
+        return key;
+    }
+    
+    key = safe_malloc(sizeof(interned_key_t) + len + 1, "intern_key: key");
+    if (key == NULL) {
+        return NULL;
+    }
+    key->hash = hash;
+    key->refcount = 1;
+    key->len = len;
+    memcpy(key->text, text, len + 1);
+    if (g_interned.slots[slot] == NULL) {
+        g_interned.used++;
+    }
+    g_interned.slots[slot] = key;
+    return key;
+}
+
+/**
+ * 释放键的一个引用，没有引用时从驻留表中删除
+ */
+static void release_key(interned_key_t *key) {
+    if (--key->refcount > 0) {
+        return;
+    }
+    g_interned.slots[intern_slot(key->text, key->len, key->hash)] = &g_deleted_key;
+    free(key);
+}
+
+/**
+ * 创建数组（associative为1时为关联数组）
+ */
+shell_array_t* array_create(int associative) {
+    shell_array_t *array = safe_malloc(sizeof(shell_array_t), "array_create: array");
+    if (array != NULL) {
+        memset(array, 0, sizeof(shell_array_t));
+        array->associative = associative;
+    }
+    return array;
+}
+
+/**
+ * 释放数组及其全部元素
+ */
+void array_free(shell_array_t *array) {
+    if (array == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < array->length; i++) {
+        free(array->values[i]);
+    }
+    for (size_t i = 0; array->sparse && i < array->count; i++) {
+        free(array->elements[i].value);
+    }
+    for (size_t i = 0; i < array->entry_count; i++) {
+        if (array->entries[i].key != NULL) {
+            release_key(array->entries[i].key);
+            free(array->entries[i].value);
+        }
+    }
+    free(array->values);
+    free(array->elements);
+    free(array->entries);
+    free(array->slots);
+    free(array);
+}
+
+/**
+ * 是否为关联数组
+ */
+int array_is_associative(const shell_array_t *array) {
+    return array->associative;
+}
+
+/**
+ * 已设置的元素个数
+ */
+size_t array_count(const shell_array_t *array) {
+    return array->count;
+}
+
+/**
+ * 在稀疏表示中二分查找下标，返回其位置或应插入的位置
+ */
+static size_t sparse_position(const shell_array_t *array, long long index) {
+    size_t low = 0;
+    size_t high = array->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (array->elements[mid].index < index) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+/**
+ * 把稠密表示转换为稀疏表示
+ */
+static int make_sparse(shell_array_t *array) {
+    size_t capacity = array->count + 8;
+    sparse_element_t *elements = safe_malloc(capacity * sizeof(sparse_element_t), "make_sparse: elements");
+    if (elements == NULL) {
+        return -1;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < array->length; i++) {
+        if (array->values[i] != NULL) {
+            elements[n].index = (long long)i;
+            elements[n].value = array->values[i];
+            n++;
+        }
+    }
+    free(array->values);
+    array->values = NULL;
+    array->length = 0;
+    array->capacity = 0;
+    array->elements = elements;
+    array->element_capacity = capacity;
+    array->sparse = 1;
+    return 0;
+}
+
+/**
+ * 取下标数组的元素（下标不小于0），未设置时返回NULL
+ */
+const char* array_get(const shell_array_t *array, long long index) {
+    if (index < 0) {
+        return NULL;
+    }
+    if (!array->sparse) {
+        return ((size_t)index < array->length) ? array->values[index] : NULL;
+    }
+    size_t pos = sparse_position(array, index);
+    return (pos < array->count && array->elements[pos].index == index) ? array->elements[pos].value : NULL;
+}
+
+/**
+ * 设置下标数组的元素（下标不小于0）
+ * 下标在已有元素附近时使用稠密向量；远超元素个数的下标（如a[1000000]=x）改用按下标排序的稀疏表示
+ */
+int array_set(shell_array_t *array, long long index, const char *value) {
+    if (index < 0) {
+        return -1;
+    }
+    char *copy = copy_value(value);
+    if (copy == NULL) {
+        return -1;
+    }
+    
+    if (!array->sparse && (unsigned long long)index >= (array->count + 1) * 4 + ARRAY_SPARSE_SLACK &&
+        (size_t)index >= array->length) {
+        if (make_sparse(array) != 0) {
+            free(copy);
+            return -1;
+        }
+    }
+    
+    if (!array->sparse) {
+        if ((size_t)index >= array->capacity) {
+            size_t new_capacity = array->capacity ? array->capacity : 8;
+            while (new_capacity <= (size_t)index) {
+                new_capacity *= 2;
+            }
+            char **values = safe_realloc(array->values, new_capacity * sizeof(char*), "array_set: values");
+            if (values == NULL) {
+                free(copy);
+                return -1;
+            }
+            memset(values + array->capacity, 0, (new_capacity - array->capacity) * sizeof(char*));
+            array->values = values;
+            array->capacity = new_capacity;
+        }
+        if (array->values[index] == NULL) {
+            array->count++;
+        }
+        free(array->values[index]);
+        array->values[index] = copy;
+        if ((size_t)index >= array->length) {
+            array->length = (size_t)index + 1;
+        }
+        return 0;
+    }
+    
+    size_t pos = sparse_position(array, index);
+    if (pos < array->count && array->elements[pos].index == index) {
+        free(array->elements[pos].value);
+        array->elements[pos].value = copy;
+        return 0;
+    }
+    if (array->count == array->element_capacity) {
+        size_t new_capacity = array->element_capacity * 2;
+        sparse_element_t *elements = safe_realloc(array->elements, new_capacity * sizeof(sparse_element_t),
+                                                  "array_set: sparse elements");
+        if (elements == NULL) {
+            free(copy);
+            return -1;
+        }
+        array->elements = elements;
+        array->element_capacity = new_capacity;
+    }
+    memmove(array->elements + pos + 1, array->elements + pos, (array->count - pos) * sizeof(sparse_element_t));
+    array->elements[pos].index = index;
+    array->elements[pos].value = copy;
+    array->count++;
+    return 0;
+}
+
+/**
+ * 删除下标数组的元素（其余元素的下标不变）
+ */
+int array_unset(shell_array_t *array, long long index) {
+    if (!array->sparse) {
+        if (index >= 0 && (size_t)index < array->length && array->values[index] != NULL) {
+            free(array->values[index]);
+            array->values[index] = NULL;
+            array->count--;
+            while (array->length > 0 && array->values[array->length - 1] == NULL) {
+                array->length--;
+            }
+        }
+        return 0;
+    }
+    
+    size_t pos = sparse_position(array, index);
+    if (pos < array->count && array->elements[pos].index == index) {
+        free(array->elements[pos].value);
+        memmove(array->elements + pos, array->elements + pos + 1, (array->count - pos - 1) * sizeof(sparse_element_t));
+        array->count--;
+    }
+    return 0;
+}
+
+/**
+ * 最大的已设置下标，数组为空时返回-1（a+=(x)从其后追加）
+ */
+long long array_max_index(const shell_array_t *array) {
+    if (array->sparse) {
+        return array->count ? array->elements[array->count - 1].index : -1;
+    }
+    return (long long)array->length - 1;
+}
+
+/**
+ * 在关联数组的散列槽中查找键，返回槽的位置；键不存在时返回可插入的槽
+ */
+static size_t map_slot(const shell_array_t *array, const interned_key_t *key, int *found) {
+    size_t mask = array->slot_count - 1;
+    size_t slot = key->hash & mask;
+    size_t insert = (size_t)-1;
+    for (;;) {
+        int32_t entry = array->slots[slot];
+        if (entry == SLOT_EMPTY) {
+            *found = 0;
+            return (insert != (size_t)-1) ? insert : slot;
+        }
+        if (entry == SLOT_DELETED) {
+            if (insert == (size_t)-1) {
+                insert = slot;
+            }
+        } else if (array->entries[entry].key == key) {
+            *found = 1;
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+/**
+ * 重建关联数组的散列槽，同时去掉已删除的元素（保持插入顺序）
+ */
+static int map_rebuild(shell_array_t *array, size_t min_entries) {
+    size_t slot_count = 16;
+    while (slot_count < (min_entries + 1) * 2) {
+        slot_count *= 2;
+    }
+    
+    size_t n = 0;
+    for (size_t i = 0; i < array->entry_count; i++) {
+        if (array->entries[i].key != NULL) {
+            array->entries[n++] = array->entries[i];
+        }
+    }
+    array->entry_count = n;
+    
+    if (min_entries > array->entry_capacity) {
+        size_t capacity = array->entry_capacity ? array->entry_capacity : 8;
+        while (capacity < min_entries) {
+            capacity *= 2;
+        }
+        map_entry_t *entries = safe_realloc(array->entries, capacity * sizeof(map_entry_t), "map_rebuild: entries");
+        if (entries == NULL) {
+            return -1;
+        }
+        array->entries = entries;
+        array->entry_capacity = capacity;
+    }
+    
+    int32_t *slots = safe_realloc(array->slots, slot_count * sizeof(int32_t), "map_rebuild: slots");
+    if (slots == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < slot_count; i++) {
+        slots[i] = SLOT_EMPTY;
+    }
+    array->slots = slots;
+    array->slot_count = slot_count;
+    for (size_t i = 0; i < n; i++) {
+        int found;
+        array->slots[map_slot(array, array->entries[i].key, &found)] = (int32_t)i;
+    }
+    return 0;
+}
+
+/**
+ * 取关联数组的元素，键不存在时返回NULL
+ */
+const char* array_get_key(const shell_array_t *array, const char *key) {
+    if (array->count == 0) {
+        return NULL;
+    }
+    interned_key_t *interned = lookup_key(key);
+    if (interned == NULL) {
+        return NULL;
+    }
+    int found;
+    size_t slot = map_slot(array, interned, &found);
+    return found ? array->entries[array->slots[slot]].value : NULL;
+}
+
+/**
+ * 设置关联数组的元素
+ */
+int array_set_key(shell_array_t *array, const char *key, const char *value) {
+    if (array->entry_count + 1 > array->entry_capacity || (array->entry_count + 1) * 2 > array->slot_count) {
+        if (map_rebuild(array, (array->count + 1) * 2) != 0) {
+            return -1;
+        }
+    }
+    
+    char *copy = copy_value(value);
+    interned_key_t *interned = (copy != NULL) ? intern_key(key) : NULL;
+    if (interned == NULL) {
+        free(copy);
+        return -1;
+    }
+    
+    int found;
+    size_t slot = map_slot(array, interned, &found);
+    if (found) {
+        map_entry_t *entry = &array->entries[array->slots[slot]];
+        free(entry->value);
+        entry->value = copy;
+        release_key(interned);
+        return 0;
+    }
+    
+    array->entries[array->entry_count].key = interned;
+    array->entries[array->entry_count].value = copy;
+    array->slots[slot] = (int32_t)array->entry_count;
+    array->entry_count++;
+    array->count++;
+    return 0;
+}
+
+/**
+ * 删除关联数组的元素
+ */
+int array_unset_key(shell_array_t *array, const char *key) {
+    interned_key_t *interned = (array->count > 0) ? lookup_key(key) : NULL;
+    if (interned == NULL) {
+        return 0;
+    }
+    int found;
+    size_t slot = map_slot(array, interned, &found);
+    if (found) {
+        map_entry_t *entry = &array->entries[array->slots[slot]];
+        free(entry->value);
+        entry->value = NULL;
+        entry->key = NULL;
+        array->slots[slot] = SLOT_DELETED;
+        array->count--;
+        release_key(interned);
+    }
+    return 0;
+}
+
+/**
+ * 按顺序遍历数组：下标数组按下标递增，关联数组按插入顺序
+ * *cursor从0开始；每次返回一个元素时返回1并设置下标（或键）和值，结束时返回0。
+ * 下标数组的*key设为NULL，关联数组的*index不变
+ */
+int array_next(const shell_array_t *array, size_t *cursor, const char **key, long long *index, const char **value) {
+    if (array->associative) {
+        while (*cursor < array->entry_count && array->entries[*cursor].key == NULL) {
+            (*cursor)++;
+        }
+        if (*cursor >= array->entry_count) {
+            return 0;
+        }
+        *key = array->entries[*cursor].key->text;
+        *value = array->entries[*cursor].value;
+        (*cursor)++;
+        return 1;
+    }
+    
+    *key = NULL;
+    if (array->sparse) {
+        if (*cursor >= array->count) {
+            return 0;
+        }
+        *index = array->elements[*cursor].index;
+        *value = array->elements[*cursor].value;
+        (*cursor)++;
+        return 1;
+    }
+    while (*cursor < array->length && array->values[*cursor] == NULL) {
+        (*cursor)++;
+    }
+    if (*cursor >= array->length) {
+        return 0;
+    }
+    *index = (long long)*cursor;
+    *value = array->values[*cursor];
+    (*cursor)++;
+    return 1;
+}
@@ -0,0 +1,521 @@
+#include "shell.h"
+
+/* 花括号展开的节点类型 */
+typedef enum {
+    BRACE_TEXT,         /* 原样复制的一段单词 */
+    BRACE_SEQUENCE,     /* 依次连接的若干节点 */
+    BRACE_LIST,         /* {a,b,c}：每次取一个候选（候选本身是SEQUENCE） */
+    BRACE_RANGE         /* {1..10..2}、{a..e}：每次取一个值 */
+} brace_node_type_t;
+
+typedef struct {
+    brace_node_type_t type;
+    size_t start;           /* TEXT：在单词中的位置和长度 */
+    size_t len;
+    int first;              /* SEQUENCE/LIST：子节点在children中的范围 */
+    int count;
+    int current;            /* LIST：当前候选 */
+    long long from;         /* RANGE：起始值、步长（带方向）、值的个数和当前下标 */
+    long long step;
+    unsigned long long total;
+    unsigned long long index;
+    int width;              /* RANGE：补0后的宽度 */
+    int is_char;            /* RANGE：字符范围 */
+} brace_node_t;
+
+/*
+ * 花括号展开生成器：单词编译成节点树，每次调用brace_next像里程表一样推进最右边的节点，
+ * 只生成当前这一个单词，不构造完整的笛卡尔积
+ */
+struct brace_expansion {
+    const char *word;
+    brace_node_t *nodes;
+    int node_count;
+    int node_capacity;
+    int *children;
+    int child_count;
+    int child_capacity;
+    int root;
+    int expandable;         /* 单词中有真正的{,}或{..} */
+    int started;
+    char *buffer;           /* 当前生成的单词 */
+    size_t len;
+    size_t capacity;
+};
+
+/**
+ * 新建一个节点，返回其下标；失败返回-1
+ */
+static int add_node(brace_expansion_t *b, brace_node_type_t type) {
+    if (b->node_count == b->node_capacity) {
+        int new_capacity = b->node_capacity ? b->node_capacity * 2 : 16;
+        brace_node_t *new_nodes = safe_realloc(b->nodes, (size_t)new_capacity * sizeof(brace_node_t), "brace_compile: nodes");
+        if (new_nodes == NULL) {
+            return -1;
+        }
+        b->nodes = new_nodes;
+        b->node_capacity = new_capacity;
+    }
+    brace_node_t *node = &b->nodes[b->node_count];
+    memset(node, 0, sizeof(*node));
+    node->type = type;
+    return b->node_count++;
+}
+
+/**
+ * 把一组子节点下标连续存入children，设置父节点的子节点范围
+ */
+static int set_children(brace_expansion_t *b, int parent, const int *items, int count) {
+    if (b->child_count + count > b->child_capacity) {
+        int new_capacity = b->child_capacity ? b->child_capacity : 16;
+        while (new_capacity < b->child_count + count) {
+            new_capacity *= 2;
+        }
+        int *new_children = safe_realloc(b->children, (size_t)new_capacity * sizeof(int), "brace_compile: children");
+        if (new_children == NULL) {
+            return -1;
+        }
+        b->children = new_children;
+        b->child_capacity = new_capacity;
+    }
+    memcpy(b->children + b->child_count, items, (size_t)count * sizeof(int));
+    b->nodes[parent].first = b->child_count;
+    b->nodes[parent].count = count;
+    b->child_count += count;
+    return 0;
+}
+
+/**
+ * 跳过从i开始的引号、转义字符或${...}，返回其后的位置；i处不是这些时返回i
+ * 其中的{、}和,不参与花括号展开
+ */
+static size_t skip_quoted(const char *w, size_t i, size_t end) {
+    char c = w[i];
+    if (c == '\\') {
+        return (i + 2 < end) ? i + 2 : end;
+    }
+    if (c == '\'' || c == '"') {
+        for (size_t k = i + 1; k < end; k++) {
+            if (c == '"' && w[k] == '\\') {
+                k++;
+            } else if (w[k] == c) {
+                return k + 1;
+            }
+        }
+        return end;
+    }
+    if (c == '$' && i + 1 < end && w[i + 1] == '{') {
+        int depth = 0;
+        for (size_t k = i + 1; k < end; k++) {
+            if (w[k] == '{') {
+                depth++;
+            } else if (w[k] == '}' && --depth == 0) {
+                return k + 1;
+            }
+        }
+        return end;
+    }
+    return i;
+}
+
+/**
+ * 查找从open处的{开始的匹配的}，并判断顶层是否有逗号；没有时返回(size_t)-1
+ */
+static size_t find_close(const char *w, size_t open, size_t end, int *has_comma) {
+    int depth = 0;
+    *has_comma = 0;
+    for (size_t i = open; i < end;) {
+        size_t next = skip_quoted(w, i, end);
+        if (next != i) {
+            i = next;
+            continue;
+        }
+        if (w[i] == '{') {
+            depth++;
+        } else if (w[i] == '}' && --depth == 0) {
+            return i;
+        } else if (w[i] == ',' && depth == 1) {
+            *has_comma = 1;
+        }
+        i++;
+    }
+    return (size_t)-1;
+}
+
+/**
+ * 解析范围的一端：整数或单个字母；返回1为整数，2为字母，0为无效
+ */
+static int parse_range_end(const char *text, long long *value) {
+    if (isalpha((unsigned char)text[0]) && text[1] == '\0') {
+        *value = (unsigned char)text[0];
+        return 2;
+    }
+    
+    const char *digits = (text[0] == '-' || text[0] == '+') ? text + 1 : text;
+    if (*digits == '\0' || strspn(digits, "0123456789") != strlen(digits)) {
+        return 0;
+    }
+    errno = 0;
+    *value = strtoll(text, NULL, 10);
+    return errno == 0 ? 1 : 0;
+}
+
+/**
+ * 数字是否带前导0（如01、-007），此时所有值补0到相同宽度
+ */
+static int has_leading_zero(const char *text) {
+    const char *digits = (text[0] == '-' || text[0] == '+') ? text + 1 : text;
+    return digits[0] == '0' && digits[1] != '\0';
+}
+
+/**
+ * 解析{x..y}或{x..y..step}的内容到RANGE节点；不是有效的范围时返回0
+ */
+static int parse_range(const char *text, size_t len, brace_node_t *node) {
+    char spec[96];
+    if (len >= sizeof(spec)) {
+        return 0;
+    }
+    memcpy(spec, text, len);
+    spec[len] = '\0';
+    
+    char *second = strstr(spec, "..");
+    if (second == NULL) {
+        return 0;
+    }
+    *second = '\0';
+    second += 2;
+    char *third = strstr(second, "..");
+    if (third != NULL) {
+        *third = '\0';
+        third += 2;
+    }
+    
+    long long from, to, step = 1;
+    int from_type = parse_range_end(spec, &from);
+    int to_type = parse_range_end(second, &to);
+    if (from_type == 0 || from_type != to_type) {
+        return 0;
+    }
+    if (third != NULL && parse_range_end(third, &step) != 1) {
+        return 0;
+    }
+    
+    /* 步长的符号被忽略，方向由两端的大小决定 */
+    unsigned long long magnitude = (step < 0) ? 0 - (unsigned long long)step : (unsigned long long)step;
+    if (magnitude == 0) {
+        magnitude = 1;
+    }
+    unsigned long long distance = (to >= from) ? (unsigned long long)to - (unsigned long long)from
+                                               : (unsigned long long)from - (unsigned long long)to;
+    node->type = BRACE_RANGE;
+    node->from = from;
+    node->step = (to >= from) ? (long long)magnitude : -(long long)magnitude;
+    node->total = distance / magnitude + 1;
+    node->is_char = (from_type == 2);
+    if (!node->is_char && (has_leading_zero(spec) || has_leading_zero(second))) {
+        size_t a = strlen(spec), b = strlen(second);
+        node->width = (int)(a > b ? a : b);
+    }
+    return 1;
+}
+
+/**
+ * 解析单词的[start, end)部分为SEQUENCE节点，返回节点下标；失败返回-1
+ * 没有匹配的}、既没有顶层逗号也不是范围的{按普通字符处理
+ */
+static int parse_sequence(brace_expansion_t *b, size_t start, size_t end) {
+    int *items = NULL;
+    int count = 0, capacity = 0;
+    int failed = 0;
+    size_t text_start = start;
+    size_t i = start;
+    
+    while (i <= end && !failed) {
+        int item = -1;
+        size_t next = i + 1;
+        if (i < end) {
+            size_t skipped = skip_quoted(b->word, i, end);
+            if (skipped != i) {
+                i = skipped;
+                continue;
+            }
+            if (b->word[i] != '{') {
+                i++;
+                continue;
+            }
+            
+            int has_comma = 0;
+            size_t close = find_close(b->word, i, end, &has_comma);
+            brace_node_t range;
+            memset(&range, 0, sizeof(range));
+            if (close == (size_t)-1 ||
+                (!has_comma && !parse_range(b->word + i + 1, close - i - 1, &range))) {
+                i++;
+                continue;
+            }
+            
+            if (has_comma) {
+                item = add_node(b, BRACE_LIST);
+                failed = (item < 0);
+            } else {
+                item = add_node(b, BRACE_RANGE);
+                if (item >= 0) {
+                    b->nodes[item] = range;
+                }
+                failed = (item < 0);
+            }
+            next = close + 1;
+            b->expandable = 1;
+            
+            /* 候选之间以顶层的逗号分隔，每个候选各自是一个SEQUENCE */
+            if (!failed && has_comma) {
+                int alternatives[64];
+                int *alts = alternatives;
+                int alt_count = 0, alt_capacity = 64;
+                int depth = 0;
+                size_t alt_start = i + 1;
+                for (size_t k = i + 1; k <= close && !failed;) {
+                    size_t skipped = skip_quoted(b->word, k, close);
+                    if (skipped != k && k < close) {
+                        k = skipped;
+                        continue;
+                    }
+                    char c = b->word[k];
+                    if (c == '{') {
+                        depth++;
+                    } else if (c == '}' && k < close) {
+                        depth--;
+                    } else if ((c == ',' && depth == 0) || k == close) {
+                        if (alt_count == alt_capacity) {
+                            alt_capacity *= 2;
+                            int *grown = safe_malloc((size_t)alt_capacity * sizeof(int), "brace_compile: alternatives");
+                            if (grown == NULL) {
+                                failed = 1;
+                                break;
+                            }
+                            memcpy(grown, alts, (size_t)alt_count * sizeof(int));
+                            if (alts != alternatives) {
+                                free(alts);
+                            }
+                            alts = grown;
+                        }
+                        int alt = parse_sequence(b, alt_start, k);
+                        failed = (alt < 0);
+                        alts[alt_count++] = alt;
+                        alt_start = k + 1;
+                    }
+                    k++;
+                }
+                if (!failed) {
+                    failed = set_children(b, item, alts, alt_count) != 0;
+                }
+                if (alts != alternatives) {
+                    free(alts);
+                }
+            }
+        }
+        
+        /* 在{...}之前（或单词末尾）结束当前的文本段 */
+        int pieces[2];
+        int piece_count = 0;
+        if (!failed && i > text_start) {
+            int text = add_node(b, BRACE_TEXT);
+            failed = (text < 0);
+            if (!failed) {
+                b->nodes[text].start = text_start;
+                b->nodes[text].len = i - text_start;
+                pieces[piece_count++] = text;
+            }
+        }
+        if (!failed && item >= 0) {
+            pieces[piece_count++] = item;
+        }
+        if (!failed && count + piece_count > capacity) {
+            capacity = capacity ? capacity * 2 : 8;
+            int *new_items = safe_realloc(items, (size_t)capacity * sizeof(int), "brace_compile: sequence");
+            failed = (new_items == NULL);
+            items = failed ? items : new_items;
+        }
+        for (int k = 0; k < piece_count && !failed; k++) {
+            items[count++] = pieces[k];
+        }
+        text_start = next;
+        i = next;
+    }
+    
+    int sequence = failed ? -1 : add_node(b, BRACE_SEQUENCE);
+    if (sequence >= 0 && set_children(b, sequence, items, count) != 0) {
+        sequence = -1;
+    }
+    free(items);
+    return sequence;
+}
+
+/**
+ * 把节点及其子节点恢复到第一个值
+ */
+static void reset_node(brace_expansion_t *b, int index) {
+    brace_node_t *node = &b->nodes[index];
+    switch (node->type) {
+        case BRACE_SEQUENCE:
+            for (int i = 0; i < node->count; i++) {
+                reset_node(b, b->children[node->first + i]);
+            }
+            break;
+        case BRACE_LIST:
+            node->current = 0;
+            reset_node(b, b->children[node->first]);
+            break;
+        case BRACE_RANGE:
+            node->index = 0;
+            break;
+        case BRACE_TEXT:
+            break;
+    }
+}
+
+/**
+ * 把节点推进到下一个值；已经是最后一个值时回到第一个值并返回0（向左进位）
+ */
+static int advance_node(brace_expansion_t *b, int index) {
+    brace_node_t *node = &b->nodes[index];
+    switch (node->type) {
+        case BRACE_SEQUENCE:
+            for (int i = node->count - 1; i >= 0; i--) {
+                if (advance_node(b, b->children[node->first + i])) {
+                    return 1;
+                }
+            }
+            return 0;
+        case BRACE_LIST:
+            if (advance_node(b, b->children[node->first + node->current])) {
+                return 1;
+            }
+            node->current = (node->current + 1 < node->count) ? node->current + 1 : 0;
+            reset_node(b, b->children[node->first + node->current]);
+            return node->current != 0;
+        case BRACE_RANGE:
+            node->index = (node->index + 1 < node->total) ? node->index + 1 : 0;
+            return node->index != 0;
+        case BRACE_TEXT:
+            break;
+    }
+    return 0;
+}
+
+/**
+ * 向当前单词追加内容
+ */
+static int buffer_append(brace_expansion_t *b, const char *data, size_t len) {
+    if (b->len + len + 1 > b->capacity) {
+        size_t new_capacity = b->capacity ? b->capacity * 2 : 64;
+        while (new_capacity < b->len + len + 1) {
+            new_capacity *= 2;
+        }
+        char *new_buffer = safe_realloc(b->buffer, new_capacity, "brace_next: word");
+        if (new_buffer == NULL) {
+            return -1;
+        }
+        b->buffer = new_buffer;
+        b->capacity = new_capacity;
+    }
+    memcpy(b->buffer + b->len, data, len);
+    b->len += len;
+    b->buffer[b->len] = '\0';
+    return 0;
+}
+
+/**
+ * 按各节点的当前值生成单词
+ */
+static int render_node(brace_expansion_t *b, int index) {
+    const brace_node_t *node = &b->nodes[index];
+    switch (node->type) {
+        case BRACE_TEXT:
+            return buffer_append(b, b->word + node->start, node->len);
+        case BRACE_SEQUENCE:
+            for (int i = 0; i < node->count; i++) {
+                if (render_node(b, b->children[node->first + i]) != 0) {
+                    return -1;
+                }
+            }
+            return 0;
+        case BRACE_LIST:
+            return render_node(b, b->children[node->first + node->current]);
+        case BRACE_RANGE: {
+            long long value = node->from + (long long)node->index * node->step;
+            char text[128];
+            int n;
+            if (node->is_char) {
+                text[0] = (char)value;
+                n = 1;
+            } else {
+                n = snprintf(text, sizeof(text), "%0*lld", node->width, value);
+            }
+            return buffer_append(b, text, (size_t)n);
+        }
+    }
+    return 0;
+}
+
+/**
+ * 编译单词中的花括号展开（{a,b}、{1..10}、{a..e..2}，可以嵌套）
+ * 引号、转义和${...}中的花括号不展开；单词没有花括号展开时*out为NULL
+ * 生成器引用word，使用期间word必须保持有效；返回0表示成功，-1表示内存分配失败
+ */
+int brace_compile(const char *word, brace_expansion_t **out) {
+    *out = NULL;
+    if (word == NULL || strchr(word, '{') == NULL) {
+        return 0;
+    }
+    
+    brace_expansion_t *b = safe_malloc(sizeof(brace_expansion_t), "brace_compile: generator");
+    if (b == NULL) {
+        return -1;
+    }
+    memset(b, 0, sizeof(*b));
+    b->word = word;
+    b->root = parse_sequence(b, 0, strlen(word));
+    if (b->root < 0 || !b->expandable) {
+        int result = (b->root < 0) ? -1 : 0;
+        brace_free(b);
+        return result;
+    }
+    *out = b;
+    return 0;
+}
+
+/**
+ * 生成下一个单词（从左到右，右边的花括号变化最快）
+ * 返回的字符串在下一次调用之前有效；全部生成完毕返回NULL，*failed表示是否因内存不足而停止
+ */
+const char* brace_next(brace_expansion_t *b, int *failed) {
+    *failed = 0;
+    if (!b->started) {
+        b->started = 1;
+        reset_node(b, b->root);
+    } else if (!advance_node(b, b->root)) {
+        return NULL;
+    }
+    
+    b->len = 0;
+    if (buffer_append(b, "", 0) != 0 || render_node(b, b->root) != 0) {
+        *failed = 1;
+        return NULL;
+    }
+    return b->buffer;
+}
+
+/**
+ * 释放花括号展开生成器
+ */
+void brace_free(brace_expansion_t *b) {
+    if (b == NULL) {
+        return;
+    }
+    free(b->nodes);
+    free(b->children);
+    free(b->buffer);
+    free(b);
+}
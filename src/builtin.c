@@ -1,7 +1,6 @@
 #include "shell.h"
 
 /* 静态函数声明 */
-static char* process_escape_sequences(const char *input);
 static int is_valid_var_name(const char *name);
 
 /* 内部命令信息结构体 */
@@ -16,18 +15,33 @@ typedef struct {
 
 /* 内部命令注册表 */
 static builtin_info_t builtin_commands[] = {
-    {"ls", builtin_ls, 0, 1, "ls [directory]", "List directory contents"},
-    {"cat", builtin_cat, 1, -1, "cat <file1> [file2] ...", "Display file contents"},
+    {"ls", builtin_ls, 0, 2, "ls [-la] [directory]", "List directory contents"},
+    {"cat", builtin_cat, 0, -1, "cat [file] ...", "Display file contents"},
     {"cp", builtin_cp, 2, 2, "cp <source> <destination>", "Copy files"},
     {"rm", builtin_rm, 1, -1, "rm <file1> [file2] ...", "Remove files"},
-    {"touch", builtin_touch, 1, -1, "touch <file1> [file2] ...", "Create empty files"},
-    {"date", builtin_date, 0, 0, "date", "Display current date and time"},
+    {"touch", builtin_touch, 1, -1, "touch [-d date|-r ref] <file1> [file2] ...", "Create empty files or update timestamps"},
+    {"stat", builtin_stat, 1, -1, "stat [-L] <file1> [file2] ...", "Display file status"},
+    {"date", builtin_date, 0, 4, "date [-u] [-d date] [+format]", "Display current date and time"},
     {"pwd", builtin_pwd, 0, 0, "pwd", "Print working directory"},
     {"cd", builtin_cd, 0, 1, "cd [directory]", "Change directory"},
-    {"echo", builtin_echo, 0, -1, "echo [text] ...", "Display text"},
-    {"export", builtin_export, 1, 1, "export <VAR=value>", "Set environment variable"},
-    {"memstat", builtin_memstat, 0, 1, "memstat [leaks]", "Show memory statistics"},
+    {"echo", builtin_echo, 0, -1, "echo [-neE] [text] ...", "Display text"},
+    {"export", builtin_export, 0, -1, "export [-p] [VAR[=value] ...]", "Export variables to the environment of child processes"},
+    {"memstat", builtin_memstat, 0, 2, "memstat [leaks | cache [size]]", "Show memory and parse cache statistics"},
     {"exit", builtin_exit, 0, 1, "exit [code]", "Exit the shell"},
+    {"break", builtin_break, 0, 1, "break [n]", "Exit from n enclosing loops"},
+    {"continue", builtin_continue, 0, 1, "continue [n]", "Resume the next iteration of the n-th enclosing loop"},
+    {"true", builtin_true, 0, -1, "true", "Return a successful exit status"},
+    {"false", builtin_false, 0, -1, "false", "Return an unsuccessful exit status"},
+    {":", builtin_true, 0, -1, ": [arguments]", "Do nothing and return success"},
+    {"return", builtin_return, 0, 1, "return [n]", "Return from a shell function"},
+    {"local", builtin_local, 1, -1, "local [-aA] <name[=value]> ...", "Declare variables local to a function"},
+    {"declare", builtin_declare, 0, -1, "declare [-aAxp] [name[=value] ...]", "Declare variables and arrays"},
+    {"typeset", builtin_declare, 0, -1, "typeset [-aAxp] [name[=value] ...]", "Declare variables and arrays"},
+    {"unset", builtin_unset, 1, -1, "unset [-v] <name | name[subscript]> ...", "Unset variables or array elements"},
+    {"shopt", builtin_shopt, 0, -1, "shopt [-s|-u] [optname ...]", "Set or unset pathname expansion options"},
+    {"let", builtin_let, 1, -1, "let <expression> ...", "Evaluate arithmetic expressions"},
+    {"test", builtin_test, 0, -1, "test [expression]", "Evaluate a conditional expression"},
+    {"[", builtin_bracket, 0, -1, "[ [expression] ]", "Evaluate a conditional expression"},
     {"help", builtin_help, 0, 1, "help [command]", "Show help information"},
     {NULL, NULL, 0, 0, NULL, NULL}  /* 结束标记 */
 };
@@ -60,14 +74,14 @@ static int validate_args(builtin_info_t *cmd_info, char **args) {
     /* 检查最少参数个数 */
     if (argc < cmd_info->min_args) {
         print_error("Too few arguments");
-        printf("Usage: %s\n", cmd_info->usage);
+        output_printf(STDOUT_FILENO, "Usage: %s\n", cmd_info->usage);
         return 0;
     }
     
     /* 检查最多参数个数 */
     if (cmd_info->max_args != -1 && argc > cmd_info->max_args) {
         print_error("Too many arguments");
-        printf("Usage: %s\n", cmd_info->usage);
+        output_printf(STDOUT_FILENO, "Usage: %s\n", cmd_info->usage);
         return 0;
     }
     
@@ -97,6 +111,22 @@ int is_builtin(char *command) {
     return find_builtin_info(command) != NULL;
 }
 
+/**
+ * 内部命令结束时写出缓冲区；输出没能写出（如EPIPE、ENOSPC）时报告错误并使退出状态非零
+ */
+static int finish_builtin_output(const char *command, int status) {
+    output_flush_all();
+    
+    int error = output_take_error();
+    if (error == 0) {
+        return status;
+    }
+    output_printf(STDERR_FILENO, "%s: write error: %s\n", command, strerror(error));
+    output_flush(STDERR_FILENO);
+    output_take_error();
+    return (status != 0) ? status : 1;
+}
+
 /**
  * 执行内部命令
  */
@@ -117,8 +147,14 @@ int execute_builtin(char *command, char **args) {
         return -1;
     }
     
-    /* 执行命令 */
-    int result = cmd_info->func(args);
+    /* 之前其他输出的写出失败与本命令无关 */
+    output_take_error();
+    
+    /* 执行命令（出错时返回的-1记为退出状态1） */
+    int result = exit_status_from_result(cmd_info->func(args));
+    
+    /* 每个内部命令结束时统一写出一次缓冲区 */
+    result = finish_builtin_output(command, result);
     
     /* 更新最后执行状态 */
     g_shell_state.last_exit_status = result;
@@ -130,12 +166,12 @@ int execute_builtin(char *command, char **args) {
  * 获取所有内部命令列表
  */
 void list_builtin_commands(void) {
-    printf("Available built-in commands:\n");
-    printf("%-10s %s\n", "Command", "Description");
-    printf("%-10s %s\n", "-------", "-----------");
+    output_printf(STDOUT_FILENO, "Available built-in commands:\n");
+    output_printf(STDOUT_FILENO, "%-10s %s\n", "Command", "Description");
+    output_printf(STDOUT_FILENO, "%-10s %s\n", "-------", "-----------");
     
     for (int i = 0; builtin_commands[i].name != NULL; i++) {
-        printf("%-10s %s\n", builtin_commands[i].name, builtin_commands[i].description);
+        output_printf(STDOUT_FILENO, "%-10s %s\n", builtin_commands[i].name, builtin_commands[i].description);
     }
 }
 
@@ -150,24 +186,162 @@ void show_command_help(char *command) {
     
     builtin_info_t *cmd_info = find_builtin_info(command);
     if (cmd_info == NULL) {
-        printf("Unknown command: %s\n", command);
-        printf("Type 'help' to see available commands.\n");
+        output_printf(STDOUT_FILENO, "Unknown command: %s\n", command);
+        output_printf(STDOUT_FILENO, "Type 'help' to see available commands.\n");
         return;
     }
     
-    printf("Command: %s\n", cmd_info->name);
-    printf("Usage: %s\n", cmd_info->usage);
-    printf("Description: %s\n", cmd_info->description);
+    output_printf(STDOUT_FILENO, "Command: %s\n", cmd_info->name);
+    output_printf(STDOUT_FILENO, "Usage: %s\n", cmd_info->usage);
+    output_printf(STDOUT_FILENO, "Description: %s\n", cmd_info->description);
 }
 
 /* 内部命令实现 - 占位符函数 */
 
+/* ls收集的目录项（名字统一存放在一块连续缓冲区中） */
+typedef struct {
+    size_t name_offset;
+} ls_entry_t;
+
+/* 排序后的目录项 */
+typedef struct {
+    const char *name;
+} ls_sorted_t;
+
+/**
+ * 按字节序比较目录项名字
+ */
+static int compare_entries(const void *a, const void *b) {
+    return strcmp(((const ls_sorted_t *)a)->name, ((const ls_sorted_t *)b)->name);
+}
+
+/**
+ * 生成类型+权限字符串，例如 "drwxr-xr-x"
+ */
+static void format_mode(mode_t mode, char out[11]) {
+    char type_char = '-';
+    if (S_ISDIR(mode)) {
+        type_char = 'd';
+    } else if (S_ISLNK(mode)) {
+        type_char = 'l';
+    } else if (S_ISCHR(mode)) {
+        type_char = 'c';
+    } else if (S_ISBLK(mode)) {
+        type_char = 'b';
+    } else if (S_ISFIFO(mode)) {
+        type_char = 'p';
+    } else if (S_ISSOCK(mode)) {
+        type_char = 's';
+    }
+    
+    out[0] = type_char;
+    out[1] = (mode & S_IRUSR) ? 'r' : '-';
+    out[2] = (mode & S_IWUSR) ? 'w' : '-';
+    out[3] = (mode & S_IXUSR) ? 'x' : '-';
+    out[4] = (mode & S_IRGRP) ? 'r' : '-';
+    out[5] = (mode & S_IWGRP) ? 'w' : '-';
+    out[6] = (mode & S_IXGRP) ? 'x' : '-';
+    out[7] = (mode & S_IROTH) ? 'r' : '-';
+    out[8] = (mode & S_IWOTH) ? 'w' : '-';
+    out[9] = (mode & S_IXOTH) ? 'x' : '-';
+    out[10] = '\0';
+}
+
+/**
+ * 将uid/gid转换为名字（缓存上一次的查询结果，目录中的文件通常属于同一用户）
+ */
+static const char* lookup_user_name(uid_t uid, char *fallback, size_t size) {
+    static uid_t cached_uid = (uid_t)-1;
+    static char cached_name[64];
+    
+    if (uid != cached_uid) {
+        struct passwd *pw = getpwuid(uid);
+        if (pw == NULL) {
+            snprintf(fallback, size, "%u", (unsigned)uid);
+            return fallback;
+        }
+        snprintf(cached_name, sizeof(cached_name), "%s", pw->pw_name);
+        cached_uid = uid;
+    }
+    return cached_name;
+}
+
+static const char* lookup_group_name(gid_t gid, char *fallback, size_t size) {
+    static gid_t cached_gid = (gid_t)-1;
+    static char cached_name[64];
+    
+    if (gid != cached_gid) {
+        struct group *gr = getgrgid(gid);
+        if (gr == NULL) {
+            snprintf(fallback, size, "%u", (unsigned)gid);
+            return fallback;
+        }
+        snprintf(cached_name, sizeof(cached_name), "%s", gr->gr_name);
+        cached_gid = gid;
+    }
+    return cached_name;
+}
+
+/**
+ * 打印ls -l格式的一行
+ */
+static void print_long_entry(int dirfd, const char *name, const struct stat *st, time_t now) {
+    char mode_str[11];
+    format_mode(st->st_mode, mode_str);
+    
+    char uid_buf[32], gid_buf[32];
+    const char *user = lookup_user_name(st->st_uid, uid_buf, sizeof(uid_buf));
+    const char *group = lookup_group_name(st->st_gid, gid_buf, sizeof(gid_buf));
+    
+    /* 半年以内的文件显示时间，更早的显示年份 */
+    char time_str[32];
+    struct tm tm_info;
+    localtime_r(&st->st_mtime, &tm_info);
+    if (st->st_mtime > now - 15778476 && st->st_mtime <= now + 3600) {
+        strftime(time_str, sizeof(time_str), "%b %e %H:%M", &tm_info);
+    } else {
+        strftime(time_str, sizeof(time_str), "%b %e  %Y", &tm_info);
+    }
+    
+    output_printf(STDOUT_FILENO, "%s %3lu %-8s %-8s %8lld %s %s", mode_str, (unsigned long)st->st_nlink,
+           user, group, (long long)st->st_size, time_str, name);
+    
+    if (S_ISDIR(st->st_mode)) {
+        output_putc(STDOUT_FILENO, '/');
+    } else if (S_ISLNK(st->st_mode)) {
+        char target[MAX_PATH_SIZE];
+        ssize_t len = readlinkat(dirfd, name, target, sizeof(target) - 1);
+        if (len >= 0) {
+            target[len] = '\0';
+            output_printf(STDOUT_FILENO, " -> %s", target);
+        }
+    }
+    output_putc(STDOUT_FILENO, '\n');
+}
+
 int builtin_ls(char **args) {
     char *target_dir = ".";  /* 默认为当前目录 */
+    int long_format = 0;
+    int show_all = 0;
     
-    /* 如果提供了目录参数 */
-    if (args != NULL && args[0] != NULL) {
-        target_dir = args[0];
+    /* 解析选项和目录参数：短选项可以合并（如-la） */
+    for (int i = 0; args != NULL && args[i] != NULL; i++) {
+        if (args[i][0] != '-' || args[i][1] == '\0') {
+            target_dir = args[i];
+            continue;
+        }
+        for (const char *p = args[i] + 1; *p; p++) {
+            if (*p == 'l') {
+                long_format = 1;
+            } else if (*p == 'a') {
+                show_all = 1;
+            } else {
+                char message[64];
+                snprintf(message, sizeof(message), "ls: invalid option -- '%c'", *p);
+                print_error(message);
+                return -1;
+            }
+        }
     }
     
     /* 使用opendir系统调用打开目录 */
@@ -191,60 +365,108 @@ int builtin_ls(char **args) {
         return -1;
     }
     
-    struct dirent *entry;
-    struct stat file_stat;
-    char full_path[MAX_PATH_SIZE];
+    ls_entry_t *entries = NULL;
+    size_t entry_count = 0, entry_capacity = 0;
+    char *names = NULL;
+    size_t names_len = 0, names_capacity = 0;
+    int result = 0;
     
-    /* 使用readdir系统调用读取目录项 */
+    /* 第一遍：只读取目录项，不做任何stat */
+    struct dirent *entry;
     while ((entry = readdir(dir)) != NULL) {
-        /* 跳过隐藏文件（以.开头的文件，除了.和..） */
-        if (entry->d_name[0] == '.' && 
+        /* 跳过隐藏文件（以.开头的文件，除了.和..；-a时全部列出） */
+        if (!show_all && entry->d_name[0] == '.' && 
             strcmp(entry->d_name, ".") != 0 && 
             strcmp(entry->d_name, "..") != 0) {
             continue;
         }
         
-        /* 构建完整路径用于获取文件信息 */
-        snprintf(full_path, sizeof(full_path), "%s/%s", target_dir, entry->d_name);
-        
-        /* 获取文件状态信息 */
-        if (stat(full_path, &file_stat) == 0) {
-            /* 显示文件类型标识 */
-            char type_char = '-';
-            if (S_ISDIR(file_stat.st_mode)) {
-                type_char = 'd';
-            } else if (S_ISLNK(file_stat.st_mode)) {
-                type_char = 'l';
-            } else if (S_ISREG(file_stat.st_mode)) {
-                type_char = '-';
+        size_t name_len = strlen(entry->d_name) + 1;
+        if (names_len + name_len > names_capacity) {
+            size_t new_capacity = names_capacity ? names_capacity * 2 : 4096;
+            while (new_capacity < names_len + name_len) {
+                new_capacity *= 2;
             }
-            
-            /* 显示权限信息 */
-            char permissions[10];
-            permissions[0] = (file_stat.st_mode & S_IRUSR) ? 'r' : '-';
-            permissions[1] = (file_stat.st_mode & S_IWUSR) ? 'w' : '-';
-            permissions[2] = (file_stat.st_mode & S_IXUSR) ? 'x' : '-';
-            permissions[3] = (file_stat.st_mode & S_IRGRP) ? 'r' : '-';
-            permissions[4] = (file_stat.st_mode & S_IWGRP) ? 'w' : '-';
-            permissions[5] = (file_stat.st_mode & S_IXGRP) ? 'x' : '-';
-            permissions[6] = (file_stat.st_mode & S_IROTH) ? 'r' : '-';
-            permissions[7] = (file_stat.st_mode & S_IWOTH) ? 'w' : '-';
-            permissions[8] = (file_stat.st_mode & S_IXOTH) ? 'x' : '-';
-            permissions[9] = '\0';
-            
-            /* 显示文件信息：类型+权限 文件名 */
-            printf("%c%s  %s", type_char, permissions, entry->d_name);
-            
-            /* 如果是目录，添加/标识 */
-            if (S_ISDIR(file_stat.st_mode)) {
-                printf("/");
+            char *new_names = safe_realloc(names, new_capacity, "builtin_ls: name buffer");
+            if (new_names == NULL) {
+                result = -1;
+                goto cleanup;
             }
-            printf("\n");
-        } else {
-            /* 如果无法获取文件状态，只显示文件名 */
-            printf("?---------  %s\n", entry->d_name);
+            names = new_names;
+            names_capacity = new_capacity;
+        }
+        if (entry_count == entry_capacity) {
+            size_t new_capacity = entry_capacity ? entry_capacity * 2 : 64;
+            ls_entry_t *new_entries = safe_realloc(entries, new_capacity * sizeof(ls_entry_t),
+                                                   "builtin_ls: entry array");
+            if (new_entries == NULL) {
+                result = -1;
+                goto cleanup;
+            }
+            entries = new_entries;
+            entry_capacity = new_capacity;
+        }
+        
+        memcpy(names + names_len, entry->d_name, name_len);
+        entries[entry_count].name_offset = names_len;
+        entry_count++;
+        names_len += name_len;
+    }
+    
+    if (entry_count > 0) {
+        /* 名字缓冲区已不再增长，此时可以安全地把偏移换成指针再排序 */
+        ls_sorted_t *sorted = safe_malloc(entry_count * sizeof(ls_sorted_t), "builtin_ls: sort array");
+        meta_request_t *reqs = NULL;
+        if (sorted == NULL) {
+            result = -1;
+            goto cleanup;
         }
+        for (size_t i = 0; i < entry_count; i++) {
+            sorted[i].name = names + entries[i].name_offset;
+        }
+        qsort(sorted, entry_count, sizeof(ls_sorted_t), compare_entries);
+        
+        /* 第二遍：并发获取元数据，结果按排序后的顺序返回 */
+        reqs = safe_malloc(entry_count * sizeof(meta_request_t), "builtin_ls: metadata requests");
+        if (reqs == NULL) {
+            free(sorted);
+            result = -1;
+            goto cleanup;
+        }
+        for (size_t i = 0; i < entry_count; i++) {
+            reqs[i].name = sorted[i].name;
+        }
+        fetch_metadata_batch(dirfd(dir), reqs, entry_count,
+                             long_format ? AT_SYMLINK_NOFOLLOW : 0);
+        
+        time_t now = time(NULL);
+        for (size_t i = 0; i < entry_count; i++) {
+            if (long_format) {
+                if (reqs[i].error == 0) {
+                    print_long_entry(dirfd(dir), sorted[i].name, &reqs[i].st, now);
+                } else {
+                    /* 如果无法获取文件状态，只显示文件名 */
+                    output_printf(STDOUT_FILENO, "?---------   ? ?        ?               ?            %s\n", sorted[i].name);
+                }
+            } else if (reqs[i].error == 0) {
+                /* 显示文件信息：类型+权限 文件名，目录加/标识 */
+                char mode_str[11];
+                format_mode(reqs[i].st.st_mode, mode_str);
+                output_printf(STDOUT_FILENO, "%s  %s%s\n", mode_str, sorted[i].name,
+                              S_ISDIR(reqs[i].st.st_mode) ? "/" : "");
+            } else {
+                /* 如果无法获取文件状态，只显示文件名 */
+                output_printf(STDOUT_FILENO, "?---------  %s\n", sorted[i].name);
+            }
+        }
+        
+        free(reqs);
+        free(sorted);
     }
+
+cleanup:
+    free(entries);
+    free(names);
     
     /* 使用closedir系统调用关闭目录 */
     if (closedir(dir) != 0) {
@@ -252,13 +474,139 @@ int builtin_ls(char **args) {
         return -1;
     }
     
+    return result;
+}
+
+/**
+ * 按GNU stat的样式打印一个文件的元数据
+ */
+static void print_stat_entry(const char *name, const struct stat *st) {
+    const char *type = "regular file";
+    if (S_ISDIR(st->st_mode)) {
+        type = "directory";
+    } else if (S_ISLNK(st->st_mode)) {
+        type = "symbolic link";
+    } else if (S_ISCHR(st->st_mode)) {
+        type = "character special file";
+    } else if (S_ISBLK(st->st_mode)) {
+        type = "block special file";
+    } else if (S_ISFIFO(st->st_mode)) {
+        type = "fifo";
+    } else if (S_ISSOCK(st->st_mode)) {
+        type = "socket";
+    } else if (S_ISREG(st->st_mode) && st->st_size == 0) {
+        type = "regular empty file";
+    }
+    
+    char mode_str[11];
+    format_mode(st->st_mode, mode_str);
+    
+    char uid_buf[32], gid_buf[32];
+    const char *user = lookup_user_name(st->st_uid, uid_buf, sizeof(uid_buf));
+    const char *group = lookup_group_name(st->st_gid, gid_buf, sizeof(gid_buf));
+    
+    output_printf(STDOUT_FILENO, "  File: %s\n", name);
+    output_printf(STDOUT_FILENO, "  Size: %-15lld Blocks: %-10lld IO Block: %-6ld %s\n",
+           (long long)st->st_size, (long long)st->st_blocks, (long)st->st_blksize, type);
+    output_printf(STDOUT_FILENO, "Device: %u,%u\tInode: %-11llu Links: %lu\n",
+           major(st->st_dev), minor(st->st_dev),
+           (unsigned long long)st->st_ino, (unsigned long)st->st_nlink);
+    output_printf(STDOUT_FILENO, "Access: (%04o/%s)  Uid: (%5u/%8s)   Gid: (%5u/%8s)\n",
+           (unsigned)(st->st_mode & 07777), mode_str,
+           (unsigned)st->st_uid, user, (unsigned)st->st_gid, group);
+    
+    const struct timespec *times[3] = { &st->st_atim, &st->st_mtim, &st->st_ctim };
+    const char *labels[3] = { "Access", "Modify", "Change" };
+    for (int i = 0; i < 3; i++) {
+        struct tm tm_info;
+        char date_part[64], zone_part[16];
+        localtime_r(&times[i]->tv_sec, &tm_info);
+        strftime(date_part, sizeof(date_part), "%Y-%m-%d %H:%M:%S", &tm_info);
+        strftime(zone_part, sizeof(zone_part), "%z", &tm_info);
+        output_printf(STDOUT_FILENO, "%s: %s.%09ld %s\n", labels[i], date_part, times[i]->tv_nsec, zone_part);
+    }
+}
+
+int builtin_stat(char **args) {
+    if (args == NULL || args[0] == NULL) {
+        print_error("stat: missing operand");
+        return -1;
+    }
+    
+    int flags = AT_SYMLINK_NOFOLLOW;
+    size_t count = 0;
+    
+    /* -L 跟随符号链接 */
+    for (int i = 0; args[i] != NULL; i++) {
+        if (strcmp(args[i], "-L") == 0) {
+            flags = 0;
+        } else {
+            count++;
+        }
+    }
+    if (count == 0) {
+        print_error("stat: missing operand");
+        return -1;
+    }
+    
+    meta_request_t *reqs = safe_malloc(count * sizeof(meta_request_t), "builtin_stat: requests");
+    if (reqs == NULL) {
+        return -1;
+    }
+    
+    size_t n = 0;
+    for (int i = 0; args[i] != NULL; i++) {
+        if (strcmp(args[i], "-L") != 0) {
+            reqs[n++].name = args[i];
+        }
+    }
+    
+    /* 所有文件的元数据请求同时发出，输出保持参数顺序 */
+    fetch_metadata_batch(AT_FDCWD, reqs, count, flags);
+    
+    int overall_result = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (reqs[i].error != 0) {
+            char error_msg[MAX_PATH_SIZE + 64];
+            snprintf(error_msg, sizeof(error_msg), "stat: cannot stat '%s': %s",
+                     reqs[i].name, strerror(reqs[i].error));
+            print_error(error_msg);
+            overall_result = -1;
+            continue;
+        }
+        print_stat_entry(reqs[i].name, &reqs[i].st);
+    }
+    
+    free(reqs);
+    return overall_result;
+}
+
+/**
+ * 把描述符中的内容全部经输出缓冲区写到标准输出
+ */
+static int copy_to_stdout(int fd) {
+    char buffer[4096];
+    ssize_t bytes_read;
+    while ((bytes_read = read(fd, buffer, sizeof(buffer))) != 0) {
+        if (bytes_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        output_write(STDOUT_FILENO, buffer, (size_t)bytes_read);
+    }
     return 0;
 }
 
 int builtin_cat(char **args) {
+    /* 没有文件参数时读取标准输入（如cat < file） */
     if (args == NULL || args[0] == NULL) {
-        print_error("cat: missing file operand");
-        return -1;
+        if (copy_to_stdout(STDIN_FILENO) != 0) {
+            handle_error(ERROR_SYSTEM_CALL, "read failed");
+            return -1;
+        }
+        return 0;
     }
     
     int overall_result = 0;
@@ -292,8 +640,8 @@ int builtin_cat(char **args) {
             continue;
         }
         
-        /* 检查是否为常规文件 */
-        if (!S_ISREG(file_stat.st_mode)) {
+        /* 检查是否为常规文件（管道也可以读取，如进程替换的/dev/fd/N） */
+        if (!S_ISREG(file_stat.st_mode) && !S_ISFIFO(file_stat.st_mode)) {
             print_error("cat: not a regular file");
             overall_result = -1;
             continue;
@@ -320,33 +668,8 @@ int builtin_cat(char **args) {
             continue;
         }
         
-        /* 读取并输出文件内容 */
-        char buffer[4096];  /* 4KB缓冲区，适合处理大文件 */
-        ssize_t bytes_read;
-        
-        while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) {
-            /* 使用write系统调用输出到标准输出 */
-            ssize_t bytes_written = 0;
-            ssize_t total_written = 0;
-            
-            while (total_written < bytes_read) {
-                bytes_written = write(STDOUT_FILENO, buffer + total_written, 
-                                    bytes_read - total_written);
-                if (bytes_written == -1) {
-                    if (errno == EINTR) {
-                        /* 被信号中断，继续写入 */
-                        continue;
-                    }
-                    handle_error(ERROR_SYSTEM_CALL, "write to stdout failed");
-                    close(fd);
-                    return -1;
-                }
-                total_written += bytes_written;
-            }
-        }
-        
-        /* 检查读取是否出错 */
-        if (bytes_read == -1) {
+        /* 读取并输出文件内容，检查读取是否出错 */
+        if (copy_to_stdout(fd) != 0) {
             handle_error(ERROR_SYSTEM_CALL, "read failed");
             close(fd);
             overall_result = -1;
@@ -366,7 +689,7 @@ int builtin_cat(char **args) {
 int builtin_cp(char **args) {
     if (args == NULL || args[0] == NULL || args[1] == NULL) {
         print_error("cp: missing file operand");
-        printf("Usage: cp <source> <destination>\n");
+        output_printf(STDOUT_FILENO, "Usage: cp <source> <destination>\n");
         return -1;
     }
     
@@ -424,7 +747,7 @@ int builtin_cp(char **args) {
                 "cp: overwrite '%s'?", destination);
         
         if (!confirm_action(confirm_msg)) {
-            printf("cp: not overwriting '%s'\n", destination);
+            output_printf(STDOUT_FILENO, "cp: not overwriting '%s'\n", destination);
             return 0;
         }
     }
@@ -514,7 +837,7 @@ int builtin_cp(char **args) {
         handle_error(ERROR_SYSTEM_CALL, "fsync failed");
         copy_result = -1;
     }
-    
+
 cleanup:
     /* 关闭文件描述符 */
     if (close(source_fd) != 0) {
@@ -543,7 +866,7 @@ cleanup:
         print_warning("cp: failed to preserve timestamps");
     }
     
-    printf("cp: copied '%s' to '%s'\n", source, destination);
+    output_printf(STDOUT_FILENO, "cp: copied '%s' to '%s'\n", source, destination);
     return 0;
 }
 
@@ -592,7 +915,7 @@ int builtin_rm(char **args) {
                     "rm: remove write-protected file '%s'?", filename);
             
             if (!confirm_action(confirm_msg)) {
-                printf("rm: skipping '%s'\n", filename);
+                output_printf(STDOUT_FILENO, "rm: skipping '%s'\n", filename);
                 continue;
             }
         }
@@ -624,164 +947,455 @@ int builtin_rm(char **args) {
         }
         
         /* 成功删除文件 */
-        printf("rm: removed '%s'\n", filename);
+        output_printf(STDOUT_FILENO, "rm: removed '%s'\n", filename);
     }
     
     return overall_result;
 }
 
-int builtin_touch(char **args) {
-    if (args == NULL || args[0] == NULL) {
-        print_error("touch: missing file operand");
-        return -1;
+/**
+ * 解析小数秒部分（最多9位，纳秒精度）
+ * 返回解析结束的位置
+ */
+static const char* parse_nanoseconds(const char *p, long *nsec) {
+    *nsec = 0;
+    if (*p != '.' && *p != ',') {
+        return p;
     }
+    p++;
     
-    int overall_result = 0;
-    
-    /* 处理多个文件参数 */
-    for (int i = 0; args[i] != NULL; i++) {
-        char *filename = args[i];
-        
-        /* 检查文件是否已存在 */
-        struct stat file_stat;
-        int file_exists = (stat(filename, &file_stat) == 0);
-        
-        if (file_exists) {
-            /* 文件已存在，更新访问和修改时间 */
-            if (utime(filename, NULL) != 0) {
-                switch (errno) {
-                    case EACCES:
-                        print_error("touch: cannot touch file: Permission denied");
-                        break;
-                    case ENOENT:
-                        print_error("touch: cannot touch file: No such file or directory");
-                        break;
-                    default:
-                        handle_error(ERROR_SYSTEM_CALL, "utime failed");
-                        break;
-                }
-                overall_result = -1;
-                continue;
-            }
-        } else {
-            /* 文件不存在，创建新文件 */
-            /* 使用open系统调用创建文件，设置适当的权限 */
-            int fd = open(filename, O_CREAT | O_WRONLY | O_EXCL, 
-                         S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);  /* 644权限 */
-            
-            if (fd == -1) {
-                switch (errno) {
-                    case EEXIST:
-                        /* 文件在检查后被创建，尝试更新时间戳 */
-                        if (utime(filename, NULL) != 0) {
-                            print_error("touch: cannot touch file: Permission denied");
-                            overall_result = -1;
-                        }
-                        break;
-                    case EACCES:
-                        print_error("touch: cannot create file: Permission denied");
-                        overall_result = -1;
-                        break;
-                    case ENOENT:
-                        print_error("touch: cannot create file: No such file or directory");
-                        overall_result = -1;
-                        break;
-                    case ENOSPC:
-                        print_error("touch: cannot create file: No space left on device");
-                        overall_result = -1;
-                        break;
-                    default:
-                        handle_error(ERROR_SYSTEM_CALL, "open failed");
-                        overall_result = -1;
-                        break;
-                }
-                continue;
-            }
-            
-            /* 关闭文件描述符 */
-            if (close(fd) != 0) {
-                handle_error(ERROR_SYSTEM_CALL, "close failed");
-                overall_result = -1;
-            }
-        }
+    long scale = 100000000L;
+    while (isdigit((unsigned char)*p)) {
+        *nsec += (*p - '0') * scale;
+        scale /= 10;
+        p++;
     }
-    
-    return overall_result;
+    return p;
 }
 
-int builtin_date(char **args) {
-    (void)args;  /* 避免未使用参数警告 */
-    
-    /* 使用time系统调用获取当前时间 */
-    time_t current_time = time(NULL);
-    if (current_time == (time_t)-1) {
-        handle_error(ERROR_SYSTEM_CALL, "time system call failed");
+/**
+ * 解析时间描述
+ * 支持 "@秒数[.小数]"、"YYYY-MM-DD[ T]HH:MM[:SS[.小数]]"、"YYYY-MM-DD" 和 "now"
+ */
+static int parse_time_spec(const char *text, struct timespec *out) {
+    if (text == NULL || out == NULL) {
         return -1;
     }
     
-    /* 将时间转换为本地时间结构 */
-    struct tm *local_time = localtime(&current_time);
-    if (local_time == NULL) {
-        handle_error(ERROR_SYSTEM_CALL, "localtime failed");
-        return -1;
+    if (strcmp(text, "now") == 0) {
+        return clock_gettime(CLOCK_REALTIME, out);
     }
     
-    /* 格式化时间输出 - 使用标准的date命令格式 */
-    char time_buffer[256];
-    if (strftime(time_buffer, sizeof(time_buffer), 
-                "%a %b %d %H:%M:%S %Z %Y", local_time) == 0) {
-        print_error("date: failed to format time");
-        return -1;
+    /* @epoch 形式 */
+    if (text[0] == '@') {
+        char *endptr;
+        errno = 0;
+        long long seconds = strtoll(text + 1, &endptr, 10);
+        if (endptr == text + 1 || errno != 0) {
+            return -1;
+        }
+        long nsec;
+        const char *rest = parse_nanoseconds(endptr, &nsec);
+        if (*rest != '\0') {
+            return -1;
+        }
+        out->tv_sec = (time_t)seconds;
+        out->tv_nsec = nsec;
+        if (seconds < 0 && nsec > 0) {
+            /* -1.5 表示 -2 秒再加 0.5 秒 */
+            out->tv_sec -= 1;
+            out->tv_nsec = 1000000000L - nsec;
+        }
+        return 0;
     }
     
-    /* 输出格式化的时间 */
-    printf("%s\n", time_buffer);
+    static const char *formats[] = {
+        "%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S",
+        "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M", "%Y-%m-%d", NULL
+    };
     
-    return 0;
+    for (int i = 0; formats[i] != NULL; i++) {
+        struct tm tm_info;
+        memset(&tm_info, 0, sizeof(tm_info));
+        const char *rest = strptime(text, formats[i], &tm_info);
+        if (rest == NULL) {
+            continue;
+        }
+        
+        long nsec = 0;
+        rest = parse_nanoseconds(rest, &nsec);
+        if (*rest != '\0') {
+            continue;
+        }
+        
+        tm_info.tm_isdst = -1;
+        time_t seconds = mktime(&tm_info);
+        if (seconds == (time_t)-1) {
+            return -1;
+        }
+        out->tv_sec = seconds;
+        out->tv_nsec = nsec;
+        return 0;
+    }
+    
+    return -1;
 }
 
-int builtin_pwd(char **args) {
-    (void)args;  /* 避免未使用参数警告 */
-    
-    LOG_FUNCTION_ENTRY("builtin_pwd");
-    
-    char *cwd = NULL;
-    size_t size = MAX_PATH_SIZE;
-    
-    /* 使用安全内存分配 */
-    cwd = safe_malloc(size, "builtin_pwd: buffer allocation");
-    if (cwd == NULL) {
+/**
+ * 打印touch失败信息
+ */
+static void report_touch_error(const char *filename, int error, int creating) {
+    char error_msg[MAX_PATH_SIZE + 64];
+    
+    switch (error) {
+        case EACCES:
+        case EPERM:
+            snprintf(error_msg, sizeof(error_msg), "touch: cannot %s '%s': Permission denied",
+                     creating ? "create" : "touch", filename);
+            print_error(error_msg);
+            break;
+        case ENOENT:
+        case ENOTDIR:
+            snprintf(error_msg, sizeof(error_msg), "touch: cannot %s '%s': No such file or directory",
+                     creating ? "create" : "touch", filename);
+            print_error(error_msg);
+            break;
+        case ENOSPC:
+            snprintf(error_msg, sizeof(error_msg), "touch: cannot create '%s': No space left on device",
+                     filename);
+            print_error(error_msg);
+            break;
+        default:
+            errno = error;
+            handle_error(ERROR_SYSTEM_CALL, creating ? "openat failed" : "utimensat failed");
+            break;
+    }
+}
+
+int builtin_touch(char **args) {
+    if (args == NULL || args[0] == NULL) {
+        print_error("touch: missing file operand");
         return -1;
     }
     
-    /* 调用getcwd系统调用获取当前工作目录 */
-    if (getcwd(cwd, size) == NULL) {
-        /* 如果缓冲区太小，动态增加大小 */
-        if (errno == ERANGE) {
-            SAFE_FREE(cwd);
-            size *= 2;
-            cwd = safe_malloc(size, "builtin_pwd: larger buffer allocation");
-            if (cwd == NULL) {
+    struct timespec times[2];
+    struct timespec *times_ptr = NULL;  /* NULL表示使用当前时间 */
+    int file_count = 0;
+    
+    /* 解析 -d <时间> 和 -r <参考文件> 选项 */
+    for (int i = 0; args[i] != NULL; i++) {
+        if (strcmp(args[i], "-d") == 0 || strcmp(args[i], "-r") == 0) {
+            if (args[i + 1] == NULL) {
+                print_error("touch: option requires an argument");
                 return -1;
             }
             
-            if (getcwd(cwd, size) == NULL) {
-                handle_syscall_error("getcwd", "builtin_pwd");
-                SAFE_FREE(cwd);
-                return -1;
+            if (args[i][1] == 'd') {
+                if (parse_time_spec(args[i + 1], &times[0]) != 0) {
+                    print_error("touch: invalid date format");
+                    return -1;
+                }
+                times[1] = times[0];
+            } else {
+                struct stat ref_stat;
+                if (stat(args[i + 1], &ref_stat) != 0) {
+                    print_error("touch: cannot stat reference file");
+                    return -1;
+                }
+                times[0] = ref_stat.st_atim;
+                times[1] = ref_stat.st_mtim;
             }
-        } else {
-            handle_syscall_error("getcwd", "builtin_pwd");
-            SAFE_FREE(cwd);
-            return -1;
+            times_ptr = times;
+            i++;
+            continue;
         }
+        file_count++;
     }
     
-    /* 输出当前工作目录 */
-    printf("%s\n", cwd);
+    if (file_count == 0) {
+        print_error("touch: missing file operand");
+        return -1;
+    }
     
-    /* 释放内存 */
-    SAFE_FREE(cwd);
+    int overall_result = 0;
+    int dir_fd = AT_FDCWD;
+    char current_dir[MAX_PATH_SIZE] = "";  /* dir_fd对应的父目录 */
+    
+    /* 处理多个文件参数 */
+    for (int i = 0; args[i] != NULL; i++) {
+        if (strcmp(args[i], "-d") == 0 || strcmp(args[i], "-r") == 0) {
+            i++;
+            continue;
+        }
+        
+        char *filename = args[i];
+        const char *base = filename;
+        int target_fd = AT_FDCWD;
+        
+        /* 同一父目录下的文件共用一个目录fd，避免每次都重新解析路径 */
+        char *last_slash = strrchr(filename, '/');
+        if (last_slash != NULL && last_slash[1] != '\0') {
+            size_t dir_len = (size_t)(last_slash - filename);
+            if (dir_len == 0) {
+                dir_len = 1;  /* 根目录 */
+            }
+            
+            if (dir_len < sizeof(current_dir)) {
+                if (strncmp(current_dir, filename, dir_len) != 0 || current_dir[dir_len] != '\0') {
+                    if (dir_fd != AT_FDCWD) {
+                        close(dir_fd);
+                    }
+                    memcpy(current_dir, filename, dir_len);
+                    current_dir[dir_len] = '\0';
+                    dir_fd = open(current_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                    if (dir_fd == -1) {
+                        current_dir[0] = '\0';
+                        dir_fd = AT_FDCWD;
+                    }
+                }
+                if (dir_fd != AT_FDCWD) {
+                    target_fd = dir_fd;
+                    base = last_slash + 1;
+                }
+            }
+        }
+        
+        /* 先直接更新时间戳：已存在的文件只需要这一次系统调用 */
+        if (utimensat(target_fd, base, times_ptr, 0) == 0) {
+            continue;
+        }
+        if (errno != ENOENT) {
+            report_touch_error(filename, errno, 0);
+            overall_result = -1;
+            continue;
+        }
+        
+        /* 文件不存在，创建新文件；O_EXCL不是必需的，文件被并发创建时直接沿用 */
+        int fd = openat(target_fd, base, O_WRONLY | O_CREAT | O_NOCTTY | O_NONBLOCK | O_CLOEXEC,
+                        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);  /* 644权限 */
+        if (fd == -1) {
+            report_touch_error(filename, errno, 1);
+            overall_result = -1;
+            continue;
+        }
+        
+        /* 新文件需要显式时间时直接对fd设置，无需再次解析路径 */
+        if (times_ptr != NULL && futimens(fd, times_ptr) != 0) {
+            report_touch_error(filename, errno, 0);
+            overall_result = -1;
+        }
+        
+        /* 关闭文件描述符 */
+        if (close(fd) != 0) {
+            handle_error(ERROR_SYSTEM_CALL, "close failed");
+            overall_result = -1;
+        }
+    }
+    
+    if (dir_fd != AT_FDCWD) {
+        close(dir_fd);
+    }
+    
+    return overall_result;
+}
+
+/* 时区缓存：只在TZ变化时重新tzset，之后localtime_r不再检查/etc/localtime */
+static int g_tz_loaded = 0;
+static char g_tz_value[256];
+
+/**
+ * 确保时区数据已加载
+ */
+static void ensure_timezone_loaded(void) {
+    const char *tz = get_env_var("TZ");
+    const char *current = (tz != NULL) ? tz : "";
+    
+    if (g_tz_loaded && strcmp(g_tz_value, current) == 0) {
+        return;
+    }
+    
+    /* Shell变量不写入进程环境，tzset只读取environ，TZ变化时才同步这一个变量 */
+    if (tz != NULL) {
+        setenv("TZ", tz, 1);
+    } else {
+        unsetenv("TZ");
+    }
+    
+    tzset();
+    snprintf(g_tz_value, sizeof(g_tz_value), "%s", current);
+    g_tz_loaded = 1;
+}
+
+/**
+ * 展开格式串中strftime不支持的%N（纳秒，可带宽度如%3N）
+ * 其余转换说明原样保留，交给strftime处理
+ */
+static int expand_nanosecond_format(const char *format, long nsec, char *out, size_t out_size) {
+    char digits[10];
+    snprintf(digits, sizeof(digits), "%09ld", nsec);
+    
+    size_t pos = 0;
+    const char *p = format;
+    while (*p != '\0') {
+        if (p[0] == '%') {
+            const char *q = p + 1;
+            int width = 0;
+            while (*q >= '0' && *q <= '9') {
+                width = width * 10 + (*q - '0');
+                q++;
+            }
+            if (*q == 'N') {
+                if (width <= 0 || width > 9) {
+                    width = 9;
+                }
+                if (pos + (size_t)width >= out_size) {
+                    return -1;
+                }
+                memcpy(out + pos, digits, (size_t)width);
+                pos += (size_t)width;
+                p = q + 1;
+                continue;
+            }
+            if (p[1] == '%') {
+                /* %%需要原样交给strftime */
+                if (pos + 2 >= out_size) {
+                    return -1;
+                }
+                out[pos++] = '%';
+                out[pos++] = '%';
+                p += 2;
+                continue;
+            }
+        }
+        if (pos + 1 >= out_size) {
+            return -1;
+        }
+        out[pos++] = *p++;
+    }
+    out[pos] = '\0';
+    return 0;
+}
+
+int builtin_date(char **args) {
+    int utc = 0;
+    const char *date_spec = NULL;
+    const char *format = "%a %b %d %H:%M:%S %Z %Y";  /* 标准date命令格式 */
+    
+    /* 解析参数：-u、-d 时间描述、+格式 */
+    for (int i = 0; args != NULL && args[i] != NULL; i++) {
+        if (strcmp(args[i], "-u") == 0) {
+            utc = 1;
+        } else if (strcmp(args[i], "-d") == 0) {
+            if (args[i + 1] == NULL) {
+                print_error("date: option requires an argument -- 'd'");
+                return -1;
+            }
+            date_spec = args[++i];
+        } else if (strncmp(args[i], "-d", 2) == 0) {
+            date_spec = args[i] + 2;
+        } else if (args[i][0] == '+') {
+            format = args[i] + 1;
+        } else {
+            char error_msg[MAX_INPUT_SIZE];
+            snprintf(error_msg, sizeof(error_msg), "date: invalid argument '%s'", args[i]);
+            print_error(error_msg);
+            return -1;
+        }
+    }
+    
+    /* 获取纳秒精度的时间 */
+    struct timespec now;
+    if (date_spec != NULL) {
+        if (parse_time_spec(date_spec, &now) != 0) {
+            char error_msg[MAX_INPUT_SIZE];
+            snprintf(error_msg, sizeof(error_msg), "date: invalid date '%s'", date_spec);
+            print_error(error_msg);
+            return -1;
+        }
+    } else if (clock_gettime(CLOCK_REALTIME, &now) != 0) {
+        handle_error(ERROR_SYSTEM_CALL, "clock_gettime failed");
+        return -1;
+    }
+    
+    /* 转换为日历时间 */
+    struct tm time_info;
+    if (utc) {
+        if (gmtime_r(&now.tv_sec, &time_info) == NULL) {
+            handle_error(ERROR_SYSTEM_CALL, "gmtime_r failed");
+            return -1;
+        }
+        time_info.tm_zone = "UTC";
+    } else {
+        ensure_timezone_loaded();
+        if (localtime_r(&now.tv_sec, &time_info) == NULL) {
+            handle_error(ERROR_SYSTEM_CALL, "localtime_r failed");
+            return -1;
+        }
+    }
+    
+    char expanded_format[256];
+    if (expand_nanosecond_format(format, now.tv_nsec, expanded_format, sizeof(expanded_format)) != 0) {
+        print_error("date: format too long");
+        return -1;
+    }
+    
+    /* 格式化时间输出 */
+    char time_buffer[512];
+    size_t length = strftime(time_buffer, sizeof(time_buffer), expanded_format, &time_info);
+    if (length == 0 && expanded_format[0] != '\0') {
+        print_error("date: failed to format time");
+        return -1;
+    }
+    
+    output_write(STDOUT_FILENO, time_buffer, length);
+    output_putc(STDOUT_FILENO, '\n');
+    
+    return 0;
+}
+
+int builtin_pwd(char **args) {
+    (void)args;  /* 避免未使用参数警告 */
+    
+    LOG_FUNCTION_ENTRY("builtin_pwd");
+    
+    char *cwd = NULL;
+    size_t size = MAX_PATH_SIZE;
+    
+    /* 使用安全内存分配 */
+    cwd = safe_malloc(size, "builtin_pwd: buffer allocation");
+    if (cwd == NULL) {
+        return -1;
+    }
+    
+    /* 调用getcwd系统调用获取当前工作目录 */
+    if (getcwd(cwd, size) == NULL) {
+        /* 如果缓冲区太小，动态增加大小 */
+        if (errno == ERANGE) {
+            SAFE_FREE(cwd);
+            size *= 2;
+            cwd = safe_malloc(size, "builtin_pwd: larger buffer allocation");
+            if (cwd == NULL) {
+                return -1;
+            }
+            
+            if (getcwd(cwd, size) == NULL) {
+                handle_syscall_error("getcwd", "builtin_pwd");
+                SAFE_FREE(cwd);
+                return -1;
+            }
+        } else {
+            handle_syscall_error("getcwd", "builtin_pwd");
+            SAFE_FREE(cwd);
+            return -1;
+        }
+    }
+    
+    /* 输出当前工作目录 */
+    output_puts(STDOUT_FILENO, cwd);
+    output_putc(STDOUT_FILENO, '\n');
+    
+    /* 释放内存 */
+    SAFE_FREE(cwd);
     
     LOG_FUNCTION_EXIT("builtin_pwd");
     return 0;
@@ -830,230 +1444,437 @@ int builtin_cd(char **args) {
     }
     
     /* 更新PWD环境变量 */
-    char *new_cwd = safe_malloc(MAX_PATH_SIZE, "builtin_cd: new directory buffer");
-    if (new_cwd == NULL) {
-        return -1;
-    }
-    
-    if (getcwd(new_cwd, MAX_PATH_SIZE) == NULL) {
+    char cwd[MAX_PATH_SIZE];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
         handle_syscall_error("getcwd", "builtin_cd: after chdir");
-        SAFE_FREE(new_cwd);
         return -1;
     }
     
     /* 设置PWD环境变量 */
-    if (set_env_var("PWD", new_cwd) != 0) {
+    if (set_env_var("PWD", cwd) != 0) {
         handle_error(ERROR_ENVIRONMENT, "builtin_cd: failed to update PWD");
-        SAFE_FREE(new_cwd);
         return -1;
     }
     
-    /* 更新Shell状态中的当前目录 */
-    SAFE_FREE(g_shell_state.current_dir);
-    g_shell_state.current_dir = new_cwd;  /* 转移所有权 */
+    /* 更新Shell状态中的当前目录（与shell_init相同，由内存跟踪分配） */
+    char *new_cwd = TRACKED_STRDUP(cwd, "builtin_cd: current directory");
+    if (new_cwd == NULL) {
+        return -1;
+    }
+    TRACKED_FREE(g_shell_state.current_dir);
+    g_shell_state.current_dir = new_cwd;
     
     LOG_FUNCTION_EXIT("builtin_cd");
     return 0;
 }
 
-int builtin_echo(char **args) {
-    int newline = 1;  /* 默认输出换行符 */
-    int start_index = 0;
-    
-    /* 检查是否有-n选项（不输出换行符） */
-    if (args != NULL && args[0] != NULL && strcmp(args[0], "-n") == 0) {
-        newline = 0;
-        start_index = 1;
+/* echo转义解码器状态 */
+typedef enum {
+    ECHO_NORMAL = 0,
+    ECHO_BACKSLASH,
+    ECHO_OCTAL,
+    ECHO_HEX
+} echo_state_t;
+
+typedef struct {
+    int escapes;        /* 是否解释转义序列（-e/-E） */
+    echo_state_t state;
+    int digits;         /* 已读取的八进制/十六进制位数 */
+    int value;          /* 正在累积的字符值 */
+    int stopped;        /* 遇到\c，停止所有输出 */
+} echo_decoder_t;
+
+/**
+ * 十六进制字符转数值，非法字符返回-1
+ */
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * 结束一个未完成的八进制/十六进制序列
+ */
+static void echo_finish_numeric(echo_decoder_t *d) {
+    if (d->state == ECHO_HEX && d->digits == 0) {
+        /* \x后没有十六进制数字，原样输出 */
+        output_write(STDOUT_FILENO, "\\x", 2);
+    } else {
+        output_putc(STDOUT_FILENO, (char)d->value);
     }
+    d->state = ECHO_NORMAL;
+}
+
+/**
+ * 向解码器输入一段文本，解码结果直接写入输出缓冲区
+ */
+static void echo_feed(echo_decoder_t *d, const char *data, size_t len) {
+    size_t i = 0;
     
-    /* 如果没有参数（除了可能的-n选项），只输出换行或什么都不输出 */
-    if (args == NULL || args[start_index] == NULL) {
-        if (newline) {
-            printf("\n");
+    while (i < len && !d->stopped) {
+        char c = data[i];
+        
+        switch (d->state) {
+            case ECHO_NORMAL: {
+                if (!d->escapes) {
+                    output_write(STDOUT_FILENO, data + i, len - i);
+                    return;
+                }
+                /* 一次写出到下一个反斜杠之前的所有字符 */
+                const char *slash = memchr(data + i, '\\', len - i);
+                size_t run = slash ? (size_t)(slash - (data + i)) : len - i;
+                output_write(STDOUT_FILENO, data + i, run);
+                i += run;
+                if (slash != NULL) {
+                    d->state = ECHO_BACKSLASH;
+                    i++;
+                }
+                break;
+            }
+            
+            case ECHO_BACKSLASH:
+                d->state = ECHO_NORMAL;
+                i++;
+                switch (c) {
+                    case 'n':  output_putc(STDOUT_FILENO, '\n'); break;
+                    case 't':  output_putc(STDOUT_FILENO, '\t'); break;
+                    case 'r':  output_putc(STDOUT_FILENO, '\r'); break;
+                    case '\\': output_putc(STDOUT_FILENO, '\\'); break;
+                    case '"':  output_putc(STDOUT_FILENO, '"'); break;
+                    case '\'': output_putc(STDOUT_FILENO, '\''); break;
+                    case 'a':  output_putc(STDOUT_FILENO, '\a'); break;  /* 响铃 */
+                    case 'b':  output_putc(STDOUT_FILENO, '\b'); break;  /* 退格 */
+                    case 'e':  output_putc(STDOUT_FILENO, '\033'); break;
+                    case 'f':  output_putc(STDOUT_FILENO, '\f'); break;  /* 换页 */
+                    case 'v':  output_putc(STDOUT_FILENO, '\v'); break;  /* 垂直制表符 */
+                    case 'c':  d->stopped = 1; break;                   /* 停止输出 */
+                    case '0':
+                        d->state = ECHO_OCTAL;
+                        d->digits = 0;
+                        d->value = 0;
+                        break;
+                    case 'x':
+                        d->state = ECHO_HEX;
+                        d->digits = 0;
+                        d->value = 0;
+                        break;
+                    default:
+                        /* 不识别的转义序列，保持原样 */
+                        output_putc(STDOUT_FILENO, '\\');
+                        output_putc(STDOUT_FILENO, c);
+                        break;
+                }
+                break;
+            
+            case ECHO_OCTAL:
+                if (c >= '0' && c <= '7' && d->digits < 3) {
+                    d->value = d->value * 8 + (c - '0');
+                    d->digits++;
+                    i++;
+                } else {
+                    echo_finish_numeric(d);
+                }
+                break;
+            
+            case ECHO_HEX:
+                if (hex_value(c) >= 0 && d->digits < 2) {
+                    d->value = d->value * 16 + hex_value(c);
+                    d->digits++;
+                    i++;
+                } else {
+                    echo_finish_numeric(d);
+                }
+                break;
         }
+    }
+}
+
+/**
+ * 结束一个参数：输出末尾悬空的反斜杠或数字序列
+ */
+static void echo_flush_pending(echo_decoder_t *d) {
+    if (d->stopped) {
+        return;
+    }
+    if (d->state == ECHO_BACKSLASH) {
+        output_putc(STDOUT_FILENO, '\\');
+        d->state = ECHO_NORMAL;
+    } else if (d->state == ECHO_OCTAL || d->state == ECHO_HEX) {
+        echo_finish_numeric(d);
+    }
+}
+
+/**
+ * 单遍处理一个已扩展的参数：直接解码写出，不做任何堆分配
+ */
+static void echo_emit_arg(echo_decoder_t *d, const char *arg) {
+    echo_feed(d, arg, strlen(arg));
+    echo_flush_pending(d);
+}
+
+/**
+ * 判断参数是否为echo选项（仅由n、e、E组成）
+ */
+static int is_echo_option(const char *arg) {
+    if (arg[0] != '-' || arg[1] == '\0') {
         return 0;
     }
-    
-    /* 输出所有参数，用空格分隔 */
-    for (int i = start_index; args[i] != NULL; i++) {
-        if (i > start_index) {
-            printf(" ");
+    for (const char *p = arg + 1; *p; p++) {
+        if (*p != 'n' && *p != 'e' && *p != 'E') {
+            return 0;
         }
-        
-        /* 处理环境变量扩展和转义字符 */
-        char *expanded_arg = expand_variables(args[i]);
-        if (expanded_arg != NULL) {
-            /* 处理转义字符 */
-            char *processed_arg = process_escape_sequences(expanded_arg);
-            if (processed_arg != NULL) {
-                printf("%s", processed_arg);
-                free(processed_arg);
-            } else {
-                printf("%s", expanded_arg);
+    }
+    return 1;
+}
+
+/**
+ * 解析p处（指向$）的单值参数引用：$NAME、${NAME}、$1、${10}、$?、$#、$$、$!
+ * 成功时参数名写入name并返回引用的长度，不是这样的引用时返回0
+ */
+static size_t echo_param_ref(const char *p, char name[256]) {
+    size_t name_len = 0;
+    
+    if (p[1] == '{') {
+        const char *body = p + 2;
+        if (isdigit((unsigned char)body[0])) {
+            while (isdigit((unsigned char)body[name_len]) && name_len < 255) {
+                name_len++;
             }
-            free(expanded_arg);
-        } else {
-            /* 如果环境变量扩展失败，直接输出原字符串 */
-            char *processed_arg = process_escape_sequences(args[i]);
-            if (processed_arg != NULL) {
-                printf("%s", processed_arg);
-                free(processed_arg);
-            } else {
-                printf("%s", args[i]);
+        } else if (isalpha((unsigned char)body[0]) || body[0] == '_') {
+            while ((isalnum((unsigned char)body[name_len]) || body[name_len] == '_') && name_len < 255) {
+                name_len++;
             }
+        } else if (body[0] != '\0' && strchr("#?$!", body[0]) != NULL) {
+            name_len = 1;
+        }
+        if (name_len == 0 || body[name_len] != '}') {
+            return 0;
         }
+        memcpy(name, body, name_len);
+        name[name_len] = '\0';
+        return name_len + 3;
     }
     
-    if (newline) {
-        printf("\n");
+    if (isdigit((unsigned char)p[1]) || (p[1] != '\0' && strchr("#?$!", p[1]) != NULL)) {
+        name[name_len++] = p[1];
+    } else {
+        while ((isalnum((unsigned char)p[1 + name_len]) || p[1 + name_len] == '_') && name_len < 255) {
+            name[name_len] = p[1 + name_len];
+            name_len++;
+        }
     }
-    
-    return 0;
+    name[name_len] = '\0';
+    return (name_len > 0) ? name_len + 1 : 0;
 }
 
 /**
- * 处理转义字符序列
- * 支持常见的转义字符：\n, \t, \r, \\, \", \'
+ * 扩展结果的第一个字符（参数值为空时看后面的部分），结果为空时返回'\0'
  */
-static char* process_escape_sequences(const char *input) {
-    if (input == NULL) {
-        return NULL;
+static char echo_first_char(const char *word) {
+    char name[256];
+    char scratch[PARAM_SCRATCH_SIZE];
+    const char *p = word;
+    
+    while (*p != '\0') {
+        size_t ref = (*p == '$') ? echo_param_ref(p, name) : 0;
+        if (ref == 0) {
+            return *p;
+        }
+        const char *value = get_shell_param(name, scratch);
+        if (value != NULL && value[0] != '\0') {
+            return value[0];
+        }
+        p += ref;
     }
+    return '\0';
+}
+
+/**
+ * 判断echo的参数能否不经expand_arguments、在输出时直接扩展：
+ * 参数中只有普通字符和单值参数引用（没有引号、反斜杠、通配符、花括号展开、
+ * $@、命令替换和${...}运算符），引用的值中没有通配符（未加引号的扩展结果要做路径名扩展），
+ * 并且第一个非选项参数的扩展结果不会被当作选项或被删除
+ */
+int echo_args_are_simple(char **args, int argc) {
+    char name[256];
+    char scratch[PARAM_SCRATCH_SIZE];
     
-    size_t input_len = strlen(input);
-    char *output = malloc(input_len + 1);  /* 最多和输入一样长 */
-    if (output == NULL) {
-        return NULL;
+    for (int i = 0; i < argc; i++) {
+        const char *word = args[i];
+        if (strpbrk(word, "`'\"\\*?[<>") != NULL) {
+            return 0;
+        }
+        for (const char *p = word; *p != '\0'; p++) {
+            if (*p == '{') {
+                return 0;
+            }
+            if (*p != '$') {
+                continue;
+            }
+            if (p[1] == '(' || p[1] == '@' || p[1] == '*') {
+                return 0;
+            }
+            size_t ref = echo_param_ref(p, name);
+            if (ref == 0 && p[1] == '{') {
+                return 0;
+            }
+            if (ref > 0) {
+                const char *value = get_shell_param(name, scratch);
+                if (value != NULL && strpbrk(value, "*?[") != NULL) {
+                    return 0;
+                }
+                p += ref - 1;
+            }
+        }
     }
     
-    size_t out_pos = 0;
-    for (size_t i = 0; i < input_len; i++) {
-        if (input[i] == '\\' && i + 1 < input_len) {
-            /* 处理转义字符 */
-            switch (input[i + 1]) {
-                case 'n':
-                    output[out_pos++] = '\n';
-                    i++;  /* 跳过下一个字符 */
-                    break;
-                case 't':
-                    output[out_pos++] = '\t';
-                    i++;
-                    break;
-                case 'r':
-                    output[out_pos++] = '\r';
-                    i++;
-                    break;
-                case '\\':
-                    output[out_pos++] = '\\';
-                    i++;
-                    break;
-                case '"':
-                    output[out_pos++] = '"';
-                    i++;
-                    break;
-                case '\'':
-                    output[out_pos++] = '\'';
-                    i++;
-                    break;
-                case 'a':
-                    output[out_pos++] = '\a';  /* 响铃 */
-                    i++;
-                    break;
-                case 'b':
-                    output[out_pos++] = '\b';  /* 退格 */
-                    i++;
-                    break;
-                case 'f':
-                    output[out_pos++] = '\f';  /* 换页 */
-                    i++;
-                    break;
-                case 'v':
-                    output[out_pos++] = '\v';  /* 垂直制表符 */
-                    i++;
-                    break;
-                default:
-                    /* 不识别的转义序列，保持原样 */
-                    output[out_pos++] = input[i];
-                    break;
+    int first = 0;
+    while (first < argc && is_echo_option(args[first])) {
+        first++;
+    }
+    if (first < argc && strchr(args[first], '$') != NULL) {
+        char c = echo_first_char(args[first]);
+        return c != '\0' && c != '-';
+    }
+    return 1;
+}
+
+/**
+ * 扩展并输出一个参数：字面文本和参数值依次送入解码器，与转义解码在同一遍中完成
+ * 扩展结果为空的参数不产生输出（与expand_arguments删除空参数一致），
+ * separate为1时在非空结果之前输出分隔的空格；返回是否输出了内容
+ */
+static int echo_expand_arg(echo_decoder_t *d, const char *word, int separate) {
+    char name[256];
+    char scratch[PARAM_SCRATCH_SIZE];
+    int emitted = 0;
+    const char *p = word;
+    
+    while (*p != '\0' && !d->stopped) {
+        const char *text = p;
+        size_t len;
+        size_t ref = (*p == '$') ? echo_param_ref(p, name) : 0;
+        if (ref > 0) {
+            text = get_shell_param(name, scratch);
+            len = (text != NULL) ? strlen(text) : 0;
+            p += ref;
+        } else {
+            /* 到下一个$之前的字面文本（不构成引用的$按普通字符输出） */
+            len = strcspn(p + 1, "$") + 1;
+            p += len;
+        }
+        if (len > 0) {
+            if (!emitted && separate) {
+                output_putc(STDOUT_FILENO, ' ');
+            }
+            emitted = 1;
+            echo_feed(d, text, len);
+        }
+    }
+    
+    if (emitted) {
+        echo_flush_pending(d);
+    }
+    return emitted;
+}
+
+/**
+ * echo的实现：expand为1时参数尚未扩展（已由echo_args_are_simple检查），在输出时逐个扩展
+ */
+static int run_echo(char **args, int expand) {
+    int newline = 1;  /* 默认输出换行符 */
+    int start_index = 0;
+    echo_decoder_t decoder = { 1, ECHO_NORMAL, 0, 0, 0 };  /* 默认解释转义字符 */
+    
+    /* 解析选项：-n不输出换行，-e解释转义，-E原样输出 */
+    while (args != NULL && args[start_index] != NULL && is_echo_option(args[start_index])) {
+        for (const char *p = args[start_index] + 1; *p; p++) {
+            if (*p == 'n') {
+                newline = 0;
+            } else if (*p == 'e') {
+                decoder.escapes = 1;
+            } else {
+                decoder.escapes = 0;
             }
+        }
+        start_index++;
+    }
+    
+    /* 输出所有参数，用空格分隔 */
+    int emitted = 0;
+    for (int i = start_index; args != NULL && args[i] != NULL; i++) {
+        if (expand) {
+            emitted |= echo_expand_arg(&decoder, args[i], emitted);
         } else {
-            /* 普通字符 */
-            output[out_pos++] = input[i];
+            if (i > start_index) {
+                output_putc(STDOUT_FILENO, ' ');
+            }
+            echo_emit_arg(&decoder, args[i]);
         }
+        if (decoder.stopped) {
+            /* \c 同时抑制末尾换行 */
+            return 0;
+        }
+    }
+    
+    if (newline) {
+        output_putc(STDOUT_FILENO, '\n');
     }
     
-    output[out_pos] = '\0';
-    return output;
+    return 0;
+}
+
+int builtin_echo(char **args) {
+    return run_echo(args, 0);
+}
+
+/**
+ * 对未扩展的参数执行echo（参数须满足echo_args_are_simple）：
+ * 参数引用在输出时查找，扩展与转义解码一遍完成，不构造参数数组，不做任何堆分配
+ */
+int builtin_echo_unexpanded(char **args) {
+    output_take_error();
+    return finish_builtin_output("echo", exit_status_from_result(run_echo(args, 1)));
 }
 
 int builtin_export(char **args) {
-    /* 如果没有参数，显示所有环境变量 */
-    if (args == NULL || args[0] == NULL) {
-        print_all_env_vars();
+    /* 没有参数（或-p）时按declare -x的格式显示所有导出的变量 */
+    if (args == NULL || args[0] == NULL || (strcmp(args[0], "-p") == 0 && args[1] == NULL)) {
+        for (env_var_t *var = g_shell_state.env_vars; var != NULL; var = var->next) {
+            if (var->exported) {
+                print_variable_declaration(var->name);
+            }
+        }
         return 0;
     }
     
     int overall_result = 0;
     
-    /* 处理多个变量赋值 */
+    /* 处理多个变量 */
     for (int i = 0; args[i] != NULL; i++) {
         char *arg = args[i];
         
-        /* 查找等号 */
+        /* 分离变量名和值（参数可能指向语法树中的只读字符串，变量名复制到局部缓冲区） */
         char *equals = strchr(arg, '=');
-        if (equals == NULL) {
-            /* 没有等号，只是导出现有变量（如果存在） */
-            if (env_var_exists(arg)) {
-                /* 变量已存在，无需操作 */
-                continue;
-            } else {
-                /* 变量不存在，设置为空值 */
-                if (set_env_var(arg, "") != 0) {
-                    print_error("export: failed to export variable");
-                    overall_result = -1;
-                }
-                continue;
-            }
-        }
-        
-        /* 分离变量名和值 */
-        *equals = '\0';
-        char *name = arg;
-        char *value = equals + 1;
-        
-        /* 验证变量名 */
-        if (strlen(name) == 0) {
-            print_error("export: empty variable name");
-            *equals = '=';  /* 恢复原字符串 */
-            overall_result = -1;
-            continue;
-        }
+        size_t name_len = equals ? (size_t)(equals - arg) : strlen(arg);
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int)name_len, arg);
         
         /* 验证变量名格式（只能包含字母、数字和下划线，且不能以数字开头） */
         if (!is_valid_var_name(name)) {
-            print_error("export: invalid variable name");
-            *equals = '=';  /* 恢复原字符串 */
-            overall_result = -1;
+            char error_msg[320];
+            snprintf(error_msg, sizeof(error_msg), "export: `%s': not a valid identifier", arg);
+            print_error(error_msg);
+            overall_result = 1;
             continue;
         }
         
-        /* 处理值中的环境变量扩展 */
-        char *expanded_value = expand_variables(value);
-        char *final_value = (expanded_value != NULL) ? expanded_value : value;
-        
-        /* 设置环境变量 */
-        int result = set_env_var(name, final_value);
-        
-        /* 清理内存 */
-        if (expanded_value != NULL) {
-            free(expanded_value);
-        }
-        
-        *equals = '=';  /* 恢复原字符串 */
-        
-        if (result != 0) {
+        /* 没有等号时只标记导出（变量不存在时设置为空值），值中的变量引用已在执行命令前扩展 */
+        if (export_env_var(name, equals ? equals + 1 : NULL) != 0) {
             print_error("export: failed to set environment variable");
-            overall_result = -1;
+            overall_result = 1;
         }
     }
     
@@ -1088,6 +1909,21 @@ static int is_valid_var_name(const char *name) {
  * 内存统计命令
  */
 int builtin_memstat(char **args) {
+    /* 解析缓存统计与内存跟踪无关 */
+    if (args != NULL && args[0] != NULL && strcmp(args[0], "cache") == 0) {
+        if (args[1] != NULL) {
+            char *endptr;
+            long size = strtol(args[1], &endptr, 10);
+            if (*endptr != '\0' || size < 0 || size > 65536) {
+                print_error("Invalid cache size. Must be a number between 0 and 65536.");
+                return -1;
+            }
+            set_parse_cache_size((int)size);
+        }
+        print_parse_cache_stats();
+        return 0;
+    }
+    
     if (!is_memory_tracking_enabled()) {
         print_error("Memory tracking is disabled");
         return -1;
@@ -1104,6 +1940,7 @@ int builtin_memstat(char **args) {
     } else {
         /* 显示内存统计信息 */
         print_memory_stats();
+        print_parse_cache_stats();
     }
     
     return 0;
@@ -1125,17 +1962,336 @@ int builtin_exit(char **args) {
         exit_code = (int)code;
     }
     
-    printf("Exiting shell with code %d...\n", exit_code);
+    if (g_shell_state.interactive) {
+        output_printf(STDOUT_FILENO, "Exiting shell with code %d...\n", exit_code);
+    }
     g_shell_state.running = 0;
     g_shell_state.last_exit_status = exit_code;
     return exit_code;
 }
 
+/**
+ * 解析break/continue的层数参数，超过当前循环层数时取最外层
+ * 返回层数，出错返回-1
+ */
+static int parse_loop_levels(const char *name, char **args) {
+    char error_msg[128];
+    if (g_shell_state.loop_depth == 0) {
+        snprintf(error_msg, sizeof(error_msg), "%s: only meaningful in a loop", name);
+        print_error(error_msg);
+        return -1;
+    }
+    
+    long levels = 1;
+    if (args != NULL && args[0] != NULL) {
+        char *endptr;
+        levels = strtol(args[0], &endptr, 10);
+        if (*endptr != '\0' || endptr == args[0] || levels < 1) {
+            snprintf(error_msg, sizeof(error_msg), "%s: %s: loop count out of range", name, args[0]);
+            print_error(error_msg);
+            return -1;
+        }
+    }
+    
+    if (levels > g_shell_state.loop_depth) {
+        levels = g_shell_state.loop_depth;
+    }
+    return (int)levels;
+}
+
+int builtin_break(char **args) {
+    int levels = parse_loop_levels("break", args);
+    if (levels < 0) {
+        return 1;
+    }
+    g_shell_state.break_levels = levels;
+    return 0;
+}
+
+int builtin_continue(char **args) {
+    int levels = parse_loop_levels("continue", args);
+    if (levels < 0) {
+        return 1;
+    }
+    g_shell_state.continue_levels = levels;
+    return 0;
+}
+
+int builtin_true(char **args) {
+    (void)args;
+    return 0;
+}
+
+int builtin_false(char **args) {
+    (void)args;
+    return 1;
+}
+
+int builtin_return(char **args) {
+    if (g_shell_state.function_depth == 0) {
+        print_error("return: can only `return' from a function");
+        return 1;
+    }
+    
+    int status = g_shell_state.last_exit_status;
+    if (args != NULL && args[0] != NULL) {
+        char *endptr;
+        long code = strtol(args[0], &endptr, 10);
+        if (*endptr != '\0' || endptr == args[0]) {
+            char error_msg[128];
+            snprintf(error_msg, sizeof(error_msg), "return: %s: numeric argument required", args[0]);
+            print_error(error_msg);
+            code = 2;
+        }
+        status = (int)(code & 0xff);
+    }
+    
+    g_shell_state.returning = 1;
+    return status;
+}
+
+/**
+ * declare、typeset和local的公共实现：declare [-aAxp] [name[=value] | name=(...)] ...
+ * local为1时（local，或函数中的declare）变量是当前函数的局部变量
+ */
+static int declare_variables(const char *command, char **args, int local) {
+    int array_kind = 0;     /* 'a'或'A' */
+    int export = 0;
+    int print = 0;
+    int i = 0;
+    for (; args != NULL && args[i] != NULL && args[i][0] == '-' && args[i][1] != '\0'; i++) {
+        for (const char *flag = args[i] + 1; *flag; flag++) {
+            if (*flag == 'a' || *flag == 'A') {
+                array_kind = *flag;
+            } else if (*flag == 'x') {
+                export = 1;
+            } else if (*flag == 'p') {
+                print = 1;
+            } else {
+                char error_msg[320];
+                snprintf(error_msg, sizeof(error_msg), "%s: -%c: invalid option", command, *flag);
+                print_error(error_msg);
+                return 2;
+            }
+        }
+    }
+    
+    if (args == NULL || args[i] == NULL) {
+        if (local && !print) {
+            return 0;
+        }
+        for (env_var_t *var = g_shell_state.env_vars; var != NULL; var = var->next) {
+            int kind_matches = (array_kind == 0 ||
+                                (var->array != NULL && array_is_associative(var->array) == (array_kind == 'A')));
+            if (kind_matches && (!export || var->exported)) {
+                print_variable_declaration(var->name);
+            }
+        }
+        return 0;
+    }
+    
+    int result = 0;
+    while (args[i] != NULL) {
+        /* 参数可能指向语法树中的只读字符串，变量名复制到局部缓冲区 */
+        char *arg = args[i++];
+        size_t equals = find_assignment(arg);
+        size_t name_len = equals ? strcspn(arg, "[+=") : strlen(arg);
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int)name_len, arg);
+        
+        /* 复合赋值的元素一直到")" */
+        int compound = (equals > 0 && strcmp(arg + equals + 1, "(") == 0);
+        int element_count = 0;
+        while (compound && args[i + element_count] != NULL && strcmp(args[i + element_count], ")") != 0) {
+            element_count++;
+        }
+        char **elements = args + i;
+        i += element_count + (compound && args[i + element_count] != NULL);
+        
+        if (!is_valid_var_name(name)) {
+            char error_msg[320];
+            snprintf(error_msg, sizeof(error_msg), "%s: `%s': not a valid identifier", command, arg);
+            print_error(error_msg);
+            result = 1;
+            continue;
+        }
+        if (print) {
+            if (print_variable_declaration(name) != 0) {
+                char error_msg[320];
+                snprintf(error_msg, sizeof(error_msg), "%s: %s: not found", command, name);
+                print_error(error_msg);
+                result = 1;
+            }
+            continue;
+        }
+        
+        int append = (equals > 0 && arg[equals - 1] == '+');
+        int plain = (equals > 0 && !compound && !append && arg[name_len] == '=' && array_kind == 0);
+        if (local && declare_local_var(name, plain ? arg + equals + 1 : NULL) != 0) {
+            result = 1;
+            continue;
+        }
+        if (array_kind != 0 && make_array_var(name, array_kind == 'A') == NULL) {
+            result = 1;
+            continue;
+        }
+        if (compound) {
+            result |= assign_compound(name, append, elements, element_count) != 0;
+        } else if (equals > 0 && !(local && plain)) {
+            char subscript[256];
+            const char *close = strrchr(arg, ']');
+            int has_subscript = (arg[name_len] == '[' && close != NULL);
+            if (has_subscript) {
+                snprintf(subscript, sizeof(subscript), "%.*s", (int)(close - arg - (int)name_len - 1), arg + name_len + 1);
+            }
+            result |= assign_shell_variable(name, has_subscript ? subscript : NULL, arg + equals + 1, append) != 0;
+        }
+        if (export && get_array_var(name) == NULL) {
+            result |= export_env_var(name, NULL) != 0;
+        }
+    }
+    return result;
+}
+
+int builtin_declare(char **args) {
+    return declare_variables("declare", args, g_shell_state.function_depth > 0);
+}
+
+int builtin_local(char **args) {
+    if (g_shell_state.function_depth == 0) {
+        print_error("local: can only be used in a function");
+        return 1;
+    }
+    return declare_variables("local", args, 1);
+}
+
+int builtin_unset(char **args) {
+    int result = 0;
+    int i = (args[0] != NULL && strcmp(args[0], "-v") == 0) ? 1 : 0;
+    for (; args[i] != NULL; i++) {
+        char name[256];
+        size_t name_len = strcspn(args[i], "[");
+        snprintf(name, sizeof(name), "%.*s", (int)name_len, args[i]);
+        size_t len = strlen(args[i]);
+        int element = (args[i][name_len] == '[' && args[i][len - 1] == ']');
+        
+        if (!is_valid_var_name(name) || (args[i][name_len] != '\0' && !element)) {
+            char error_msg[320];
+            snprintf(error_msg, sizeof(error_msg), "unset: `%s': not a valid identifier", args[i]);
+            print_error(error_msg);
+            result = 1;
+            continue;
+        }
+        if (element) {
+            /* unset arr[下标]只删除一个元素 */
+            char subscript[256];
+            snprintf(subscript, sizeof(subscript), "%.*s", (int)(len - name_len - 2), args[i] + name_len + 1);
+            result |= unset_array_element(name, subscript) != 0;
+        } else {
+            unset_env_var(name);
+        }
+    }
+    return result;
+}
+
+int builtin_test(char **args) {
+    return evaluate_test("test", args, count_args(args));
+}
+
+int builtin_bracket(char **args) {
+    int argc = count_args(args);
+    if (argc == 0 || strcmp(args[argc - 1], "]") != 0) {
+        print_error("[: missing `]'");
+        return 2;
+    }
+    return evaluate_test("[", args, argc - 1);
+}
+
+/* shopt可以设置的选项 */
+static const struct {
+    const char *name;
+    int flag;
+} shopt_options[] = {
+    {"dotglob", GLOB_OPT_DOTGLOB},
+    {"globstar", GLOB_OPT_GLOBSTAR},
+    {"nullglob", GLOB_OPT_NULLGLOB}
+};
+
+/**
+ * 查找shopt选项，返回对应的标志位；不存在时报告错误并返回0
+ */
+static int find_shopt_option(const char *name) {
+    for (size_t i = 0; i < sizeof(shopt_options) / sizeof(shopt_options[0]); i++) {
+        if (strcmp(shopt_options[i].name, name) == 0) {
+            return shopt_options[i].flag;
+        }
+    }
+    char error_msg[320];
+    snprintf(error_msg, sizeof(error_msg), "shopt: %s: invalid shell option name", name);
+    print_error(error_msg);
+    return 0;
+}
+
+int builtin_shopt(char **args) {
+    int mode = 0;   /* 1为-s，-1为-u，0为查询 */
+    int i = 0;
+    for (; args[i] != NULL && args[i][0] == '-'; i++) {
+        if (strcmp(args[i], "-s") == 0) {
+            mode = 1;
+        } else if (strcmp(args[i], "-u") == 0) {
+            mode = -1;
+        } else {
+            char error_msg[320];
+            snprintf(error_msg, sizeof(error_msg), "shopt: %s: invalid option", args[i]);
+            print_error(error_msg);
+            return 2;
+        }
+    }
+    
+    /* 没有选项名时列出所有选项（-s/-u只列出打开/关闭的） */
+    if (args[i] == NULL) {
+        for (size_t k = 0; k < sizeof(shopt_options) / sizeof(shopt_options[0]); k++) {
+            int on = (g_shell_state.glob_options & shopt_options[k].flag) != 0;
+            if (mode == 0 || on == (mode > 0)) {
+                output_printf(STDOUT_FILENO, "%-15s\t%s\n", shopt_options[k].name, on ? "on" : "off");
+            }
+        }
+        return 0;
+    }
+    
+    int result = 0;
+    for (; args[i] != NULL; i++) {
+        int flag = find_shopt_option(args[i]);
+        if (flag == 0) {
+            result = 1;
+        } else if (mode > 0) {
+            g_shell_state.glob_options |= flag;
+        } else if (mode < 0) {
+            g_shell_state.glob_options &= ~flag;
+        } else {
+            int on = (g_shell_state.glob_options & flag) != 0;
+            output_printf(STDOUT_FILENO, "%-15s\t%s\n", args[i], on ? "on" : "off");
+            result = on ? result : 1;
+        }
+    }
+    return result;
+}
+
+int builtin_let(char **args) {
+    long long value = 0;
+    for (int i = 0; args[i] != NULL; i++) {
+        if (arith_evaluate(args[i], &value) != 0) {
+            return 1;
+        }
+    }
+    return (value != 0) ? 0 : 1;
+}
+
 int builtin_help(char **args) {
     if (args == NULL || args[0] == NULL) {
         /* 显示所有命令 */
         list_builtin_commands();
-        printf("\nType 'help <command>' for detailed information about a specific command.\n");
+        output_printf(STDOUT_FILENO, "\nType 'help <command>' for detailed information about a specific command.\n");
     } else {
         /* 显示特定命令的帮助 */
         show_command_help(args[0]);
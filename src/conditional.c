@@ -0,0 +1,428 @@
+#include "shell.h"
+
+#include <fnmatch.h>
+#include <limits.h>
+#include <regex.h>
+
+/* 条件表达式的求值状态（test/[ 和 [[ ]] 共用） */
+typedef struct {
+    char **words;
+    int count;
+    int pos;
+    int cond;           /* 1表示[[ ]]：单词未扩展，连接符为&&和|| */
+    char **expanded;    /* [[ ]]中按需扩展的操作数 */
+    const char *name;   /* 报错时的命令名 */
+    int skip;           /* 大于0时处于短路的一侧，只解析不求值 */
+    int error;
+} test_state_t;
+
+/**
+ * 报告条件表达式的错误（只报告第一个）
+ */
+static void test_error(test_state_t *ts, const char *operand, const char *reason) {
+    if (!ts->error) {
+        char error_msg[256];
+        if (operand != NULL) {
+            snprintf(error_msg, sizeof(error_msg), "%s: %s: %s", ts->name, operand, reason);
+        } else {
+            snprintf(error_msg, sizeof(error_msg), "%s: %s", ts->name, reason);
+        }
+        print_error(error_msg);
+    }
+    ts->error = 1;
+}
+
+/**
+ * 取第index个单词作为操作数
+ * [[ ]]中的单词在第一次使用时扩展（不做分词，结果可以为空串）；
+ * pattern为1时按模式扩展，引号内的通配符只匹配自身
+ */
+static const char* operand_at(test_state_t *ts, int index, int pattern) {
+    if (!ts->cond) {
+        return ts->words[index];
+    }
+    if (ts->expanded[index] == NULL) {
+        ts->expanded[index] = pattern ? expand_pattern(ts->words[index])
+                                      : expand_single_word(ts->words[index]);
+        if (ts->expanded[index] == NULL) {
+            if (take_expansion_error()) {
+                ts->error = 1;
+            } else {
+                test_error(ts, NULL, "word expansion failed");
+            }
+            return "";
+        }
+    }
+    return ts->expanded[index];
+}
+
+/**
+ * 单词是否为一元运算符
+ */
+static int is_unary_op(const char *word) {
+    return word[0] == '-' && word[1] != '\0' && word[2] == '\0' &&
+           strchr("bcdefghknprstuwxzGLOS", word[1]) != NULL;
+}
+
+/**
+ * 单词是否为二元运算符
+ */
+static int is_binary_op(test_state_t *ts, const char *word) {
+    static const char *const ops[] = {
+        "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+        "-nt", "-ot", "-ef", NULL
+    };
+    for (int i = 0; ops[i] != NULL; i++) {
+        if (strcmp(word, ops[i]) == 0) {
+            return 1;
+        }
+    }
+    /* test中-a/-o是逻辑连接符，[[ ]]中=~用于正则匹配 */
+    return ts->cond && strcmp(word, "=~") == 0;
+}
+
+/**
+ * 解析整数操作数（允许首尾空白），失败时报错
+ */
+static long long parse_integer(test_state_t *ts, const char *text) {
+    char *end;
+    errno = 0;
+    long long value = strtoll(text, &end, 10);
+    while (*end == ' ' || *end == '\t') {
+        end++;
+    }
+    if (end == text || *end != '\0' || errno == ERANGE) {
+        test_error(ts, text, "integer expression expected");
+        return 0;
+    }
+    return value;
+}
+
+/**
+ * 求一元文件测试或字符串测试的值
+ */
+static int eval_unary(test_state_t *ts, char op, const char *arg) {
+    struct stat st;
+    
+    switch (op) {
+        case 'z':
+            return arg[0] == '\0';
+        case 'n':
+            return arg[0] != '\0';
+        case 't': {
+            long long fd = parse_integer(ts, arg);
+            return !ts->error && fd >= 0 && fd <= INT_MAX && isatty((int)fd);
+        }
+        case 'r':
+            return faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS) == 0;
+        case 'w':
+            return faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS) == 0;
+        case 'x':
+            return faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS) == 0;
+        case 'h':
+        case 'L':
+            return fstatat(AT_FDCWD, arg, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISLNK(st.st_mode);
+        default:
+            break;
+    }
+    
+    /* 其余都是对stat结果的测试，只需一次系统调用 */
+    if (arg[0] == '\0' || fstatat(AT_FDCWD, arg, &st, 0) != 0) {
+        return 0;
+    }
+    switch (op) {
+        case 'e': return 1;
+        case 'f': return S_ISREG(st.st_mode);
+        case 'd': return S_ISDIR(st.st_mode);
+        case 'b': return S_ISBLK(st.st_mode);
+        case 'c': return S_ISCHR(st.st_mode);
+        case 'p': return S_ISFIFO(st.st_mode);
+        case 'S': return S_ISSOCK(st.st_mode);
+        case 's': return st.st_size > 0;
+        case 'g': return (st.st_mode & S_ISGID) != 0;
+        case 'u': return (st.st_mode & S_ISUID) != 0;
+        case 'k': return (st.st_mode & S_ISVTX) != 0;
+        case 'O': return st.st_uid == geteuid();
+        case 'G': return st.st_gid == getegid();
+        default: return 0;
+    }
+}
+
+/**
+ * 比较两个文件的修改时间（不存在的文件比任何存在的文件都旧）
+ */
+static int compare_mtime(const char *left, const char *right) {
+    struct stat ls, rs;
+    int lok = fstatat(AT_FDCWD, left, &ls, 0) == 0;
+    int rok = fstatat(AT_FDCWD, right, &rs, 0) == 0;
+    if (!lok || !rok) {
+        return lok - rok;
+    }
+    if (ls.st_mtim.tv_sec != rs.st_mtim.tv_sec) {
+        return (ls.st_mtim.tv_sec > rs.st_mtim.tv_sec) ? 1 : -1;
+    }
+    if (ls.st_mtim.tv_nsec != rs.st_mtim.tv_nsec) {
+        return (ls.st_mtim.tv_nsec > rs.st_mtim.tv_nsec) ? 1 : -1;
+    }
+    return 0;
+}
+
+/**
+ * [[ ]]中的=~：用扩展正则表达式匹配
+ */
+static int regex_match(test_state_t *ts, const char *text, const char *pattern) {
+    regex_t re;
+    int rc = regcomp(&re, pattern, REG_EXTENDED | REG_NOSUB);
+    if (rc != 0) {
+        test_error(ts, pattern, "invalid regular expression");
+        return 0;
+    }
+    int matched = regexec(&re, text, 0, NULL, 0) == 0;
+    regfree(&re);
+    return matched;
+}
+
+/**
+ * 求二元比较的值，index为左操作数的位置
+ */
+static int eval_binary(test_state_t *ts, int index) {
+    const char *op = ts->words[index + 1];
+    const char *left = operand_at(ts, index, 0);
+    
+    /* [[ ]]中==和!=右侧未加引号的部分是模式 */
+    if (ts->cond && (strcmp(op, "==") == 0 || strcmp(op, "=") == 0 || strcmp(op, "!=") == 0)) {
+        const char *pattern = operand_at(ts, index + 2, 1);
+        int matched = fnmatch(pattern, left, 0) == 0;
+        return (op[0] == '!') ? !matched : matched;
+    }
+    if (strcmp(op, "=~") == 0) {
+        return regex_match(ts, left, operand_at(ts, index + 2, 0));
+    }
+    
+    const char *right = operand_at(ts, index + 2, 0);
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(left, right) == 0;
+    }
+    if (strcmp(op, "!=") == 0) {
+        return strcmp(left, right) != 0;
+    }
+    if (strcmp(op, "<") == 0) {
+        return strcmp(left, right) < 0;
+    }
+    if (strcmp(op, ">") == 0) {
+        return strcmp(left, right) > 0;
+    }
+    if (strcmp(op, "-nt") == 0) {
+        return compare_mtime(left, right) > 0;
+    }
+    if (strcmp(op, "-ot") == 0) {
+        return compare_mtime(left, right) < 0;
+    }
+    if (strcmp(op, "-ef") == 0) {
+        struct stat ls, rs;
+        return fstatat(AT_FDCWD, left, &ls, 0) == 0 && fstatat(AT_FDCWD, right, &rs, 0) == 0 &&
+               ls.st_dev == rs.st_dev && ls.st_ino == rs.st_ino;
+    }
+    
+    /* 整数比较：-eq -ne -lt -le -gt -ge */
+    long long a = parse_integer(ts, left);
+    long long b = parse_integer(ts, right);
+    if (ts->error) {
+        return 0;
+    }
+    if (strcmp(op, "-eq") == 0) {
+        return a == b;
+    }
+    if (strcmp(op, "-ne") == 0) {
+        return a != b;
+    }
+    if (strcmp(op, "-lt") == 0) {
+        return a < b;
+    }
+    if (strcmp(op, "-le") == 0) {
+        return a <= b;
+    }
+    if (strcmp(op, "-gt") == 0) {
+        return a > b;
+    }
+    return a >= b;
+}
+
+static int parse_or(test_state_t *ts);
+
+/**
+ * 当前位置的单词（已到结尾时返回NULL）
+ */
+static const char* peek_word(test_state_t *ts, int offset) {
+    int index = ts->pos + offset;
+    return (index < ts->count) ? ts->words[index] : NULL;
+}
+
+/**
+ * primary := '(' expr ')' | 一元运算符 操作数 | 操作数 二元运算符 操作数 | 操作数
+ */
+static int parse_primary(test_state_t *ts) {
+    const char *word = peek_word(ts, 0);
+    if (word == NULL) {
+        test_error(ts, NULL, "argument expected");
+        return 0;
+    }
+    
+    const char *next = peek_word(ts, 1);
+    
+    /* 二元运算符优先于一元运算符（如 [ -f = -f ]） */
+    if (next != NULL && is_binary_op(ts, next) && peek_word(ts, 2) != NULL) {
+        int result = ts->skip ? 0 : eval_binary(ts, ts->pos);
+        ts->pos += 3;
+        return result;
+    }
+    
+    if (strcmp(word, "(") == 0) {
+        ts->pos++;
+        int result = parse_or(ts);
+        const char *close = peek_word(ts, 0);
+        if (close == NULL || strcmp(close, ")") != 0) {
+            test_error(ts, NULL, "')' expected");
+            return 0;
+        }
+        ts->pos++;
+        return result;
+    }
+    
+    if (is_unary_op(word) && next != NULL) {
+        ts->pos += 2;
+        return ts->skip ? 0 : eval_unary(ts, word[1], operand_at(ts, ts->pos - 1, 0));
+    }
+    
+    ts->pos++;
+    return ts->skip ? 0 : operand_at(ts, ts->pos - 1, 0)[0] != '\0';
+}
+
+/**
+ * not := '!' not | primary
+ */
+static int parse_not(test_state_t *ts) {
+    const char *word = peek_word(ts, 0);
+    const char *next = peek_word(ts, 1);
+    if (word != NULL && strcmp(word, "!") == 0 && next != NULL &&
+        !(is_binary_op(ts, next) && peek_word(ts, 2) != NULL)) {
+        ts->pos++;
+        return !parse_not(ts);
+    }
+    return parse_primary(ts);
+}
+
+/**
+ * and := not (('-a' | '&&') not)*
+ */
+static int parse_and(test_state_t *ts) {
+    const char *op = ts->cond ? "&&" : "-a";
+    int result = parse_not(ts);
+    while (!ts->error && peek_word(ts, 0) != NULL && strcmp(peek_word(ts, 0), op) == 0) {
+        ts->pos++;
+        /* 左侧为假时右侧只解析，不再扩展和测试 */
+        ts->skip += !result;
+        int right = parse_not(ts);
+        ts->skip -= !result;
+        result = result && right;
+    }
+    return result;
+}
+
+/**
+ * or := and (('-o' | '||') and)*
+ */
+static int parse_or(test_state_t *ts) {
+    const char *op = ts->cond ? "||" : "-o";
+    int result = parse_and(ts);
+    while (!ts->error && peek_word(ts, 0) != NULL && strcmp(peek_word(ts, 0), op) == 0) {
+        ts->pos++;
+        ts->skip += result;
+        int right = parse_and(ts);
+        ts->skip -= result;
+        result = result || right;
+    }
+    return result;
+}
+
+/**
+ * 按POSIX规定的参数个数规则求值（最多4个参数时避免歧义），
+ * 其余情况使用通用的递归下降解析
+ */
+static int evaluate(test_state_t *ts) {
+    char **w = ts->words;
+    
+    if (!ts->cond) {
+        switch (ts->count) {
+            case 0:
+                return 0;
+            case 1:
+                return w[0][0] != '\0';
+            case 2:
+                if (strcmp(w[0], "!") == 0) {
+                    return w[1][0] == '\0';
+                }
+                if (is_unary_op(w[0])) {
+                    return eval_unary(ts, w[0][1], w[1]);
+                }
+                test_error(ts, w[0], "unary operator expected");
+                return 0;
+            case 3:
+                if (is_binary_op(ts, w[1]) || strcmp(w[1], "-a") == 0 || strcmp(w[1], "-o") == 0) {
+                    break;  /* 交给通用解析（-a/-o在其中处理） */
+                }
+                if (strcmp(w[0], "!") == 0) {
+                    ts->words++;
+                    ts->count--;
+                    int result = !evaluate(ts);
+                    ts->words--;
+                    ts->count++;
+                    return result;
+                }
+                if (strcmp(w[0], "(") == 0 && strcmp(w[2], ")") == 0) {
+                    return w[1][0] != '\0';
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    
+    int result = parse_or(ts);
+    if (!ts->error && ts->pos < ts->count) {
+        test_error(ts, ts->words[ts->pos], "unexpected argument");
+    }
+    return result;
+}
+
+/**
+ * test和[的求值：参数已经扩展
+ * 返回0（真）、1（假）或2（表达式错误）
+ */
+int evaluate_test(const char *name, char **args, int argc) {
+    test_state_t ts = { args, argc, 0, 0, NULL, name, 0, 0 };
+    int result = evaluate(&ts);
+    return ts.error ? 2 : !result;
+}
+
+/**
+ * [[ ]]的求值：words为未扩展的单词，操作数在用到时才扩展且不做分词，
+ * ==和!=的右侧按模式匹配，=~的右侧为扩展正则表达式
+ * 返回0（真）、1（假）或2（表达式错误）
+ */
+int evaluate_conditional(char **words, int count) {
+    char **expanded = safe_malloc((size_t)(count + 1) * sizeof(char*), "evaluate_conditional: operands");
+    if (expanded == NULL) {
+        return 2;
+    }
+    memset(expanded, 0, (size_t)(count + 1) * sizeof(char*));
+    
+    test_state_t ts = { words, count, 0, 1, expanded, "[[", 0, 0 };
+    int result = evaluate(&ts);
+    
+    for (int i = 0; i < count; i++) {
+        TRACKED_FREE(expanded[i]);
+    }
+    free(expanded);
+    return ts.error ? 2 : !result;
+}
@@ -1,226 +1,2229 @@
 #include "shell.h"
 
+#include <limits.h>
+
+/* 环境是否已导入（首次使用时才导入） */
+static int g_env_initialized = 0;
+
+/* 导出的变量是否在子进程环境的缓存生成之后变化过 */
+static int g_environment_stale = 1;
+
+static env_var_t* find_var(const char *name);
+
+/**
+ * 确保环境已导入
+ */
+static void ensure_environment(void) {
+    if (!g_env_initialized) {
+        init_environment();
+    }
+}
+
+/**
+ * 初始化环境变量
+ * 由第一次环境变量访问自动调用，也可以显式调用
+ * 进程环境中的变量全部导入变量表并标记为导出，之后只读写变量表，不再修改environ
+ */
+void init_environment(void) {
+    g_env_initialized = 1;
+    
+    for (char **entry = environ; entry != NULL && *entry != NULL; entry++) {
+        const char *equals = strchr(*entry, '=');
+        if (equals == NULL || equals == *entry || (size_t)(equals - *entry) >= 256) {
+            continue;
+        }
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int)(equals - *entry), *entry);
+        export_env_var(name, (char *)equals + 1);
+    }
+    
+    /* 初始化HOME环境变量 */
+    if (get_env_var("HOME") == NULL) {
+        export_env_var("HOME", "/tmp");  /* 默认值 */
+    }
+    
+    /* 初始化PATH环境变量 */
+    if (get_env_var("PATH") == NULL) {
+        export_env_var("PATH", "/bin:/usr/bin:/usr/local/bin");  /* 默认PATH */
+    }
+    
+    /* 设置PWD为当前目录 */
+    if (g_shell_state.current_dir) {
+        export_env_var("PWD", g_shell_state.current_dir);
+    }
+}
+
+/**
+ * 获取环境变量值
+ */
+char* get_env_var(char *name) {
+    if (name == NULL) {
+        return NULL;
+    }
+    
+    ensure_environment();
+    
+    /* 首先检查内部环境变量表 */
+    env_var_t *current = g_shell_state.env_vars;
+    while (current) {
+        if (strcmp(current->name, name) == 0) {
+            if (current->array != NULL) {
+                /* 数组变量的$name即${name[0]} */
+                return (char *)(array_is_associative(current->array) ? array_get_key(current->array, "0")
+                                                                     : array_get(current->array, 0));
+            }
+            return current->value;
+        }
+        current = current->next;
+    }
+    
+    return NULL;
+}
+
+/**
+ * 设置环境变量
+ */
+int set_env_var(char *name, char *value) {
+    if (name == NULL || value == NULL) {
+        return -1;
+    }
+    
+    ensure_environment();
+    
+    /* 检查是否已存在 */
+    env_var_t *current = g_shell_state.env_vars;
+    while (current) {
+        if (strcmp(current->name, name) == 0) {
+            if (current->array != NULL) {
+                /* 给数组变量赋值即设置${name[0]} */
+                return array_is_associative(current->array) ? array_set_key(current->array, "0", value)
+                                                            : array_set(current->array, 0, value);
+            }
+            
+            /* 更新现有变量 */
+            TRACKED_FREE(current->value);
+            current->value = TRACKED_STRDUP(value, "set_env_var: update value");
+            if (current->value == NULL) {
+                return -1;
+            }
+            g_environment_stale |= current->exported;
+            return 0;
+        }
+        current = current->next;
+    }
+    
+    /* 创建新的环境变量节点 */
+    env_var_t *new_var = TRACKED_MALLOC(sizeof(env_var_t), "set_env_var: new variable");
+    if (new_var == NULL) {
+        return -1;
+    }
+    
+    new_var->name = TRACKED_STRDUP(name, "set_env_var: variable name");
+    if (new_var->name == NULL) {
+        TRACKED_FREE(new_var);
+        return -1;
+    }
+    
+    new_var->value = TRACKED_STRDUP(value, "set_env_var: variable value");
+    if (new_var->value == NULL) {
+        TRACKED_FREE(new_var->name);
+        TRACKED_FREE(new_var);
+        return -1;
+    }
+    
+    new_var->array = NULL;
+    new_var->exported = 0;  /* 新变量只属于Shell，export之后才传给子进程 */
+    
+    /* 插入到链表头部 */
+    new_var->next = g_shell_state.env_vars;
+    g_shell_state.env_vars = new_var;
+    
+    return 0;
+}
+
+/**
+ * 导出变量（export）：value不为NULL时先赋值，变量不存在时设为空值
+ * 导出的变量出现在子进程的环境中；数组不能导出
+ */
+int export_env_var(char *name, char *value) {
+    if (name == NULL) {
+        return -1;
+    }
+    
+    if (value != NULL || find_var(name) == NULL) {
+        if (set_env_var(name, value != NULL ? value : "") != 0) {
+            return -1;
+        }
+    }
+    env_var_t *var = find_var(name);
+    if (!var->exported) {
+        var->exported = 1;
+        g_environment_stale = 1;
+    }
+    return 0;
+}
+
+/* 子进程环境（"NAME=value"数组）的缓存，导出的变量变化后重新生成 */
+static char **g_exported_environment = NULL;
+static size_t g_exported_count = 0;
+
+/**
+ * 释放子进程环境的缓存
+ */
+static void free_exported_environment(void) {
+    for (size_t i = 0; i < g_exported_count; i++) {
+        free(g_exported_environment[i]);
+    }
+    free(g_exported_environment);
+    g_exported_environment = NULL;
+    g_exported_count = 0;
+}
+
+/**
+ * 取子进程的环境（以NULL结尾的"NAME=value"数组，传给execve）
+ * 只包含导出的变量；结果被缓存，在导出的变量下一次变化之前有效，不需要释放
+ */
+char** get_exported_environment(void) {
+    ensure_environment();
+    if (g_exported_environment != NULL && !g_environment_stale) {
+        return g_exported_environment;
+    }
+    free_exported_environment();
+    
+    size_t count = 0;
+    for (env_var_t *var = g_shell_state.env_vars; var != NULL; var = var->next) {
+        count += (var->exported && var->value != NULL);
+    }
+    g_exported_environment = safe_malloc((count + 1) * sizeof(char*), "get_exported_environment: envp");
+    if (g_exported_environment == NULL) {
+        return NULL;
+    }
+    for (env_var_t *var = g_shell_state.env_vars; var != NULL; var = var->next) {
+        if (!var->exported || var->value == NULL) {
+            continue;
+        }
+        size_t name_len = strlen(var->name);
+        size_t value_len = strlen(var->value);
+        char *entry = safe_malloc(name_len + value_len + 2, "get_exported_environment: entry");
+        if (entry == NULL) {
+            free_exported_environment();
+            return NULL;
+        }
+        memcpy(entry, var->name, name_len);
+        entry[name_len] = '=';
+        memcpy(entry + name_len + 1, var->value, value_len + 1);
+        g_exported_environment[g_exported_count++] = entry;
+    }
+    g_exported_environment[g_exported_count] = NULL;
+    g_environment_stale = 0;
+    return g_exported_environment;
+}
+
+/**
+ * 查找变量表中的变量（不查找系统环境变量）
+ */
+static env_var_t* find_var(const char *name) {
+    ensure_environment();
+    for (env_var_t *current = g_shell_state.env_vars; current != NULL; current = current->next) {
+        if (strcmp(current->name, name) == 0) {
+            return current;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 取数组变量，变量不存在或不是数组时返回NULL
+ */
+shell_array_t* get_array_var(const char *name) {
+    env_var_t *var = find_var(name);
+    return (var != NULL) ? var->array : NULL;
+}
+
+/**
+ * 把变量变为数组（declare -a/-A和数组赋值）并返回该数组
+ * 变量不存在时创建空数组；已有的普通变量的值成为第0个元素（关联数组中键为"0"）。
+ * 数组不放入进程环境。已是另一种数组时报告错误并返回NULL
+ */
+shell_array_t* make_array_var(const char *name, int associative) {
+    env_var_t *var = find_var(name);
+    if (var != NULL && var->array != NULL) {
+        if (array_is_associative(var->array) != associative) {
+            char error_msg[320];
+            snprintf(error_msg, sizeof(error_msg), "%s: cannot convert %s to %s array", name,
+                     associative ? "indexed" : "associative", associative ? "associative" : "indexed");
+            print_error(error_msg);
+            return NULL;
+        }
+        return var->array;
+    }
+    
+    shell_array_t *array = array_create(associative);
+    if (array == NULL) {
+        return NULL;
+    }
+    if (var == NULL) {
+        var = TRACKED_MALLOC(sizeof(env_var_t), "make_array_var: new variable");
+        char *name_copy = TRACKED_STRDUP(name, "make_array_var: variable name");
+        if (var == NULL || name_copy == NULL) {
+            TRACKED_FREE(var);
+            TRACKED_FREE(name_copy);
+            array_free(array);
+            return NULL;
+        }
+        var->name = name_copy;
+        var->value = NULL;
+        var->exported = 0;
+        var->next = g_shell_state.env_vars;
+        g_shell_state.env_vars = var;
+    } else if (var->value != NULL) {
+        int result = associative ? array_set_key(array, "0", var->value) : array_set(array, 0, var->value);
+        if (result != 0) {
+            array_free(array);
+            return NULL;
+        }
+        TRACKED_FREE(var->value);
+        var->value = NULL;
+        g_environment_stale |= var->exported;
+    }
+    var->array = array;
+    return array;
+}
+
+/**
+ * 把下标数组的下标（算术表达式，负数从末尾算起）转换为非负下标
+ * 返回0表示成功，下标无效时报告错误并返回-1
+ */
+static int array_index(const shell_array_t *array, const char *name, const char *subscript, long long *index) {
+    if (arith_evaluate(subscript, index) != 0) {
+        return -1;
+    }
+    if (*index < 0) {
+        long long max_index = (array != NULL) ? array_max_index(array) : -1;
+        *index += max_index + 1;
+        if (*index < 0) {
+            char error_msg[320];
+            snprintf(error_msg, sizeof(error_msg), "%s[%s]: bad array subscript", name, subscript);
+            print_error(error_msg);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 取数组元素${name[subscript]}（下标已经扩展）；普通变量只有下标0
+ * 元素未设置时返回NULL，*failed在下标出错时设为1
+ */
+const char* get_array_element(const char *name, const char *subscript, int *failed) {
+    *failed = 0;
+    env_var_t *var = find_var(name);
+    shell_array_t *array = (var != NULL) ? var->array : NULL;
+    if (array != NULL && array_is_associative(array)) {
+        return array_get_key(array, subscript);
+    }
+    
+    long long index = 0;
+    if (array_index(array, name, subscript, &index) != 0) {
+        *failed = 1;
+        return NULL;
+    }
+    if (array != NULL) {
+        return array_get(array, index);
+    }
+    return (index == 0) ? get_env_var((char *)name) : NULL;
+}
+
+/**
+ * 设置数组元素name[subscript]=value（append为1时为+=，追加到原值之后）
+ * 变量不是数组时先变为下标数组
+ */
+int set_array_element(const char *name, const char *subscript, const char *value, int append) {
+    shell_array_t *array = get_array_var(name);
+    if (array == NULL && (array = make_array_var(name, 0)) == NULL) {
+        return -1;
+    }
+    
+    long long index = 0;
+    if (!array_is_associative(array) && array_index(array, name, subscript, &index) != 0) {
+        return -1;
+    }
+    
+    char *joined = NULL;
+    if (append) {
+        const char *old = array_is_associative(array) ? array_get_key(array, subscript) : array_get(array, index);
+        if (old != NULL) {
+            size_t old_len = strlen(old);
+            joined = safe_malloc(old_len + strlen(value) + 1, "set_array_element: value");
+            if (joined == NULL) {
+                return -1;
+            }
+            memcpy(joined, old, old_len);
+            strcpy(joined + old_len, value);
+            value = joined;
+        }
+    }
+    
+    int result = array_is_associative(array) ? array_set_key(array, subscript, value)
+                                             : array_set(array, index, value);
+    free(joined);
+    return result;
+}
+
+/**
+ * 删除数组元素（unset name[subscript]）
+ */
+int unset_array_element(const char *name, const char *subscript) {
+    env_var_t *var = find_var(name);
+    if (var == NULL) {
+        return 0;
+    }
+    if (var->array == NULL) {
+        /* 普通变量只有下标0 */
+        long long index = 0;
+        if (array_index(NULL, name, subscript, &index) != 0) {
+            return -1;
+        }
+        return (index == 0) ? unset_env_var((char *)name) : 0;
+    }
+    if (array_is_associative(var->array)) {
+        return array_unset_key(var->array, subscript);
+    }
+    long long index = 0;
+    if (array_index(var->array, name, subscript, &index) != 0) {
+        return -1;
+    }
+    return array_unset(var->array, index);
+}
+
+/**
+ * 把"name[下标]"形式的引用分成变量名和下标（算术表达式中的a[i]和${m[$k]}）
+ * 关联数组的下标扩展后作为键，下标数组的下标保持原样（由算术求值）。
+ * 成功返回下标（用完后TRACKED_FREE），失败返回NULL
+ */
+static char* split_reference(const char *reference, char *name, size_t name_size) {
+    const char *bracket = strchr(reference, '[');
+    size_t len = strlen(reference);
+    if (bracket == NULL || len < 2 || reference[len - 1] != ']') {
+        return NULL;
+    }
+    snprintf(name, name_size, "%.*s", (int)(bracket - reference), reference);
+    
+    char *subscript = TRACKED_MALLOC(len, "split_reference: subscript");
+    if (subscript == NULL) {
+        return NULL;
+    }
+    size_t subscript_len = len - (size_t)(bracket - reference) - 2;
+    memcpy(subscript, bracket + 1, subscript_len);
+    subscript[subscript_len] = '\0';
+    
+    shell_array_t *array = get_array_var(name);
+    if (array != NULL && array_is_associative(array)) {
+        char *key = expand_single_word(subscript);
+        TRACKED_FREE(subscript);
+        return key;
+    }
+    return subscript;
+}
+
+/**
+ * 取"name[下标]"引用的值，未设置时返回NULL，出错时*failed设为1
+ */
+const char* get_subscripted_var(const char *reference, int *failed) {
+    char name[256];
+    char *subscript = split_reference(reference, name, sizeof(name));
+    if (subscript == NULL) {
+        *failed = 1;
+        return NULL;
+    }
+    const char *value = get_array_element(name, subscript, failed);
+    TRACKED_FREE(subscript);
+    return value;
+}
+
+/**
+ * 给"name[下标]"引用赋值，返回0表示成功，-1表示失败
+ */
+int set_subscripted_var(const char *reference, const char *value) {
+    char name[256];
+    char *subscript = split_reference(reference, name, sizeof(name));
+    if (subscript == NULL) {
+        return -1;
+    }
+    int result = set_array_element(name, subscript, value, 0);
+    TRACKED_FREE(subscript);
+    return result;
+}
+
+/**
+ * 复合赋值name=(element...)和name+=(element...)，元素已经扩展
+ * 元素为[下标]=value时设置该下标，否则设置下一个下标；关联数组中不带下标的元素两两成对作为键和值。
+ * 不带+时先清空数组（保持数组的类型），普通变量变为下标数组。返回0表示成功，-1表示失败（错误已报告）
+ */
+int assign_compound(const char *name, int append, char **elements, int count) {
+    shell_array_t *array = get_array_var(name);
+    int associative = (array != NULL) && array_is_associative(array);
+    if (!append && find_var(name) != NULL) {
+        unset_env_var((char *)name);
+    }
+    array = make_array_var(name, associative);
+    if (array == NULL) {
+        return -1;
+    }
+    
+    long long next = associative ? 0 : array_max_index(array) + 1;
+    for (int i = 0; i < count; i++) {
+        const char *element = elements[i];
+        const char *close = (element[0] == '[') ? strstr(element, "]=") : NULL;
+        if (close == NULL && element[0] == '[') {
+            close = strstr(element, "]+=");
+        }
+        if (close == NULL && associative) {
+            /* 键值对：m=(k1 v1 k2 v2) */
+            const char *value = (i + 1 < count) ? elements[++i] : "";
+            if (array_set_key(array, element, value) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        if (close == NULL) {
+            if (array_set(array, next++, element) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        
+        size_t key_len = (size_t)(close - element - 1);
+        char *key = TRACKED_MALLOC(key_len + 1, "assign_compound: subscript");
+        if (key == NULL) {
+            return -1;
+        }
+        memcpy(key, element + 1, key_len);
+        key[key_len] = '\0';
+        int plus = (close[1] == '+');
+        const char *value = close + 2 + plus;
+        
+        int result = 0;
+        if (associative) {
+            result = set_array_element(name, key, value, plus);
+        } else if ((result = array_index(array, name, key, &next)) == 0) {
+            char number[PARAM_SCRATCH_SIZE];
+            snprintf(number, sizeof(number), "%lld", next++);
+            result = set_array_element(name, number, value, plus);
+        }
+        TRACKED_FREE(key);
+        if (result != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 给变量或数组元素赋值（subscript为NULL表示不带下标，append为1时为+=）
+ * 不带下标给数组赋值即给第0个元素（关联数组中键为"0"）赋值。返回0表示成功，-1表示失败
+ */
+int assign_shell_variable(const char *name, const char *subscript, const char *value, int append) {
+    if (subscript != NULL || get_array_var(name) != NULL) {
+        return set_array_element(name, subscript ? subscript : "0", value, append);
+    }
+    
+    const char *old = append ? get_env_var((char *)name) : NULL;
+    if (old == NULL) {
+        return set_env_var((char *)name, (char *)value);
+    }
+    size_t old_len = strlen(old);
+    char *joined = TRACKED_MALLOC(old_len + strlen(value) + 1, "assign_shell_variable: value");
+    if (joined == NULL) {
+        return -1;
+    }
+    memcpy(joined, old, old_len);
+    strcpy(joined + old_len, value);
+    int result = set_env_var((char *)name, joined);
+    TRACKED_FREE(joined);
+    return result;
+}
+
+/**
+ * 执行一个赋值（未扩展的原始单词）：name=value、name+=value、name[下标]=value，
+ * 以及解析器编码为"name=("、元素、")"的复合赋值name=(...)
+ * *used设为消耗的单词数。返回0表示成功，1表示错误已报告，-1表示内存错误
+ */
+int perform_assignment(char **words, int count, int *used) {
+    const char *word = words[0];
+    size_t equals = find_assignment(word);
+    *used = 1;
+    if (equals == 0) {
+        return -1;
+    }
+    
+    int append = (word[equals - 1] == '+');
+    size_t name_len = strcspn(word, "[+=");
+    char name[256];
+    snprintf(name, sizeof(name), "%.*s", (int)name_len, word);
+    
+    if (strcmp(word + equals + 1, "(") == 0) {
+        int end = 1;
+        while (end < count && strcmp(words[end], ")") != 0) {
+            end++;
+        }
+        *used = (end < count) ? end + 1 : count;
+        
+        char **expanded = NULL;
+        int element_count = 0;
+        int status = expand_arguments(words + 1, end - 1, &expanded, &element_count);
+        if (status != 0) {
+            return status;
+        }
+        char **elements = (expanded != NULL) ? expanded : words + 1;
+        status = (assign_compound(name, append, elements, element_count) == 0) ? 0 : 1;
+        free_expanded_arguments(expanded);
+        return status;
+    }
+    
+    char *value = expand_single_word(word + equals + 1);
+    if (value == NULL) {
+        return take_expansion_error() ? 1 : -1;
+    }
+    
+    int status = 0;
+    if (word[name_len] == '[') {
+        /* 下标去掉[]后扩展 */
+        size_t subscript_end = equals - (size_t)append - 1;
+        char *raw = TRACKED_MALLOC(subscript_end - name_len, "perform_assignment: subscript");
+        char *subscript = NULL;
+        if (raw != NULL) {
+            memcpy(raw, word + name_len + 1, subscript_end - name_len - 1);
+            raw[subscript_end - name_len - 1] = '\0';
+            subscript = expand_single_word(raw);
+            TRACKED_FREE(raw);
+        }
+        if (subscript == NULL) {
+            status = take_expansion_error() ? 1 : -1;
+        } else {
+            status = (assign_shell_variable(name, subscript, value, append) == 0) ? 0 : 1;
+            TRACKED_FREE(subscript);
+        }
+    } else {
+        status = (assign_shell_variable(name, NULL, value, append) == 0) ? 0 : 1;
+    }
+    TRACKED_FREE(value);
+    return status;
+}
+
+/**
+ * 以双引号形式输出值（"、$、`和\\前加反斜杠）
+ */
+static void print_quoted_value(const char *value) {
+    output_printf(STDOUT_FILENO, "\"");
+    size_t start = 0;
+    for (size_t i = 0; value[i] != '\0'; i++) {
+        if (strchr("\"$`\\", value[i]) != NULL) {
+            output_printf(STDOUT_FILENO, "%.*s\\", (int)(i - start), value + start);
+            start = i;
+        }
+    }
+    output_printf(STDOUT_FILENO, "%s\"", value + start);
+}
+
+/**
+ * 按declare -p的格式输出变量，如declare -a arr=([0]="a" [1]="b")
+ * 变量未设置时返回-1
+ */
+int print_variable_declaration(const char *name) {
+    env_var_t *var = find_var(name);
+    if (var == NULL) {
+        return -1;
+    }
+    if (var->array == NULL) {
+        output_printf(STDOUT_FILENO, "declare -%s %s=", var->exported ? "x" : "-", name);
+        print_quoted_value(var->value);
+        output_printf(STDOUT_FILENO, "\n");
+        return 0;
+    }
+    
+    int associative = array_is_associative(var->array);
+    output_printf(STDOUT_FILENO, "declare -%c %s", associative ? 'A' : 'a', name);
+    if (array_count(var->array) > 0) {
+        size_t cursor = 0;
+        const char *key = NULL;
+        long long index = 0;
+        const char *element = NULL;
+        output_printf(STDOUT_FILENO, "=(");
+        for (int i = 0; array_next(var->array, &cursor, &key, &index, &element); i++) {
+            if (key != NULL) {
+                output_printf(STDOUT_FILENO, "%s[%s]=", i > 0 ? " " : "", key);
+            } else {
+                output_printf(STDOUT_FILENO, "%s[%lld]=", i > 0 ? " " : "", index);
+            }
+            print_quoted_value(element);
+        }
+        output_printf(STDOUT_FILENO, associative ? " )" : ")");
+    }
+    output_printf(STDOUT_FILENO, "\n");
+    return 0;
+}
+
+/**
+ * 设置位置参数（$0、$1..$N）
+ * 参数字符串不复制，调用者需保证其在Shell运行期间有效（通常来自argv）
+ */
+void set_positional_params(char *name, int count, char **values) {
+    g_shell_state.script_name = name;
+    g_shell_state.positional_params = values;
+    g_shell_state.positional_count = (values != NULL) ? count : 0;
+}
+
+/**
+ * 函数调用时替换位置参数，原来的参数保存到save中
+ * 只交换指针，不复制参数字符串；values需在pop_positional_params之前保持有效
+ */
+void push_positional_params(int count, char **values, positional_save_t *save) {
+    save->params = g_shell_state.positional_params;
+    save->count = g_shell_state.positional_count;
+    
+    g_shell_state.positional_params = values;
+    g_shell_state.positional_count = (values != NULL) ? count : 0;
+}
+
+/**
+ * 恢复push_positional_params保存的位置参数
+ */
+void pop_positional_params(positional_save_t *save) {
+    g_shell_state.positional_params = save->params;
+    g_shell_state.positional_count = save->count;
+}
+
+/* 当前的local变量作用域（不在函数中时为NULL） */
+static local_scope_t *g_local_scope = NULL;
+
+/**
+ * 进入新的local变量作用域（函数调用时）
+ */
+void push_local_scope(local_scope_t *scope) {
+    scope->bindings = NULL;
+    scope->parent = g_local_scope;
+    g_local_scope = scope;
+}
+
+/**
+ * 离开当前作用域：local变量恢复为进入作用域之前的值
+ */
+void pop_local_scope(void) {
+    local_scope_t *scope = g_local_scope;
+    if (scope == NULL) {
+        return;
+    }
+    
+    local_binding_t *binding = scope->bindings;
+    while (binding != NULL) {
+        local_binding_t *next = binding->next;
+        if (get_array_var(binding->name) != NULL) {
+            /* 函数内变成了数组的local变量整体删除后再恢复原值 */
+            unset_env_var(binding->name);
+        }
+        if (binding->saved_array != NULL) {
+            unset_env_var(binding->name);
+            if (make_array_var(binding->name, array_is_associative(binding->saved_array)) != NULL) {
+                env_var_t *var = find_var(binding->name);
+                array_free(var->array);
+                var->array = binding->saved_array;
+            } else {
+                array_free(binding->saved_array);
+            }
+        } else if (binding->saved_value != NULL) {
+            unset_env_var(binding->name);
+            if (binding->saved_exported) {
+                export_env_var(binding->name, binding->saved_value);
+            } else {
+                set_env_var(binding->name, binding->saved_value);
+            }
+            TRACKED_FREE(binding->saved_value);
+        } else {
+            unset_env_var(binding->name);
+        }
+        TRACKED_FREE(binding->name);
+        TRACKED_FREE(binding);
+        binding = next;
+    }
+    g_local_scope = scope->parent;
+}
+
+/**
+ * 在当前作用域中声明local变量（value为NULL时变量在作用域内未设置）
+ * 同一作用域中重复声明只修改值
+ */
+int declare_local_var(char *name, char *value) {
+    if (name == NULL || g_local_scope == NULL) {
+        return -1;
+    }
+    
+    local_binding_t *binding = g_local_scope->bindings;
+    while (binding != NULL && strcmp(binding->name, name) != 0) {
+        binding = binding->next;
+    }
+    
+    if (binding == NULL) {
+        binding = TRACKED_MALLOC(sizeof(local_binding_t), "declare_local_var: binding");
+        if (binding == NULL) {
+            return -1;
+        }
+        binding->name = TRACKED_STRDUP(name, "declare_local_var: name");
+        env_var_t *var = find_var(name);
+        binding->saved_exported = (var != NULL) && var->exported;
+        binding->saved_array = (var != NULL) ? var->array : NULL;
+        if (binding->saved_array != NULL) {
+            /* 数组整体保存在绑定中，函数返回时放回 */
+            var->array = NULL;
+            unset_env_var(name);
+        }
+        char *old_value = get_env_var(name);
+        binding->saved_value = old_value ? TRACKED_STRDUP(old_value, "declare_local_var: saved value") : NULL;
+        if (binding->name == NULL || (old_value != NULL && binding->saved_value == NULL)) {
+            TRACKED_FREE(binding->name);
+            TRACKED_FREE(binding->saved_value);
+            TRACKED_FREE(binding);
+            return -1;
+        }
+        binding->next = g_local_scope->bindings;
+        g_local_scope->bindings = binding;
+    }
+    
+    if (value == NULL) {
+        return unset_env_var(name);
+    }
+    /* 局部变量保留原变量的导出属性 */
+    return binding->saved_exported ? export_env_var(name, value) : set_env_var(name, value);
+}
+
+/**
+ * 命令前的临时赋值（NAME=value cmd，words为未扩展的赋值单词）
+ * 在新的作用域中赋值并导出，只对这一条命令有效；无论成功与否，命令结束后都要调用pop_local_scope恢复。
+ * 返回值与perform_assignment相同
+ */
+int push_temporary_assignments(char **words, int count, local_scope_t *scope) {
+    push_local_scope(scope);
+    
+    int i = 0;
+    while (i < count) {
+        char name[256];
+        snprintf(name, sizeof(name), "%.*s", (int)strcspn(words[i], "[+="), words[i]);
+        /* 先记录原值（不改变变量），+=仍然追加到原值之后 */
+        char *old_value = get_env_var(name);
+        char *copy = (old_value != NULL) ? TRACKED_STRDUP(old_value, "push_temporary_assignments: value") : NULL;
+        int bound = (old_value != NULL && copy == NULL) ? -1 : declare_local_var(name, copy);
+        TRACKED_FREE(copy);
+        if (bound != 0) {
+            return -1;
+        }
+        
+        int used = 0;
+        int status = perform_assignment(words + i, count - i, &used);
+        if (status != 0) {
+            return status;
+        }
+        env_var_t *var = find_var(name);
+        if (var != NULL && var->array == NULL && !var->exported) {
+            var->exported = 1;
+            g_environment_stale = 1;
+        }
+        i += used;
+    }
+    return 0;
+}
+
+/**
+ * 获取Shell参数的值
+ * 位置参数和特殊参数（$?、$$、$!、$#）直接从Shell状态中取得，数字格式化到调用者提供的
+ * scratch缓冲区（至少PARAM_SCRATCH_SIZE字节）；$@和$*由展开过程逐个追加位置参数，这里返回NULL。
+ * 其余名称按环境变量查找
+ */
+const char* get_shell_param(const char *name, char *scratch) {
+    if (name == NULL || name[0] == '\0') {
+        return NULL;
+    }
+    
+    /* 位置参数 */
+    if (isdigit((unsigned char)name[0])) {
+        char *endptr;
+        long index = strtol(name, &endptr, 10);
+        if (*endptr != '\0') {
+            return NULL;
+        }
+        if (index == 0) {
+            return g_shell_state.script_name ? g_shell_state.script_name : "myshell";
+        }
+        if (index > g_shell_state.positional_count) {
+            return NULL;
+        }
+        return g_shell_state.positional_params[index - 1];
+    }
+    
+    if (name[1] == '\0') {
+        switch (name[0]) {
+            case '?':
+                snprintf(scratch, PARAM_SCRATCH_SIZE, "%d", g_shell_state.last_exit_status);
+                return scratch;
+            case '#':
+                snprintf(scratch, PARAM_SCRATCH_SIZE, "%d", g_shell_state.positional_count);
+                return scratch;
+            case '$':
+                if (g_shell_state.shell_pid == 0) {
+                    g_shell_state.shell_pid = getpid();
+                }
+                snprintf(scratch, PARAM_SCRATCH_SIZE, "%ld", (long)g_shell_state.shell_pid);
+                return scratch;
+            case '!':
+                if (g_shell_state.last_background_pid == 0) {
+                    return NULL;
+                }
+                snprintf(scratch, PARAM_SCRATCH_SIZE, "%ld", (long)g_shell_state.last_background_pid);
+                return scratch;
+            case '@':
+            case '*':
+                return NULL;
+            default:
+                break;
+        }
+    }
+    
+    return get_env_var((char *)name);
+}
+
+/* 扩展单词时使用的可增长缓冲区 */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    int split_fields;       /* 1表示$@的每个位置参数各成一个字段（命令参数），0表示用空格连接 */
+    size_t *breaks;         /* 字段分界处在data中的偏移 */
+    int break_count;
+    int break_cap;
+    int empty_at;           /* 展开过没有任何位置参数的$@ */
+} word_buffer_t;
+
+/**
+ * 向单词缓冲区追加数据
+ */
+static int word_append(word_buffer_t *buf, const char *data, size_t len) {
+    if (buf->len + len + 1 > buf->cap) {
+        size_t new_cap = buf->cap ? buf->cap : 64;
+        while (buf->len + len + 1 > new_cap) {
+            new_cap *= 2;
+        }
+        char *new_data = TRACKED_REALLOC(buf->data, new_cap, "word_append: buffer");
+        if (new_data == NULL) {
+            return -1;
+        }
+        buf->data = new_data;
+        buf->cap = new_cap;
+    }
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+    return 0;
+}
+
+/**
+ * 向单词缓冲区追加字面内容
+ * pattern为1时在glob特殊字符前加反斜杠，使其在模式匹配中只匹配自身
+ */
+static int word_append_literal(word_buffer_t *buf, const char *data, size_t len, int pattern) {
+    if (!pattern) {
+        return word_append(buf, data, len);
+    }
+    
+    for (size_t i = 0; i < len; i++) {
+        if (strchr("*?[]\\", data[i]) != NULL && word_append(buf, "\\", 1) != 0) {
+            return -1;
+        }
+        if (word_append(buf, data + i, 1) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 在单词缓冲区的当前位置开始一个新字段
+ */
+static int word_break_field(word_buffer_t *buf) {
+    if (buf->break_count == buf->break_cap) {
+        int new_cap = buf->break_cap ? buf->break_cap * 2 : 8;
+        size_t *new_breaks = TRACKED_REALLOC(buf->breaks, (size_t)new_cap * sizeof(size_t), "word_break_field: breaks");
+        if (new_breaks == NULL) {
+            return -1;
+        }
+        buf->breaks = new_breaks;
+        buf->break_cap = new_cap;
+    }
+    buf->breaks[buf->break_count++] = buf->len;
+    return 0;
+}
+
+/**
+ * 追加$@、${name[@]}等的第index个元素：split为1时另起一个字段，否则用空格与前一个元素连接
+ */
+static int append_element(word_buffer_t *buf, int index, int split, const char *text, int literal) {
+    if (index > 0 && (split ? word_break_field(buf) : word_append(buf, " ", 1)) != 0) {
+        return -1;
+    }
+    return word_append_literal(buf, text, strlen(text), literal);
+}
+
+/**
+ * 追加$@或$*：直接逐个追加位置参数，不生成拼接好的中间字符串
+ * 作为命令参数展开时$@（以及不加引号的$*）每个位置参数各成一个字段，其余情况用空格连接
+ */
+static int append_positional(word_buffer_t *buf, int star, int quoted, int literal) {
+    int split = buf->split_fields && !(star && quoted);
+    if (g_shell_state.positional_count == 0) {
+        buf->empty_at |= split;
+        return 0;
+    }
+    
+    for (int i = 0; i < g_shell_state.positional_count; i++) {
+        const char *param = g_shell_state.positional_params[i];
+        if (append_element(buf, i, split, param, literal) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 追加${name[@]}或${name[*]}（keys为1时为${!name[@]}，追加下标或键），字段的划分与$@和$*相同
+ * 普通变量相当于只有第0个元素的数组
+ */
+static int append_array(word_buffer_t *buf, const char *name, int keys, int star, int quoted, int literal) {
+    int split = buf->split_fields && !(star && quoted);
+    shell_array_t *array = get_array_var(name);
+    if (array == NULL) {
+        const char *value = get_env_var((char *)name);
+        if (value == NULL) {
+            buf->empty_at |= split;
+            return 0;
+        }
+        return append_element(buf, 0, split, keys ? "0" : value, literal);
+    }
+    if (array_count(array) == 0) {
+        buf->empty_at |= split;
+        return 0;
+    }
+    
+    size_t cursor = 0;
+    const char *key = NULL;
+    long long index = 0;
+    const char *value = NULL;
+    for (int i = 0; array_next(array, &cursor, &key, &index, &value); i++) {
+        char number[PARAM_SCRATCH_SIZE];
+        if (keys && key == NULL) {
+            snprintf(number, sizeof(number), "%lld", index);
+            key = number;
+        }
+        if (append_element(buf, i, split, keys ? key : value, literal) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* 最近一次扩展失败时错误是否已经报告（如算术表达式错误），与内存错误区分 */
+static int g_expansion_error_reported = 0;
+
+/**
+ * 展开$((表达式))，返回消耗的字符数；不是完整的算术展开时返回0
+ */
+static size_t expand_arithmetic(const char *word, word_buffer_t *buf, int *failed) {
+    /* 从第一个(开始配对括号，算术展开必须以))结束 */
+    int depth = 0;
+    size_t i = 1;
+    for (; word[i] != '\0'; i++) {
+        if (word[i] == '(') {
+            depth++;
+        } else if (word[i] == ')' && --depth == 0) {
+            break;
+        }
+    }
+    if (word[i] != ')' || word[i - 1] != ')' || i < 4) {
+        return 0;
+    }
+    
+    size_t len = i - 4;
+    char *expression = TRACKED_MALLOC(len + 1, "expand_arithmetic: expression");
+    if (expression == NULL) {
+        *failed = 1;
+        return i + 1;
+    }
+    memcpy(expression, word + 3, len);
+    expression[len] = '\0';
+    
+    long long value = 0;
+    if (arith_evaluate(expression, &value) != 0) {
+        g_expansion_error_reported = 1;
+        *failed = 1;
+    } else {
+        char number[32];
+        int n = snprintf(number, sizeof(number), "%lld", value);
+        *failed = word_append(buf, number, (size_t)n) != 0;
+    }
+    TRACKED_FREE(expression);
+    return i + 1;
+}
+
+static char* expand_word(const char *word, int pattern, int *quoted);
+
+/**
+ * 查找从open处的{开始的${...}的结束位置（跳过引号和转义，允许嵌套），没有时返回0
+ */
+static size_t find_brace_end(const char *word, size_t open) {
+    int depth = 0;
+    for (size_t i = open; word[i] != '\0'; i++) {
+        char c = word[i];
+        if (c == '\\' && word[i + 1] != '\0') {
+            i++;
+        } else if (c == '\'' || c == '"') {
+            while (word[++i] != '\0' && word[i] != c) {
+                if (c == '"' && word[i] == '\\' && word[i + 1] != '\0') {
+                    i++;
+                }
+            }
+            if (word[i] == '\0') {
+                return 0;
+            }
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && --depth == 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/* 参数展开的操作数：不需要扩展的短操作数直接放在局部缓冲区里，不分配内存 */
+typedef struct {
+    char local[256];
+    char *allocated;
+    const char *text;
+} operand_t;
+
+/**
+ * 扩展${VAR op word}中的word（pattern为1时引号内的通配符只匹配自身）
+ * 成功返回0，结果在operand->text中，用完后调用release_operand
+ */
+static int expand_operand(operand_t *operand, const char *text, size_t len, int pattern) {
+    operand->allocated = NULL;
+    operand->text = operand->local;
+    
+    int plain = (len < sizeof(operand->local));
+    for (size_t i = 0; plain && i < len; i++) {
+        plain = (strchr("$'\"\\", text[i]) == NULL);
+    }
+    if (plain) {
+        memcpy(operand->local, text, len);
+        operand->local[len] = '\0';
+        return 0;
+    }
+    
+    char *copy = TRACKED_MALLOC(len + 1, "expand_operand: word");
+    if (copy == NULL) {
+        return -1;
+    }
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    int quoted;
+    operand->allocated = expand_word(copy, pattern, &quoted);
+    TRACKED_FREE(copy);
+    if (operand->allocated == NULL) {
+        return -1;
+    }
+    operand->text = operand->allocated;
+    return 0;
+}
+
+/**
+ * 释放expand_operand的结果
+ */
+static void release_operand(operand_t *operand) {
+    if (operand->allocated != NULL) {
+        TRACKED_FREE(operand->allocated);
+        operand->allocated = NULL;
+    }
+}
+
+/**
+ * 报告参数展开的错误（错误已报告，所在命令失败）
+ */
+static void parameter_error(const char *name, const char *body, size_t len, const char *message, int *failed) {
+    char error_msg[512];
+    if (name != NULL) {
+        snprintf(error_msg, sizeof(error_msg), "%s: %s", name, message);
+    } else {
+        snprintf(error_msg, sizeof(error_msg), "${%.*s}: %s", (int)(len < 256 ? len : 256), body, message);
+    }
+    print_error(error_msg);
+    g_expansion_error_reported = 1;
+    *failed = 1;
+}
+
+/**
+ * 在操作数中查找${VAR/pat/rep}分隔模式和替换串的/（跳过引号和转义）
+ */
+static size_t find_replacement_separator(const char *text, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        char c = text[i];
+        if (c == '\\') {
+            i++;
+        } else if (c == '\'' || c == '"') {
+            while (++i < len && text[i] != c) {
+                if (c == '"' && text[i] == '\\') {
+                    i++;
+                }
+            }
+        } else if (c == '/') {
+            return i;
+        }
+    }
+    return len;
+}
+
+/**
+ * 解析${VAR:offset:length}中的offset和length（算术表达式），省略length时*length不变
+ * 成功返回0，表达式错误时返回-1并设置*failed
+ */
+static int parse_substring_spec(const char *spec, size_t spec_len, long long *offset, long long *length, int *failed) {
+    char text[256];
+    if (spec_len >= sizeof(text)) {
+        spec_len = sizeof(text) - 1;
+    }
+    memcpy(text, spec, spec_len);
+    text[spec_len] = '\0';
+    
+    char *colon = strchr(text, ':');
+    if (colon != NULL) {
+        *colon = '\0';
+    }
+    if (arith_evaluate(text, offset) != 0 || (colon != NULL && arith_evaluate(colon + 1, length) != 0)) {
+        g_expansion_error_reported = 1;
+        *failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 报告负的子串长度
+ */
+static void substring_error(long long length, int *failed) {
+    char error_msg[64];
+    snprintf(error_msg, sizeof(error_msg), "%lld: substring expression < 0", length);
+    print_error(error_msg);
+    g_expansion_error_reported = 1;
+    *failed = 1;
+}
+
+/**
+ * ${VAR:offset[:length]}：偏移和长度是算术表达式，负的偏移从末尾算起，
+ * 负的长度表示去掉末尾的字符数
+ */
+static void expand_substring(const char *value, const char *spec, size_t spec_len,
+                             word_buffer_t *buf, int literal, int *failed) {
+    long long value_len = (long long)strlen(value);
+    long long offset = 0;
+    long long length = value_len;
+    if (parse_substring_spec(spec, spec_len, &offset, &length, failed) != 0) {
+        return;
+    }
+    
+    if (offset < 0) {
+        offset = (value_len + offset < 0) ? value_len : value_len + offset;
+    }
+    if (offset > value_len) {
+        offset = value_len;
+    }
+    long long end = (length < 0) ? value_len + length : offset + length;
+    if (end > value_len) {
+        end = value_len;
+    }
+    if (end < offset) {
+        if (length < 0) {
+            substring_error(length, failed);
+        }
+        return;
+    }
+    *failed = word_append_literal(buf, value + offset, (size_t)(end - offset), literal) != 0;
+}
+
+/**
+ * 展开${@:offset:length}和${name[@]:offset:length}：取下标从offset开始的length个元素
+ * 位置参数的下标0为$0；offset为负数时从最后一个下标之后倒数
+ */
+static void expand_slice(const char *name, const char *spec, size_t spec_len, word_buffer_t *buf,
+                         int star, int quoted, int literal, int *failed) {
+    int positional = (name[0] == '@' || name[0] == '*');
+    shell_array_t *array = positional ? NULL : get_array_var(name);
+    const char *scalar = (positional || array != NULL) ? NULL : get_env_var((char *)name);
+    long long last = positional ? g_shell_state.positional_count
+                                : (array != NULL ? array_max_index(array) : (scalar != NULL ? 0 : -1));
+    long long offset = 0;
+    long long length = LLONG_MAX;
+    if (parse_substring_spec(spec, spec_len, &offset, &length, failed) != 0) {
+        return;
+    }
+    if (length < 0) {
+        substring_error(length, failed);
+        return;
+    }
+    if (offset < 0) {
+        offset += last + 1;
+    }
+    
+    int split = buf->split_fields && !(star && quoted);
+    int taken = 0;
+    size_t cursor = 0;
+    const char *key = NULL;
+    long long index = 0;
+    const char *value = NULL;
+    for (long long ordinal = 0; offset >= 0 && taken < length && !*failed; ordinal++) {
+        if (positional) {
+            char scratch[PARAM_SCRATCH_SIZE];
+            if (ordinal > last) {
+                break;
+            }
+            index = ordinal;
+            value = (ordinal == 0) ? get_shell_param("0", scratch) : g_shell_state.positional_params[ordinal - 1];
+        } else if (array != NULL) {
+            if (!array_next(array, &cursor, &key, &index, &value)) {
+                break;
+            }
+            if (key != NULL) {
+                index = ordinal;    /* 关联数组按顺序计数 */
+            }
+        } else if (ordinal > last) {
+            break;
+        } else {
+            value = scalar;
+        }
+        if (index < offset || value == NULL) {
+            continue;
+        }
+        *failed = append_element(buf, taken++, split, value, literal) != 0;
+    }
+    if (taken == 0) {
+        buf->empty_at |= split;
+    }
+}
+
+/**
+ * ${VAR#pat}、${VAR##pat}、${VAR%pat}、${VAR%%pat}：删除匹配的最短/最长前缀或后缀
+ */
+static void expand_trim(const char *value, const char *op, size_t op_len,
+                        word_buffer_t *buf, int literal, int *failed) {
+    int suffix = (op[0] == '%');
+    int longest = (op_len > 1 && op[1] == op[0]);
+    size_t skip = longest ? 2 : 1;
+    size_t len = strlen(value);
+    
+    operand_t operand;
+    if (expand_operand(&operand, op + skip, op_len - skip, 1) != 0) {
+        *failed = 1;
+        return;
+    }
+    const glob_pattern_t *glob = glob_compile(operand.text);
+    release_operand(&operand);
+    if (glob == NULL) {
+        *failed = 1;
+        return;
+    }
+    
+    size_t start = 0;
+    size_t end = len;
+    size_t matched = suffix ? glob_match_suffix(glob, value, len, longest)
+                            : glob_match_prefix(glob, value, len, longest);
+    if (matched != (size_t)-1) {
+        if (suffix) {
+            end = len - matched;
+        } else {
+            start = matched;
+        }
+    }
+    *failed = word_append_literal(buf, value + start, end - start, literal) != 0;
+}
+
+/**
+ * ${VAR/pat/rep}、${VAR//pat/rep}：替换第一个/全部匹配（每处取最长的匹配）；
+ * ${VAR/#pat/rep}、${VAR/%pat/rep}只替换开头/末尾的匹配
+ */
+static void expand_replace(const char *value, const char *op, size_t op_len,
+                           word_buffer_t *buf, int literal, int *failed) {
+    int global = (op_len > 1 && op[1] == '/');
+    char anchor = (op_len > 1 && (op[1] == '#' || op[1] == '%')) ? op[1] : '\0';
+    size_t skip = (global || anchor) ? 2 : 1;
+    const char *rest = op + skip;
+    size_t rest_len = op_len - skip;
+    size_t separator = find_replacement_separator(rest, rest_len);
+    size_t replacement_start = (separator < rest_len) ? separator + 1 : rest_len;
+    size_t len = strlen(value);
+    
+    /* 先扩展替换串：其中嵌套的展开可能编译别的模式，使之前取得的模式失效 */
+    operand_t replacement;
+    operand_t pattern_operand;
+    if (expand_operand(&replacement, rest + replacement_start, rest_len - replacement_start, 0) != 0) {
+        *failed = 1;
+        return;
+    }
+    if (expand_operand(&pattern_operand, rest, separator, 1) != 0) {
+        release_operand(&replacement);
+        *failed = 1;
+        return;
+    }
+    /* 空模式不替换任何内容 */
+    const glob_pattern_t *glob = (pattern_operand.text[0] != '\0') ? glob_compile(pattern_operand.text) : NULL;
+    release_operand(&pattern_operand);
+    size_t replacement_len = strlen(replacement.text);
+    
+    size_t pos = 0;
+    while (glob != NULL && pos <= len && !*failed) {
+        size_t match_start = 0;
+        size_t match_len = (size_t)-1;
+        if (anchor == '#') {
+            match_len = glob_match_prefix(glob, value, len, 1);
+        } else if (anchor == '%') {
+            match_len = glob_match_suffix(glob, value, len, 1);
+            match_start = len - (match_len != (size_t)-1 ? match_len : 0);
+        } else if (!glob_find(glob, value, len, pos, &match_start, &match_len)) {
+            match_len = (size_t)-1;
+        }
+        if (match_len == (size_t)-1) {
+            break;
+        }
+        
+        *failed = word_append_literal(buf, value + pos, match_start - pos, literal) != 0 ||
+                  word_append_literal(buf, replacement.text, replacement_len, literal) != 0;
+        pos = match_start + match_len;
+        if (!global || (match_len > 0 && pos == len)) {
+            /* 非空匹配已到达末尾时结束：末尾的空串只在那里没有别的匹配时才算一次匹配 */
+            break;
+        }
+        if (match_len == 0) {
+            /* 空匹配（如模式*匹配空串）：保留一个字符后继续，避免原地循环 */
+            if (pos < len && !*failed) {
+                *failed = word_append_literal(buf, value + pos, 1, literal) != 0;
+            }
+            pos++;
+        }
+    }
+    if (pos < len && !*failed) {
+        *failed = word_append_literal(buf, value + pos, len - pos, literal) != 0;
+    }
+    release_operand(&replacement);
+}
+
+static void expand_operator(const char *name, const char *value, const char *op, size_t op_len,
+                            const char *body, size_t len, word_buffer_t *buf, int literal, int *failed);
+
+/**
+ * 查找数组下标[...]的结束位置（允许嵌套的[]），没有时返回0
+ */
+static size_t find_subscript_end(const char *body, size_t len, size_t open) {
+    int depth = 0;
+    for (size_t i = open; i < len; i++) {
+        if (body[i] == '\\' && i + 1 < len) {
+            i++;
+        } else if (body[i] == '[') {
+            depth++;
+        } else if (body[i] == ']' && --depth == 0) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 展开${...}，body为花括号内的内容：
+ * ${VAR}、${#VAR}、${VAR:-word}、${VAR:=word}、${VAR:?word}、${VAR:+word}（不带冒号时只检查是否设置）、
+ * ${VAR#pat}、${VAR%pat}、${VAR/pat/rep}和${VAR:offset:length}，
+ * 以及数组的${VAR[i]}、${VAR[@]}、${#VAR[@]}和${!VAR[@]}
+ */
+static void expand_braced(const char *body, size_t len, word_buffer_t *buf, int quoted, int pattern, int *failed) {
+    char name[256];
+    size_t name_len = 0;
+    size_t i = 0;
+    
+    int length_of = (len > 1 && body[0] == '#');
+    int keys_of = (len > 1 && body[0] == '!');
+    if (length_of || keys_of) {
+        i++;
+    }
+    if (i < len && strchr("#@*?$!", body[i]) != NULL) {
+        name[name_len++] = body[i++];
+    } else if (i < len && isdigit((unsigned char)body[i])) {
+        while (i < len && isdigit((unsigned char)body[i]) && name_len < sizeof(name) - 1) {
+            name[name_len++] = body[i++];
+        }
+    } else if (i < len && (isalpha((unsigned char)body[i]) || body[i] == '_')) {
+        while (i < len && (isalnum((unsigned char)body[i]) || body[i] == '_') && name_len < sizeof(name) - 1) {
+            name[name_len++] = body[i++];
+        }
+    }
+    name[name_len] = '\0';
+    
+    /* 数组下标 */
+    const char *subscript = NULL;
+    size_t subscript_len = 0;
+    if (name_len > 0 && i < len && body[i] == '[' && (isalpha((unsigned char)name[0]) || name[0] == '_')) {
+        size_t close = find_subscript_end(body, len, i);
+        if (close == 0) {
+            parameter_error(NULL, body, len, "bad substitution", failed);
+            return;
+        }
+        subscript = body + i + 1;
+        subscript_len = close - i - 1;
+        i = close + 1;
+    }
+    int all_elements = (subscript_len == 1 && (subscript[0] == '@' || subscript[0] == '*'));
+    
+    const char *op = body + i;
+    size_t op_len = len - i;
+    if (name_len == 0 || (length_of && op_len > 0) || (keys_of && (!all_elements || op_len > 0))) {
+        /* ${!name}（间接引用）不支持，只支持${!name[@]} */
+        parameter_error(NULL, body, len, "bad substitution", failed);
+        return;
+    }
+    
+    int literal = quoted && pattern;
+    if (all_elements) {
+        int star = (subscript[0] == '*');
+        if (length_of) {
+            shell_array_t *array = get_array_var(name);
+            size_t count = array ? array_count(array) : (get_env_var(name) != NULL);
+            char number[32];
+            int n = snprintf(number, sizeof(number), "%zu", count);
+            *failed = word_append(buf, number, (size_t)n) != 0;
+        } else if (op_len == 0) {
+            *failed = append_array(buf, name, keys_of, star, quoted, literal) != 0;
+        } else if (op[0] == ':' && !(op_len > 1 && strchr("-=?+", op[1]) != NULL)) {
+            expand_slice(name, op + 1, op_len - 1, buf, star, quoted, literal, failed);
+        } else {
+            /* 与$@相同，对${name[@]}使用运算符时先把元素连接成一个值 */
+            word_buffer_t joined = { 0 };
+            if (word_append(&joined, "", 0) != 0 || append_array(&joined, name, 0, 1, 1, 0) != 0) {
+                *failed = 1;
+            } else {
+                int set = (get_array_var(name) != NULL) ? array_count(get_array_var(name)) > 0
+                                                        : get_env_var(name) != NULL;
+                expand_operator(name, set ? joined.data : NULL, op, op_len, body, len, buf, literal, failed);
+            }
+            TRACKED_FREE(joined.data);
+        }
+        return;
+    }
+    if (subscript != NULL) {
+        operand_t index;
+        if (expand_operand(&index, subscript, subscript_len, 0) != 0) {
+            *failed = 1;
+            return;
+        }
+        const char *value = get_array_element(name, index.text, failed);
+        if (*failed) {
+            g_expansion_error_reported = 1;
+        } else if (length_of) {
+            char number[32];
+            int n = snprintf(number, sizeof(number), "%zu", value ? strlen(value) : (size_t)0);
+            *failed = word_append(buf, number, (size_t)n) != 0;
+        } else {
+            /* 运算符中的name带上下标，${a[i]:=word}给该元素赋值 */
+            char element[256];
+            snprintf(element, sizeof(element), "%s[%s]", name, index.text);
+            expand_operator(element, value, op, op_len, body, len, buf, literal, failed);
+        }
+        release_operand(&index);
+        return;
+    }
+    if ((name[0] == '@' || name[0] == '*') && name[1] == '\0') {
+        if (length_of) {
+            char number[PARAM_SCRATCH_SIZE];
+            int n = snprintf(number, sizeof(number), "%d", g_shell_state.positional_count);
+            *failed = word_append(buf, number, (size_t)n) != 0;
+        } else if (op_len == 0) {
+            *failed = append_positional(buf, name[0] == '*', quoted, literal) != 0;
+        } else if (op[0] == ':' && !(op_len > 1 && strchr("-=?+", op[1]) != NULL)) {
+            expand_slice(name, op + 1, op_len - 1, buf, name[0] == '*', quoted, literal, failed);
+        } else {
+            /* 对$@/$*使用运算符时先把位置参数连接成一个值 */
+            word_buffer_t joined = { 0 };
+            if (word_append(&joined, "", 0) != 0 || append_positional(&joined, 1, 1, 0) != 0) {
+                *failed = 1;
+            } else {
+                expand_operator(name, g_shell_state.positional_count ? joined.data : NULL,
+                                op, op_len, body, len, buf, literal, failed);
+            }
+            TRACKED_FREE(joined.data);
+        }
+        return;
+    }
+    
+    char scratch[PARAM_SCRATCH_SIZE];
+    const char *value = get_shell_param(name, scratch);
+    if (length_of) {
+        char number[32];
+        int n = snprintf(number, sizeof(number), "%zu", value ? strlen(value) : (size_t)0);
+        *failed = word_append(buf, number, (size_t)n) != 0;
+        return;
+    }
+    expand_operator(name, value, op, op_len, body, len, buf, literal, failed);
+}
+
 /**
- * 初始化环境变量
+ * 对参数值value应用${name op}中的运算符（value为NULL表示参数未设置）
  */
-void init_environment(void) {
-    /* 初始化HOME环境变量 */
-    char *home = getenv("HOME");
-    if (home == NULL) {
-        home = "/tmp";  /* 默认值 */
+static void expand_operator(const char *name, const char *value, const char *op, size_t op_len,
+                            const char *body, size_t len, word_buffer_t *buf, int literal, int *failed) {
+    if (op_len == 0) {
+        if (value != NULL) {
+            *failed = word_append_literal(buf, value, strlen(value), literal) != 0;
+        }
+        return;
     }
-    set_env_var("HOME", home);
     
-    /* 初始化PATH环境变量 */
-    char *path = getenv("PATH");
-    if (path == NULL) {
-        path = "/bin:/usr/bin:/usr/local/bin";  /* 默认PATH */
+    /* 带冒号的形式把空值也当作未设置 */
+    int colon = (op[0] == ':' && op_len > 1 && strchr("-=?+", op[1]) != NULL);
+    char kind = op[colon];
+    if (op[0] == ':' && !colon) {
+        expand_substring(value ? value : "", op + 1, op_len - 1, buf, literal, failed);
+        return;
+    }
+    if (kind == '#' || kind == '%') {
+        expand_trim(value ? value : "", op, op_len, buf, literal, failed);
+        return;
+    }
+    if (kind == '/') {
+        expand_replace(value ? value : "", op, op_len, buf, literal, failed);
+        return;
+    }
+    if (strchr("-=?+", kind) == NULL) {
+        parameter_error(NULL, body, len, "bad substitution", failed);
+        return;
     }
-    set_env_var("PATH", path);
     
-    /* 设置PWD为当前目录 */
-    if (g_shell_state.current_dir) {
-        set_env_var("PWD", g_shell_state.current_dir);
+    int unset = (value == NULL || (colon && value[0] == '\0'));
+    if ((kind == '+') == unset) {
+        /* ${VAR-word}等在已设置时、${VAR+word}在未设置时使用变量本身的值 */
+        if (value != NULL && kind != '+') {
+            *failed = word_append_literal(buf, value, strlen(value), literal) != 0;
+        }
+        return;
+    }
+    
+    operand_t operand;
+    size_t skip = (size_t)colon + 1;
+    if (expand_operand(&operand, op + skip, op_len - skip, 0) != 0) {
+        *failed = 1;
+        return;
+    }
+    if (kind == '?') {
+        parameter_error(name, NULL, 0, operand.text[0] ? operand.text : "parameter null or not set", failed);
+        if (!g_shell_state.interactive) {
+            /* 非交互Shell（脚本）在必需的参数缺失时退出 */
+            g_shell_state.running = 0;
+        }
+    } else if (kind == '=' && !(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+        char label[260];
+        snprintf(label, sizeof(label), "$%s", name);
+        parameter_error(label, NULL, 0, "cannot assign in this way", failed);
+    } else {
+        const char *bracket = strchr(name, '[');
+        if (kind == '=' && bracket != NULL) {
+            /* ${a[i]:=word}：name为"a[下标]" */
+            char array_name[256];
+            snprintf(array_name, sizeof(array_name), "%.*s", (int)(bracket - name), name);
+            char *subscript = TRACKED_STRDUP(bracket + 1, "expand_operator: subscript");
+            if (subscript == NULL) {
+                *failed = 1;
+            } else {
+                subscript[strlen(subscript) - 1] = '\0';
+                *failed = set_array_element(array_name, subscript, operand.text, 0) != 0;
+                TRACKED_FREE(subscript);
+            }
+        } else if (kind == '=' && set_env_var((char *)name, (char *)operand.text) != 0) {
+            *failed = 1;
+        }
+        if (!*failed) {
+            *failed = word_append_literal(buf, operand.text, strlen(operand.text), literal) != 0;
+        }
     }
+    release_operand(&operand);
 }
 
 /**
- * 获取环境变量值
+ * 追加命令替换的输出：在引号内或不拆分字段时作为一个整体，
+ * 否则按空白（空格、制表符、换行）拆分，每段另起一个字段
  */
-char* get_env_var(char *name) {
-    if (name == NULL) {
-        return NULL;
+static int append_substitution(word_buffer_t *buf, const char *output, size_t len, int quoted, int literal) {
+    if (quoted || !buf->split_fields) {
+        return word_append_literal(buf, output, len, literal);
     }
     
-    /* 首先检查内部环境变量表 */
-    env_var_t *current = g_shell_state.env_vars;
-    while (current) {
-        if (strcmp(current->name, name) == 0) {
-            return current->value;
+    size_t i = 0;
+    int first = 1;
+    while (i < len) {
+        while (i < len && (output[i] == ' ' || output[i] == '\t' || output[i] == '\n')) {
+            i++;
         }
-        current = current->next;
+        size_t start = i;
+        while (i < len && output[i] != ' ' && output[i] != '\t' && output[i] != '\n') {
+            i++;
+        }
+        if (i == start) {
+            break;
+        }
+        if ((!first && word_break_field(buf) != 0) || word_append(buf, output + start, i - start) != 0) {
+            return -1;
+        }
+        first = 0;
     }
-    
-    /* 如果内部表中没有，检查系统环境变量 */
-    return getenv(name);
+    return 0;
 }
 
 /**
- * 设置环境变量
+ * 执行命令替换（$(...)或`...`中的命令text[0, len)）并追加其输出
  */
-int set_env_var(char *name, char *value) {
-    if (name == NULL || value == NULL) {
-        return -1;
+static void expand_command(const char *text, size_t len, word_buffer_t *buf, int quoted, int pattern, int *failed) {
+    char *output = NULL;
+    size_t out_len = 0;
+    if (command_substitute(text, len, &output, &out_len) < 0) {
+        g_expansion_error_reported = 1;
+        *failed = 1;
+    } else if (out_len > 0) {
+        *failed = append_substitution(buf, output, out_len, quoted, quoted && pattern) != 0;
+    }
+    free(output);
+}
+
+/**
+ * 查找从open处的(开始的$(...)的结束位置（跳过引号和转义，允许嵌套，case的模式括号不计入），
+ * 没有时返回0
+ */
+static size_t find_paren_end(const char *word, size_t open) {
+    size_t end = find_command_paren_end(word, strlen(word), open);
+    return (end != (size_t)-1) ? end : 0;
+}
+
+/**
+ * 执行`...`形式的命令替换：其中的\\、\`和\$去掉反斜杠后作为命令；返回消耗的字符数
+ */
+static size_t expand_backquote(const char *word, word_buffer_t *buf, int quoted, int pattern, int *failed) {
+    size_t end = 1;
+    while (word[end] != '\0' && word[end] != '`') {
+        end += (word[end] == '\\' && word[end + 1] != '\0') ? 2 : 1;
+    }
+    if (word[end] == '\0') {
+        *failed = word_append(buf, "`", 1) != 0;
+        return 1;
     }
     
-    /* 检查是否已存在 */
-    env_var_t *current = g_shell_state.env_vars;
-    while (current) {
-        if (strcmp(current->name, name) == 0) {
-            /* 更新现有变量 */
-            TRACKED_FREE(current->value);
-            current->value = TRACKED_STRDUP(value, "set_env_var: update value");
-            if (current->value == NULL) {
-                return -1;
-            }
-            
-            /* 同时更新系统环境变量 */
-            setenv(name, value, 1);
-            return 0;
+    char *command = TRACKED_MALLOC(end, "expand_backquote: command");
+    if (command == NULL) {
+        *failed = 1;
+        return end + 1;
+    }
+    size_t len = 0;
+    for (size_t i = 1; i < end; i++) {
+        if (word[i] == '\\' && (word[i + 1] == '\\' || word[i + 1] == '`' || word[i + 1] == '$')) {
+            i++;
         }
-        current = current->next;
+        command[len++] = word[i];
+    }
+    command[len] = '\0';
+    expand_command(command, len, buf, quoted, pattern, failed);
+    TRACKED_FREE(command);
+    return end + 1;
+}
+
+/**
+ * 进程替换<(...)和>(...)：启动命令，追加与它相连的管道的路径/dev/fd/N，返回消耗的字符数
+ */
+static size_t expand_process(const char *word, word_buffer_t *buf, int *failed) {
+    size_t close = find_paren_end(word, 1);
+    if (close == 0) {
+        *failed = word_append(buf, word, 1) != 0;
+        return 1;
     }
     
-    /* 创建新的环境变量节点 */
-    env_var_t *new_var = TRACKED_MALLOC(sizeof(env_var_t), "set_env_var: new variable");
-    if (new_var == NULL) {
-        return -1;
+    char path[32];
+    if (process_substitute(word + 2, close - 2, word[0] == '>', path, sizeof(path)) != 0) {
+        g_expansion_error_reported = 1;
+        *failed = 1;
+    } else {
+        *failed = word_append(buf, path, strlen(path)) != 0;
     }
+    return close + 1;
+}
+
+/**
+ * 展开单词中从$开始的参数引用，返回消耗的字符数（包括$）
+ * 不构成参数引用的$按普通字符处理；quoted为1时参数值按字面内容追加
+ */
+static size_t expand_parameter(const char *word, word_buffer_t *buf, int quoted, int pattern, int *failed) {
+    char name[256];
+    size_t name_len = 0;
+    size_t i = 1;
     
-    new_var->name = TRACKED_STRDUP(name, "set_env_var: variable name");
-    if (new_var->name == NULL) {
-        TRACKED_FREE(new_var);
-        return -1;
+    if (word[1] == '(' && word[2] == '(') {
+        size_t consumed = expand_arithmetic(word, buf, failed);
+        if (consumed > 0) {
+            return consumed;
+        }
+    }
+    if (word[1] == '(') {
+        size_t close = find_paren_end(word, 1);
+        if (close == 0) {
+            *failed = word_append(buf, "$", 1) != 0;
+            return 1;
+        }
+        expand_command(word + 2, close - 2, buf, quoted, pattern, failed);
+        return close + 1;
     }
     
-    new_var->value = TRACKED_STRDUP(value, "set_env_var: variable value");
-    if (new_var->value == NULL) {
-        TRACKED_FREE(new_var->name);
-        TRACKED_FREE(new_var);
-        return -1;
+    if (word[i] == '{') {
+        size_t close = find_brace_end(word, i);
+        if (close == 0) {
+            *failed = word_append(buf, "$", 1) != 0;
+            return 1;
+        }
+        expand_braced(word + i + 1, close - i - 1, buf, quoted, pattern, failed);
+        return close + 1;
+    } else if (isdigit((unsigned char)word[i]) || (word[i] != '\0' && strchr("#@*?$!", word[i]) != NULL)) {
+        /* 单字符的位置参数和特殊参数：$0-$9、$#、$@、$*、$?、$$、$! */
+        name[name_len++] = word[i++];
+    } else {
+        while ((isalnum((unsigned char)word[i]) || word[i] == '_') && name_len < sizeof(name) - 1) {
+            name[name_len++] = word[i++];
+        }
     }
     
-    /* 插入到链表头部 */
-    new_var->next = g_shell_state.env_vars;
-    g_shell_state.env_vars = new_var;
+    if (name_len == 0 && i == 1) {
+        *failed = word_append(buf, "$", 1) != 0;
+        return 1;
+    }
+    name[name_len] = '\0';
     
-    /* 同时设置系统环境变量 */
-    setenv(name, value, 1);
+    if (name[0] == '@' || name[0] == '*') {
+        *failed = append_positional(buf, name[0] == '*', quoted, quoted && pattern) != 0;
+        return i;
+    }
     
-    return 0;
+    /* 未加引号的参数值在模式中保留通配符的含义 */
+    char scratch[PARAM_SCRATCH_SIZE];
+    const char *value = get_shell_param(name, scratch);
+    if (value != NULL && word_append_literal(buf, value, strlen(value), quoted && pattern) != 0) {
+        *failed = 1;
+    }
+    return i;
 }
 
 /**
- * 展开环境变量（完整实现）
- * 支持 $VAR 和 ${VAR} 语法
+ * 展开字符串中的环境变量（引号按普通字符处理）
+ * 支持 $VAR、${VAR}、${VAR:-word}等参数展开运算符和$((表达式))
  */
 char* expand_variables(char *input) {
     if (input == NULL) {
         return NULL;
     }
     
-    size_t input_len = strlen(input);
-    size_t result_size = input_len * 2;  /* 初始分配更大的空间 */
-    char *result = TRACKED_MALLOC(result_size, "expand_variables: result buffer");
-    if (result == NULL) {
+    word_buffer_t buf = { 0 };
+    int failed = word_append(&buf, "", 0) != 0;
+    size_t i = 0;
+    while (input[i] != '\0' && !failed) {
+        if (input[i] == '$') {
+            i += expand_parameter(input + i, &buf, 0, 0, &failed);
+        } else {
+            size_t len = strcspn(input + i, "$");
+            failed = word_append(&buf, input + i, len) != 0;
+            i += len;
+        }
+    }
+    
+    if (failed) {
+        take_expansion_error();
+        TRACKED_FREE(buf.data);
         return NULL;
     }
+    return buf.data;
+}
+
+/**
+ * 把单词扩展到buf中：展开$参数（单引号内除外），并去掉引号和转义用的反斜杠
+ * pattern为1时结果用作glob模式：引号内和转义的通配符前保留反斜杠
+ * *quoted设置为单词中是否出现过引号。成功返回0，失败返回-1（buf中的内容由调用者释放）
+ */
+static int expand_word_into(const char *word, int pattern, int *quoted, word_buffer_t *buf) {
+    int in_double = 0;
+    int failed = word_append(buf, "", 0) != 0;
+    *quoted = 0;
     
-    size_t result_pos = 0;
     size_t i = 0;
-    
-    while (i < input_len) {
-        if (input[i] == '$') {
-            i++;  /* 跳过 $ */
-            
-            char var_name[256] = {0};
-            size_t var_name_len = 0;
-            int is_braced = 0;
-            
-            /* 检查是否是 ${VAR} 格式 */
-            if (i < input_len && input[i] == '{') {
-                is_braced = 1;
-                i++;  /* 跳过 { */
-            }
-            
-            /* 提取变量名 */
-            while (i < input_len && var_name_len < sizeof(var_name) - 1) {
-                char c = input[i];
-                
-                if (is_braced) {
-                    if (c == '}') {
-                        i++;  /* 跳过 } */
-                        break;
-                    }
-                    var_name[var_name_len++] = c;
-                } else {
-                    /* 变量名只能包含字母、数字和下划线 */
-                    if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || 
-                        (c >= '0' && c <= '9') || c == '_') {
-                        var_name[var_name_len++] = c;
-                    } else {
-                        break;
-                    }
-                }
-                i++;
-            }
-            
-            /* 获取变量值 */
-            if (var_name_len > 0) {
-                var_name[var_name_len] = '\0';
-                char *var_value = get_env_var(var_name);
-                
-                if (var_value != NULL) {
-                    size_t var_value_len = strlen(var_value);
-                    
-                    /* 检查是否需要扩展结果缓冲区 */
-                    while (result_pos + var_value_len >= result_size) {
-                        result_size *= 2;
-                        char *new_result = TRACKED_REALLOC(result, result_size, "expand_variables: expand buffer");
-                        if (new_result == NULL) {
-                            TRACKED_FREE(result);
-                            return NULL;
-                        }
-                        result = new_result;
-                    }
-                    
-                    /* 复制变量值到结果中 */
-                    strcpy(result + result_pos, var_value);
-                    result_pos += var_value_len;
-                }
-                /* 如果变量不存在，则不添加任何内容（变量被替换为空字符串） */
+    while (word[i] != '\0' && !failed) {
+        char c = word[i];
+        
+        if (c == '\'' && !in_double) {
+            const char *close = strchr(word + i + 1, '\'');
+            size_t len = close ? (size_t)(close - (word + i + 1)) : strlen(word + i + 1);
+            failed = word_append_literal(buf, word + i + 1, len, pattern) != 0;
+            i += len + (close ? 2 : 1);
+            *quoted = 1;
+        } else if (c == '"') {
+            in_double = !in_double;
+            *quoted = 1;
+            i++;
+        } else if (c == '\\' && word[i + 1] != '\0') {
+            /* 双引号内只有$ ` " \\前的反斜杠起转义作用 */
+            char next = word[i + 1];
+            if (in_double && next != '$' && next != '`' && next != '"' && next != '\\') {
+                failed = word_append_literal(buf, word + i, 2, pattern) != 0;
             } else {
-                /* 如果没有有效的变量名，保留原始的 $ */
-                if (result_pos + 1 >= result_size) {
-                    result_size *= 2;
-                    char *new_result = TRACKED_REALLOC(result, result_size, "expand_variables: expand for dollar");
-                    if (new_result == NULL) {
-                        TRACKED_FREE(result);
-                        return NULL;
-                    }
-                    result = new_result;
-                }
-                result[result_pos++] = '$';
+                failed = word_append_literal(buf, &next, 1, pattern) != 0;
             }
+            i += 2;
+        } else if (c == '$') {
+            i += expand_parameter(word + i, buf, in_double, pattern, &failed);
+        } else if (c == '`') {
+            i += expand_backquote(word + i, buf, in_double, pattern, &failed);
+        } else if ((c == '<' || c == '>') && word[i + 1] == '(' && !in_double) {
+            i += expand_process(word + i, buf, &failed);
         } else {
-            /* 普通字符，直接复制 */
-            if (result_pos + 1 >= result_size) {
-                result_size *= 2;
-                char *new_result = TRACKED_REALLOC(result, result_size, "expand_variables: expand for char");
-                if (new_result == NULL) {
-                    TRACKED_FREE(result);
-                    return NULL;
-                }
-                result = new_result;
+            /* 连续的普通字符一次复制 */
+            size_t len = strcspn(word + i, "'\"\\$`<>");
+            if (len == 0) {
+                len = 1;
             }
-            result[result_pos++] = input[i];
+            failed = word_append_literal(buf, word + i, len, pattern && in_double) != 0;
+            i += len;
+        }
+    }
+    
+    return failed ? -1 : 0;
+}
+
+/**
+ * 扩展单个单词，返回新分配的字符串（需用TRACKED_FREE释放），失败返回NULL
+ */
+static char* expand_word(const char *word, int pattern, int *quoted) {
+    word_buffer_t buf = { 0 };
+    if (expand_word_into(word, pattern, quoted, &buf) != 0) {
+        TRACKED_FREE(buf.data);
+        return NULL;
+    }
+    return buf.data;
+}
+
+/**
+ * 扩展单词为一个字符串（不删除空结果，如case的单词）
+ * 返回新分配的字符串（需用TRACKED_FREE释放）
+ */
+char* expand_single_word(const char *word) {
+    int quoted;
+    return expand_word(word, 0, &quoted);
+}
+
+/**
+ * 展开here-document的正文：$参数、$(...)、$((...))和`...`按双引号内的规则展开，不分词；
+ * 反斜杠只在$ ` \和换行前起转义作用，引号按普通字符处理
+ * 返回新分配的字符串（需用TRACKED_FREE释放），*out_len为其长度；失败返回NULL
+ */
+char* expand_heredoc(const char *body, size_t *out_len) {
+    word_buffer_t buf = { 0 };
+    int failed = word_append(&buf, "", 0) != 0;
+    size_t i = 0;
+    while (body[i] != '\0' && !failed) {
+        char c = body[i];
+        if (c == '\\' && body[i + 1] == '\n') {
+            i += 2;
+        } else if (c == '\\' && body[i + 1] != '\0' && strchr("$`\\", body[i + 1]) != NULL) {
+            failed = word_append(&buf, body + i + 1, 1) != 0;
+            i += 2;
+        } else if (c == '$') {
+            i += expand_parameter(body + i, &buf, 1, 0, &failed);
+        } else if (c == '`') {
+            i += expand_backquote(body + i, &buf, 1, 0, &failed);
+        } else {
+            /* 连续的普通字符一次复制 */
+            size_t len = strcspn(body + i + 1, "\\$`") + 1;
+            failed = word_append(&buf, body + i, len) != 0;
+            i += len;
+        }
+    }
+    
+    if (failed) {
+        TRACKED_FREE(buf.data);
+        return NULL;
+    }
+    *out_len = buf.len;
+    return buf.data;
+}
+
+/**
+ * 扩展单词为glob模式（如case分支的模式）：引号内的通配符只匹配自身
+ * 返回新分配的字符串（需用TRACKED_FREE释放）
+ */
+char* expand_pattern(const char *word) {
+    int quoted;
+    return expand_word(word, 1, &quoted);
+}
+
+/* 扩展后的参数数组（以NULL结尾，按需增长） */
+typedef struct {
+    char **args;
+    int count;
+    int capacity;
+} argument_list_t;
+
+/* 参数数组的最大容量：指针数组不超过单次分配的上限 */
+#define ARGUMENT_LIST_MAX ((int)(MAX_ALLOCATION_SIZE / sizeof(char*)))
+
+/**
+ * 向参数数组追加一个参数（arg为NULL时只保证数组以NULL结尾）
+ * 超过ARGUMENT_LIST_MAX时报告参数过多（g_expansion_error_reported置位）并返回-1
+ */
+static int argument_list_push(argument_list_t *list, char *arg) {
+    if (list->count + 2 > list->capacity) {
+        if (list->count + 2 > ARGUMENT_LIST_MAX) {
+            print_error("argument list too long");
+            g_expansion_error_reported = 1;
+            return -1;
+        }
+        int new_capacity = list->capacity ? list->capacity * 2 : 8;
+        if (new_capacity > ARGUMENT_LIST_MAX) {
+            new_capacity = ARGUMENT_LIST_MAX;
+        }
+        char **new_args = TRACKED_REALLOC(list->args, (size_t)new_capacity * sizeof(char*), "expand_arguments: argument array");
+        if (new_args == NULL) {
+            return -1;
+        }
+        list->args = new_args;
+        list->capacity = new_capacity;
+    }
+    if (arg != NULL) {
+        list->args[list->count++] = arg;
+    }
+    list->args[list->count] = NULL;
+    return 0;
+}
+
+/**
+ * 单词扩展后是否可能需要路径名扩展：有引号之外的通配符（*、?、[），
+ * 或者有引号之外的参数展开（其值中的通配符也起作用）
+ */
+static int word_has_glob(const char *word) {
+    int in_double = 0;
+    for (size_t i = 0; word[i] != '\0'; i++) {
+        char c = word[i];
+        if (c == '\\' && word[i + 1] != '\0') {
             i++;
+        } else if (c == '"') {
+            in_double = !in_double;
+        } else if (c == '\'' && !in_double) {
+            const char *close = strchr(word + i + 1, '\'');
+            if (close == NULL) {
+                return 0;
+            }
+            i = (size_t)(close - word);
+        } else if (c == '$' && !in_double && word[i + 1] != '(') {
+            return 1;
+        } else if (c == '$' && word[i + 1] == '{') {
+            size_t end = find_brace_end(word, i + 1);
+            if (end == 0) {
+                return 0;
+            }
+            i = end;
+        } else if (c == '$' && word[i + 1] == '(') {
+            size_t end = find_paren_end(word, i + 1);
+            if (end == 0) {
+                return 0;
+            }
+            i = end;
+        } else if (!in_double && (c == '*' || c == '?' || c == '[')) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 把路径名扩展的一个结果加入参数数组（glob_expand_path的回调）
+ */
+static int push_pathname(const char *path, void *data) {
+    char *copy = TRACKED_STRDUP(path, "expand_arguments: pathname");
+    if (copy == NULL || argument_list_push((argument_list_t *)data, copy) != 0) {
+        TRACKED_FREE(copy);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * 对模式形式的字段做路径名扩展，匹配的路径按顺序加入参数数组（取得field的所有权）
+ * 没有通配符或没有匹配时原样保留（escaped为1时先去掉引号部分产生的转义）；
+ * 设置了nullglob时没有匹配的字段被删除
+ */
+static int push_pathnames(argument_list_t *list, char *field, int escaped) {
+    if (glob_has_magic(field)) {
+        int options = g_shell_state.glob_options;
+        const char *sort = get_env_var("GLOBSORT");
+        if (sort != NULL && strcmp(sort, "nosort") == 0) {
+            options |= GLOB_OPT_NOSORT;
+        }
+        
+        int matched = glob_expand_path(field, options, push_pathname, list);
+        if (matched != 0 || (options & GLOB_OPT_NULLGLOB)) {
+            TRACKED_FREE(field);
+            return matched < 0 ? -1 : 0;
         }
     }
     
-    /* 添加字符串结束符 */
-    if (result_pos >= result_size) {
-        result_size++;
-        char *new_result = TRACKED_REALLOC(result, result_size, "expand_variables: null terminator");
-        if (new_result == NULL) {
-            TRACKED_FREE(result);
-            return NULL;
+    if (escaped) {
+        glob_unescape(field);
+    }
+    int status = argument_list_push(list, field);
+    if (status != 0) {
+        TRACKED_FREE(field);
+    }
+    return status;
+}
+
+/**
+ * 最近一次扩展失败时错误是否已经报告（返回后清除该标记）
+ * 已报告的错误（如除以0）只需设置退出状态，未报告的是内存错误
+ */
+int take_expansion_error(void) {
+    int reported = g_expansion_error_reported;
+    g_expansion_error_reported = 0;
+    return reported;
+}
+
+/**
+ * 扩展一个单词（花括号展开之后的），结果字段依次加入参数数组
+ * 返回0表示成功，1表示扩展出错且错误已报告，-1表示内存分配失败
+ */
+static int expand_argument(argument_list_t *list, const char *word) {
+    if (strpbrk(word, "$`'\"\\*?[<>") == NULL) {
+        char *copy = TRACKED_STRDUP(word, "expand_arguments: argument");
+        if (copy == NULL || argument_list_push(list, copy) != 0) {
+            TRACKED_FREE(copy);
+            return -1;
         }
-        result = new_result;
+        return 0;
     }
-    result[result_pos] = '\0';
     
-    return result;
+    /* "$@"等展开为多个字段时，buf.breaks记录字段的分界 */
+    /* 需要路径名扩展时按模式展开：引号内的通配符被转义，只匹配自身；
+       没有引号和反斜杠的单词按模式展开和按字面展开的结果相同 */
+    word_buffer_t buf = { 0 };
+    buf.split_fields = 1;
+    int globbing = word_has_glob(word);
+    int escaped = globbing && strpbrk(word, "'\"\\") != NULL;
+    int quoted = 0;
+    int status = 0;
+    if (expand_word_into(word, globbing, &quoted, &buf) != 0) {
+        status = take_expansion_error() ? 1 : -1;
+    } else if (buf.len == 0 && buf.break_count == 0 && (!quoted || buf.empty_at)) {
+        /* 未加引号的空扩展（如未设置的$VAR）和没有位置参数的"$@"不产生参数 */
+    } else if (buf.break_count == 0 && !globbing) {
+        status = argument_list_push(list, buf.data);
+        buf.data = (status == 0) ? NULL : buf.data;
+    } else {
+        size_t start = 0;
+        for (int k = 0; k <= buf.break_count && status == 0; k++) {
+            size_t end = (k < buf.break_count) ? buf.breaks[k] : buf.len;
+            char *field = TRACKED_MALLOC(end - start + 1, "expand_arguments: field");
+            if (field == NULL) {
+                status = -1;
+                break;
+            }
+            memcpy(field, buf.data + start, end - start);
+            field[end - start] = '\0';
+            if (globbing) {
+                status = push_pathnames(list, field, escaped);
+            } else if ((status = argument_list_push(list, field)) != 0) {
+                TRACKED_FREE(field);
+            }
+            start = end;
+        }
+    }
+    TRACKED_FREE(buf.data);
+    TRACKED_FREE(buf.breaks);
+    return status;
+}
+
+/**
+ * 对命令的参数数组做扩展：花括号展开，展开$参数、去掉引号，并对引号之外含通配符的参数做路径名扩展
+ * 单独的$@或"$@"展开为每个位置参数各一个参数；未加引号且扩展结果为空的参数被删除
+ * 花括号展开逐个生成单词并立即扩展，{1..100000}这样的范围不会先生成完整的单词列表
+ * 没有任何参数需要扩展时*out_args为NULL，表示直接使用原数组；否则*out_args为新的参数数组，
+ * 需用free_expanded_arguments释放
+ * 返回0表示成功，1表示扩展出错且错误已报告（如算术错误），-1表示内存分配失败
+ */
+int expand_arguments(char **args, int argc, char ***out_args, int *out_argc) {
+    *out_args = NULL;
+    *out_argc = argc;
+    
+    int needs_expansion = 0;
+    for (int i = 0; i < argc && !needs_expansion; i++) {
+        needs_expansion = (strpbrk(args[i], "$`'\"\\*?[{<>") != NULL);
+    }
+    if (!needs_expansion) {
+        return 0;
+    }
+    
+    argument_list_t list = { NULL, 0, 0 };
+    if (argument_list_push(&list, NULL) != 0) {
+        return -1;
+    }
+    
+    for (int i = 0; i < argc; i++) {
+        brace_expansion_t *braces = NULL;
+        int status = brace_compile(args[i], &braces);
+        if (status == 0 && braces == NULL) {
+            status = expand_argument(&list, args[i]);
+        } else if (status == 0) {
+            const char *word;
+            int failed = 0;
+            while (status == 0 && (word = brace_next(braces, &failed)) != NULL) {
+                /* {,x}生成的空单词不产生参数 */
+                status = (word[0] != '\0') ? expand_argument(&list, word) : 0;
+            }
+            status = failed ? -1 : status;
+            brace_free(braces);
+        }
+        if (status != 0) {
+            free_expanded_arguments(list.args);
+            /* 参数过多等已报告的错误也可能以-1的形式返回 */
+            return (status < 0 && take_expansion_error()) ? 1 : status;
+        }
+    }
+    
+    *out_args = list.args;
+    *out_argc = list.count;
+    return 0;
+}
+
+/**
+ * 释放expand_arguments返回的参数数组
+ */
+void free_expanded_arguments(char **args) {
+    if (args == NULL) {
+        return;
+    }
+    
+    /* 按分配的相反顺序释放：内存跟踪链表中后分配的块在前面，释放时不必遍历整个链表 */
+    int count = 0;
+    while (args[count] != NULL) {
+        count++;
+    }
+    while (count > 0) {
+        TRACKED_FREE(args[--count]);
+    }
+    TRACKED_FREE(args);
 }
 
 /**
@@ -301,12 +2304,16 @@ void cleanup_environment(void) {
         env_var_t *next = current->next;
         TRACKED_FREE(current->name);
         TRACKED_FREE(current->value);
+        array_free(current->array);
         TRACKED_FREE(current);
         current = next;
         count++;
     }
     
     g_shell_state.env_vars = NULL;
+    g_env_initialized = 0;
+    free_exported_environment();
+    g_environment_stale = 1;
     
     char cleanup_msg[128];
     snprintf(cleanup_msg, sizeof(cleanup_msg), "Cleaned up %d environment variables", count);
@@ -317,10 +2324,16 @@ void cleanup_environment(void) {
  * 打印所有环境变量（用于调试）
  */
 void print_all_env_vars(void) {
+    ensure_environment();
+    
     env_var_t *current = g_shell_state.env_vars;
-    printf("Internal environment variables:\n");
+    output_printf(STDOUT_FILENO, "Internal environment variables:\n");
     while (current) {
-        printf("%s=%s\n", current->name, current->value);
+        if (current->array != NULL) {
+            print_variable_declaration(current->name);
+        } else {
+            output_printf(STDOUT_FILENO, "%s=%s\n", current->name, current->value);
+        }
         current = current->next;
     }
 }
@@ -333,6 +2346,8 @@ int env_var_exists(char *name) {
         return 0;
     }
     
+    ensure_environment();
+    
     env_var_t *current = g_shell_state.env_vars;
     while (current) {
         if (strcmp(current->name, name) == 0) {
@@ -341,8 +2356,7 @@ int env_var_exists(char *name) {
         current = current->next;
     }
     
-    /* 检查系统环境变量 */
-    return getenv(name) != NULL;
+    return 0;
 }
 
 /**
@@ -353,6 +2367,8 @@ int unset_env_var(char *name) {
         return -1;
     }
     
+    ensure_environment();
+    
     env_var_t *current = g_shell_state.env_vars;
     env_var_t *prev = NULL;
     
@@ -366,20 +2382,17 @@ int unset_env_var(char *name) {
             }
             
             /* 释放内存 */
+            g_environment_stale |= current->exported;
             TRACKED_FREE(current->name);
             TRACKED_FREE(current->value);
+            array_free(current->array);
             TRACKED_FREE(current);
             
-            /* 从系统环境变量中删除 */
-            unsetenv(name);
-            
             return 0;
         }
         prev = current;
         current = current->next;
     }
     
-    /* 如果内部表中没有，尝试从系统环境变量中删除 */
-    unsetenv(name);
     return 0;
 }
@@ -28,16 +28,30 @@ void init_error_system(void) {
     g_error_state.error_count = 0;
     g_error_state.log_enabled = 1;
     g_error_state.log_file = NULL;
+    g_error_state.log_file_opened = 0;  /* 日志文件在第一次写日志时才打开 */
     
     /* 初始化内存跟踪 */
     init_memory_tracking();
+}
+
+/**
+ * 设置日志输出的最低级别
+ */
+void set_log_threshold(log_level_t level) {
+    g_error_state.log_threshold = level;
+}
+
+/**
+ * 打开日志文件（只尝试一次）
+ */
+static void open_log_file(void) {
+    g_error_state.log_file_opened = 1;
     
-    /* 尝试打开日志文件 */
     char *home = getenv("HOME");
     if (home) {
         char log_path[MAX_PATH_SIZE];
         snprintf(log_path, sizeof(log_path), "%s/.myshell.log", home);
-        g_error_state.log_file = fopen(log_path, "a");
+        g_error_state.log_file = fopen(log_path, "ae");
     }
 }
 
@@ -49,14 +63,19 @@ void cleanup_memory_tracking(void) {
         return;
     }
     
-    /* 打印内存统计信息 */
-    print_memory_stats();
+    /* 打印内存统计信息（批处理和脚本模式下不混入命令输出） */
+    if (g_shell_state.interactive) {
+        print_memory_stats();
+    }
     
     /* 检查内存泄漏 */
     int leaks = check_memory_leaks();
     if (leaks > 0) {
         log_warning("Memory leaks detected during cleanup");
-        print_memory_leaks();
+        /* 泄漏报告写往stdout，只在交互模式下显示，不混入脚本和-c的输出 */
+        if (g_shell_state.interactive) {
+            print_memory_leaks();
+        }
     }
     
     /* 释放所有未释放的内存块 */
@@ -95,6 +114,7 @@ void cleanup_error_system(void) {
         fclose(g_error_state.log_file);
         g_error_state.log_file = NULL;
     }
+    g_error_state.log_file_opened = 0;
 }
 
 /**
@@ -128,7 +148,8 @@ void handle_error(error_code_t code, const char *context) {
         strcpy(full_message, errno_msg);
     }
     
-    /* 输出错误到stderr */
+    /* 输出错误到stderr（先写出缓冲区中较早的输出） */
+    output_flush_all();
     fprintf(stderr, "%s\n", full_message);
     
     /* 记录错误到日志 */
@@ -176,22 +197,27 @@ void log_error(const char *message) {
  * 记录错误到日志 - 带级别版本
  */
 void log_error_with_level(log_level_t level, const char *message) {
-    if (!g_error_state.log_enabled || !message) {
+    if (!g_error_state.log_enabled || !message || level < g_error_state.log_threshold) {
         return;
     }
     
+    if (!g_error_state.log_file_opened) {
+        open_log_file();
+    }
+    
     time_t now;
-    struct tm *tm_info;
+    struct tm tm_info;
     char timestamp[64];
     
     /* 获取当前时间 */
     time(&now);
-    tm_info = localtime(&now);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tm_info);
+    localtime_r(&now, &tm_info);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_info);
     
     const char *level_str = get_log_level_string(level);
     
-    /* 输出到stderr */
+    /* 输出到stderr（先写出缓冲区中较早的输出） */
+    output_flush_all();
     fprintf(stderr, "[%s] %s: %s\n", timestamp, level_str, message);
     
     /* 输出到日志文件 */
@@ -585,16 +611,16 @@ void tracked_free(void *ptr, const char *file, int line) {
  */
 void print_memory_stats(void) {
     if (!g_memory_state.tracking_enabled) {
-        printf("Memory tracking is disabled\n");
+        output_printf(STDOUT_FILENO, "Memory tracking is disabled\n");
         return;
     }
     
-    printf("\n=== Memory Statistics ===\n");
-    printf("Total allocations: %d\n", g_memory_state.allocation_count);
-    printf("Total deallocations: %d\n", g_memory_state.deallocation_count);
-    printf("Current allocated: %zu bytes\n", g_memory_state.total_allocated);
-    printf("Peak allocated: %zu bytes\n", g_memory_state.peak_allocated);
-    printf("Outstanding blocks: %d\n", 
+    output_printf(STDOUT_FILENO, "\n=== Memory Statistics ===\n");
+    output_printf(STDOUT_FILENO, "Total allocations: %d\n", g_memory_state.allocation_count);
+    output_printf(STDOUT_FILENO, "Total deallocations: %d\n", g_memory_state.deallocation_count);
+    output_printf(STDOUT_FILENO, "Current allocated: %zu bytes\n", g_memory_state.total_allocated);
+    output_printf(STDOUT_FILENO, "Peak allocated: %zu bytes\n", g_memory_state.peak_allocated);
+    output_printf(STDOUT_FILENO, "Outstanding blocks: %d\n", 
            g_memory_state.allocation_count - g_memory_state.deallocation_count);
     
     /* 计算当前分配的块数 */
@@ -604,8 +630,8 @@ void print_memory_stats(void) {
         block_count++;
         block = block->next;
     }
-    printf("Tracked blocks: %d\n", block_count);
-    printf("========================\n\n");
+    output_printf(STDOUT_FILENO, "Tracked blocks: %d\n", block_count);
+    output_printf(STDOUT_FILENO, "========================\n\n");
 }
 
 /**
@@ -620,27 +646,27 @@ void print_memory_leaks(void) {
     int leak_count = 0;
     
     if (!block) {
-        printf("No memory leaks detected.\n");
+        output_printf(STDOUT_FILENO, "No memory leaks detected.\n");
         return;
     }
     
-    printf("\n=== Memory Leaks Detected ===\n");
+    output_printf(STDOUT_FILENO, "\n=== Memory Leaks Detected ===\n");
     
     while (block) {
         leak_count++;
-        printf("Leak #%d:\n", leak_count);
-        printf("  Address: %p\n", block->ptr);
-        printf("  Size: %zu bytes\n", block->size);
-        printf("  Context: %s\n", block->context ? block->context : "unknown");
-        printf("  Location: %s:%d\n", 
+        output_printf(STDOUT_FILENO, "Leak #%d:\n", leak_count);
+        output_printf(STDOUT_FILENO, "  Address: %p\n", block->ptr);
+        output_printf(STDOUT_FILENO, "  Size: %zu bytes\n", block->size);
+        output_printf(STDOUT_FILENO, "  Context: %s\n", block->context ? block->context : "unknown");
+        output_printf(STDOUT_FILENO, "  Location: %s:%d\n", 
                block->file ? block->file : "unknown", block->line);
-        printf("\n");
+        output_printf(STDOUT_FILENO, "\n");
         block = block->next;
     }
     
-    printf("Total leaks: %d blocks, %zu bytes\n", 
+    output_printf(STDOUT_FILENO, "Total leaks: %d blocks, %zu bytes\n", 
            leak_count, g_memory_state.total_allocated);
-    printf("=============================\n\n");
+    output_printf(STDOUT_FILENO, "=============================\n\n");
 }
 
 /**
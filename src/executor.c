@@ -0,0 +1,1065 @@
+#include "shell.h"
+
+#include <fnmatch.h>
+
+/**
+ * 把命令的返回值转换为0-255的退出状态：内部命令出错时返回的负数记为1
+ */
+int exit_status_from_result(int result) {
+    if (result < 0) {
+        return 1;
+    }
+    return result & 0xff;
+}
+
+/**
+ * 在当前进程中exec外部命令（不再返回，失败时返回退出状态）
+ */
+static int exec_external_in_place(char *command, char **args) {
+    char *executable_path = find_executable(command);
+    if (executable_path == NULL) {
+        output_printf(STDERR_FILENO, "%s: command not found\n", command);
+        return 127;  /* 命令未找到的标准退出码 */
+    }
+    
+    /* exec之后缓冲区中的内容会丢失，先全部写出 */
+    output_flush_all();
+    input_sync_stdin();
+    
+    execve(executable_path, args, get_exported_environment());
+    
+    /* execve只有失败时才会返回 */
+    int saved_errno = errno;
+    output_printf(STDERR_FILENO, "%s: %s\n", command, strerror(saved_errno));
+    TRACKED_FREE(executable_path);
+    return (saved_errno == ENOENT) ? 127 : 126;
+}
+
+/* 函数调用的最大嵌套层数（防止无限递归耗尽栈空间） */
+#define MAX_FUNCTION_DEPTH 1000
+
+static int execute_node(node_t *node, int in_place);
+
+/* 最近一次命令替换的退出状态（-1表示没有），作为只有赋值的命令的退出状态 */
+static int g_substitution_status = -1;
+
+/* 进程替换的子进程及Shell一端的管道描述符，使用它们的命令结束时关闭并回收 */
+typedef struct {
+    pid_t pid;
+    int fd;
+} process_substitution_t;
+
+static process_substitution_t *g_process_substitutions = NULL;
+static int g_process_substitution_count = 0;
+static int g_process_substitution_capacity = 0;
+
+/**
+ * 在当前进程中调用函数：位置参数替换为函数的参数，并进入新的local作用域
+ * 函数体已在定义时解析，调用时不复制参数也不重新解析
+ */
+static int execute_function(syntax_tree_t *body, int argc, char **argv) {
+    if (g_shell_state.function_depth >= MAX_FUNCTION_DEPTH) {
+        char error_msg[256];
+        snprintf(error_msg, sizeof(error_msg), "%s: maximum function nesting level exceeded (%d)",
+                 argv[0], MAX_FUNCTION_DEPTH);
+        print_error(error_msg);
+        return 1;
+    }
+    
+    /* 函数执行期间可能被重新定义，持有一个引用 */
+    body->refcount++;
+    
+    positional_save_t saved_params;
+    local_scope_t scope;
+    int saved_loop_depth = g_shell_state.loop_depth;
+    push_positional_params(argc - 1, argv + 1, &saved_params);
+    push_local_scope(&scope);
+    g_shell_state.loop_depth = 0;  /* 函数中的break/continue不作用于调用者的循环 */
+    g_shell_state.function_depth++;
+    
+    int status = execute_node(body->root, 0);
+    if (g_shell_state.returning) {
+        status = g_shell_state.last_exit_status;
+        g_shell_state.returning = 0;
+    }
+    
+    g_shell_state.function_depth--;
+    g_shell_state.loop_depth = saved_loop_depth;
+    pop_local_scope();
+    pop_positional_params(&saved_params);
+    free_syntax_tree(body);
+    return status;
+}
+
+/**
+ * 命令开头的赋值单词个数（name=value ...，复合赋值name=(...)包括其元素和")"）
+ */
+static int count_assignments(const command_t *cmd) {
+    int i = 0;
+    while (i < cmd->argc) {
+        size_t equals = find_assignment(cmd->args[i]);
+        if (equals == 0) {
+            break;
+        }
+        if (strcmp(cmd->args[i] + equals + 1, "(") == 0) {
+            while (i < cmd->argc && strcmp(cmd->args[i], ")") != 0) {
+                i++;
+            }
+        }
+        i++;
+    }
+    return (i < cmd->argc) ? i : cmd->argc;
+}
+
+/**
+ * 在当前Shell中依次执行赋值单词words[0, count)，返回退出状态
+ */
+static int execute_assignments(char **words, int count) {
+    int i = 0;
+    while (i < count) {
+        int used = 0;
+        int result = perform_assignment(words + i, count - i, &used);
+        if (result < 0) {
+            handle_error(ERROR_MEMORY_ALLOCATION, "execute_command: assignment failed");
+            return -1;
+        }
+        if (result > 0) {
+            return 1;
+        }
+        i += used;
+    }
+    return 0;
+}
+
+/**
+ * 扩展参数并分派命令（函数优先于内部命令和外部命令）
+ * in_place为1时外部命令直接exec替换当前进程
+ */
+static int dispatch_command(command_t *cmd, int in_place) {
+    if (cmd == NULL || cmd->args == NULL || (cmd->argc == 0 && cmd->redirections == NULL)) {
+        handle_error(ERROR_INVALID_ARGUMENT, "execute_command: empty command");
+        return -1;
+    }
+    
+    int assign_count = (cmd->argc > 0 && find_assignment(cmd->args[0]) > 0) ? count_assignments(cmd) : 0;
+    if (assign_count == cmd->argc) {
+        /* 只有赋值的命令以其中最后一个命令替换的退出状态为退出状态 */
+        g_substitution_status = -1;
+        int status = execute_assignments(cmd->args, assign_count);
+        if (status == 0 && g_substitution_status >= 0) {
+            status = g_substitution_status;
+        }
+        /* 没有命令时重定向只创建（或检查）文件 */
+        redirect_plan_t plan;
+        if (status == 0 && cmd->redirections != NULL && (status = redirect_prepare(cmd->redirections, &plan)) == 0) {
+            redirect_release(&plan);
+        }
+        status = exit_status_from_result(status);
+        g_shell_state.last_exit_status = status;
+        return status;
+    }
+    
+    char **expanded = NULL;
+    int argc = cmd->argc - assign_count;
+    /* echo的参数只含简单的参数引用时不预先扩展，由echo在输出时一遍完成扩展和转义解码 */
+    int fused_echo = (assign_count == 0 && strcmp(cmd->args[0], "echo") == 0 && find_function("echo") == NULL &&
+                      echo_args_are_simple(cmd->args + 1, argc - 1));
+    int expand_status = fused_echo ? 0 : expand_arguments(cmd->args + assign_count, argc, &expanded, &argc);
+    if (expand_status > 0) {
+        g_shell_state.last_exit_status = 1;
+        return 1;
+    } else if (expand_status < 0) {
+        /* 分配失败已由分配函数报告 */
+        g_shell_state.last_exit_status = 1;
+        return 1;
+    }
+    char **argv = (expanded != NULL) ? expanded : cmd->args + assign_count;
+    
+    /* 命令前的赋值只对这一条命令有效：先扩展命令的单词，再在临时作用域中赋值并导出 */
+    local_scope_t temporary;
+    int has_temporary = (assign_count > 0 && argc > 0 && argv[0][0] != '\0');
+    int status = 0;
+    if (has_temporary) {
+        status = push_temporary_assignments(cmd->args, assign_count, &temporary);
+    } else if (assign_count > 0) {
+        /* 命令扩展为空时赋值在当前Shell中生效 */
+        status = execute_assignments(cmd->args, assign_count);
+    }
+    
+    /* 重定向在参数扩展之后、命令执行之前打开，失败时不执行命令 */
+    redirect_plan_t plan;
+    int redirected = 0;
+    if (status == 0 && cmd->redirections != NULL) {
+        status = redirect_prepare(cmd->redirections, &plan);
+        redirected = (status == 0);
+    }
+    
+    syntax_tree_t *function = NULL;
+    if (status != 0 || argc == 0 || argv[0][0] == '\0') {
+        /* 扩展后为空（如未设置的"$@"），不执行任何命令 */
+        status = (status > 0) ? 1 : status;
+    } else if ((function = find_function(argv[0])) == NULL && !is_builtin(argv[0]) && !in_place) {
+        /* 外部命令：重定向作为spawn的文件操作在子进程中执行，Shell的描述符不动 */
+        status = execute_external_redirected(argv[0], argv, redirected ? &plan : NULL);
+    } else if (redirected && redirect_apply(&plan) != 0) {
+        status = 1;
+    } else {
+        /* 函数、内部命令和直接exec的外部命令：在当前进程中临时替换描述符，执行后换回 */
+        if (function != NULL) {
+            status = execute_function(function, argc, argv);
+        } else if (is_builtin(argv[0])) {
+            /* 对于内部命令，传递参数时跳过命令名 */
+            char **builtin_args = (argc > 1) ? &argv[1] : NULL;
+            status = fused_echo ? builtin_echo_unexpanded(builtin_args) : execute_builtin(argv[0], builtin_args);
+        } else {
+            status = exec_external_in_place(argv[0], argv);
+        }
+        if (redirected) {
+            redirect_restore(&plan);
+        }
+    }
+    if (redirected) {
+        redirect_release(&plan);
+    }
+    if (has_temporary) {
+        pop_local_scope();
+    }
+    
+    free_expanded_arguments(expanded);
+    
+    status = exit_status_from_result(status);
+    g_shell_state.last_exit_status = status;
+    return status;
+}
+
+/**
+ * 执行一条已解析的命令
+ * 先对参数做变量扩展（包括位置参数），再分派给内部命令或外部命令
+ * 返回命令的退出状态，同时写入g_shell_state.last_exit_status
+ */
+int execute_command(command_t *cmd) {
+    return dispatch_command(cmd, 0);
+}
+
+/**
+ * fork一个执行Shell代码的子进程（用于管道的各段和( )）
+ * 子进程恢复默认的信号处理
+ */
+static pid_t fork_subshell(void) {
+    /* fork之前写出缓冲区并归还预读的输入，与fork_and_exec相同 */
+    output_flush_all();
+    input_sync_stdin();
+    
+    pid_t pid = fork();
+    if (pid == -1) {
+        handle_syscall_error("fork", "fork_subshell");
+    } else if (pid == 0) {
+        signal(SIGINT, SIG_DFL);
+        signal(SIGQUIT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+    }
+    return pid;
+}
+
+/**
+ * 子进程执行完毕后退出（写出缓冲区，不执行atexit清理）
+ */
+static void exit_subshell(int status) {
+    output_flush_all();
+    _exit(status & 0xff);
+}
+
+/**
+ * 等待子进程并返回其退出状态
+ */
+static int wait_for_child(pid_t pid) {
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            handle_syscall_error("waitpid", "wait_for_child");
+            return -1;
+        }
+    }
+    
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return 0;
+}
+
+/* 只产生输出、不改变Shell状态的内部命令：命令替换中只有它们时不必fork */
+static const char *const OUTPUT_ONLY_BUILTINS[] = {
+    "echo", "pwd", "true", "false", ":", "test", "[", "date", "cat", "ls", "stat", "help", NULL
+};
+
+/* 在当前进程中执行的命令替换检查函数体时的最大嵌套层数 */
+#define MAX_SUBSTITUTION_FUNCTION_DEPTH 4
+
+/**
+ * 单词的扩展是否可能修改Shell变量：$((...))中的赋值和自增自减、${...}中的=（如${x:=y}）
+ */
+static int word_may_assign(const char *word) {
+    for (const char *p = strchr(word, '$'); p != NULL; p = strchr(p + 1, '$')) {
+        const char *end = NULL;
+        if (p[1] == '(' && p[2] == '(') {
+            end = strstr(p, "))");
+        } else if (p[1] == '{') {
+            end = strchr(p, '}');
+        }
+        if (end == NULL) {
+            continue;
+        }
+        for (const char *q = p + 2; q < end; q++) {
+            if (*q == '=' || ((*q == '+' || *q == '-') && q[1] == *q)) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * 重定向是否涉及标准输出（>file、&>file、>&2、2>&1等）
+ * 在当前进程中捕获输出时stdout不是真正的描述符，这样的命令只能在子进程中执行
+ */
+static int redirects_stdout(const redirection_t *r) {
+    for (; r != NULL; r = r->next) {
+        if (r->fd == STDOUT_FILENO || r->type == REDIR_OUTPUT_ALL || r->type == REDIR_APPEND_ALL ||
+            (r->type == REDIR_DUPLICATE && strcmp(r->word, "1") == 0)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 语法树是否可以在当前进程中执行而不影响Shell的状态：
+ * 只由列表、if、[[ ]]和调用只输出的内部命令（或这样的函数）的简单命令组成，且没有赋值
+ */
+static int runs_without_side_effects(const node_t *node, int function_depth) {
+    for (; node != NULL; node = node->next) {
+        switch (node->type) {
+            case NODE_COMMAND: {
+                const command_t *cmd = node->command;
+                if (cmd->argc == 0 || find_assignment(cmd->args[0]) > 0 ||
+                    strpbrk(cmd->args[0], "$`'\"\\*?[{") != NULL || redirects_stdout(cmd->redirections)) {
+                    return 0;
+                }
+                for (int i = 0; i < cmd->argc; i++) {
+                    if (word_may_assign(cmd->args[i])) {
+                        return 0;
+                    }
+                }
+                
+                const char *name = cmd->args[0];
+                syntax_tree_t *function = find_function(name);
+                if (function != NULL) {
+                    if (function_depth >= MAX_SUBSTITUTION_FUNCTION_DEPTH ||
+                        !runs_without_side_effects(function->root, function_depth + 1)) {
+                        return 0;
+                    }
+                    break;
+                }
+                /* local和return只作用于函数自己的作用域 */
+                int allowed = function_depth > 0 && (strcmp(name, "local") == 0 || strcmp(name, "return") == 0);
+                for (int i = 0; OUTPUT_ONLY_BUILTINS[i] != NULL && !allowed; i++) {
+                    allowed = (strcmp(name, OUTPUT_ONLY_BUILTINS[i]) == 0);
+                }
+                if (!allowed) {
+                    return 0;
+                }
+                break;
+            }
+            case NODE_AND:
+            case NODE_OR:
+                if (!runs_without_side_effects(node->left, function_depth) ||
+                    !runs_without_side_effects(node->right, function_depth)) {
+                    return 0;
+                }
+                break;
+            case NODE_SEQUENCE:
+            case NODE_GROUP:
+                if (!runs_without_side_effects(node->children, function_depth)) {
+                    return 0;
+                }
+                break;
+            case NODE_IF:
+                if (!runs_without_side_effects(node->left, function_depth) ||
+                    !runs_without_side_effects(node->right, function_depth) ||
+                    !runs_without_side_effects(node->else_part, function_depth)) {
+                    return 0;
+                }
+                break;
+            case NODE_COND:
+                for (int i = 0; i < node->command->argc; i++) {
+                    if (word_may_assign(node->command->args[i])) {
+                        return 0;
+                    }
+                }
+                break;
+            default:
+                return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 在子进程中执行命令替换，经管道把输出读入可增长的缓冲区
+ * 子进程中最后的外部命令直接exec，整个替换只有一次fork
+ */
+static int substitute_in_child(syntax_tree_t *tree, char **output, size_t *out_len) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        handle_syscall_error("pipe2", "command_substitute");
+        return -1;
+    }
+    
+    pid_t pid = fork_subshell();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        output_capture_detach();
+        output_reset_tty_cache();
+        exit_subshell(execute_node(tree->root, 1));
+    }
+    close(fds[1]);
+    
+    char *data = NULL;
+    size_t len = 0, capacity = 0;
+    int failed = 0;
+    for (;;) {
+        if (len + 1 >= capacity) {
+            size_t new_capacity = capacity ? capacity * 2 : 4096;
+            char *new_data = safe_realloc(data, new_capacity, "command_substitute: output");
+            if (new_data == NULL) {
+                failed = 1;
+                break;
+            }
+            data = new_data;
+            capacity = new_capacity;
+        }
+        ssize_t n = read(fds[0], data + len, capacity - len - 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += (size_t)n;
+    }
+    close(fds[0]);
+    
+    int status = wait_for_child(pid);
+    if (failed) {
+        free(data);
+        return -1;
+    }
+    if (data != NULL) {
+        data[len] = '\0';
+    }
+    *output = data;
+    *out_len = len;
+    return status;
+}
+
+/**
+ * 命令替换：执行text[0, len)中的命令，返回其标准输出（去掉末尾的换行）
+ * 只由只输出的内部命令和这样的函数组成时在当前进程中执行，输出直接写入内存缓冲区，不fork；
+ * 否则在子进程中执行，输出经管道读入
+ * *output（可能为NULL）需用free释放；返回命令的退出状态，出错时（已报告）返回-1
+ */
+int command_substitute(const char *text, size_t len, char **output, size_t *out_len) {
+    *output = NULL;
+    *out_len = 0;
+    
+    int incomplete = 0;
+    syntax_tree_t *tree = parse_line_cached(text, len, &incomplete);
+    if (tree == NULL) {
+        if (incomplete) {
+            print_error("syntax error: unexpected end of command substitution");
+        }
+        return -1;
+    }
+    
+    int status;
+    if (tree->root == NULL) {
+        status = 0;
+    } else if (runs_without_side_effects(tree->root, 0)) {
+        output_capture_t capture;
+        output_capture_begin(&capture);
+        status = execute_node(tree->root, 0);
+        output_capture_end(&capture);
+        if (capture.failed) {
+            free(capture.data);
+            status = -1;
+        } else {
+            *output = capture.data;
+            *out_len = capture.len;
+        }
+    } else {
+        status = substitute_in_child(tree, output, out_len);
+    }
+    free_syntax_tree(tree);
+    
+    /* 末尾的换行原地去掉 */
+    while (*out_len > 0 && (*output)[*out_len - 1] == '\n') {
+        (*output)[--*out_len] = '\0';
+    }
+    if (status >= 0) {
+        g_shell_state.last_exit_status = status;
+        g_substitution_status = status;
+    }
+    return status;
+}
+
+/**
+ * 进程替换：在与当前命令并发运行的子进程中执行text[0, len)中的命令，
+ * <(...)的标准输出（writing为1时>(...)的标准输入）接到管道上，path中写入Shell一端的路径/dev/fd/N
+ * Shell一端不带O_CLOEXEC，由使用它的外部命令继承；命令结束时由execute_node关闭并回收子进程
+ * 成功返回0，出错时（已报告）返回-1
+ */
+int process_substitute(const char *text, size_t len, int writing, char *path, size_t path_size) {
+    if (g_process_substitution_count == g_process_substitution_capacity) {
+        int new_capacity = g_process_substitution_capacity ? g_process_substitution_capacity * 2 : 4;
+        process_substitution_t *grown = safe_realloc(g_process_substitutions,
+                                                     (size_t)new_capacity * sizeof(process_substitution_t),
+                                                     "process_substitute: children");
+        if (grown == NULL) {
+            return -1;
+        }
+        g_process_substitutions = grown;
+        g_process_substitution_capacity = new_capacity;
+    }
+    
+    int incomplete = 0;
+    syntax_tree_t *tree = parse_line_cached(text, len, &incomplete);
+    if (tree == NULL) {
+        if (incomplete) {
+            print_error("syntax error: unexpected end of process substitution");
+        }
+        return -1;
+    }
+    
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        handle_syscall_error("pipe2", "process_substitute");
+        free_syntax_tree(tree);
+        return -1;
+    }
+    int child_end = writing ? fds[0] : fds[1];
+    int shell_end = writing ? fds[1] : fds[0];
+    
+    pid_t pid = fork_subshell();
+    if (pid == -1) {
+        close(fds[0]);
+        close(fds[1]);
+        free_syntax_tree(tree);
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(child_end, writing ? STDIN_FILENO : STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        /* 之前的进程替换的管道不留在这个子进程中，否则>(...)的读者等不到EOF */
+        for (int i = 0; i < g_process_substitution_count; i++) {
+            close(g_process_substitutions[i].fd);
+        }
+        g_process_substitution_count = 0;
+        output_capture_detach();
+        output_reset_tty_cache();
+        exit_subshell(execute_node(tree->root, 1));
+    }
+    close(child_end);
+    free_syntax_tree(tree);
+    fcntl(shell_end, F_SETFD, 0);
+    
+    process_substitution_t *entry = &g_process_substitutions[g_process_substitution_count++];
+    entry->pid = pid;
+    entry->fd = shell_end;
+    snprintf(path, path_size, "/dev/fd/%d", shell_end);
+    return 0;
+}
+
+/**
+ * 关闭从第mark个开始的进程替换的管道，并等待其子进程结束
+ * 先关闭全部管道：<(...)的写者不再阻塞，>(...)的读者读到EOF
+ */
+static void finish_process_substitutions(int mark) {
+    for (int i = mark; i < g_process_substitution_count; i++) {
+        close(g_process_substitutions[i].fd);
+    }
+    for (int i = mark; i < g_process_substitution_count; i++) {
+        wait_for_child(g_process_substitutions[i].pid);
+    }
+    g_process_substitution_count = mark;
+}
+
+/**
+ * 是否应停止执行后续命令（exit、return，或有待处理的break/continue）
+ */
+static int execution_interrupted(void) {
+    return !g_shell_state.running || g_shell_state.returning ||
+           g_shell_state.break_levels > 0 || g_shell_state.continue_levels > 0;
+}
+
+/**
+ * 依次执行列表中的各项（exit、return、break、continue之后停止），返回最后一项的退出状态
+ */
+static int execute_list(node_t *first, int in_place) {
+    int status = 0;
+    for (node_t *item = first; item != NULL && !execution_interrupted(); item = item->next) {
+        status = execute_node(item, in_place && item->next == NULL);
+    }
+    return status;
+}
+
+/**
+ * 执行管道：每一段在各自的子进程中运行，相邻两段通过pipe连接
+ * 返回最后一段的退出状态
+ */
+static int execute_pipeline(node_t *node) {
+    int stage_count = 0;
+    for (node_t *stage = node->children; stage != NULL; stage = stage->next) {
+        stage_count++;
+    }
+    
+    pid_t *pids = safe_malloc((size_t)stage_count * sizeof(pid_t), "execute_pipeline: pids");
+    if (pids == NULL) {
+        return -1;
+    }
+    
+    int started = 0;
+    int prev_read = -1;
+    for (node_t *stage = node->children; stage != NULL; stage = stage->next) {
+        int fds[2] = { -1, -1 };
+        if (stage->next != NULL && pipe2(fds, O_CLOEXEC) == -1) {
+            handle_syscall_error("pipe2", "execute_pipeline");
+            break;
+        }
+        
+        pid_t pid = fork_subshell();
+        if (pid == -1) {
+            if (fds[0] != -1) {
+                close(fds[0]);
+                close(fds[1]);
+            }
+            break;
+        }
+        
+        if (pid == 0) {
+            /* 子进程：连接上一段的输出和下一段的输入；最后的外部命令直接exec */
+            if (prev_read != -1) {
+                dup2(prev_read, STDIN_FILENO);
+                close(prev_read);
+            }
+            if (fds[1] != -1) {
+                dup2(fds[1], STDOUT_FILENO);
+                close(fds[0]);
+                close(fds[1]);
+            }
+            output_reset_tty_cache();
+            exit_subshell(execute_node(stage, 1));
+        }
+        
+        pids[started++] = pid;
+        if (prev_read != -1) {
+            close(prev_read);
+        }
+        if (fds[1] != -1) {
+            close(fds[1]);
+        }
+        prev_read = fds[0];
+    }
+    if (prev_read != -1) {
+        close(prev_read);
+    }
+    
+    int status = (started == stage_count) ? 0 : -1;
+    for (int i = 0; i < started; i++) {
+        int stage_status = wait_for_child(pids[i]);
+        if (i == stage_count - 1) {
+            status = stage_status;
+        }
+    }
+    
+    free(pids);
+    return status;
+}
+
+/**
+ * 执行( list )：在子进程中执行，其中的cd、export和exit不影响当前Shell
+ * 已经处于最后一条命令的位置时不必fork，直接在当前进程中执行
+ */
+static int execute_subshell(node_t *node, int in_place) {
+    if (in_place) {
+        return execute_list(node->children, 1);
+    }
+    
+    pid_t pid = fork_subshell();
+    if (pid == -1) {
+        return -1;
+    }
+    if (pid == 0) {
+        exit_subshell(execute_list(node->children, 1));
+    }
+    return wait_for_child(pid);
+}
+
+/**
+ * 执行if语句：elif由else_part中嵌套的NODE_IF表示
+ * 没有执行任何分支时返回0
+ */
+static int execute_if(node_t *node, int in_place) {
+    int condition = execute_list(node->left, 0);
+    if (execution_interrupted()) {
+        return condition;
+    }
+    
+    if (condition == 0) {
+        return execute_list(node->right, in_place);
+    }
+    if (node->else_part != NULL) {
+        return execute_node(node->else_part, in_place);
+    }
+    return 0;
+}
+
+/**
+ * 循环体执行完一次后处理break/continue
+ * 返回1表示应退出当前循环
+ */
+static int loop_should_exit(void) {
+    if (!g_shell_state.running || g_shell_state.returning) {
+        return 1;
+    }
+    if (g_shell_state.break_levels > 0) {
+        g_shell_state.break_levels--;
+        return 1;
+    }
+    if (g_shell_state.continue_levels > 0) {
+        /* continue n：退出内层的n-1层循环，继续第n层 */
+        if (--g_shell_state.continue_levels > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 执行while/until循环
+ * 返回最后一次执行循环体的退出状态，循环体一次也没有执行时返回0
+ */
+static int execute_while(node_t *node) {
+    int status = 0;
+    int until = (node->type == NODE_UNTIL);
+    
+    g_shell_state.loop_depth++;
+    for (;;) {
+        int condition = execute_list(node->left, 0);
+        if (execution_interrupted()) {
+            if (loop_should_exit()) {
+                break;
+            }
+            continue;
+        }
+        if ((condition == 0) == until) {
+            break;
+        }
+        
+        status = execute_list(node->right, 0);
+        if (execution_interrupted() && loop_should_exit()) {
+            break;
+        }
+    }
+    g_shell_state.loop_depth--;
+    
+    return status;
+}
+
+/* for循环的一段取值：一个单词扩展得到的字段，或者逐个生成的花括号展开 */
+typedef struct {
+    char **fields;              /* 以NULL结尾，用free_expanded_arguments释放 */
+    int count;
+    brace_expansion_t *braces;  /* 不为NULL时每次迭代才生成下一个取值 */
+} for_segment_t;
+
+/**
+ * 单词是否只有花括号展开：没有引号、参数展开、命令替换和通配符时，
+ * 生成的单词不需要再扩展，也与Shell的状态无关，可以在循环的每次迭代时才生成
+ */
+static int is_literal_brace_word(const char *word) {
+    return strchr(word, '{') != NULL && strpbrk(word, "$`'\"\\*?[<>") == NULL;
+}
+
+/**
+ * 把values[0, count)复制为一段取值（位置参数和不需要扩展的单词在循环中可能被修改或释放）
+ */
+static int copy_for_fields(for_segment_t *segment, char **values, int count) {
+    segment->fields = TRACKED_MALLOC(((size_t)count + 1) * sizeof(char*), "execute_for: items");
+    if (segment->fields == NULL) {
+        return -1;
+    }
+    segment->fields[0] = NULL;
+    for (int i = 0; i < count; i++) {
+        segment->fields[i] = TRACKED_STRDUP(values[i], "execute_for: item");
+        if (segment->fields[i] == NULL) {
+            return -1;
+        }
+        segment->fields[i + 1] = NULL;
+        segment->count = i + 1;
+    }
+    return 0;
+}
+
+/**
+ * 在循环开始之前扩展for的单词列表，每个单词得到一段取值
+ * 只有花括号展开的单词（{1..1000000}）只编译生成器，不展开成列表
+ * 返回0表示成功，1表示扩展出错且错误已报告，-1表示内存分配失败
+ */
+static int prepare_for_segments(node_t *node, for_segment_t *segments, int count) {
+    if (node->command == NULL) {
+        return copy_for_fields(&segments[0], g_shell_state.positional_params, g_shell_state.positional_count);
+    }
+    
+    for (int i = 0; i < count; i++) {
+        char **word = &node->command->args[i];
+        if (is_literal_brace_word(*word)) {
+            if (brace_compile(*word, &segments[i].braces) != 0) {
+                return -1;
+            }
+            if (segments[i].braces != NULL) {
+                continue;
+            }
+        }
+        
+        char **expanded = NULL;
+        int expanded_count = 1;
+        int status = expand_arguments(word, 1, &expanded, &expanded_count);
+        if (status != 0) {
+            return status;
+        }
+        if (expanded == NULL) {
+            status = copy_for_fields(&segments[i], word, 1);
+        } else {
+            segments[i].fields = expanded;
+            segments[i].count = expanded_count;
+        }
+        if (status != 0) {
+            return status;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 以value为循环变量的值执行一次循环体，返回是否应结束循环
+ */
+static int run_for_iteration(node_t *node, char *value, int *status) {
+    set_env_var(node->name, value);
+    *status = execute_list(node->right, 0);
+    return execution_interrupted() && loop_should_exit();
+}
+
+/**
+ * 执行for循环：省略in时遍历位置参数
+ * 单词列表在循环开始前扩展完毕；只有花括号展开的单词在迭代时才逐个生成，
+ * for i in {1..1000000}不需要保存一百万个取值
+ */
+static int execute_for(node_t *node) {
+    int segment_count = (node->command != NULL) ? node->command->argc : 1;
+    size_t segments_size = (size_t)(segment_count > 0 ? segment_count : 1) * sizeof(for_segment_t);
+    for_segment_t *segments = TRACKED_MALLOC(segments_size, "execute_for: segments");
+    if (segments == NULL) {
+        return 1;
+    }
+    memset(segments, 0, segments_size);
+    
+    int status = prepare_for_segments(node, segments, segment_count);
+    if (status == 0) {
+        int done = 0;
+        g_shell_state.loop_depth++;
+        for (int s = 0; s < segment_count && !done; s++) {
+            for_segment_t *segment = &segments[s];
+            if (segment->braces == NULL) {
+                for (int i = 0; i < segment->count && !done; i++) {
+                    done = run_for_iteration(node, segment->fields[i], &status);
+                }
+                continue;
+            }
+            
+            const char *value;
+            int failed = 0;
+            while (!done && (value = brace_next(segment->braces, &failed)) != NULL) {
+                /* {,x}生成的空单词不产生取值 */
+                if (value[0] != '\0') {
+                    done = run_for_iteration(node, (char *)value, &status);
+                }
+            }
+            if (failed) {
+                status = 1;
+                done = 1;
+            }
+        }
+        g_shell_state.loop_depth--;
+    } else {
+        /* 分配失败已由分配函数报告 */
+        status = 1;
+    }
+    
+    for (int s = 0; s < segment_count; s++) {
+        free_expanded_arguments(segments[s].fields);
+        brace_free(segments[s].braces);
+    }
+    TRACKED_FREE(segments);
+    return status;
+}
+
+/**
+ * 执行case语句：依次用各分支的模式匹配扩展后的单词，执行第一个匹配的分支
+ * 没有匹配的分支时返回0
+ */
+static int execute_case(node_t *node, int in_place) {
+    char *subject = expand_single_word(node->command->args[0]);
+    if (subject == NULL) {
+        if (take_expansion_error()) {
+            return 1;
+        }
+        handle_error(ERROR_MEMORY_ALLOCATION, "execute_case: word expansion failed");
+        return -1;
+    }
+    
+    node_t *matched = NULL;
+    for (node_t *item = node->children; item != NULL && matched == NULL; item = item->next) {
+        for (int i = 0; i < item->command->argc; i++) {
+            char *pattern = expand_pattern(item->command->args[i]);
+            int match = (pattern != NULL && fnmatch(pattern, subject, 0) == 0);
+            TRACKED_FREE(pattern);
+            if (match) {
+                matched = item;
+                break;
+            }
+        }
+    }
+    TRACKED_FREE(subject);
+    
+    if (matched == NULL) {
+        return 0;
+    }
+    return execute_list(matched->right, in_place);
+}
+
+/**
+ * 执行语法树节点
+ * in_place为1表示该节点之后Shell不再执行任何命令，外部命令可以直接exec
+ */
+static int execute_node(node_t *node, int in_place) {
+    /* 需要对退出状态取反时，Shell必须等到命令结束 */
+    if (node->negated) {
+        in_place = 0;
+    }
+    
+    int substitution_mark = g_process_substitution_count;
+    int status = 0;
+    switch (node->type) {
+        case NODE_COMMAND:
+            status = dispatch_command(node->command, in_place);
+            break;
+        case NODE_PIPELINE:
+            status = execute_pipeline(node);
+            break;
+        case NODE_AND:
+            status = execute_node(node->left, 0);
+            if (status == 0 && !execution_interrupted()) {
+                status = execute_node(node->right, in_place);
+            }
+            break;
+        case NODE_OR:
+            status = execute_node(node->left, 0);
+            if (status != 0 && !execution_interrupted()) {
+                status = execute_node(node->right, in_place);
+            }
+            break;
+        case NODE_SEQUENCE:
+        case NODE_GROUP:
+            status = execute_list(node->children, in_place);
+            break;
+        case NODE_SUBSHELL:
+            status = execute_subshell(node, in_place);
+            break;
+        case NODE_IF:
+            status = execute_if(node, in_place);
+            break;
+        case NODE_WHILE:
+        case NODE_UNTIL:
+            status = execute_while(node);
+            break;
+        case NODE_FOR:
+            status = execute_for(node);
+            break;
+        case NODE_CASE:
+            status = execute_case(node, in_place);
+            break;
+        case NODE_COND:
+            status = evaluate_conditional(node->command->args, node->command->argc);
+            break;
+        case NODE_FUNCTION:
+            status = define_function(node->name, node->right) == 0 ? 0 : 1;
+            break;
+        case NODE_ARITH: {
+            long long value = 0;
+            if (arith_evaluate(node->command->args[0], &value) != 0) {
+                status = 1;
+            } else {
+                status = (value != 0) ? 0 : 1;
+            }
+            break;
+        }
+        case NODE_CASE_ITEM:
+            /* 只作为NODE_CASE的子节点出现 */
+            break;
+    }
+    
+    /* 命令中的进程替换在命令结束时收尾 */
+    if (g_process_substitution_count > substitution_mark) {
+        finish_process_substitutions(substitution_mark);
+    }
+    
+    if (node->negated) {
+        status = (status == 0);
+    }
+    g_shell_state.last_exit_status = status;
+    return status;
+}
+
+/**
+ * 执行语法树
+ * 返回最后执行的命令的退出状态
+ */
+int execute_tree(node_t *root) {
+    if (root == NULL) {
+        return g_shell_state.last_exit_status;
+    }
+    return execute_node(root, 0);
+}
+
+/**
+ * 执行语法树，且之后Shell不再执行任何命令（-c字符串）
+ * 处于最后位置的外部命令不再fork+wait，而是直接exec替换Shell进程，
+ * 退出状态由内核直接交给父进程
+ */
+int execute_tree_in_place(node_t *root) {
+    if (root == NULL) {
+        return g_shell_state.last_exit_status;
+    }
+    return execute_node(root, 1);
+}
@@ -1,9 +1,18 @@
 #include "shell.h"
 
+#include <spawn.h>
+
 /**
  * 执行外部命令
  */
 int execute_external(char *command, char **args) {
+    return execute_external_redirected(command, args, NULL);
+}
+
+/**
+ * 执行外部命令，子进程中先按plan重定向（plan为NULL时不重定向）
+ */
+int execute_external_redirected(char *command, char **args, const redirect_plan_t *plan) {
     if (command == NULL) {
         return -1;
     }
@@ -11,14 +20,14 @@ int execute_external(char *command, char **args) {
     /* 查找可执行文件 */
     char *executable_path = find_executable(command);
     if (executable_path == NULL) {
-        fprintf(stderr, "%s: command not found\n", command);
+        output_printf(STDERR_FILENO, "%s: command not found\n", command);
         return 127;  /* 命令未找到的标准退出码 */
     }
     
     /* 创建子进程并执行 */
-    int exit_status = fork_and_exec(executable_path, args);
+    int exit_status = spawn_and_wait(executable_path, args, plan);
     
-    free(executable_path);
+    TRACKED_FREE(executable_path);
     return exit_status;
 }
 
@@ -33,7 +42,7 @@ char* find_executable(char *command) {
     /* 如果命令包含路径分隔符，直接检查 */
     if (strchr(command, '/') != NULL) {
         if (access(command, X_OK) == 0) {
-            return strdup(command);
+            return TRACKED_STRDUP(command, "find_executable: command path");
         }
         return NULL;
     }
@@ -54,22 +63,14 @@ char* find_executable(char *command) {
         snprintf(full_path, MAX_PATH_SIZE, "%s/%s", path_dirs[i], command);
         
         if (access(full_path, X_OK) == 0) {
-            /* 释放path_dirs */
-            for (int j = 0; path_dirs[j] != NULL; j++) {
-                free(path_dirs[j]);
-            }
-            free(path_dirs);
-            
+            free_path_dirs(path_dirs);
             return full_path;
         }
     }
     
     /* 清理资源 */
-    for (int i = 0; path_dirs[i] != NULL; i++) {
-        free(path_dirs[i]);
-    }
-    free(path_dirs);
-    free(full_path);
+    free_path_dirs(path_dirs);
+    TRACKED_FREE(full_path);
     
     return NULL;
 }
@@ -78,34 +79,87 @@ char* find_executable(char *command) {
  * 创建子进程并执行程序
  */
 int fork_and_exec(char *path, char **args) {
+    return spawn_and_wait(path, args, NULL);
+}
+
+/**
+ * 参数和环境变量（字符串及其指针）的总大小是否超过系统的ARG_MAX
+ * 超过时execve必然以E2BIG失败，不必再建立子进程
+ */
+static int exceeds_arg_max(char **args, char **envp) {
+    long limit = sysconf(_SC_ARG_MAX);
+    if (limit <= 0) {
+        return 0;
+    }
+    
+    size_t total = 0;
+    for (char **v = args; *v != NULL; v++) {
+        total += strlen(*v) + 1 + sizeof(char*);
+    }
+    for (char **v = envp; *v != NULL; v++) {
+        total += strlen(*v) + 1 + sizeof(char*);
+    }
+    return total > (size_t)limit;
+}
+
+/**
+ * 用posix_spawn启动程序并等待其结束
+ * 重定向作为spawn的文件操作按顺序在子进程中执行（dup2清除O_CLOEXEC），父进程的描述符不受影响
+ */
+int spawn_and_wait(char *path, char **args, const redirect_plan_t *plan) {
     if (path == NULL) {
         return -1;
     }
     
-    pid_t pid = fork();
+    /* spawn之前写出缓冲区，避免输出顺序错乱 */
+    output_flush_all();
     
-    if (pid == -1) {
-        perror("fork");
+    /* 子进程可能读取stdin，先归还预读的输入 */
+    input_sync_stdin();
+    
+    /* 子进程的环境只包含导出的变量 */
+    char **envp = get_exported_environment();
+    if (envp == NULL) {
         return -1;
-    } else if (pid == 0) {
-        /* 子进程 */
-        if (execv(path, args) == -1) {
-            perror("execv");
-            exit(EXIT_FAILURE);
+    }
+    
+    if (exceeds_arg_max(args, envp)) {
+        output_printf(STDERR_FILENO, "%s: %s\n", args[0] ? args[0] : path, strerror(E2BIG));
+        return 126;
+    }
+    
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    for (int i = 0; plan != NULL && i < plan->count; i++) {
+        const redirect_step_t *step = &plan->steps[i];
+        if (step->source == -1) {
+            posix_spawn_file_actions_addclose(&actions, step->fd);
+        } else {
+            posix_spawn_file_actions_adddup2(&actions, step->source, step->fd);
         }
-    } else {
-        /* 父进程 */
-        int status;
-        if (waitpid(pid, &status, 0) == -1) {
+    }
+    
+    pid_t pid;
+    int error = posix_spawn(&pid, path, &actions, NULL, args, envp);
+    posix_spawn_file_actions_destroy(&actions);
+    
+    if (error != 0) {
+        output_printf(STDERR_FILENO, "%s: %s\n", args[0] ? args[0] : path, strerror(error));
+        return (error == ENOENT) ? 127 : 126;
+    }
+    
+    int status;
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
             perror("waitpid");
             return -1;
         }
-        
-        if (WIFEXITED(status)) {
-            return WEXITSTATUS(status);
-        } else if (WIFSIGNALED(status)) {
-            return 128 + WTERMSIG(status);
-        }
+    }
+    
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
     }
     
     return 0;
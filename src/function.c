@@ -0,0 +1,106 @@
+#include "shell.h"
+
+#include <stdint.h>
+
+/* 函数表的散列桶个数（2的幂） */
+#define FUNCTION_TABLE_SIZE 64
+
+/* 函数表项：函数名及其函数体（独立的语法树，不依赖定义它的输入行） */
+typedef struct function_entry {
+    char *name;
+    syntax_tree_t *body;
+    struct function_entry *next;
+} function_entry_t;
+
+static function_entry_t *g_functions[FUNCTION_TABLE_SIZE];
+static int g_function_count = 0;
+
+/**
+ * 函数名的FNV-1a散列，返回桶下标
+ */
+static size_t function_bucket(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash & (FUNCTION_TABLE_SIZE - 1);
+}
+
+/**
+ * 定义（或重新定义）函数
+ * 函数体被复制成独立的语法树，之后每次调用直接执行，不再解析；
+ * 正在执行的旧函数体由引用计数保证在返回之前不被释放
+ */
+int define_function(const char *name, const node_t *body) {
+    if (name == NULL || body == NULL) {
+        handle_error(ERROR_INVALID_ARGUMENT, "define_function: invalid function");
+        return -1;
+    }
+    
+    syntax_tree_t *tree = copy_syntax_tree(body);
+    if (tree == NULL) {
+        return -1;
+    }
+    
+    size_t bucket = function_bucket(name);
+    for (function_entry_t *entry = g_functions[bucket]; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            free_syntax_tree(entry->body);
+            entry->body = tree;
+            return 0;
+        }
+    }
+    
+    function_entry_t *entry = safe_malloc(sizeof(function_entry_t), "define_function: entry");
+    char *name_copy = safe_malloc(strlen(name) + 1, "define_function: name");
+    if (entry == NULL || name_copy == NULL) {
+        free(entry);
+        free(name_copy);
+        free_syntax_tree(tree);
+        return -1;
+    }
+    strcpy(name_copy, name);
+    
+    entry->name = name_copy;
+    entry->body = tree;
+    entry->next = g_functions[bucket];
+    g_functions[bucket] = entry;
+    g_function_count++;
+    return 0;
+}
+
+/**
+ * 查找函数，返回函数体的语法树（未定义时返回NULL）
+ * 调用者执行期间如需保持函数体有效，应增加其引用计数
+ */
+syntax_tree_t* find_function(const char *name) {
+    if (g_function_count == 0 || name == NULL) {
+        return NULL;
+    }
+    
+    for (function_entry_t *entry = g_functions[function_bucket(name)]; entry != NULL; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            return entry->body;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * 删除所有函数定义
+ */
+void clear_functions(void) {
+    for (size_t i = 0; i < FUNCTION_TABLE_SIZE; i++) {
+        function_entry_t *entry = g_functions[i];
+        while (entry != NULL) {
+            function_entry_t *next = entry->next;
+            free_syntax_tree(entry->body);
+            free(entry->name);
+            free(entry);
+            entry = next;
+        }
+        g_functions[i] = NULL;
+    }
+    g_function_count = 0;
+}
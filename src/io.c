@@ -1,20 +1,389 @@
 #include "shell.h"
 
-/* 输入缓冲区管理 */
-static char input_buffer[MAX_INPUT_SIZE];
-static size_t buffer_pos = 0;
+#include <sys/uio.h>
+
+/* 行编辑器的行缓冲区（按需增长，跨提示符复用，不再每次分配） */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    size_t cursor;  /* 光标在行内的位置 */
+} line_buffer_t;
+
+static line_buffer_t g_line = { NULL, 0, 0, 0 };
+
+/* 非交互模式的块读取缓冲区：每次read至少64KB，用memchr切分出行 */
+#define INPUT_BLOCK_SIZE 65536
+
+typedef struct {
+    char *data;
+    size_t cap;
+    size_t start;   /* 下一行的起始位置 */
+    size_t end;     /* 已读入数据的结尾 */
+    int eof;
+} block_reader_t;
+
+static block_reader_t g_block = { NULL, 0, 0, 0, 0 };
+
+/* 终端按键的预读缓冲区（一次read取走所有已到达的字节，粘贴时不逐字节系统调用） */
+static unsigned char g_key_buffer[256];
+static size_t g_key_pos = 0;
+static size_t g_key_len = 0;
+
+/* Shell自有的输出缓冲区（stdout和stderr各一个） */
+typedef struct {
+    int fd;
+    int error;      /* 上次取走以来第一次写出失败的errno，0表示没有 */
+    size_t len;
+    char data[OUTPUT_BUFFER_SIZE];
+} output_buffer_t;
+
+static output_buffer_t g_output_buffers[2] = {
+    { STDOUT_FILENO, 0, 0, {0} },
+    { STDERR_FILENO, 0, 0, {0} }
+};
+
+/* 当前进程中执行的命令替换：写往stdout的内容收集到最内层的捕获缓冲区 */
+static output_capture_t *g_capture = NULL;
+
+/* 当前显示的是否为续行提示符，以及续行时是否按了Ctrl+C */
+static int g_prompt_continuation = 0;
+static int g_input_cancelled = 0;
+
+/* 行编辑器的显示状态：每个字符占一列，超过终端宽度的行由终端自动折行 */
+static size_t g_prompt_width = 0;   /* 提示符占用的列数（不含颜色控制序列） */
+static size_t g_term_cols = 80;
+
+/* isatty结果缓存：-1表示尚未查询 */
+static int g_tty_cache[3] = { -1, -1, -1 };
+
+/**
+ * 查找fd对应的输出缓冲区；不受管理的fd返回NULL
+ */
+static output_buffer_t* get_output_buffer(int fd) {
+    if (fd == STDOUT_FILENO) {
+        return &g_output_buffers[0];
+    }
+    if (fd == STDERR_FILENO) {
+        return &g_output_buffers[1];
+    }
+    return NULL;
+}
+
+/**
+ * 用writev一次写出多个片段，处理部分写入和EINTR
+ */
+static int write_all_vectors(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t written = writev(fd, iov, iovcnt);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (written == 0) {
+            errno = EIO;
+            return -1;
+        }
+        
+        /* 跳过已经完整写出的片段 */
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 写出缓冲区内容以及可选的附加数据（一次writev）
+ * 写出失败时记下errno，由output_take_error取走
+ */
+static void flush_with_payload(output_buffer_t *buf, const char *payload, size_t payload_len) {
+    struct iovec iov[2];
+    int iovcnt = 0;
+    
+    if (buf->len > 0) {
+        iov[iovcnt].iov_base = buf->data;
+        iov[iovcnt].iov_len = buf->len;
+        iovcnt++;
+    }
+    if (payload_len > 0) {
+        iov[iovcnt].iov_base = (void *)payload;
+        iov[iovcnt].iov_len = payload_len;
+        iovcnt++;
+    }
+    buf->len = 0;
+    
+    if (iovcnt == 0) {
+        return;
+    }
+    
+    /* 先排空stdio中残留的数据，保持输出顺序 */
+    fflush(buf->fd == STDOUT_FILENO ? stdout : stderr);
+    if (write_all_vectors(buf->fd, iov, iovcnt) != 0 && buf->error == 0) {
+        buf->error = errno;
+    }
+}
+
+/**
+ * 写入stdout或stderr的缓冲区之前先写出另一个缓冲区中待输出的内容，
+ * 使两者在fd上的顺序与程序中写入的顺序一致
+ */
+static void flush_other_stream(const output_buffer_t *buf) {
+    output_buffer_t *other = (buf == &g_output_buffers[0]) ? &g_output_buffers[1] : &g_output_buffers[0];
+    if (other->len > 0) {
+        flush_with_payload(other, NULL, 0);
+    }
+}
+
+/**
+ * 向捕获缓冲区追加数据（按需增长）
+ */
+static int capture_append(output_capture_t *capture, const char *data, size_t len) {
+    if (capture->len + len + 1 > capture->capacity) {
+        size_t new_capacity = capture->capacity ? capture->capacity * 2 : 256;
+        while (new_capacity < capture->len + len + 1) {
+            new_capacity *= 2;
+        }
+        char *new_data = safe_realloc(capture->data, new_capacity, "output_capture: buffer");
+        if (new_data == NULL) {
+            capture->failed = 1;
+            return -1;
+        }
+        capture->data = new_data;
+        capture->capacity = new_capacity;
+    }
+    memcpy(capture->data + capture->len, data, len);
+    capture->len += len;
+    capture->data[capture->len] = '\0';
+    return 0;
+}
+
+/**
+ * 开始捕获stdout：之后经output_*写往stdout的内容都追加到capture中，不写入fd
+ * 可以嵌套（命令替换中的命令替换），必须与output_capture_end成对调用
+ */
+void output_capture_begin(output_capture_t *capture) {
+    memset(capture, 0, sizeof(*capture));
+    capture->parent = g_capture;
+    g_capture = capture;
+}
+
+/**
+ * 结束最内层的捕获，恢复外层的捕获或真正的stdout；capture->data由调用者用free释放
+ */
+void output_capture_end(output_capture_t *capture) {
+    if (g_capture == capture) {
+        g_capture = capture->parent;
+    }
+}
+
+/**
+ * 丢弃所有捕获状态（fork出的子进程的输出应写入它自己的stdout）
+ */
+void output_capture_detach(void) {
+    g_capture = NULL;
+}
+
+/**
+ * 向fd写入数据（经过Shell的输出缓冲区）
+ */
+void output_write(int fd, const char *data, size_t len) {
+    if (data == NULL || len == 0) {
+        return;
+    }
+    
+    if (fd == STDOUT_FILENO && g_capture != NULL) {
+        capture_append(g_capture, data, len);
+        return;
+    }
+    
+    output_buffer_t *buf = get_output_buffer(fd);
+    if (buf == NULL) {
+        struct iovec iov = { (void *)data, len };
+        write_all_vectors(fd, &iov, 1);
+        return;
+    }
+    
+    flush_other_stream(buf);
+    
+    if (buf->len + len <= OUTPUT_BUFFER_SIZE) {
+        memcpy(buf->data + buf->len, data, len);
+        buf->len += len;
+        return;
+    }
+    
+    /* 放不下：大块数据与缓冲区内容一起writev写出，小块数据则写出缓冲区后再复制 */
+    if (len >= OUTPUT_BUFFER_SIZE / 2) {
+        flush_with_payload(buf, data, len);
+    } else {
+        flush_with_payload(buf, NULL, 0);
+        memcpy(buf->data, data, len);
+        buf->len = len;
+    }
+}
+
+/**
+ * 写入字符串
+ */
+void output_puts(int fd, const char *str) {
+    if (str != NULL) {
+        output_write(fd, str, strlen(str));
+    }
+}
+
+/**
+ * 写入单个字符
+ */
+void output_putc(int fd, char ch) {
+    output_buffer_t *buf = get_output_buffer(fd);
+    if (buf != NULL && buf->len < OUTPUT_BUFFER_SIZE && (fd != STDOUT_FILENO || g_capture == NULL)) {
+        flush_other_stream(buf);
+        buf->data[buf->len++] = ch;
+        return;
+    }
+    output_write(fd, &ch, 1);
+}
+
+/**
+ * 格式化写入（直接格式化到缓冲区的剩余空间中）
+ */
+void output_vprintf(int fd, const char *format, va_list args) {
+    if (format == NULL) {
+        return;
+    }
+    
+    va_list retry;
+    output_buffer_t *buf = get_output_buffer(fd);
+    if (fd == STDOUT_FILENO && g_capture != NULL) {
+        buf = NULL;     /* 捕获时经下面的output_write写入捕获缓冲区 */
+    }
+    
+    if (buf != NULL) {
+        flush_other_stream(buf);
+        size_t space = OUTPUT_BUFFER_SIZE - buf->len;
+        va_copy(retry, args);
+        int needed = vsnprintf(buf->data + buf->len, space, format, retry);
+        va_end(retry);
+        
+        if (needed < 0) {
+            return;
+        }
+        if ((size_t)needed < space) {
+            buf->len += (size_t)needed;
+            return;
+        }
+        
+        /* 剩余空间不够：写出后重新格式化 */
+        output_flush(fd);
+        if ((size_t)needed < OUTPUT_BUFFER_SIZE) {
+            va_copy(retry, args);
+            vsnprintf(buf->data, OUTPUT_BUFFER_SIZE, format, retry);
+            va_end(retry);
+            buf->len = (size_t)needed;
+            return;
+        }
+    }
+    
+    /* 超长内容或不受管理的fd：临时格式化后写出 */
+    char stack_buf[1024];
+    va_copy(retry, args);
+    int needed = vsnprintf(stack_buf, sizeof(stack_buf), format, retry);
+    va_end(retry);
+    if (needed < 0) {
+        return;
+    }
+    if ((size_t)needed < sizeof(stack_buf)) {
+        output_write(fd, stack_buf, (size_t)needed);
+        return;
+    }
+    
+    char *heap_buf = safe_malloc((size_t)needed + 1, "output_vprintf: large message");
+    if (heap_buf == NULL) {
+        return;
+    }
+    vsnprintf(heap_buf, (size_t)needed + 1, format, args);
+    output_write(fd, heap_buf, (size_t)needed);
+    free(heap_buf);
+}
+
+void output_printf(int fd, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    output_vprintf(fd, format, args);
+    va_end(args);
+}
+
+/**
+ * 写出fd的缓冲区
+ */
+void output_flush(int fd) {
+    output_buffer_t *buf = get_output_buffer(fd);
+    if (buf != NULL && buf->len > 0) {
+        flush_with_payload(buf, NULL, 0);
+    }
+}
+
+/**
+ * 写出所有缓冲区（每个命令结束时、fork之前和读取输入之前调用）
+ */
+void output_flush_all(void) {
+    /* 其他代码直接通过stdio写出的内容也一并排空 */
+    fflush(stdout);
+    output_flush(STDOUT_FILENO);
+    output_flush(STDERR_FILENO);
+}
+
+/**
+ * 取走并清除上次调用以来写出stdout或stderr时第一次失败的errno（如EPIPE、ENOSPC），没有失败时返回0
+ */
+int output_take_error(void) {
+    int error = g_output_buffers[0].error ? g_output_buffers[0].error : g_output_buffers[1].error;
+    g_output_buffers[0].error = 0;
+    g_output_buffers[1].error = 0;
+    return error;
+}
+
+/**
+ * 带缓存的isatty：每个fd只查询一次
+ */
+int output_is_tty(int fd) {
+    if (fd < 0 || fd > STDERR_FILENO) {
+        return isatty(fd);
+    }
+    if (g_tty_cache[fd] == -1) {
+        g_tty_cache[fd] = isatty(fd) ? 1 : 0;
+    }
+    return g_tty_cache[fd];
+}
+
+/**
+ * 使isatty缓存失效（标准fd被重新指向时调用）
+ */
+void output_reset_tty_cache(void) {
+    g_tty_cache[0] = g_tty_cache[1] = g_tty_cache[2] = -1;
+}
 
 /**
  * 显示命令提示符
  * 根据用户权限显示不同的提示符样式
  */
 void display_prompt(void) {
-    char *user = getenv("USER");
+    g_prompt_continuation = 0;
+    
+    char *user = get_env_var("USER");
     if (user == NULL) {
         user = "user";
     }
     
-    char *hostname = getenv("HOSTNAME");
+    char *hostname = get_env_var("HOSTNAME");
     if (hostname == NULL) {
         hostname = "localhost";
     }
@@ -36,122 +405,581 @@ void display_prompt(void) {
     /* 检查是否为root用户，显示不同的提示符 */
     char prompt_char = (getuid() == 0) ? '#' : '$';
     
+    /* 行编辑器按提示符的宽度计算折行位置 */
+    int width = snprintf(NULL, 0, "[%s@%s %s]%c ", user, hostname,
+                         basename_dir ? basename_dir : "unknown", prompt_char);
+    g_prompt_width = (width > 0) ? (size_t)width : 0;
+    
     /* 显示彩色提示符（如果终端支持） */
-    if (isatty(STDOUT_FILENO)) {
-        printf("\033[1;32m[%s@%s \033[1;34m%s\033[1;32m]%c\033[0m ", 
-               user, hostname, basename_dir ? basename_dir : "unknown", prompt_char);
+    if (output_is_tty(STDOUT_FILENO)) {
+        output_printf(STDOUT_FILENO, "\033[1;32m[%s@%s \033[1;34m%s\033[1;32m]%c\033[0m ", 
+                      user, hostname, basename_dir ? basename_dir : "unknown", prompt_char);
     } else {
-        printf("[%s@%s %s]%c ", user, hostname, basename_dir ? basename_dir : "unknown", prompt_char);
+        output_printf(STDOUT_FILENO, "[%s@%s %s]%c ", user, hostname,
+                      basename_dir ? basename_dir : "unknown", prompt_char);
     }
     
-    fflush(stdout);
+    /* 读取输入前写出所有待输出内容 */
+    output_flush_all();
 }
 
 /**
- * 验证输入字符是否安全
+ * 显示续行提示符（多行的if、while、引号等尚未结束时）
  */
-static int is_safe_char(char c) {
-    /* 允许可打印字符、空格、制表符 */
-    return (c >= 32 && c <= 126) || c == '\t';
+void display_continuation_prompt(void) {
+    g_prompt_continuation = 1;
+    g_prompt_width = 2;
+    output_puts(STDOUT_FILENO, "> ");
+    output_flush_all();
+}
+
+/**
+ * 重新显示当前的提示符（主提示符或续行提示符）
+ */
+static void redisplay_prompt(void) {
+    if (g_prompt_continuation) {
+        display_continuation_prompt();
+    } else {
+        display_prompt();
+    }
 }
 
 /**
- * 清理输入缓冲区
+ * 上一次read_input是否因Ctrl+C放弃了续行输入（读取后清除标志）
  */
-static void clear_input_buffer(void) {
-    buffer_pos = 0;
-    memset(input_buffer, 0, MAX_INPUT_SIZE);
+int input_cancelled(void) {
+    int cancelled = g_input_cancelled;
+    g_input_cancelled = 0;
+    return cancelled;
+}
+
+/**
+ * 验证输入字符是否安全
+ */
+static int is_safe_char(char c) {
+    /* 允许可打印字符、空格、制表符 */
+    return (c >= 32 && c <= 126) || c == '\t';
 }
 
 /**
  * 验证输入安全性
+ * 单次遍历同时检查不安全字符（包括空字节）和路径穿越模式
  */
-static int validate_input(const char *input) {
+static int validate_input(const char *input, size_t len) {
     if (input == NULL) {
         return 0;
     }
     
-    size_t len = strlen(input);
-    
-    /* 检查输入长度 */
+    /* 行缓冲区按需增长，不限制输入长度 */
     if (len == 0) {
         return 1;  /* 空输入是有效的 */
     }
     
-    if (len >= MAX_INPUT_SIZE - 1) {
-        print_error("Input too long");
-        return 0;
-    }
-    
-    /* 检查是否包含不安全字符 */
+    int traversal = 0;
     for (size_t i = 0; i < len; i++) {
+        if (input[i] == '\0') {
+            print_error("Null byte in input detected");
+            return 0;
+        }
+        
+        /* 检查是否包含不安全字符 */
         if (!is_safe_char(input[i])) {
             print_error("Input contains invalid characters");
             return 0;
         }
+        
+        /* 检查是否包含潜在的注入攻击模式 */
+        if (input[i] == '.' && i + 2 < len && input[i + 1] == '.' && input[i + 2] == '/') {
+            traversal = 1;
+        }
     }
     
-    /* 检查是否包含潜在的注入攻击模式 */
-    if (strstr(input, "../") != NULL) {
+    if (traversal) {
         print_error("Path traversal attempt detected");
         return 0;
     }
     
-    /* 检查是否包含空字节 */
-    if (strlen(input) != len) {
-        print_error("Null byte in input detected");
+    return 1;
+}
+
+/**
+ * 确保行缓冲区至少能容纳needed字节（含结尾的'\0'）
+ */
+static int line_reserve(size_t needed) {
+    if (needed <= g_line.cap) {
         return 0;
     }
     
-    return 1;
+    size_t new_cap = g_line.cap ? g_line.cap : 256;
+    while (new_cap < needed) {
+        new_cap *= 2;
+    }
+    
+    char *new_data = safe_realloc(g_line.data, new_cap, "line_reserve: line buffer");
+    if (new_data == NULL) {
+        return -1;
+    }
+    g_line.data = new_data;
+    g_line.cap = new_cap;
+    return 0;
 }
 
 /**
- * 读取用户输入（带缓冲和验证）
+ * 从终端取一个字节；预读缓冲区为空时一次读入所有可用字节
+ * 行编辑器和read_char_noecho共用这个缓冲区，粘贴的内容不会在两者之间丢失
+ * 返回-1表示EOF或读取错误
  */
-char* read_input(void) {
-    char *input = TRACKED_MALLOC(MAX_INPUT_SIZE, "read_input: input buffer");
-    if (input == NULL) {
-        return NULL;
+static int terminal_read_byte(void) {
+    if (g_key_pos >= g_key_len) {
+        ssize_t n;
+        do {
+            n = read(STDIN_FILENO, g_key_buffer, sizeof(g_key_buffer));
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) {
+            return -1;
+        }
+        g_key_pos = 0;
+        g_key_len = (size_t)n;
+    }
+    return g_key_buffer[g_key_pos++];
+}
+
+/**
+ * 光标在同一屏幕行内左移/右移n列
+ */
+static void editor_move_left(size_t n) {
+    if (n == 1) {
+        output_putc(STDOUT_FILENO, '\b');
+    } else if (n > 1) {
+        output_printf(STDOUT_FILENO, "\033[%zuD", n);
+    }
+}
+
+static void editor_move_right(size_t n) {
+    if (n > 0) {
+        output_printf(STDOUT_FILENO, "\033[%zuC", n);
+    }
+}
+
+/**
+ * 把光标从行内位置from移到to：在同一屏幕行内只做水平移动，
+ * 跨行时先上下移动，再回到行首定位到目标列
+ */
+static void editor_move(size_t from, size_t to) {
+    size_t from_pos = g_prompt_width + from;
+    size_t to_pos = g_prompt_width + to;
+    size_t from_row = from_pos / g_term_cols;
+    size_t to_row = to_pos / g_term_cols;
+    size_t to_col = to_pos % g_term_cols;
+    
+    if (from_row == to_row) {
+        size_t from_col = from_pos % g_term_cols;
+        if (to_col < from_col) {
+            editor_move_left(from_col - to_col);
+        } else {
+            editor_move_right(to_col - from_col);
+        }
+        return;
+    }
+    
+    if (to_row < from_row) {
+        output_printf(STDOUT_FILENO, "\033[%zuA", from_row - to_row);
+    } else {
+        output_printf(STDOUT_FILENO, "\033[%zuB", to_row - from_row);
+    }
+    output_putc(STDOUT_FILENO, '\r');
+    editor_move_right(to_col);
+}
+
+/**
+ * 写出从位置from到行尾的内容，光标停在行尾
+ * 行尾恰好落在终端的最后一列时，终端把光标留在该列等待折行；
+ * 再写一个空格并回到行首，使光标确实位于下一行的开头
+ */
+static void editor_write_tail(size_t from) {
+    size_t i = from;
+    while (i < g_line.len) {
+        /* 制表符显示为一个空格，保持每个字符占一列 */
+        const char *tab = memchr(g_line.data + i, '\t', g_line.len - i);
+        size_t end = (tab != NULL) ? (size_t)(tab - g_line.data) : g_line.len;
+        output_write(STDOUT_FILENO, g_line.data + i, end - i);
+        if (tab != NULL) {
+            output_putc(STDOUT_FILENO, ' ');
+            end++;
+        }
+        i = end;
+    }
+    if (g_line.len > from && (g_prompt_width + g_line.len) % g_term_cols == 0) {
+        output_puts(STDOUT_FILENO, " \r");
+    }
+}
+
+/**
+ * 重绘从光标处到行尾的部分（clear为1时擦除原来更长的内容留下的残余，可能跨越多个屏幕行），
+ * 然后把光标移回原位置；光标之前的内容保持不动
+ */
+static void editor_redraw_tail(int clear) {
+    editor_write_tail(g_line.cursor);
+    if (clear) {
+        output_puts(STDOUT_FILENO, "\033[J");
+    }
+    editor_move(g_line.len, g_line.cursor);
+}
+
+/**
+ * 在光标处插入一个字符（在行尾追加时只回显这一个字符）
+ */
+static int editor_insert(char ch) {
+    if (line_reserve(g_line.len + 2) != 0) {
+        return -1;
+    }
+    
+    memmove(g_line.data + g_line.cursor + 1, g_line.data + g_line.cursor,
+            g_line.len - g_line.cursor);
+    g_line.data[g_line.cursor] = ch;
+    g_line.len++;
+    editor_write_tail(g_line.cursor);
+    g_line.cursor++;
+    editor_move(g_line.len, g_line.cursor);
+    return 0;
+}
+
+/**
+ * 删除[from, to)范围内的字符，光标停在from处
+ */
+static void editor_delete_range(size_t from, size_t to) {
+    if (from >= to) {
+        return;
     }
     
-    /* 清理输入缓冲区 */
-    clear_input_buffer();
+    editor_move(g_line.cursor, from);
+    memmove(g_line.data + from, g_line.data + to, g_line.len - to);
+    g_line.len -= to - from;
+    g_line.cursor = from;
+    editor_redraw_tail(1);
+}
+
+/**
+ * 把光标移到行内位置to
+ */
+static void editor_set_cursor(size_t to) {
+    editor_move(g_line.cursor, to);
+    g_line.cursor = to;
+}
+
+/**
+ * 获取终端宽度（每次读取一行和清屏重绘时更新，窗口大小改变后按新的宽度折行）
+ */
+static void editor_update_width(void) {
+    int cols = 0;
+    get_terminal_size(NULL, &cols);
+    g_term_cols = (cols > 0) ? (size_t)cols : 80;
+}
+
+/**
+ * 处理ESC开头的控制序列（方向键、Home/End、Delete）
+ */
+static void editor_handle_escape(void) {
+    int first = terminal_read_byte();
+    if (first != '[' && first != 'O') {
+        return;
+    }
     
-    /* 读取输入 */
-    if (fgets(input, MAX_INPUT_SIZE, stdin) == NULL) {
-        TRACKED_FREE(input);
-        if (feof(stdin)) {
-            return NULL;  /* EOF */
+    int code = terminal_read_byte();
+    if (code >= '0' && code <= '9') {
+        /* 形如 ESC [ 3 ~ 的扩展序列 */
+        int terminator = terminal_read_byte();
+        if (terminator != '~') {
+            return;
+        }
+        if (code == '3' && g_line.cursor < g_line.len) {
+            editor_delete_range(g_line.cursor, g_line.cursor + 1);
+        } else if (code == '1' || code == '7') {
+            code = 'H';
+        } else if (code == '4' || code == '8') {
+            code = 'F';
         } else {
-            print_error("Failed to read input");
-            return NULL;  /* 读取错误 */
+            return;
+        }
+    }
+    
+    switch (code) {
+        case 'C':  /* 右 */
+            if (g_line.cursor < g_line.len) {
+                editor_set_cursor(g_line.cursor + 1);
+            }
+            break;
+        case 'D':  /* 左 */
+            if (g_line.cursor > 0) {
+                editor_set_cursor(g_line.cursor - 1);
+            }
+            break;
+        case 'H':  /* Home */
+            editor_set_cursor(0);
+            break;
+        case 'F':  /* End */
+            editor_set_cursor(g_line.len);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * 终端下的行编辑器
+ * 关闭规范模式和回显后逐键处理，每次只重绘发生变化的区域
+ * 返回0表示读到一行，-1表示EOF
+ */
+static int read_line_interactive(void) {
+    struct termios old_termios, raw_termios;
+    if (tcgetattr(STDIN_FILENO, &old_termios) != 0) {
+        return -1;
+    }
+    
+    raw_termios = old_termios;
+    raw_termios.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
+    raw_termios.c_iflag &= ~(IXON | ICRNL);
+    raw_termios.c_cc[VMIN] = 1;
+    raw_termios.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &raw_termios) != 0) {
+        return -1;
+    }
+    editor_update_width();
+    
+    int result = 0;
+    int done = 0;
+    while (!done) {
+        int ch = terminal_read_byte();
+        
+        switch (ch) {
+            case -1:
+                result = -1;
+                done = 1;
+                break;
+            
+            case '\r':
+            case '\n':
+                /* 换行写在输入的最后一行之后 */
+                editor_move(g_line.cursor, g_line.len);
+                output_putc(STDOUT_FILENO, '\n');
+                done = 1;
+                break;
+            
+            case 4:    /* Ctrl+D：空行时表示EOF，否则删除光标处字符 */
+                if (g_line.len == 0) {
+                    result = -1;
+                    done = 1;
+                } else if (g_line.cursor < g_line.len) {
+                    editor_delete_range(g_line.cursor, g_line.cursor + 1);
+                }
+                break;
+            
+            case 3:    /* Ctrl+C：放弃当前行，重新显示提示符；续行时放弃整个多行输入 */
+                editor_move(g_line.cursor, g_line.len);
+                output_puts(STDOUT_FILENO, "^C\n");
+                g_line.len = 0;
+                g_line.cursor = 0;
+                if (g_prompt_continuation) {
+                    g_input_cancelled = 1;
+                    done = 1;
+                } else {
+                    display_prompt();
+                }
+                break;
+            
+            case 127:  /* Backspace */
+            case 8:    /* Ctrl+H */
+                if (g_line.cursor > 0) {
+                    editor_delete_range(g_line.cursor - 1, g_line.cursor);
+                }
+                break;
+            
+            case 1:    /* Ctrl+A：行首 */
+                editor_set_cursor(0);
+                break;
+            
+            case 5:    /* Ctrl+E：行尾 */
+                editor_set_cursor(g_line.len);
+                break;
+            
+            case 2:    /* Ctrl+B：左移 */
+                if (g_line.cursor > 0) {
+                    editor_set_cursor(g_line.cursor - 1);
+                }
+                break;
+            
+            case 6:    /* Ctrl+F：右移 */
+                if (g_line.cursor < g_line.len) {
+                    editor_set_cursor(g_line.cursor + 1);
+                }
+                break;
+            
+            case 11:   /* Ctrl+K：删除到行尾（可能跨越多个屏幕行） */
+                if (g_line.cursor < g_line.len) {
+                    g_line.len = g_line.cursor;
+                    output_puts(STDOUT_FILENO, "\033[J");
+                }
+                break;
+            
+            case 21:   /* Ctrl+U：删除到行首 */
+                editor_delete_range(0, g_line.cursor);
+                break;
+            
+            case 12:   /* Ctrl+L：清屏后完整重绘一次 */
+                clear_screen();
+                editor_update_width();
+                redisplay_prompt();
+                editor_write_tail(0);
+                editor_move(g_line.len, g_line.cursor);
+                break;
+            
+            case '\t':  /* 没有自动补全，制表符作为普通字符插入 */
+                editor_insert('\t');
+                break;
+            
+            case 27:   /* ESC控制序列 */
+                editor_handle_escape();
+                break;
+            
+            default:
+                if (ch >= 32) {
+                    editor_insert((char)ch);
+                }
+                break;
+        }
+        
+        /* 预读的按键处理完后才写出，粘贴多个字符时合并为一次写 */
+        if (done || g_key_pos >= g_key_len) {
+            output_flush(STDOUT_FILENO);
         }
     }
     
-    /* 移除换行符 */
-    size_t len = strlen(input);
-    if (len > 0 && input[len - 1] == '\n') {
-        input[len - 1] = '\0';
-        len--;
+    tcsetattr(STDIN_FILENO, TCSANOW, &old_termios);
+    return result;
+}
+
+/**
+ * 非交互模式读取一行
+ * 一次读入一大块数据，用memchr逐行切分并原地写入'\0'，行内容不再复制；
+ * 跨越块边界的行会先移到缓冲区开头，必要时扩大缓冲区后继续读取
+ * 返回0表示读到一行，-1表示EOF或读取错误
+ */
+static int read_line_batch(char **line, size_t *len) {
+    for (;;) {
+        size_t available = g_block.end - g_block.start;
+        char *begin = g_block.data + g_block.start;
+        char *newline = available ? memchr(begin, '\n', available) : NULL;
+        
+        if (newline != NULL) {
+            *newline = '\0';
+            *line = begin;
+            *len = (size_t)(newline - begin);
+            g_block.start += *len + 1;
+            return 0;
+        }
+        
+        if (g_block.eof) {
+            if (available == 0) {
+                /* EOF不保留：stdin被替换（或终端上再次输入）后可以继续读取 */
+                g_block.eof = 0;
+                return -1;
+            }
+            /* 最后一行没有换行符；每次read都在结尾预留了一个字节 */
+            begin[available] = '\0';
+            *line = begin;
+            *len = available;
+            g_block.start = g_block.end;
+            return 0;
+        }
+        
+        /* 把未完成的行移到缓冲区开头 */
+        if (g_block.start > 0) {
+            memmove(g_block.data, begin, available);
+            g_block.start = 0;
+            g_block.end = available;
+        }
+        
+        /* 保证至少能再读一整块，并为结尾的'\0'留出空间 */
+        if (g_block.cap - g_block.end < INPUT_BLOCK_SIZE + 1) {
+            size_t new_cap = g_block.cap ? g_block.cap * 2 : INPUT_BLOCK_SIZE + 1;
+            while (new_cap - g_block.end < INPUT_BLOCK_SIZE + 1) {
+                new_cap *= 2;
+            }
+            char *new_data = safe_realloc(g_block.data, new_cap, "read_line_batch: block buffer");
+            if (new_data == NULL) {
+                return -1;
+            }
+            g_block.data = new_data;
+            g_block.cap = new_cap;
+        }
+        
+        ssize_t n;
+        do {
+            n = read(STDIN_FILENO, g_block.data + g_block.end, g_block.cap - g_block.end - 1);
+        } while (n < 0 && errno == EINTR);
+        
+        if (n < 0) {
+            print_error("Failed to read input");
+            return -1;
+        }
+        if (n == 0) {
+            g_block.eof = 1;
+        }
+        g_block.end += (size_t)n;
+    }
+}
+
+/**
+ * 把预读但尚未执行的输入归还给stdin
+ * 在启动可能读取stdin的子进程前调用：stdin可以lseek（普通文件）时回退文件偏移，
+ * 使子进程从下一条命令处开始读取；管道无法回退，保持原样
+ */
+void input_sync_stdin(void) {
+    size_t unread = g_block.end - g_block.start;
+    if (unread == 0) {
+        return;
     }
     
-    /* 验证输入安全性 */
-    if (!validate_input(input)) {
-        TRACKED_FREE(input);
-        return NULL;
+    if (lseek(STDIN_FILENO, -(off_t)unread, SEEK_CUR) != (off_t)-1) {
+        g_block.start = 0;
+        g_block.end = 0;
+        g_block.eof = 0;
     }
+}
+
+/**
+ * 读取用户输入
+ * 交互模式使用行编辑器并验证输入；否则按块读取，与脚本文件和-c一样不做验证
+ * （不限制行长，允许非ASCII字符和../）
+ * 返回的字符串属于io.c的缓冲区，在下一次调用read_input前有效，调用者不应释放
+ */
+char* read_input(void) {
+    char *line;
+    size_t len;
     
-    /* 如果输入过长，清理stdin缓冲区 */
-    if (len == MAX_INPUT_SIZE - 2) {
-        int c;
-        while ((c = getchar()) != '\n' && c != EOF) {
-            /* 丢弃剩余字符 */
+    if (g_shell_state.interactive) {
+        if (line_reserve(MAX_INPUT_SIZE) != 0) {
+            return NULL;
+        }
+        g_line.len = 0;
+        g_line.cursor = 0;
+        
+        if (read_line_interactive() != 0) {
+            return NULL;  /* EOF (Ctrl+D) 或读取错误 */
+        }
+        g_line.data[g_line.len] = '\0';
+        line = g_line.data;
+        len = g_line.len;
+        
+        /* 验证交互输入的安全性 */
+        if (!validate_input(line, len)) {
+            line[0] = '\0';
         }
-        print_error("Input truncated due to length limit");
+    } else if (read_line_batch(&line, &len) != 0) {
+        return NULL;  /* EOF 或读取错误 */
     }
     
-    return input;
+    return line;
 }
 
 /**
@@ -163,13 +991,13 @@ void print_error(char *message) {
     }
     
     /* 使用红色文本显示错误（如果终端支持） */
-    if (isatty(STDERR_FILENO)) {
-        fprintf(stderr, "\033[1;31mError:\033[0m %s\n", message);
+    if (output_is_tty(STDERR_FILENO)) {
+        output_puts(STDERR_FILENO, "\033[1;31mError:\033[0m ");
     } else {
-        fprintf(stderr, "Error: %s\n", message);
+        output_puts(STDERR_FILENO, "Error: ");
     }
-    
-    fflush(stderr);
+    output_puts(STDERR_FILENO, message);
+    output_putc(STDERR_FILENO, '\n');
 }
 
 /**
@@ -180,8 +1008,8 @@ void print_output(char *message) {
         return;
     }
     
-    printf("%s\n", message);
-    fflush(stdout);
+    output_puts(STDOUT_FILENO, message);
+    output_putc(STDOUT_FILENO, '\n');
 }
 
 /**
@@ -193,13 +1021,13 @@ void print_warning(char *message) {
     }
     
     /* 使用黄色文本显示警告（如果终端支持） */
-    if (isatty(STDERR_FILENO)) {
-        fprintf(stderr, "\033[1;33mWarning:\033[0m %s\n", message);
+    if (output_is_tty(STDERR_FILENO)) {
+        output_puts(STDERR_FILENO, "\033[1;33mWarning:\033[0m ");
     } else {
-        fprintf(stderr, "Warning: %s\n", message);
+        output_puts(STDERR_FILENO, "Warning: ");
     }
-    
-    fflush(stderr);
+    output_puts(STDERR_FILENO, message);
+    output_putc(STDERR_FILENO, '\n');
 }
 
 /**
@@ -211,13 +1039,12 @@ void print_success(char *message) {
     }
     
     /* 使用绿色文本显示成功信息（如果终端支持） */
-    if (isatty(STDOUT_FILENO)) {
-        printf("\033[1;32m%s\033[0m\n", message);
+    if (output_is_tty(STDOUT_FILENO)) {
+        output_printf(STDOUT_FILENO, "\033[1;32m%s\033[0m\n", message);
     } else {
-        printf("%s\n", message);
+        output_puts(STDOUT_FILENO, message);
+        output_putc(STDOUT_FILENO, '\n');
     }
-    
-    fflush(stdout);
 }
 
 /**
@@ -230,10 +1057,8 @@ void print_formatted(const char *format, ...) {
     
     va_list args;
     va_start(args, format);
-    vprintf(format, args);
+    output_vprintf(STDOUT_FILENO, format, args);
     va_end(args);
-    
-    fflush(stdout);
 }
 
 /**
@@ -244,33 +1069,34 @@ void print_safe(const char *str) {
         return;
     }
     
-    /* 使用%s格式化字符串，防止格式字符串攻击 */
-    printf("%s", str);
-    fflush(stdout);
+    /* 原样写入，不经过格式化 */
+    output_puts(STDOUT_FILENO, str);
 }
 
 /**
  * 读取单个字符（无回显）
+ * 与行编辑器共用预读缓冲区，已经读入的按键不会丢失
  */
 int read_char_noecho(void) {
     struct termios old_termios, new_termios;
-    int ch;
     
     /* 获取当前终端设置 */
     if (tcgetattr(STDIN_FILENO, &old_termios) != 0) {
         return -1;
     }
     
-    /* 设置新的终端模式（无回显，无缓冲） */
+    /* 设置新的终端模式（无回显，无缓冲，至少读到一个字节） */
     new_termios = old_termios;
     new_termios.c_lflag &= ~(ECHO | ICANON);
+    new_termios.c_cc[VMIN] = 1;
+    new_termios.c_cc[VTIME] = 0;
     
     if (tcsetattr(STDIN_FILENO, TCSANOW, &new_termios) != 0) {
         return -1;
     }
     
     /* 读取字符 */
-    ch = getchar();
+    int ch = terminal_read_byte();
     
     /* 恢复原始终端设置 */
     tcsetattr(STDIN_FILENO, TCSANOW, &old_termios);
@@ -286,11 +1112,11 @@ int confirm_action(const char *message) {
         return 0;
     }
     
-    printf("%s (y/n): ", message);
-    fflush(stdout);
+    output_printf(STDOUT_FILENO, "%s (y/n): ", message);
+    output_flush_all();
     
     int ch = read_char_noecho();
-    printf("%c\n", ch);  /* 显示用户输入的字符 */
+    output_printf(STDOUT_FILENO, "%c\n", ch);  /* 显示用户输入的字符 */
     
     return (ch == 'y' || ch == 'Y');
 }
@@ -299,24 +1125,24 @@ int confirm_action(const char *message) {
  * 清屏函数
  */
 void clear_screen(void) {
-    if (isatty(STDOUT_FILENO)) {
-        printf("\033[2J\033[H");  /* ANSI转义序列清屏 */
+    if (output_is_tty(STDOUT_FILENO)) {
+        output_puts(STDOUT_FILENO, "\033[2J\033[H");  /* ANSI转义序列清屏 */
     } else {
         /* 如果不是终端，输出换行符 */
         for (int i = 0; i < 50; i++) {
-            printf("\n");
+            output_putc(STDOUT_FILENO, '\n');
         }
     }
-    fflush(stdout);
+    output_flush(STDOUT_FILENO);
 }
 
 /**
  * 设置光标位置
  */
 void set_cursor_position(int row, int col) {
-    if (isatty(STDOUT_FILENO)) {
-        printf("\033[%d;%dH", row, col);
-        fflush(stdout);
+    if (output_is_tty(STDOUT_FILENO)) {
+        output_printf(STDOUT_FILENO, "\033[%d;%dH", row, col);
+        output_flush(STDOUT_FILENO);
     }
 }
 
@@ -350,9 +1176,8 @@ void print_separator(char ch, int length) {
     }
     
     for (int i = 0; i < length; i++) {
-        putchar(ch);
+        output_putc(STDOUT_FILENO, ch);
     }
-    putchar('\n');
-    fflush(stdout);
+    output_putc(STDOUT_FILENO, '\n');
 }
 /* End of io.c */
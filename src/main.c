@@ -3,18 +3,73 @@
 /* 全局Shell状态 */
 shell_state_t g_shell_state;
 
+/* 命令行选项 */
+static int g_opt_read_stdin = 0;  /* -s：从标准输入读取命令，不显示提示符 */
+static char *g_opt_script = NULL; /* 要执行的脚本文件 */
+static char *g_opt_command = NULL; /* -c：要执行的命令字符串 */
+
+/**
+ * 解析命令行选项
+ * 用法：myshell [-s] [参数...]、myshell 脚本文件 [参数...] 或 myshell -c 命令 [$0 [参数...]]
+ * 返回0表示成功，-1表示存在无效选项
+ */
+static int parse_options(int argc, char *argv[]) {
+    int i = 1;
+    for (; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--") == 0) {
+            i++;
+            break;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            g_opt_read_stdin = 1;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "myshell: -c: option requires an argument\n");
+                return -1;
+            }
+            g_opt_command = argv[++i];
+        } else {
+            fprintf(stderr, "myshell: invalid option: %s\n", argv[i]);
+            fprintf(stderr, "Usage: myshell [-s] [args...] | myshell script [args...] | myshell -c command [name [args...]]\n");
+            return -1;
+        }
+    }
+    
+    if (g_opt_command != NULL) {
+        /* -c之后的第一个参数是$0，其余参数成为$1..$N */
+        char *name = (i < argc) ? argv[i++] : NULL;
+        set_positional_params(name, argc - i, &argv[i]);
+        return 0;
+    }
+    
+    /* 没有-s时，第一个非选项参数是脚本文件，其余参数成为$1..$N */
+    if (!g_opt_read_stdin && i < argc) {
+        g_opt_script = argv[i++];
+    }
+    set_positional_params(g_opt_script, argc - i, &argv[i]);
+    return 0;
+}
+
 /**
  * 主程序入口点
  */
 int main(int argc, char *argv[]) {
-    (void)argc;  /* 避免未使用参数警告 */
-    (void)argv;
+    if (parse_options(argc, argv) != 0) {
+        return 2;
+    }
     
     /* 初始化Shell */
     shell_init();
     
-    /* 启动主循环 */
-    main_loop();
+    if (g_opt_command != NULL) {
+        /* 执行命令字符串（最后一条外部命令直接exec） */
+        run_command_string(g_opt_command);
+    } else if (g_opt_script != NULL) {
+        /* 执行脚本文件 */
+        run_script_file(g_opt_script);
+    } else {
+        /* 启动主循环 */
+        main_loop();
+    }
     
     /* 清理资源 */
     shell_cleanup();
@@ -29,9 +84,10 @@ void handle_sigint(int sig) {
     (void)sig;  /* 避免未使用参数警告 */
     
     /* 如果在主循环中，显示新的提示符 */
-    printf("\n");
-    display_prompt();
-    fflush(stdout);
+    if (g_shell_state.interactive) {
+        output_putc(STDOUT_FILENO, '\n');
+        display_prompt();
+    }
 }
 
 /**
@@ -41,9 +97,10 @@ void handle_sigquit(int sig) {
     (void)sig;  /* 避免未使用参数警告 */
     
     /* 忽略SIGQUIT，不退出Shell */
-    printf("\nUse 'exit' to quit the shell.\n");
-    display_prompt();
-    fflush(stdout);
+    if (g_shell_state.interactive) {
+        output_puts(STDOUT_FILENO, "\nUse 'exit' to quit the shell.\n");
+        display_prompt();
+    }
 }
 
 /**
@@ -78,6 +135,15 @@ void setup_signal_handlers(void) {
  * 初始化Shell环境
  */
 void shell_init(void) {
+    /* stdin不是终端、指定了-s/-c或执行脚本时进入批处理模式：不显示提示符，按块读取输入 */
+    g_shell_state.interactive = !g_opt_read_stdin && g_opt_script == NULL &&
+                                g_opt_command == NULL && isatty(STDIN_FILENO);
+    
+    /* 非交互模式只记录警告及以上级别的日志，正常运行时不会打开日志文件 */
+    if (!g_shell_state.interactive) {
+        set_log_threshold(LOG_LEVEL_WARNING);
+    }
+    
     /* 初始化错误处理系统 */
     init_error_system();
     
@@ -86,6 +152,9 @@ void shell_init(void) {
     g_shell_state.env_vars = NULL;
     g_shell_state.last_exit_status = 0;
     g_shell_state.running = 1;
+    g_shell_state.shell_pid = getpid();
+    g_shell_state.last_background_pid = 0;
+    g_shell_state.glob_options = GLOB_OPT_GLOBSTAR;
     
     /* 获取当前工作目录 */
     char *cwd = getcwd(NULL, 0);
@@ -112,15 +181,50 @@ void shell_init(void) {
         }
     }
     
-    /* 初始化环境变量 */
-    init_environment();
+    /* 环境变量在第一次访问时才导入（见environment.c） */
     
-    /* 设置信号处理 */
-    setup_signal_handlers();
+    if (g_shell_state.interactive) {
+        /* 只有交互模式需要拦截Ctrl+C等信号，批处理模式保持默认行为 */
+        setup_signal_handlers();
+        
+        output_puts(STDOUT_FILENO, "MyShell v1.0 - Linux Shell Interpreter\n");
+        output_puts(STDOUT_FILENO, "Type 'exit' to quit.\n");
+        output_puts(STDOUT_FILENO, "Press Ctrl+C to interrupt, Ctrl+D to exit.\n\n");
+    }
+}
+
+/* 跨行输入（未完成的if、while、引号等）的累积缓冲区 */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} pending_input_t;
+
+/**
+ * 把一行追加到累积缓冲区（行之间用换行连接）
+ */
+static int append_pending(pending_input_t *pending, const char *line, size_t len) {
+    size_t needed = pending->len + len + 2;
+    if (needed > pending->cap) {
+        size_t new_cap = pending->cap ? pending->cap * 2 : 256;
+        while (new_cap < needed) {
+            new_cap *= 2;
+        }
+        char *new_data = safe_realloc(pending->data, new_cap, "append_pending: buffer");
+        if (new_data == NULL) {
+            return -1;
+        }
+        pending->data = new_data;
+        pending->cap = new_cap;
+    }
     
-    printf("MyShell v1.0 - Linux Shell Interpreter\n");
-    printf("Type 'exit' to quit.\n");
-    printf("Press Ctrl+C to interrupt, Ctrl+D to exit.\n\n");
+    if (pending->len > 0) {
+        pending->data[pending->len++] = '\n';
+    }
+    memcpy(pending->data + pending->len, line, len);
+    pending->len += len;
+    pending->data[pending->len] = '\0';
+    return 0;
 }
 
 /**
@@ -128,48 +232,86 @@ void shell_init(void) {
  */
 void main_loop(void) {
     char *input;
-    command_t *cmd;
+    syntax_tree_t *tree;
+    pending_input_t pending = { NULL, 0, 0 };
     
     while (g_shell_state.running) {
-        /* 显示提示符 */
-        display_prompt();
+        /* 显示提示符（批处理模式下不显示）；跨行输入时显示续行提示符 */
+        if (g_shell_state.interactive) {
+            if (pending.len > 0) {
+                display_continuation_prompt();
+            } else {
+                display_prompt();
+            }
+        }
         
         /* 读取用户输入 */
         input = read_input();
         if (input == NULL) {
             /* EOF (Ctrl+D) 或读取错误 */
-            printf("\n");
+            if (pending.len > 0) {
+                print_error("syntax error: unexpected end of file");
+                g_shell_state.last_exit_status = 2;
+                if (g_shell_state.interactive) {
+                    /* 交互模式下Ctrl+D只放弃未完成的多行输入 */
+                    output_putc(STDOUT_FILENO, '\n');
+                    pending.len = 0;
+                    continue;
+                }
+            }
+            if (g_shell_state.interactive) {
+                output_putc(STDOUT_FILENO, '\n');
+            }
             break;
         }
         
+        /* Ctrl+C放弃尚未完成的多行输入 */
+        if (input_cancelled()) {
+            pending.len = 0;
+            continue;
+        }
+        
         /* 跳过空输入 */
-        if (strlen(input) == 0) {
-            TRACKED_FREE(input);
+        if (input[0] == '\0' && pending.len == 0) {
             continue;
         }
         
-        /* 解析命令 */
-        cmd = parse_command(input);
-        if (cmd == NULL) {
-            /* 解析错误，显示错误信息并继续 */
-            print_error("Invalid command syntax");
-            TRACKED_FREE(input);
+        const char *text = input;
+        size_t len = strlen(input);
+        if (pending.len > 0) {
+            if (append_pending(&pending, input, len) != 0) {
+                pending.len = 0;
+                continue;
+            }
+            text = pending.data;
+            len = pending.len;
+        }
+        
+        /* 解析命令（重复的行直接使用缓存的语法树；语法错误已由解析器报告） */
+        int incomplete;
+        tree = parse_line_cached(text, len, &incomplete);
+        if (tree == NULL) {
+            if (incomplete) {
+                /* 结构尚未结束，继续读取下一行 */
+                if (pending.len == 0 && append_pending(&pending, input, len) != 0) {
+                    pending.len = 0;
+                }
+                continue;
+            }
+            pending.len = 0;
+            g_shell_state.last_exit_status = 2;
             continue;
         }
+        pending.len = 0;
         
         /* 执行命令 */
-        if (is_builtin(cmd->command)) {
-            /* 对于内部命令，传递参数时跳过命令名 */
-            char **builtin_args = (cmd->argc > 1) ? &cmd->args[1] : NULL;
-            g_shell_state.last_exit_status = execute_builtin(cmd->command, builtin_args);
-        } else {
-            g_shell_state.last_exit_status = execute_external(cmd->command, cmd->args);
-        }
+        execute_tree(tree->root);
         
         /* 清理资源 */
-        free_command(cmd);
-        TRACKED_FREE(input);
+        free_syntax_tree(tree);
     }
+    
+    free(pending.data);
 }
 
 /**
@@ -187,13 +329,18 @@ void shell_cleanup(void) {
     /* 释放环境变量链表 */
     cleanup_environment();
     
-    /* 打印内存统计信息 */
-    if (is_memory_tracking_enabled()) {
-        print_memory_stats();
-    }
+    /* 释放缓存的语法树和函数定义 */
+    clear_parse_cache();
+    clear_functions();
+    clear_arith_cache();
+    clear_glob_cache();
     
+    /* 内存统计信息由cleanup_error_system在清理内存跟踪时打印 */
     /* 清理错误处理系统（包括内存跟踪） */
     cleanup_error_system();
     
-    printf("Shell exited.\n");
+    if (g_shell_state.interactive) {
+        output_puts(STDOUT_FILENO, "Shell exited.\n");
+    }
+    output_flush_all();
 }
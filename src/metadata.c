@@ -0,0 +1,384 @@
+#include "shell.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+/* 元数据批量获取的调度参数 */
+#define META_RING_ENTRIES 128       /* io_uring队列深度 */
+#define META_MAX_THREADS 8          /* 线程池最大线程数 */
+#define META_ENTRIES_PER_THREAD 16  /* 每个线程至少分摊的条目数 */
+
+/**
+ * 将struct statx转换为struct stat
+ */
+static void statx_to_stat(const struct statx *stx, struct stat *st) {
+    memset(st, 0, sizeof(*st));
+    st->st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+    st->st_ino = stx->stx_ino;
+    st->st_mode = stx->stx_mode;
+    st->st_nlink = stx->stx_nlink;
+    st->st_uid = stx->stx_uid;
+    st->st_gid = stx->stx_gid;
+    st->st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor);
+    st->st_size = (off_t)stx->stx_size;
+    st->st_blksize = stx->stx_blksize;
+    st->st_blocks = (blkcnt_t)stx->stx_blocks;
+    st->st_atim.tv_sec = stx->stx_atime.tv_sec;
+    st->st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+    st->st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+    st->st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+    st->st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+    st->st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+}
+
+/**
+ * 顺序获取单个条目的元数据
+ */
+static void fetch_one(int dirfd, meta_request_t *req, int flags) {
+    if (fstatat(dirfd, req->name, &req->st, flags) == 0) {
+        req->error = 0;
+    } else {
+        req->error = errno;
+    }
+}
+
+#ifdef HAVE_IO_URING
+
+/* io_uring实例（进程内只建立一次，后续调用复用） */
+typedef struct {
+    int fd;
+    unsigned entries;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+} meta_ring_t;
+
+static meta_ring_t g_ring = { -1, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+                              NULL, NULL, NULL, NULL, 0, 0 };
+static int g_ring_unavailable = 0;
+
+/**
+ * 建立io_uring实例
+ * 内核不支持或被seccomp禁止时返回-1，之后不再尝试
+ */
+static int ring_init(void) {
+    if (g_ring_unavailable) {
+        return -1;
+    }
+    if (g_ring.fd >= 0) {
+        return 0;
+    }
+    
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    
+    int fd = (int)syscall(__NR_io_uring_setup, META_RING_ENTRIES, &params);
+    if (fd < 0) {
+        g_ring_unavailable = 1;
+        return -1;
+    }
+    
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && cq_size > sq_size) {
+        sq_size = cq_size;
+    }
+    
+    void *sq_ring = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        close(fd);
+        g_ring_unavailable = 1;
+        return -1;
+    }
+    
+    void *cq_ring = sq_ring;
+    if (!single_mmap) {
+        cq_ring = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            munmap(sq_ring, sq_size);
+            close(fd);
+            g_ring_unavailable = 1;
+            return -1;
+        }
+    }
+    
+    size_t sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        if (!single_mmap) {
+            munmap(cq_ring, cq_size);
+        }
+        munmap(sq_ring, sq_size);
+        close(fd);
+        g_ring_unavailable = 1;
+        return -1;
+    }
+    
+    char *sq = sq_ring;
+    char *cq = cq_ring;
+    g_ring.fd = fd;
+    g_ring.entries = params.sq_entries;
+    g_ring.sq_head = (unsigned *)(sq + params.sq_off.head);
+    g_ring.sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    g_ring.sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    g_ring.sq_array = (unsigned *)(sq + params.sq_off.array);
+    g_ring.cq_head = (unsigned *)(cq + params.cq_off.head);
+    g_ring.cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    g_ring.cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    g_ring.cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    g_ring.sqes = sqes;
+    g_ring.sq_ring = sq_ring;
+    g_ring.cq_ring = single_mmap ? NULL : cq_ring;
+    g_ring.sq_ring_size = sq_size;
+    g_ring.cq_ring_size = cq_size;
+    
+    return 0;
+}
+
+/**
+ * 收割完成队列中已有的全部事件，结果写回对应的请求，返回收割的个数
+ */
+static unsigned ring_reap(int dirfd, meta_request_t *reqs, const struct statx *buffers, int flags,
+                          int *unsupported) {
+    unsigned reaped = 0;
+    unsigned head = *g_ring.cq_head;
+    unsigned cq_tail = __atomic_load_n(g_ring.cq_tail, __ATOMIC_ACQUIRE);
+    while (head != cq_tail) {
+        struct io_uring_cqe *cqe = &g_ring.cqes[head & *g_ring.cq_mask];
+        size_t i = (size_t)cqe->user_data;
+        if (cqe->res == 0) {
+            statx_to_stat(&buffers[i], &reqs[i].st);
+            reqs[i].error = 0;
+        } else if (cqe->res == -EINVAL || cqe->res == -EOPNOTSUPP) {
+            /* 旧内核不认识IORING_OP_STATX，改为同步获取 */
+            *unsupported = 1;
+            fetch_one(dirfd, &reqs[i], flags);
+        } else {
+            reqs[i].error = -cqe->res;
+        }
+        head++;
+        reaped++;
+    }
+    __atomic_store_n(g_ring.cq_head, head, __ATOMIC_RELEASE);
+    return reaped;
+}
+
+/**
+ * 通过io_uring并发提交IORING_OP_STATX请求
+ * 返回0表示所有条目都已处理；返回-1表示应回退到其他方式（此时没有请求留在内核中）
+ */
+static int fetch_with_ring(int dirfd, meta_request_t *reqs, size_t count, int flags) {
+    if (ring_init() != 0) {
+        return -1;
+    }
+    
+    struct statx *buffers = safe_malloc(count * sizeof(struct statx), "fetch_with_ring: statx buffers");
+    if (buffers == NULL) {
+        return -1;
+    }
+    
+    size_t submitted = 0;
+    size_t completed = 0;
+    unsigned in_flight = 0;
+    int unsupported = 0;
+    
+    while (completed < count) {
+        /* 填满提交队列 */
+        unsigned tail = *g_ring.sq_tail;
+        unsigned to_submit = 0;
+        while (submitted < count && in_flight + to_submit < g_ring.entries) {
+            unsigned index = tail & *g_ring.sq_mask;
+            struct io_uring_sqe *sqe = &g_ring.sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_STATX;
+            sqe->fd = dirfd;
+            sqe->addr = (__u64)(uintptr_t)reqs[submitted].name;
+            sqe->len = STATX_BASIC_STATS;
+            sqe->off = (__u64)(uintptr_t)&buffers[submitted];
+            sqe->statx_flags = (unsigned)flags;
+            sqe->user_data = submitted;
+            g_ring.sq_array[index] = index;
+            tail++;
+            submitted++;
+            to_submit++;
+        }
+        __atomic_store_n(g_ring.sq_tail, tail, __ATOMIC_RELEASE);
+        
+        /* 提交并等待至少一个完成事件 */
+        long ret;
+        do {
+            ret = syscall(__NR_io_uring_enter, g_ring.fd, to_submit, 1,
+                          IORING_ENTER_GETEVENTS, NULL, 0);
+        } while (ret < 0 && errno == EINTR);
+        
+        /* 内核没有取走的SQE（出错或只提交了一部分）从队列中撤回，之后重新准备；
+           没有SQPOLL线程，内核只在io_uring_enter中读取提交队列，撤回是安全的 */
+        unsigned accepted = (ret > 0) ? (unsigned)ret : 0;
+        unsigned leftover = to_submit - accepted;
+        if (leftover > 0) {
+            __atomic_store_n(g_ring.sq_tail, tail - leftover, __ATOMIC_RELEASE);
+            submitted -= leftover;
+        }
+        in_flight += accepted;
+        
+        if (ret < 0) {
+            /* 整体回退：先等内核中的请求全部完成，之后才能释放它们写入的缓冲区 */
+            int error = errno;
+            while (in_flight > 0) {
+                if (syscall(__NR_io_uring_enter, g_ring.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+                    errno != EINTR) {
+                    /* 无法等待时完成事件仍会由内核写入，让出CPU后再检查 */
+                    sched_yield();
+                }
+                in_flight -= ring_reap(dirfd, reqs, buffers, flags, &unsupported);
+            }
+            free(buffers);
+            /* 资源暂时不足时环仍可继续使用，其他错误不再使用io_uring */
+            if (error != EAGAIN && error != EBUSY && error != ENOMEM) {
+                g_ring_unavailable = 1;
+            }
+            return -1;
+        }
+        if (leftover > 0 && in_flight == 0) {
+            /* 一个请求也提交不进去：剩下的请求同步获取 */
+            for (size_t i = submitted; i < count; i++) {
+                fetch_one(dirfd, &reqs[i], flags);
+            }
+            completed += count - submitted;
+            submitted = count;
+        } else if (leftover > 0) {
+            /* 部分提交时内核不等待完成事件，这里等待一个，避免空转 */
+            do {
+                ret = syscall(__NR_io_uring_enter, g_ring.fd, 0, 1,
+                              IORING_ENTER_GETEVENTS, NULL, 0);
+            } while (ret < 0 && errno == EINTR);
+        }
+        
+        /* 收割完成队列 */
+        unsigned reaped = ring_reap(dirfd, reqs, buffers, flags, &unsupported);
+        completed += reaped;
+        in_flight -= reaped;
+    }
+    
+    if (unsupported) {
+        g_ring_unavailable = 1;
+    }
+    
+    free(buffers);
+    return 0;
+}
+
+#endif /* HAVE_IO_URING */
+
+/* 线程池共享的工作队列 */
+typedef struct {
+    int dirfd;
+    int flags;
+    meta_request_t *reqs;
+    size_t count;
+    size_t next;
+    pthread_mutex_t lock;
+} meta_queue_t;
+
+/**
+ * 线程池工作函数：从共享队列中依次领取条目
+ */
+static void* meta_worker(void *arg) {
+    meta_queue_t *queue = arg;
+    
+    for (;;) {
+        pthread_mutex_lock(&queue->lock);
+        size_t i = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+        
+        if (i >= queue->count) {
+            break;
+        }
+        fetch_one(queue->dirfd, &queue->reqs[i], queue->flags);
+    }
+    return NULL;
+}
+
+/**
+ * 通过小型线程池并发执行fstatat
+ */
+static void fetch_with_threads(int dirfd, meta_request_t *reqs, size_t count, int flags) {
+    size_t thread_count = (count + META_ENTRIES_PER_THREAD - 1) / META_ENTRIES_PER_THREAD;
+    if (thread_count > META_MAX_THREADS) {
+        thread_count = META_MAX_THREADS;
+    }
+    
+    meta_queue_t queue;
+    queue.dirfd = dirfd;
+    queue.flags = flags;
+    queue.reqs = reqs;
+    queue.count = count;
+    queue.next = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+    
+    /* 调用线程本身也参与工作，因此只额外创建thread_count-1个线程 */
+    pthread_t threads[META_MAX_THREADS];
+    size_t started = 0;
+    for (size_t t = 1; t < thread_count; t++) {
+        if (pthread_create(&threads[started], NULL, meta_worker, &queue) != 0) {
+            break;
+        }
+        started++;
+    }
+    
+    meta_worker(&queue);
+    
+    for (size_t t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_mutex_destroy(&queue.lock);
+}
+
+/**
+ * 批量获取元数据
+ * 所有请求并发发出（优先使用io_uring的IORING_OP_STATX，否则使用线程池），
+ * 结果按请求数组原有顺序写回，每个条目的error为0或errno
+ * flags与fstatat相同（如AT_SYMLINK_NOFOLLOW）
+ */
+int fetch_metadata_batch(int dirfd, meta_request_t *reqs, size_t count, int flags) {
+    if (reqs == NULL && count > 0) {
+        handle_error(ERROR_INVALID_ARGUMENT, "fetch_metadata_batch: reqs is NULL");
+        return -1;
+    }
+    
+    if (count == 1) {
+        fetch_one(dirfd, &reqs[0], flags);
+        return 0;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+#ifdef HAVE_IO_URING
+    if (fetch_with_ring(dirfd, reqs, count, flags) == 0) {
+        return 0;
+    }
+#endif
+
+    fetch_with_threads(dirfd, reqs, count, flags);
+    return 0;
+}
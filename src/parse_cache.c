@@ -0,0 +1,226 @@
+#include "shell.h"
+
+#include <stdint.h>
+
+/* 默认缓存的语法树个数 */
+#define PARSE_CACHE_DEFAULT_SIZE 64
+
+/* 缓存项：原始输入行及其语法树（语法树只读，执行时与缓存共享） */
+typedef struct cache_entry {
+    uint64_t hash;
+    char *line;
+    size_t len;
+    syntax_tree_t *tree;
+    struct cache_entry *hash_next;  /* 同一散列桶中的下一项 */
+    struct cache_entry *lru_prev;   /* 更近使用的一项 */
+    struct cache_entry *lru_next;   /* 更久未使用的一项 */
+} cache_entry_t;
+
+/* 解析缓存：散列表 + LRU双向链表 */
+typedef struct {
+    cache_entry_t **buckets;
+    size_t bucket_count;    /* 2的幂 */
+    int capacity;
+    int count;
+    cache_entry_t *lru_head;  /* 最近使用 */
+    cache_entry_t *lru_tail;  /* 最久未使用 */
+    unsigned long hits;
+    unsigned long misses;
+} parse_cache_t;
+
+static parse_cache_t g_cache = { NULL, 0, PARSE_CACHE_DEFAULT_SIZE, 0, NULL, NULL, 0, 0 };
+
+/**
+ * FNV-1a散列
+ */
+static uint64_t hash_line(const char *line, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)line[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * 从LRU链表中摘下一项
+ */
+static void lru_unlink(cache_entry_t *entry) {
+    if (entry->lru_prev) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        g_cache.lru_head = entry->lru_next;
+    }
+    if (entry->lru_next) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        g_cache.lru_tail = entry->lru_prev;
+    }
+    entry->lru_prev = NULL;
+    entry->lru_next = NULL;
+}
+
+/**
+ * 把一项放到LRU链表头部（最近使用）
+ */
+static void lru_push_front(cache_entry_t *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = g_cache.lru_head;
+    if (g_cache.lru_head) {
+        g_cache.lru_head->lru_prev = entry;
+    } else {
+        g_cache.lru_tail = entry;
+    }
+    g_cache.lru_head = entry;
+}
+
+/**
+ * 移除并释放一项（正在执行的语法树由引用计数保证不被提前释放）
+ */
+static void remove_entry(cache_entry_t *entry) {
+    cache_entry_t **link = &g_cache.buckets[entry->hash & (g_cache.bucket_count - 1)];
+    while (*link != entry) {
+        link = &(*link)->hash_next;
+    }
+    *link = entry->hash_next;
+    
+    lru_unlink(entry);
+    free_syntax_tree(entry->tree);
+    free(entry->line);
+    free(entry);
+    g_cache.count--;
+}
+
+/**
+ * 按容量分配散列桶（装载因子不超过0.5）
+ */
+static int ensure_buckets(void) {
+    if (g_cache.buckets != NULL) {
+        return 0;
+    }
+    
+    size_t bucket_count = 16;
+    while (bucket_count < (size_t)g_cache.capacity * 2) {
+        bucket_count *= 2;
+    }
+    g_cache.buckets = calloc(bucket_count, sizeof(cache_entry_t*));
+    if (g_cache.buckets == NULL) {
+        handle_memory_error("ensure_buckets: parse cache buckets", bucket_count * sizeof(cache_entry_t*));
+        return -1;
+    }
+    g_cache.bucket_count = bucket_count;
+    return 0;
+}
+
+/**
+ * 解析一行输入，优先使用缓存
+ * 命中时直接返回缓存的语法树，不再分词和分配内存；语法树只读，参数扩展在执行时进行
+ * 返回的语法树用完后需调用free_syntax_tree（释放调用者的引用）；有语法错误时返回NULL，
+ * 输入未完成（如缺少fi）时设置*incomplete并返回NULL
+ */
+syntax_tree_t* parse_line_cached(const char *line, size_t len, int *incomplete) {
+    *incomplete = 0;
+    if (line == NULL) {
+        handle_error(ERROR_INVALID_ARGUMENT, "parse_line_cached: line is NULL");
+        return NULL;
+    }
+    
+    if (g_cache.capacity <= 0 || ensure_buckets() != 0) {
+        return parse_input_partial(line, len, incomplete);
+    }
+    
+    uint64_t hash = hash_line(line, len);
+    cache_entry_t *entry = g_cache.buckets[hash & (g_cache.bucket_count - 1)];
+    for (; entry != NULL; entry = entry->hash_next) {
+        if (entry->hash == hash && entry->len == len && memcmp(entry->line, line, len) == 0) {
+            g_cache.hits++;
+            if (entry != g_cache.lru_head) {
+                lru_unlink(entry);
+                lru_push_front(entry);
+            }
+            entry->tree->refcount++;
+            return entry->tree;
+        }
+    }
+    
+    g_cache.misses++;
+    syntax_tree_t *tree = parse_input_partial(line, len, incomplete);
+    if (tree == NULL) {
+        return NULL;  /* 语法错误和未完成的输入不缓存 */
+    }
+    
+    entry = safe_malloc(sizeof(cache_entry_t), "parse_line_cached: entry");
+    char *key = safe_malloc(len + 1, "parse_line_cached: key");
+    if (entry == NULL || key == NULL) {
+        free(entry);
+        free(key);
+        return tree;  /* 缓存失败不影响执行 */
+    }
+    memcpy(key, line, len);
+    key[len] = '\0';
+    
+    if (g_cache.count >= g_cache.capacity) {
+        remove_entry(g_cache.lru_tail);
+    }
+    
+    size_t bucket = hash & (g_cache.bucket_count - 1);
+    entry->hash = hash;
+    entry->line = key;
+    entry->len = len;
+    entry->tree = tree;
+    entry->hash_next = g_cache.buckets[bucket];
+    g_cache.buckets[bucket] = entry;
+    lru_push_front(entry);
+    g_cache.count++;
+    
+    tree->refcount++;  /* 缓存持有一个引用 */
+    return tree;
+}
+
+/**
+ * 清空解析缓存
+ */
+void clear_parse_cache(void) {
+    while (g_cache.lru_head != NULL) {
+        remove_entry(g_cache.lru_head);
+    }
+    free(g_cache.buckets);
+    g_cache.buckets = NULL;
+    g_cache.bucket_count = 0;
+}
+
+/**
+ * 设置缓存容量（0表示禁用缓存），已有的缓存项被清空
+ */
+void set_parse_cache_size(int size) {
+    clear_parse_cache();
+    g_cache.capacity = (size > 0) ? size : 0;
+}
+
+/**
+ * 获取缓存统计信息（参数可以为NULL）
+ */
+void get_parse_cache_stats(unsigned long *hits, unsigned long *misses, int *entries) {
+    if (hits) {
+        *hits = g_cache.hits;
+    }
+    if (misses) {
+        *misses = g_cache.misses;
+    }
+    if (entries) {
+        *entries = g_cache.count;
+    }
+}
+
+/**
+ * 打印缓存统计信息
+ */
+void print_parse_cache_stats(void) {
+    unsigned long lookups = g_cache.hits + g_cache.misses;
+    output_printf(STDOUT_FILENO, "Parse cache:\n");
+    output_printf(STDOUT_FILENO, "  Entries: %d / %d\n", g_cache.count, g_cache.capacity);
+    output_printf(STDOUT_FILENO, "  Hits: %lu\n", g_cache.hits);
+    output_printf(STDOUT_FILENO, "  Misses: %lu\n", g_cache.misses);
+    output_printf(STDOUT_FILENO, "  Hit rate: %.1f%%\n",
+                  lookups ? 100.0 * (double)g_cache.hits / (double)lookups : 0.0);
+}
@@ -28,13 +28,17 @@ command_t* parse_command(char *input) {
     cmd->argc = 0;
     cmd->input_file = NULL;
     cmd->output_file = NULL;
+    cmd->redirections = NULL;
     
     /* 分词处理 */
     int token_count;
     char **tokens = tokenize_input(input, &token_count);
     if (tokens == NULL || token_count == 0) {
         handle_error(ERROR_PARSING, "parse_command: tokenization failed");
-        free(cmd);
+        if (tokens != NULL) {
+            TRACKED_FREE(tokens);
+        }
+        TRACKED_FREE(cmd);
         return NULL;
     }
     
@@ -44,9 +48,9 @@ command_t* parse_command(char *input) {
         TRACKED_FREE(cmd);
         /* 释放tokens */
         for (int i = 0; i < token_count; i++) {
-            free(tokens[i]);
+            TRACKED_FREE(tokens[i]);
         }
-        free(tokens);
+        TRACKED_FREE(tokens);
         return NULL;
     }
     
@@ -58,9 +62,9 @@ command_t* parse_command(char *input) {
         TRACKED_FREE(cmd);
         /* 释放tokens */
         for (int i = 0; i < token_count; i++) {
-            free(tokens[i]);
+            TRACKED_FREE(tokens[i]);
         }
-        free(tokens);
+        TRACKED_FREE(tokens);
         return NULL;
     }
     
@@ -76,9 +80,9 @@ command_t* parse_command(char *input) {
             TRACKED_FREE(cmd);
             /* 释放tokens */
             for (int k = 0; k < token_count; k++) {
-                free(tokens[k]);
+                TRACKED_FREE(tokens[k]);
             }
-            free(tokens);
+            TRACKED_FREE(tokens);
             return NULL;
         }
     }
@@ -86,9 +90,9 @@ command_t* parse_command(char *input) {
     
     /* 释放临时tokens */
     for (int i = 0; i < token_count; i++) {
-        free(tokens[i]);
+        TRACKED_FREE(tokens[i]);
     }
-    free(tokens);
+    TRACKED_FREE(tokens);
     
     LOG_FUNCTION_EXIT("parse_command");
     return cmd;
@@ -207,3 +211,1833 @@ char** tokenize_input(char *input, int *token_count) {
     LOG_FUNCTION_EXIT("tokenize_input");
     return tokens;
 }
+
+/* ========== 命令语法解析（; && || | { } ( )） ========== */
+
+/* 语法树内存池的默认块大小 */
+#define TREE_CHUNK_SIZE 4096
+
+/* 语法树内存池中的一块 */
+struct tree_chunk {
+    struct tree_chunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+/* 词法单元类型 */
+typedef enum {
+    TOKEN_WORD,
+    TOKEN_NEWLINE,
+    TOKEN_SEMI,     /* ; */
+    TOKEN_DSEMI,    /* ;;（case分支结束） */
+    TOKEN_AND_IF,   /* && */
+    TOKEN_OR_IF,    /* || */
+    TOKEN_PIPE,     /* | */
+    TOKEN_LPAREN,   /* ( */
+    TOKEN_RPAREN,   /* ) */
+    TOKEN_REDIRECT, /* 重定向运算符（含前面的描述符号），目标是下一个单词 */
+    TOKEN_EOF,
+    TOKEN_INVALID   /* 词法错误，已报告 */
+} token_type_t;
+
+/* 等待读取正文的here-document（正文从命令所在行之后的下一行开始） */
+struct pending_heredoc {
+    redirection_t *redirection;
+    char *delimiter;        /* 去掉引号后的结束符 */
+    int strip_tabs;         /* <<-：去掉正文各行和结束符行开头的制表符 */
+    struct pending_heredoc *next;
+};
+
+/* 语法分析器状态：输入只扫描一次，单词直接复制到语法树的内存池中 */
+typedef struct {
+    const char *name;       /* 报错时的名称（脚本路径或-c），交互输入为NULL */
+    const char *input;
+    size_t len;
+    size_t pos;
+    int line;
+    syntax_tree_t *tree;
+    token_type_t type;      /* 当前（向前看的）词法单元 */
+    char *word;             /* TOKEN_WORD的文本（保留引号，扩展时才去掉）；TOKEN_REDIRECT的运算符 */
+    redirection_type_t redirect_type;   /* TOKEN_REDIRECT的类型和被重定向的描述符 */
+    int redirect_fd;
+    int token_line;
+    int error_reported;     /* 当前命令已报告过错误 */
+    int partial;            /* 输入可能未完（交互或逐行输入），结尾处的错误不报告 */
+    int incomplete;         /* 输入在未完成的结构中结束，需要继续读取 */
+    int out_of_memory;
+    char **argv;            /* 收集简单命令参数的临时数组 */
+    size_t argv_capacity;
+    struct pending_heredoc *heredocs;       /* 在下一个换行处读取正文的here-document */
+    struct pending_heredoc **heredoc_tail;
+} parser_t;
+
+/**
+ * 从语法树的内存池中分配内存（按指针大小对齐）
+ */
+static void* tree_alloc(syntax_tree_t *tree, size_t size) {
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    
+    struct tree_chunk *chunk = tree->chunks;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > TREE_CHUNK_SIZE ? size : TREE_CHUNK_SIZE;
+        chunk = safe_malloc(sizeof(struct tree_chunk) + chunk_size, "tree_alloc: chunk");
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = tree->chunks;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        tree->chunks = chunk;
+    }
+    
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+/**
+ * 把字符串复制到语法树的内存池
+ */
+static char* tree_strdup(syntax_tree_t *tree, const char *str) {
+    if (str == NULL) {
+        return NULL;
+    }
+    size_t len = strlen(str) + 1;
+    char *copy = tree_alloc(tree, len);
+    if (copy != NULL) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+static node_t* copy_node_chain(syntax_tree_t *tree, const node_t *first, int *failed);
+
+/**
+ * 把单个节点（及其子节点，不含next）复制到另一棵语法树的内存池
+ */
+static node_t* copy_node(syntax_tree_t *tree, const node_t *node, int *failed) {
+    node_t *copy = tree_alloc(tree, sizeof(node_t));
+    if (copy == NULL) {
+        *failed = 1;
+        return NULL;
+    }
+    *copy = *node;
+    copy->next = NULL;
+    copy->name = tree_strdup(tree, node->name);
+    
+    if (node->command != NULL) {
+        const command_t *cmd = node->command;
+        command_t *cmd_copy = tree_alloc(tree, sizeof(command_t));
+        char **args = tree_alloc(tree, ((size_t)cmd->argc + 1) * sizeof(char*));
+        if (cmd_copy == NULL || args == NULL) {
+            *failed = 1;
+            return NULL;
+        }
+        for (int i = 0; i < cmd->argc; i++) {
+            args[i] = tree_strdup(tree, cmd->args[i]);
+            if (args[i] == NULL) {
+                *failed = 1;
+                return NULL;
+            }
+        }
+        args[cmd->argc] = NULL;
+        *cmd_copy = *cmd;
+        cmd_copy->args = args;
+        cmd_copy->command = args[0];
+        cmd_copy->redirections = NULL;
+        redirection_t **link = &cmd_copy->redirections;
+        for (const redirection_t *r = cmd->redirections; r != NULL; r = r->next) {
+            redirection_t *r_copy = tree_alloc(tree, sizeof(redirection_t));
+            if (r_copy == NULL || (r_copy->word = tree_strdup(tree, r->word)) == NULL) {
+                *failed = 1;
+                return NULL;
+            }
+            r_copy->type = r->type;
+            r_copy->fd = r->fd;
+            r_copy->next = NULL;
+            *link = r_copy;
+            link = &r_copy->next;
+        }
+        copy->command = cmd_copy;
+    }
+    
+    copy->left = copy_node_chain(tree, node->left, failed);
+    copy->right = copy_node_chain(tree, node->right, failed);
+    copy->else_part = copy_node_chain(tree, node->else_part, failed);
+    copy->children = copy_node_chain(tree, node->children, failed);
+    return copy;
+}
+
+/**
+ * 复制以next相连的节点列表
+ */
+static node_t* copy_node_chain(syntax_tree_t *tree, const node_t *first, int *failed) {
+    node_t *head = NULL;
+    node_t **link = &head;
+    for (const node_t *node = first; node != NULL && !*failed; node = node->next) {
+        *link = copy_node(tree, node, failed);
+        if (*link == NULL) {
+            break;
+        }
+        link = &(*link)->next;
+    }
+    return head;
+}
+
+/**
+ * 把一个节点复制成独立的语法树（如函数体，使其不依赖于所在输入行的语法树）
+ * 返回的语法树用完后需调用free_syntax_tree
+ */
+syntax_tree_t* copy_syntax_tree(const node_t *node) {
+    syntax_tree_t *tree = safe_malloc(sizeof(syntax_tree_t), "copy_syntax_tree: tree");
+    if (tree == NULL) {
+        return NULL;
+    }
+    tree->root = NULL;
+    tree->chunks = NULL;
+    tree->refcount = 1;
+    
+    int failed = 0;
+    tree->root = copy_node(tree, node, &failed);
+    if (failed) {
+        free_syntax_tree(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+/**
+ * 释放对语法树的一个引用，最后一个引用释放时回收整个内存池
+ */
+void free_syntax_tree(syntax_tree_t *tree) {
+    if (tree == NULL || --tree->refcount > 0) {
+        return;
+    }
+    
+    struct tree_chunk *chunk = tree->chunks;
+    while (chunk != NULL) {
+        struct tree_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(tree);
+}
+
+/**
+ * 报告语法错误（同一条命令只报告第一个错误）
+ */
+static void syntax_error(parser_t *p, int line, const char *reason) {
+    if (p->error_reported) {
+        return;
+    }
+    p->error_reported = 1;
+    
+    char error_msg[MAX_PATH_SIZE + 128];
+    if (p->name != NULL) {
+        snprintf(error_msg, sizeof(error_msg), "%s: line %d: %s", p->name, line, reason);
+    } else {
+        snprintf(error_msg, sizeof(error_msg), "%s", reason);
+    }
+    print_error(error_msg);
+}
+
+/**
+ * 报告"意外的词法单元"错误
+ */
+static void unexpected_token(parser_t *p) {
+    const char *text;
+    switch (p->type) {
+        case TOKEN_WORD:    text = p->word; break;
+        case TOKEN_NEWLINE: text = "newline"; break;
+        case TOKEN_SEMI:    text = ";"; break;
+        case TOKEN_DSEMI:   text = ";;"; break;
+        case TOKEN_AND_IF:  text = "&&"; break;
+        case TOKEN_OR_IF:   text = "||"; break;
+        case TOKEN_PIPE:    text = "|"; break;
+        case TOKEN_LPAREN:  text = "("; break;
+        case TOKEN_RPAREN:  text = ")"; break;
+        case TOKEN_REDIRECT: text = p->word; break;
+        case TOKEN_EOF:
+            if (p->partial && !p->error_reported) {
+                p->incomplete = 1;
+                p->error_reported = 1;
+                return;
+            }
+            syntax_error(p, p->token_line, "syntax error: unexpected end of file");
+            return;
+        default:
+            return;  /* 词法错误已经报告过 */
+    }
+    
+    char reason[MAX_INPUT_SIZE];
+    snprintf(reason, sizeof(reason), "syntax error near unexpected token `%s'", text);
+    syntax_error(p, p->token_line, reason);
+}
+
+/**
+ * 判断字符是否结束一个未加引号的单词
+ */
+static int is_word_terminator(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == ';' ||
+           c == '&' || c == '|' || c == '(' || c == ')' || c == '<' || c == '>';
+}
+
+/**
+ * 向单词缓冲区追加一个字符（out为NULL时只计数）
+ */
+static void emit_char(char *out, size_t *n, char c) {
+    if (out != NULL) {
+        out[*n] = c;
+    }
+    (*n)++;
+}
+
+/**
+ * 跳到下一行（词法错误后从下一行继续检查）
+ */
+static void skip_to_next_line(parser_t *p) {
+    const char *newline = memchr(p->input + p->pos, '\n', p->len - p->pos);
+    p->pos = newline ? (size_t)(newline - p->input) : p->len;
+}
+
+/* 命令替换中case语句的扫描状态 */
+enum {
+    CASE_SUBJECT,   /* case之后，等待被匹配的单词 */
+    CASE_IN,        /* 等待in */
+    CASE_PATTERN,   /* 模式列表：其中的)结束模式，不是右括号 */
+    CASE_BODY       /* 分支的命令，直到;;、;&或;;& */
+};
+
+/* 命令替换中可以跟踪的case嵌套层数，更深的嵌套按普通的括号配对 */
+#define CASE_NESTING_MAX 16
+
+/**
+ * 判断text[start, start+len)是否为保留字word
+ */
+static int is_reserved_word(const char *text, size_t start, size_t len, const char *word) {
+    return strlen(word) == len && memcmp(text + start, word, len) == 0;
+}
+
+/**
+ * 查找从open处的(开始的命令替换（$(...)、<(...)、>(...)）的右括号，范围为text[0, len)
+ * 跳过引号、转义和注释，允许嵌套的括号；case语句的模式（如x)和(x)）中的括号不参与配对
+ * 以((开始的算术展开按普通的括号配对
+ * 返回右括号的位置，括号没有闭合时返回(size_t)-1
+ */
+size_t find_command_paren_end(const char *text, size_t len, size_t open) {
+    int arithmetic = (open + 1 < len && text[open + 1] == '(');
+    int depth = 0;
+    int case_state[CASE_NESTING_MAX];
+    int case_depth[CASE_NESTING_MAX];   /* case语句所在的括号层数 */
+    int case_count = 0;
+    int command_start = 1;              /* 下一个单词是否处于命令的开头（可以是保留字） */
+    
+    for (size_t i = open; i < len; i++) {
+        char c = text[i];
+        int *state = (!arithmetic && case_count > 0 && case_depth[case_count - 1] == depth)
+                     ? &case_state[case_count - 1] : NULL;
+        
+        if (c == '\\') {
+            i++;
+            command_start = 0;
+        } else if (c == '\'' || c == '"') {
+            while (++i < len && text[i] != c) {
+                if (c == '"' && text[i] == '\\') {
+                    i++;
+                }
+            }
+            command_start = 0;
+        } else if (c == '(') {
+            /* 模式前可以有一个可选的( */
+            if (state == NULL || *state != CASE_PATTERN) {
+                depth++;
+                command_start = 1;
+            }
+        } else if (c == ')') {
+            if (state != NULL && *state == CASE_PATTERN) {
+                *state = CASE_BODY;
+                command_start = 1;
+            } else if (--depth == 0) {
+                return i;
+            } else {
+                command_start = 0;
+            }
+        } else if (c == ';') {
+            if (state != NULL && *state == CASE_BODY && i + 1 < len && (text[i + 1] == ';' || text[i + 1] == '&')) {
+                /* ;;、;&和;;&结束一个分支 */
+                *state = CASE_PATTERN;
+                i++;
+                if (text[i] == ';' && i + 1 < len && text[i + 1] == '&') {
+                    i++;
+                }
+            }
+            command_start = 1;
+        } else if (c == '&' || c == '|' || c == '\n') {
+            command_start = 1;
+        } else if (c == '<' || c == '>') {
+            command_start = 0;
+        } else if (c == '#' && !arithmetic) {
+            /* 单词开头的#开始注释，到行尾为止 */
+            while (i + 1 < len && text[i + 1] != '\n') {
+                i++;
+            }
+        } else if (c != ' ' && c != '\t') {
+            /* 一个单词：只有保留字会改变扫描状态 */
+            size_t start = i;
+            while (i + 1 < len && strchr(" \t\n;&|()<>'\"\\", text[i + 1]) == NULL) {
+                i++;
+            }
+            size_t word_len = i - start + 1;
+            if (arithmetic) {
+                continue;
+            }
+            if (state != NULL && *state == CASE_SUBJECT) {
+                *state = CASE_IN;
+            } else if (state != NULL && *state == CASE_IN && is_reserved_word(text, start, word_len, "in")) {
+                *state = CASE_PATTERN;
+            } else if (state != NULL && (*state == CASE_PATTERN || (*state == CASE_BODY && command_start)) &&
+                       is_reserved_word(text, start, word_len, "esac")) {
+                case_count--;
+                command_start = 0;
+            } else if (state != NULL && *state == CASE_PATTERN) {
+                /* 模式中的单词 */
+            } else if (command_start && is_reserved_word(text, start, word_len, "case") &&
+                       case_count < CASE_NESTING_MAX) {
+                case_state[case_count] = CASE_SUBJECT;
+                case_depth[case_count] = depth;
+                case_count++;
+                command_start = 0;
+            } else {
+                /* 这些保留字之后仍是命令的开头 */
+                static const char *const leading[] = {
+                    "then", "do", "else", "elif", "if", "while", "until", "!", "{", "time", NULL
+                };
+                int keyword = 0;
+                for (int k = 0; command_start && leading[k] != NULL && !keyword; k++) {
+                    keyword = is_reserved_word(text, start, word_len, leading[k]);
+                }
+                command_start = keyword;
+            }
+        }
+    }
+    return (size_t)-1;
+}
+
+/**
+ * 从open处的左括号（或${的左花括号）开始查找匹配的右括号（跳过引号内的内容），返回其位置
+ * 输入在括号闭合之前结束时报告错误并返回(size_t)-1
+ */
+static size_t find_closing_paren(parser_t *p, size_t open) {
+    const char *in = p->input;
+    char open_char = in[open];
+    char close_char = (open_char == '{') ? '}' : ')';
+    
+    if (open_char == '(' && open > 0 && in[open - 1] != '(') {
+        /* $(...)等命令替换中的命令按命令的语法配对（case的模式括号不计入） */
+        size_t end = find_command_paren_end(in, p->len, open);
+        if (end != (size_t)-1) {
+            return end;
+        }
+    } else {
+        int depth = 0;
+        for (size_t i = open; i < p->len; i++) {
+            char c = in[i];
+            if (c == '\\') {
+                i++;
+            } else if (c == '\'' || c == '"') {
+                while (++i < p->len && in[i] != c) {
+                    if (c == '"' && in[i] == '\\') {
+                        i++;
+                    }
+                }
+            } else if (c == open_char) {
+                depth++;
+            } else if (c == close_char && --depth == 0) {
+                return i;
+            }
+        }
+    }
+    
+    if (p->partial && !p->error_reported) {
+        p->incomplete = 1;
+        p->error_reported = 1;
+    }
+    syntax_error(p, p->line, (open_char == '{') ? "syntax error: bad substitution"
+                                                : "syntax error: unterminated `$('");
+    p->pos = p->len;
+    return (size_t)-1;
+}
+
+/**
+ * 扫描一个单词
+ * out为NULL时只确定单词的结束位置并统计其中的换行；否则把单词复制到out
+ * （去掉反斜杠续行，保留引号）。返回单词结束位置，出错时返回(size_t)-1
+ */
+static size_t scan_word(parser_t *p, char *out, size_t *out_len) {
+    const char *in = p->input;
+    size_t i = p->pos;
+    size_t n = 0;
+    int counting = (out == NULL);
+    
+    while (i < p->len) {
+        char c = in[i];
+        
+        if (c == '\\') {
+            if (i + 1 < p->len && in[i + 1] == '\n') {
+                p->line += counting;
+                i += 2;
+                continue;
+            }
+            if (i + 1 == p->len && p->partial && !p->error_reported) {
+                /* 行尾的反斜杠：命令在下一行继续 */
+                p->incomplete = 1;
+                p->error_reported = 1;
+                p->pos = p->len;
+                return (size_t)-1;
+            }
+            emit_char(out, &n, in[i++]);
+            if (i < p->len) {
+                emit_char(out, &n, in[i++]);
+            }
+            continue;
+        }
+        
+        if (c == '\'' || c == '"') {
+            /* 引号内的内容原样保留，直到匹配的引号 */
+            int start_line = p->line;
+            emit_char(out, &n, in[i++]);
+            while (i < p->len && in[i] != c) {
+                if (c == '"' && in[i] == '$' && i + 1 < p->len && (in[i + 1] == '{' || in[i + 1] == '(')) {
+                    /* 双引号内的${...}和$(...)可以包含引号 */
+                    size_t end = find_closing_paren(p, i + 1);
+                    if (end == (size_t)-1) {
+                        return (size_t)-1;
+                    }
+                    while (i <= end) {
+                        if (in[i] == '\n') {
+                            p->line += counting;
+                        }
+                        emit_char(out, &n, in[i++]);
+                    }
+                    continue;
+                }
+                if (c == '"' && in[i] == '\\' && i + 1 < p->len) {
+                    if (in[i + 1] == '\n') {
+                        p->line += counting;
+                        i += 2;
+                        continue;
+                    }
+                    emit_char(out, &n, in[i++]);
+                }
+                if (in[i] == '\n') {
+                    p->line += counting;
+                }
+                emit_char(out, &n, in[i++]);
+            }
+            if (i >= p->len) {
+                if (p->partial && !p->error_reported) {
+                    p->incomplete = 1;
+                    p->error_reported = 1;
+                }
+                syntax_error(p, start_line, "syntax error: unterminated quote");
+                p->pos = p->len;
+                return (size_t)-1;
+            }
+            emit_char(out, &n, in[i++]);
+            continue;
+        }
+        
+        if ((c == '$' || c == '<' || c == '>') && i + 1 < p->len && in[i + 1] == '(') {
+            /* $( ... )、$(( ... ))和进程替换<( ... )、>( ... )：到匹配的右括号为止都属于同一个单词 */
+            size_t end = find_closing_paren(p, i + 1);
+            if (end == (size_t)-1) {
+                return (size_t)-1;
+            }
+            while (i <= end) {
+                if (in[i] == '\n') {
+                    p->line += counting;
+                }
+                emit_char(out, &n, in[i++]);
+            }
+            continue;
+        }
+        
+        if (c == '`') {
+            /* `...`到下一个未转义的反引号为止都属于同一个单词 */
+            int start_line = p->line;
+            emit_char(out, &n, in[i++]);
+            while (i < p->len && in[i] != '`') {
+                if (in[i] == '\\' && i + 1 < p->len) {
+                    emit_char(out, &n, in[i++]);
+                }
+                if (in[i] == '\n') {
+                    p->line += counting;
+                }
+                emit_char(out, &n, in[i++]);
+            }
+            if (i >= p->len) {
+                if (p->partial && !p->error_reported) {
+                    p->incomplete = 1;
+                    p->error_reported = 1;
+                }
+                syntax_error(p, start_line, "syntax error: unterminated `");
+                p->pos = p->len;
+                return (size_t)-1;
+            }
+            emit_char(out, &n, in[i++]);
+            continue;
+        }
+        
+        if (c == '$' && i + 1 < p->len && in[i + 1] == '{') {
+            /* ${...}中的内容（包括嵌套的${...}和引号）属于同一个单词 */
+            size_t end = find_closing_paren(p, i + 1);
+            if (end == (size_t)-1) {
+                return (size_t)-1;
+            }
+            while (i <= end) {
+                if (in[i] == '\n') {
+                    p->line += counting;
+                }
+                emit_char(out, &n, in[i++]);
+            }
+            continue;
+        }
+        
+        if (is_word_terminator(c)) {
+            break;
+        }
+        if ((unsigned char)c < 32 && c != '\t') {
+            syntax_error(p, p->line, "syntax error: invalid character");
+            skip_to_next_line(p);
+            return (size_t)-1;
+        }
+        
+        emit_char(out, &n, in[i++]);
+    }
+    
+    if (out_len) {
+        *out_len = n;
+    }
+    return i;
+}
+
+/**
+ * 识别重定向运算符：[n]<、[n]<&、[n]<<、[n]<<-、[n]<<<、[n]>、[n]>>、[n]>|、[n]>&、&>和&>>
+ * （n为紧挨着运算符的描述符号）。识别到时设置TOKEN_REDIRECT并返回1，否则不移动位置并返回0
+ */
+static int scan_redirect(parser_t *p) {
+    const char *in = p->input;
+    size_t i = p->pos;
+    int fd = -1;
+    
+    if (isdigit((unsigned char)in[i])) {
+        fd = 0;
+        while (i < p->len && isdigit((unsigned char)in[i])) {
+            if (fd <= 99999999) {
+                fd = fd * 10 + (in[i] - '0');
+            }
+            i++;
+        }
+        if (i >= p->len || (in[i] != '<' && in[i] != '>')) {
+            return 0;
+        }
+    }
+    
+    char c = in[i];
+    char next = (i + 1 < p->len) ? in[i + 1] : '\0';
+    size_t op_len = 2;
+    redirection_type_t type;
+    if (c == '&') {
+        type = REDIR_OUTPUT_ALL;
+        if (i + 2 < p->len && in[i + 2] == '>') {
+            type = REDIR_APPEND_ALL;
+            op_len = 3;
+        }
+        fd = STDOUT_FILENO;
+    } else if (c == '<') {
+        char third = (i + 2 < p->len) ? in[i + 2] : '\0';
+        if (next == '<') {
+            type = (third == '<') ? REDIR_HERESTRING : REDIR_HEREDOC;
+            op_len = (third == '<' || third == '-') ? 3 : 2;
+        } else {
+            type = (next == '&') ? REDIR_DUPLICATE : REDIR_INPUT;
+            op_len = (next == '&') ? 2 : 1;
+        }
+        fd = (fd == -1) ? STDIN_FILENO : fd;
+    } else {
+        switch (next) {
+            case '>': type = REDIR_APPEND; break;
+            case '&': type = REDIR_DUPLICATE; break;
+            case '|': type = REDIR_OUTPUT; break;
+            default:  type = REDIR_OUTPUT; op_len = 1; break;
+        }
+        fd = (fd == -1) ? STDOUT_FILENO : fd;
+    }
+    
+    /* 运算符的文本用于报错，以及在[[ ]]中作为比较运算符 */
+    size_t end = i + op_len;
+    char *text = tree_alloc(p->tree, end - p->pos + 1);
+    if (text == NULL) {
+        p->out_of_memory = 1;
+        p->type = TOKEN_INVALID;
+        p->pos = p->len;
+        return 1;
+    }
+    memcpy(text, in + p->pos, end - p->pos);
+    text[end - p->pos] = '\0';
+    
+    p->pos = end;
+    p->type = TOKEN_REDIRECT;
+    p->word = text;
+    p->redirect_type = type;
+    p->redirect_fd = fd;
+    return 1;
+}
+
+/**
+ * 读取一个here-document的正文：从当前位置（命令行之后的下一行）开始，到只包含结束符的一行为止
+ * 正文复制到语法树的内存池（<<-时去掉各行开头的制表符），位置移到结束符行之后
+ * 输入在结束符之前结束时：可能未完的输入返回-1（需要继续读取），否则像Bash一样警告后使用已有的内容
+ */
+static int read_heredoc_body(parser_t *p, struct pending_heredoc *heredoc) {
+    const char *in = p->input;
+    size_t delimiter_len = strlen(heredoc->delimiter);
+    size_t body_end = p->len;
+    size_t resume = p->len;
+    int lines = 0;
+    int found = 0;
+    
+    for (size_t pos = p->pos; pos < p->len; ) {
+        const char *newline = memchr(in + pos, '\n', p->len - pos);
+        size_t line_end = newline ? (size_t)(newline - in) : p->len;
+        size_t text = pos;
+        while (heredoc->strip_tabs && text < line_end && in[text] == '\t') {
+            text++;
+        }
+        lines += (newline != NULL);
+        if (line_end - text == delimiter_len && memcmp(in + text, heredoc->delimiter, delimiter_len) == 0) {
+            body_end = pos;
+            resume = newline ? line_end + 1 : line_end;
+            found = 1;
+            break;
+        }
+        pos = newline ? line_end + 1 : p->len;
+    }
+    
+    if (!found) {
+        if (p->partial && !p->error_reported) {
+            p->incomplete = 1;
+            p->error_reported = 1;
+            p->pos = p->len;
+            return -1;
+        }
+        char message[MAX_PATH_SIZE + 128];
+        snprintf(message, sizeof(message), "%s%shere-document at line %d delimited by end-of-file (wanted `%s')",
+                 p->name ? p->name : "", p->name ? ": " : "", p->token_line, heredoc->delimiter);
+        print_warning(message);
+    }
+    
+    char *body = tree_alloc(p->tree, body_end - p->pos + 1);
+    if (body == NULL) {
+        p->out_of_memory = 1;
+        return -1;
+    }
+    size_t n = 0;
+    int line_start = 1;
+    for (size_t i = p->pos; i < body_end; i++) {
+        if (line_start && heredoc->strip_tabs && in[i] == '\t') {
+            continue;
+        }
+        body[n++] = in[i];
+        line_start = (in[i] == '\n');
+    }
+    body[n] = '\0';
+    
+    heredoc->redirection->word = body;
+    p->line += lines;
+    p->pos = resume;
+    return 0;
+}
+
+/**
+ * 读取命令行中所有here-document的正文（按出现的顺序），出错时返回-1
+ */
+static int read_heredoc_bodies(parser_t *p) {
+    struct pending_heredoc *heredoc = p->heredocs;
+    p->heredocs = NULL;
+    p->heredoc_tail = &p->heredocs;
+    for (; heredoc != NULL; heredoc = heredoc->next) {
+        if (read_heredoc_body(p, heredoc) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 读取下一个词法单元
+ */
+static void next_token(parser_t *p) {
+    const char *in = p->input;
+    
+    /* 跳过空白、续行和注释 */
+    for (;;) {
+        while (p->pos < p->len && (in[p->pos] == ' ' || in[p->pos] == '\t' || in[p->pos] == '\r')) {
+            p->pos++;
+        }
+        if (p->pos + 1 < p->len && in[p->pos] == '\\' && in[p->pos + 1] == '\n') {
+            p->pos += 2;
+            p->line++;
+            continue;
+        }
+        if (p->pos < p->len && in[p->pos] == '#') {
+            const char *newline = memchr(in + p->pos, '\n', p->len - p->pos);
+            p->pos = newline ? (size_t)(newline - in) : p->len;
+        }
+        break;
+    }
+    
+    p->token_line = p->line;
+    p->word = NULL;
+    
+    if (p->pos >= p->len) {
+        /* 输入在here-document的正文之前结束 */
+        p->type = (p->heredocs != NULL && read_heredoc_bodies(p) != 0) ? TOKEN_INVALID : TOKEN_EOF;
+        return;
+    }
+    
+    char c = in[p->pos];
+    char next = (p->pos + 1 < p->len) ? in[p->pos + 1] : '\0';
+    switch (c) {
+        case '\n':
+            p->type = TOKEN_NEWLINE;
+            p->pos++;
+            p->line++;
+            if (p->heredocs != NULL && read_heredoc_bodies(p) != 0) {
+                p->type = TOKEN_INVALID;
+            }
+            return;
+        case ';':
+            if (next == ';') {
+                p->type = TOKEN_DSEMI;
+                p->pos += 2;
+            } else {
+                p->type = TOKEN_SEMI;
+                p->pos++;
+            }
+            return;
+        case '&':
+            if (next == '&') {
+                p->type = TOKEN_AND_IF;
+                p->pos += 2;
+                return;
+            }
+            if (next == '>') {
+                scan_redirect(p);
+                return;
+            }
+            syntax_error(p, p->line, "syntax error: background jobs (&) are not supported");
+            p->type = TOKEN_INVALID;
+            p->pos++;
+            return;
+        case '|':
+            if (next == '|') {
+                p->type = TOKEN_OR_IF;
+                p->pos += 2;
+            } else {
+                p->type = TOKEN_PIPE;
+                p->pos++;
+            }
+            return;
+        case '(':
+            p->type = TOKEN_LPAREN;
+            p->pos++;
+            return;
+        case ')':
+            p->type = TOKEN_RPAREN;
+            p->pos++;
+            return;
+        case '<':
+        case '>':
+            if (next != '(') {
+                scan_redirect(p);
+                return;
+            }
+            break;  /* 进程替换<(...)和>(...)是单词 */
+        default:
+            if (isdigit((unsigned char)c) && scan_redirect(p)) {
+                return;
+            }
+            break;
+    }
+    
+    /* 单词：先确定长度，再一次复制到内存池 */
+    size_t start = p->pos;
+    size_t end = scan_word(p, NULL, NULL);
+    if (end == (size_t)-1) {
+        p->type = TOKEN_INVALID;
+        return;
+    }
+    
+    char *word = tree_alloc(p->tree, end - start + 1);
+    if (word == NULL) {
+        p->out_of_memory = 1;
+        p->type = TOKEN_INVALID;
+        p->pos = p->len;
+        return;
+    }
+    size_t word_len;
+    scan_word(p, word, &word_len);
+    word[word_len] = '\0';
+    
+    p->pos = end;
+    p->type = TOKEN_WORD;
+    p->word = word;
+}
+
+/**
+ * 当前词法单元是否为指定的保留字（只在命令开始处识别）
+ */
+static int at_reserved(parser_t *p, const char *word) {
+    return p->type == TOKEN_WORD && strcmp(p->word, word) == 0;
+}
+
+/**
+ * 跳过连续的换行
+ */
+static void skip_newlines(parser_t *p) {
+    while (p->type == TOKEN_NEWLINE) {
+        next_token(p);
+    }
+}
+
+/**
+ * 创建语法树节点
+ */
+static node_t* new_node(parser_t *p, node_type_t type, int line) {
+    node_t *node = tree_alloc(p->tree, sizeof(node_t));
+    if (node == NULL) {
+        p->out_of_memory = 1;
+        return NULL;
+    }
+    memset(node, 0, sizeof(node_t));
+    node->type = type;
+    node->line = line;
+    return node;
+}
+
+static node_t* parse_and_or(parser_t *p);
+static node_t* parse_command_node(parser_t *p);
+
+/**
+ * 用给定的单词构造command_t（参数数组以NULL结尾，分配在语法树的内存池中）
+ */
+static command_t* make_word_list(parser_t *p, char **words, size_t count) {
+    command_t *cmd = tree_alloc(p->tree, sizeof(command_t));
+    char **args = tree_alloc(p->tree, (count + 1) * sizeof(char*));
+    if (cmd == NULL || args == NULL) {
+        p->out_of_memory = 1;
+        return NULL;
+    }
+    
+    if (count > 0) {
+        memcpy(args, words, count * sizeof(char*));
+    }
+    args[count] = NULL;
+    cmd->command = args[0];
+    cmd->args = args;
+    cmd->argc = (int)count;
+    cmd->input_file = NULL;
+    cmd->output_file = NULL;
+    cmd->redirections = NULL;
+    return cmd;
+}
+
+/**
+ * 把单词放到临时参数数组的第index项（按需扩容）
+ */
+static int push_word(parser_t *p, size_t index, char *word) {
+    if (index + 1 >= p->argv_capacity) {
+        size_t new_capacity = p->argv_capacity ? p->argv_capacity * 2 : 16;
+        char **argv = safe_realloc(p->argv, new_capacity * sizeof(char*), "push_word: argv");
+        if (argv == NULL) {
+            p->out_of_memory = 1;
+            return -1;
+        }
+        p->argv = argv;
+        p->argv_capacity = new_capacity;
+    }
+    p->argv[index] = word;
+    return 0;
+}
+
+/**
+ * 判断单词是否为赋值：name=value、name+=value或name[下标]=value（下标中允许嵌套的[]）
+ * 返回=的位置，不是赋值时返回0
+ */
+size_t find_assignment(const char *word) {
+    if (!(isalpha((unsigned char)word[0]) || word[0] == '_')) {
+        return 0;
+    }
+    size_t i = 1;
+    while (isalnum((unsigned char)word[i]) || word[i] == '_') {
+        i++;
+    }
+    if (word[i] == '[') {
+        int depth = 0;
+        do {
+            if (word[i] == '\\' && word[i + 1] != '\0') {
+                i++;
+            } else if (word[i] == '[') {
+                depth++;
+            } else if (word[i] == ']') {
+                depth--;
+            }
+            i++;
+        } while (depth > 0 && word[i] != '\0');
+        if (depth > 0) {
+            return 0;
+        }
+    }
+    if (word[i] == '+') {
+        i++;
+    }
+    return (word[i] == '=') ? i : 0;
+}
+
+/**
+ * 解析复合赋值name=(word...)的元素，当前词法单元是紧跟在name=之后的(
+ * 在参数数组中依次放入"name=("、各元素和")"，返回下一个参数的位置，出错时返回(size_t)-1
+ */
+static size_t collect_compound_assignment(parser_t *p, size_t argc) {
+    size_t len = strlen(p->argv[argc - 1]);
+    char *opener = tree_alloc(p->tree, len + 2);
+    char *closer = tree_alloc(p->tree, 2);
+    if (opener == NULL || closer == NULL) {
+        p->out_of_memory = 1;
+        return (size_t)-1;
+    }
+    memcpy(opener, p->argv[argc - 1], len);
+    strcpy(opener + len, "(");
+    strcpy(closer, ")");
+    p->argv[argc - 1] = opener;
+    
+    next_token(p);
+    skip_newlines(p);
+    while (p->type == TOKEN_WORD) {
+        if (push_word(p, argc++, p->word) != 0) {
+            return (size_t)-1;
+        }
+        next_token(p);
+        skip_newlines(p);
+    }
+    if (p->type != TOKEN_RPAREN) {
+        unexpected_token(p);
+        return (size_t)-1;
+    }
+    next_token(p);
+    return (push_word(p, argc, closer) == 0) ? argc + 1 : (size_t)-1;
+}
+
+/**
+ * 记下here-document，在命令行结束的换行处读取其正文
+ * 结束符中有引号或反斜杠时去掉它们，正文按原样使用（不展开）
+ */
+static int queue_heredoc(parser_t *p, redirection_t *redirection, const char *operator) {
+    struct pending_heredoc *heredoc = tree_alloc(p->tree, sizeof(struct pending_heredoc));
+    char *delimiter = tree_alloc(p->tree, strlen(redirection->word) + 1);
+    if (heredoc == NULL || delimiter == NULL) {
+        p->out_of_memory = 1;
+        return -1;
+    }
+    
+    size_t n = 0;
+    for (const char *c = redirection->word; *c; c++) {
+        if (*c == '\'' || *c == '"') {
+            redirection->type = REDIR_HEREDOC_LITERAL;
+        } else if (*c == '\\' && c[1] != '\0') {
+            redirection->type = REDIR_HEREDOC_LITERAL;
+            delimiter[n++] = *++c;
+        } else {
+            delimiter[n++] = *c;
+        }
+    }
+    delimiter[n] = '\0';
+    
+    heredoc->redirection = redirection;
+    heredoc->delimiter = delimiter;
+    heredoc->strip_tabs = (operator[strlen(operator) - 1] == '-');
+    heredoc->next = NULL;
+    redirection->word = "";
+    *p->heredoc_tail = heredoc;
+    p->heredoc_tail = &heredoc->next;
+    return 0;
+}
+
+/**
+ * 解析一个重定向（当前词法单元是重定向运算符），追加到*tail处
+ * 成功时返回新的链表尾，出错时返回NULL
+ */
+static redirection_t** collect_redirection(parser_t *p, redirection_t **tail) {
+    const char *operator = p->word;
+    redirection_t *redirection = tree_alloc(p->tree, sizeof(redirection_t));
+    if (redirection == NULL) {
+        p->out_of_memory = 1;
+        return NULL;
+    }
+    redirection->type = p->redirect_type;
+    redirection->fd = p->redirect_fd;
+    redirection->next = NULL;
+    
+    next_token(p);
+    if (p->type != TOKEN_WORD) {
+        unexpected_token(p);
+        return NULL;
+    }
+    redirection->word = p->word;
+    if (redirection->type == REDIR_HEREDOC && queue_heredoc(p, redirection, operator) != 0) {
+        return NULL;
+    }
+    next_token(p);
+    
+    *tail = redirection;
+    return &redirection->next;
+}
+
+/**
+ * 收集连续的单词，构造command_t（没有单词时argc为0）
+ * assignments为1时识别复合赋值name=(...)：在开头的赋值中，以及declare、typeset和local的参数中；
+ * 同时收集简单命令中任意位置的重定向
+ */
+static command_t* collect_words(parser_t *p, int assignments) {
+    size_t argc = 0;
+    int leading = assignments;
+    int declaration = 0;
+    redirection_t *redirections = NULL;
+    redirection_t **tail = &redirections;
+    
+    while (p->type == TOKEN_WORD || (assignments && p->type == TOKEN_REDIRECT)) {
+        if (p->type == TOKEN_REDIRECT) {
+            if ((tail = collect_redirection(p, tail)) == NULL) {
+                return NULL;
+            }
+            continue;
+        }
+        
+        size_t equals = assignments ? find_assignment(p->word) : 0;
+        if (argc == 0 && assignments) {
+            declaration = (strcmp(p->word, "declare") == 0 || strcmp(p->word, "typeset") == 0 ||
+                           strcmp(p->word, "local") == 0);
+        }
+        leading = leading && equals > 0;
+        
+        int compound = (equals > 0 && p->word[equals + 1] == '\0' && (leading || declaration) &&
+                        p->pos < p->len && p->input[p->pos] == '(');
+        if (push_word(p, argc++, p->word) != 0) {
+            return NULL;
+        }
+        next_token(p);
+        if (compound && (argc = collect_compound_assignment(p, argc)) == (size_t)-1) {
+            return NULL;
+        }
+    }
+    
+    command_t *cmd = make_word_list(p, p->argv, argc);
+    if (cmd != NULL) {
+        cmd->redirections = redirections;
+    }
+    return cmd;
+}
+
+/**
+ * 解析简单命令：连续的单词和重定向
+ */
+static node_t* parse_simple_command(parser_t *p) {
+    node_t *node = new_node(p, NODE_COMMAND, p->token_line);
+    if (node == NULL) {
+        return NULL;
+    }
+    node->command = collect_words(p, 1);
+    return node->command ? node : NULL;
+}
+
+/**
+ * 当前词法单元是否为结束符之一
+ * closers为以NULL结尾的保留字列表，")"和";;"分别对应相应的运算符
+ */
+static int at_closer(parser_t *p, const char *const *closers) {
+    for (int i = 0; closers[i] != NULL; i++) {
+        if (strcmp(closers[i], ")") == 0) {
+            if (p->type == TOKEN_RPAREN) {
+                return 1;
+            }
+        } else if (strcmp(closers[i], ";;") == 0) {
+            if (p->type == TOKEN_DSEMI) {
+                return 1;
+            }
+        } else if (at_reserved(p, closers[i])) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 解析复合命令中的命令列表，直到遇到结束符（不消耗结束符）
+ * 返回列表的第一项（各项通过next相连）；allow_empty为1时允许空列表（返回NULL且不报错）
+ */
+static node_t* parse_compound_list(parser_t *p, const char *const *closers, int allow_empty) {
+    node_t *first = NULL;
+    node_t *last = NULL;
+    
+    skip_newlines(p);
+    for (;;) {
+        if (at_closer(p, closers)) {
+            if (first == NULL && !allow_empty) {
+                unexpected_token(p);
+            }
+            return first;
+        }
+        
+        node_t *item = parse_and_or(p);
+        if (item == NULL) {
+            return NULL;
+        }
+        if (last) {
+            last->next = item;
+        } else {
+            first = item;
+        }
+        last = item;
+        
+        if (p->type == TOKEN_SEMI || p->type == TOKEN_NEWLINE) {
+            next_token(p);
+            skip_newlines(p);
+        } else if (!at_closer(p, closers)) {
+            unexpected_token(p);
+            return NULL;
+        }
+    }
+}
+
+/**
+ * 要求当前词法单元为指定的保留字并跳过它
+ */
+static int expect_reserved(parser_t *p, const char *word) {
+    if (!at_reserved(p, word)) {
+        unexpected_token(p);
+        return -1;
+    }
+    next_token(p);
+    return 0;
+}
+
+/**
+ * 判断单词是否为合法的变量名
+ */
+static int is_valid_name(const char *word) {
+    if (!(isalpha((unsigned char)word[0]) || word[0] == '_')) {
+        return 0;
+    }
+    for (const char *c = word + 1; *c; c++) {
+        if (!(isalnum((unsigned char)*c) || *c == '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* 复合命令各部分的结束符 */
+static const char *const CLOSE_THEN[] = { "then", NULL };
+static const char *const CLOSE_ELSE[] = { "elif", "else", "fi", NULL };
+static const char *const CLOSE_FI[] = { "fi", NULL };
+static const char *const CLOSE_DO[] = { "do", NULL };
+static const char *const CLOSE_DONE[] = { "done", NULL };
+static const char *const CLOSE_BRACE[] = { "}", NULL };
+static const char *const CLOSE_PAREN[] = { ")", NULL };
+static const char *const CLOSE_CASE_ITEM[] = { ";;", "esac", NULL };
+
+/**
+ * 解析if语句（if已被消耗；elif部分递归解析为嵌套的NODE_IF）
+ * if list; then list; [elif list; then list;]... [else list;] fi
+ */
+static node_t* parse_if(parser_t *p, int line) {
+    node_t *node = new_node(p, NODE_IF, line);
+    if (node == NULL) {
+        return NULL;
+    }
+    
+    node->left = parse_compound_list(p, CLOSE_THEN, 0);
+    if (node->left == NULL || expect_reserved(p, "then") != 0) {
+        return NULL;
+    }
+    node->right = parse_compound_list(p, CLOSE_ELSE, 0);
+    if (node->right == NULL) {
+        return NULL;
+    }
+    
+    if (at_reserved(p, "elif")) {
+        int elif_line = p->token_line;
+        next_token(p);
+        /* elif与外层if共用同一个fi */
+        node->else_part = parse_if(p, elif_line);
+        return node->else_part ? node : NULL;
+    }
+    if (at_reserved(p, "else")) {
+        next_token(p);
+        node->else_part = parse_compound_list(p, CLOSE_FI, 0);
+        if (node->else_part == NULL) {
+            return NULL;
+        }
+    }
+    return expect_reserved(p, "fi") == 0 ? node : NULL;
+}
+
+/**
+ * 解析while/until循环（关键字已被消耗）
+ * while list; do list; done
+ */
+static node_t* parse_while(parser_t *p, node_type_t type, int line) {
+    node_t *node = new_node(p, type, line);
+    if (node == NULL) {
+        return NULL;
+    }
+    
+    node->left = parse_compound_list(p, CLOSE_DO, 0);
+    if (node->left == NULL || expect_reserved(p, "do") != 0) {
+        return NULL;
+    }
+    node->right = parse_compound_list(p, CLOSE_DONE, 0);
+    if (node->right == NULL || expect_reserved(p, "done") != 0) {
+        return NULL;
+    }
+    return node;
+}
+
+/**
+ * 解析for循环（for已被消耗）
+ * for name [in word...]; do list; done，省略in时遍历位置参数
+ */
+static node_t* parse_for(parser_t *p, int line) {
+    node_t *node = new_node(p, NODE_FOR, line);
+    if (node == NULL) {
+        return NULL;
+    }
+    
+    if (p->type != TOKEN_WORD) {
+        unexpected_token(p);
+        return NULL;
+    }
+    if (!is_valid_name(p->word)) {
+        char reason[MAX_INPUT_SIZE];
+        snprintf(reason, sizeof(reason), "syntax error: `%s': not a valid identifier", p->word);
+        syntax_error(p, p->token_line, reason);
+        return NULL;
+    }
+    node->name = p->word;
+    next_token(p);
+    skip_newlines(p);
+    
+    if (at_reserved(p, "in")) {
+        next_token(p);
+        node->command = collect_words(p, 0);
+        if (node->command == NULL) {
+            return NULL;
+        }
+        if (p->type != TOKEN_SEMI && p->type != TOKEN_NEWLINE) {
+            unexpected_token(p);
+            return NULL;
+        }
+        next_token(p);
+    } else if (p->type == TOKEN_SEMI) {
+        next_token(p);
+    }
+    skip_newlines(p);
+    
+    if (expect_reserved(p, "do") != 0) {
+        return NULL;
+    }
+    node->right = parse_compound_list(p, CLOSE_DONE, 0);
+    if (node->right == NULL || expect_reserved(p, "done") != 0) {
+        return NULL;
+    }
+    return node;
+}
+
+/**
+ * 解析case语句（case已被消耗）
+ * case word in [(]pattern[|pattern]...) list;; ... esac
+ * 各分支为NODE_CASE_ITEM：command保存模式，right保存命令列表（可以为空）
+ */
+static node_t* parse_case(parser_t *p, int line) {
+    node_t *node = new_node(p, NODE_CASE, line);
+    if (node == NULL) {
+        return NULL;
+    }
+    
+    if (p->type != TOKEN_WORD) {
+        unexpected_token(p);
+        return NULL;
+    }
+    node->command = make_word_list(p, &p->word, 1);
+    if (node->command == NULL) {
+        return NULL;
+    }
+    next_token(p);
+    skip_newlines(p);
+    if (expect_reserved(p, "in") != 0) {
+        return NULL;
+    }
+    skip_newlines(p);
+    
+    node_t *last = NULL;
+    while (!at_reserved(p, "esac")) {
+        node_t *item = new_node(p, NODE_CASE_ITEM, p->token_line);
+        if (item == NULL) {
+            return NULL;
+        }
+        
+        if (p->type == TOKEN_LPAREN) {
+            next_token(p);
+        }
+        
+        /* 模式之间用|分隔 */
+        size_t count = 0;
+        char *patterns[MAX_ARGS];
+        for (;;) {
+            if (p->type != TOKEN_WORD || count >= MAX_ARGS - 1) {
+                unexpected_token(p);
+                return NULL;
+            }
+            patterns[count++] = p->word;
+            next_token(p);
+            if (p->type != TOKEN_PIPE) {
+                break;
+            }
+            next_token(p);
+        }
+        if (p->type != TOKEN_RPAREN) {
+            unexpected_token(p);
+            return NULL;
+        }
+        next_token(p);
+        
+        item->command = make_word_list(p, patterns, count);
+        if (item->command == NULL) {
+            return NULL;
+        }
+        
+        item->right = parse_compound_list(p, CLOSE_CASE_ITEM, 1);
+        if (item->right == NULL && p->error_reported) {
+            return NULL;
+        }
+        
+        if (last) {
+            last->next = item;
+        } else {
+            node->children = item;
+        }
+        last = item;
+        
+        if (p->type == TOKEN_DSEMI) {
+            next_token(p);
+            skip_newlines(p);
+        } else if (!at_reserved(p, "esac")) {
+            unexpected_token(p);
+            return NULL;
+        }
+    }
+    next_token(p);  /* 跳过esac */
+    return node;
+}
+
+/**
+ * 解析[[ expression ]]：收集到]]为止的单词，&&、||、(、)作为普通单词保存，
+ * 由evaluate_conditional在执行时求值
+ */
+static node_t* parse_conditional(parser_t *p, int line) {
+    size_t count = 0;
+    
+    for (;;) {
+        const char *word = NULL;
+        switch (p->type) {
+            case TOKEN_WORD:
+                word = (strcmp(p->word, "]]") == 0) ? NULL : p->word;
+                break;
+            case TOKEN_AND_IF:
+                word = "&&";
+                break;
+            case TOKEN_OR_IF:
+                word = "||";
+                break;
+            case TOKEN_LPAREN:
+                word = "(";
+                break;
+            case TOKEN_RPAREN:
+                word = ")";
+                break;
+            case TOKEN_REDIRECT:
+                /* <和>在[[ ]]中是字符串比较运算符 */
+                word = p->word;
+                break;
+            case TOKEN_NEWLINE:
+                next_token(p);
+                continue;
+            default:
+                unexpected_token(p);
+                return NULL;
+        }
+        if (word == NULL) {
+            break;
+        }
+        
+        if (push_word(p, count++, (char *)word) != 0) {
+            return NULL;
+        }
+        next_token(p);
+    }
+    
+    if (count == 0) {
+        unexpected_token(p);
+        return NULL;
+    }
+    next_token(p);  /* 跳过]] */
+    
+    node_t *node = new_node(p, NODE_COND, line);
+    if (node == NULL) {
+        return NULL;
+    }
+    node->command = make_word_list(p, p->argv, count);
+    return node->command ? node : NULL;
+}
+
+/**
+ * 当前单词之后（跳过空白）是否紧跟(，即name()形式的函数定义
+ */
+static int at_function_definition(parser_t *p) {
+    if (p->type != TOKEN_WORD || !is_valid_name(p->word)) {
+        return 0;
+    }
+    size_t i = p->pos;
+    while (i < p->len && (p->input[i] == ' ' || p->input[i] == '\t')) {
+        i++;
+    }
+    return i < p->len && p->input[i] == '(';
+}
+
+/**
+ * 解析函数定义：name ( ) [换行...] 复合命令
+ */
+static node_t* parse_function(parser_t *p, int line) {
+    node_t *node = new_node(p, NODE_FUNCTION, line);
+    if (node == NULL) {
+        return NULL;
+    }
+    node->name = p->word;
+    
+    next_token(p);  /* ( */
+    next_token(p);
+    if (p->type != TOKEN_RPAREN) {
+        unexpected_token(p);
+        return NULL;
+    }
+    next_token(p);
+    skip_newlines(p);
+    
+    /* 函数体必须是复合命令 */
+    if (p->type != TOKEN_LPAREN && !at_reserved(p, "{") && !at_reserved(p, "if") &&
+        !at_reserved(p, "while") && !at_reserved(p, "until") && !at_reserved(p, "for") &&
+        !at_reserved(p, "case") && !at_reserved(p, "[[")) {
+        unexpected_token(p);
+        return NULL;
+    }
+    node->right = parse_command_node(p);
+    return node->right ? node : NULL;
+}
+
+/**
+ * 解析算术命令(( expression ))：表达式原样保存，执行时由arith_evaluate求值
+ * 调用时当前词法单元是第一个(，p->pos指向第二个(
+ */
+static node_t* parse_arith_command(parser_t *p, int line) {
+    size_t close = find_closing_paren(p, p->pos);
+    if (close == (size_t)-1) {
+        return NULL;
+    }
+    if (close + 1 >= p->len || p->input[close + 1] != ')') {
+        syntax_error(p, line, "syntax error: `))' expected");
+        skip_to_next_line(p);
+        return NULL;
+    }
+    
+    size_t len = close - p->pos - 1;
+    char *expression = tree_alloc(p->tree, len + 1);
+    if (expression == NULL) {
+        p->out_of_memory = 1;
+        return NULL;
+    }
+    memcpy(expression, p->input + p->pos + 1, len);
+    expression[len] = '\0';
+    for (size_t i = 0; i < len; i++) {
+        p->line += (expression[i] == '\n');
+    }
+    
+    p->pos = close + 2;
+    next_token(p);
+    
+    node_t *node = new_node(p, NODE_ARITH, line);
+    if (node == NULL) {
+        return NULL;
+    }
+    node->command = make_word_list(p, &expression, 1);
+    return node->command ? node : NULL;
+}
+
+/**
+ * 解析命令：简单命令、{ list; }、( list )、[[ ]]、(( ))、函数定义或if/while/until/for/case复合命令
+ */
+static node_t* parse_command_node(parser_t *p) {
+    int line = p->token_line;
+    
+    if (p->type == TOKEN_LPAREN && p->pos < p->len && p->input[p->pos] == '(') {
+        return parse_arith_command(p, line);
+    }
+    
+    if (at_reserved(p, "{") || p->type == TOKEN_LPAREN) {
+        int is_group = (p->type == TOKEN_WORD);
+        next_token(p);
+        
+        node_t *body = parse_compound_list(p, is_group ? CLOSE_BRACE : CLOSE_PAREN, 0);
+        if (body == NULL) {
+            return NULL;
+        }
+        next_token(p);  /* 跳过结束符 */
+        
+        node_t *node = new_node(p, is_group ? NODE_GROUP : NODE_SUBSHELL, line);
+        if (node == NULL) {
+            return NULL;
+        }
+        node->children = body;
+        return node;
+    }
+    
+    if (p->type == TOKEN_WORD) {
+        if (strcmp(p->word, "if") == 0) {
+            next_token(p);
+            return parse_if(p, line);
+        }
+        if (strcmp(p->word, "while") == 0 || strcmp(p->word, "until") == 0) {
+            node_type_t type = (p->word[0] == 'w') ? NODE_WHILE : NODE_UNTIL;
+            next_token(p);
+            return parse_while(p, type, line);
+        }
+        if (strcmp(p->word, "for") == 0) {
+            next_token(p);
+            return parse_for(p, line);
+        }
+        if (strcmp(p->word, "case") == 0) {
+            next_token(p);
+            return parse_case(p, line);
+        }
+        if (strcmp(p->word, "[[") == 0) {
+            next_token(p);
+            return parse_conditional(p, line);
+        }
+        if (at_function_definition(p)) {
+            return parse_function(p, line);
+        }
+    }
+    
+    /* 其他保留字不能出现在命令开始处 */
+    static const char *const reserved[] = { "}", "then", "elif", "else", "fi", "do", "done", "esac", NULL };
+    if ((p->type != TOKEN_WORD && p->type != TOKEN_REDIRECT) || at_closer(p, reserved)) {
+        unexpected_token(p);
+        return NULL;
+    }
+    return parse_simple_command(p);
+}
+
+/**
+ * 解析管道：[!] command [| command]...
+ */
+static node_t* parse_pipeline(parser_t *p) {
+    int line = p->token_line;
+    int negated = 0;
+    if (at_reserved(p, "!")) {
+        negated = 1;
+        next_token(p);
+    }
+    
+    node_t *first = parse_command_node(p);
+    if (first == NULL) {
+        return NULL;
+    }
+    if (p->type != TOKEN_PIPE) {
+        first->negated ^= negated;
+        return first;
+    }
+    
+    node_t *last = first;
+    while (p->type == TOKEN_PIPE) {
+        next_token(p);
+        skip_newlines(p);
+        node_t *stage = parse_command_node(p);
+        if (stage == NULL) {
+            return NULL;
+        }
+        last->next = stage;
+        last = stage;
+    }
+    
+    node_t *node = new_node(p, NODE_PIPELINE, line);
+    if (node == NULL) {
+        return NULL;
+    }
+    node->children = first;
+    node->negated = negated;
+    return node;
+}
+
+/**
+ * 解析与或列表：pipeline [&& pipeline | || pipeline]...（左结合）
+ */
+static node_t* parse_and_or(parser_t *p) {
+    node_t *left = parse_pipeline(p);
+    
+    while (left != NULL && (p->type == TOKEN_AND_IF || p->type == TOKEN_OR_IF)) {
+        node_type_t type = (p->type == TOKEN_AND_IF) ? NODE_AND : NODE_OR;
+        next_token(p);
+        skip_newlines(p);
+        
+        node_t *right = parse_pipeline(p);
+        if (right == NULL) {
+            return NULL;
+        }
+        node_t *node = new_node(p, type, left->line);
+        if (node == NULL) {
+            return NULL;
+        }
+        node->left = left;
+        node->right = right;
+        left = node;
+    }
+    return left;
+}
+
+/**
+ * 解析输入缓冲区
+ * incomplete不为NULL时，输入在未完成的结构中结束不算错误：不报告，设置*incomplete并返回NULL
+ */
+static syntax_tree_t* parse_buffer(const char *name, const char *input, size_t len, int *incomplete) {
+    if (input == NULL) {
+        handle_error(ERROR_INVALID_ARGUMENT, "parse_input: input is NULL");
+        return NULL;
+    }
+    
+    syntax_tree_t *tree = safe_malloc(sizeof(syntax_tree_t), "parse_input: tree");
+    if (tree == NULL) {
+        return NULL;
+    }
+    tree->root = NULL;
+    tree->chunks = NULL;
+    tree->refcount = 1;
+    
+    parser_t p;
+    memset(&p, 0, sizeof(p));
+    p.heredoc_tail = &p.heredocs;
+    p.name = name;
+    p.input = input;
+    p.len = len;
+    p.line = 1;
+    p.tree = tree;
+    p.partial = (incomplete != NULL);
+    
+    int errors = 0;
+    node_t *first = NULL;
+    node_t *last = NULL;
+    int count = 0;
+    
+    next_token(&p);
+    for (;;) {
+        p.error_reported = 0;
+        skip_newlines(&p);
+        if (p.type == TOKEN_EOF || p.out_of_memory) {
+            break;
+        }
+        
+        node_t *item = parse_and_or(&p);
+        if (item != NULL && p.type != TOKEN_SEMI && p.type != TOKEN_NEWLINE && p.type != TOKEN_EOF) {
+            unexpected_token(&p);
+            item = NULL;
+        }
+        
+        if (item == NULL) {
+            errors++;
+            /* 跳到下一行继续检查 */
+            while (p.type != TOKEN_NEWLINE && p.type != TOKEN_EOF && !p.out_of_memory) {
+                next_token(&p);
+            }
+            continue;
+        }
+        
+        if (last) {
+            last->next = item;
+        } else {
+            first = item;
+        }
+        last = item;
+        count++;
+        
+        if (p.type == TOKEN_SEMI) {
+            next_token(&p);
+        }
+    }
+    
+    free(p.argv);
+    
+    if (incomplete != NULL) {
+        *incomplete = (p.incomplete && errors == 1);
+    }
+    if (p.out_of_memory) {
+        handle_error(ERROR_MEMORY_ALLOCATION, "parse_input: syntax tree allocation failed");
+        errors++;
+    }
+    if (errors > 0) {
+        free_syntax_tree(tree);
+        return NULL;
+    }
+    
+    if (count == 1) {
+        tree->root = first;
+    } else if (count > 1) {
+        tree->root = new_node(&p, NODE_SEQUENCE, first->line);
+        if (tree->root == NULL) {
+            handle_error(ERROR_MEMORY_ALLOCATION, "parse_input: syntax tree allocation failed");
+            free_syntax_tree(tree);
+            return NULL;
+        }
+        tree->root->children = first;
+    }
+    return tree;
+}
+
+/**
+ * 解析完整的输入（-c字符串或整个脚本文件）
+ * 语法错误带行号报告（name为NULL时不带位置）；出错后跳到下一行继续检查，
+ * 因此一次能报告脚本中的所有错误
+ * 返回语法树，有任何错误时返回NULL
+ */
+syntax_tree_t* parse_input(const char *name, const char *input, size_t len) {
+    return parse_buffer(name, input, len, NULL);
+}
+
+/**
+ * 解析逐行读入的输入（交互输入或标准输入）
+ * 输入在if、引号、&&等未完成的结构中结束时不报告错误，而是设置*incomplete为1并返回NULL，
+ * 调用者读入下一行后连同已有的内容重新解析
+ */
+syntax_tree_t* parse_input_partial(const char *input, size_t len, int *incomplete) {
+    *incomplete = 0;
+    return parse_buffer(NULL, input, len, incomplete);
+}
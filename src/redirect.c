@@ -0,0 +1,336 @@
+#include "shell.h"
+
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+/* 为重定向打开的文件和保存的原描述符都放在这个编号之上，避开用户常用的0-9 */
+#define REDIRECT_FD_BASE 10
+
+/* 不超过这个大小的here-document经管道传递（Linux管道缓冲区的默认容量），更大的放在memfd中 */
+#define DOCUMENT_PIPE_LIMIT 65536
+
+/**
+ * 报告重定向错误：目标: 原因
+ */
+static void redirect_error(const char *target, const char *reason) {
+    char error_msg[MAX_PATH_SIZE + 128];
+    snprintf(error_msg, sizeof(error_msg), "%s: %s", target, reason);
+    print_error(error_msg);
+}
+
+/**
+ * 把新打开的描述符移到REDIRECT_FD_BASE之上（带O_CLOEXEC），返回新的描述符
+ */
+static int move_above_base(int fd) {
+    if (fd >= REDIRECT_FD_BASE) {
+        return fd;
+    }
+    int moved = fcntl(fd, F_DUPFD_CLOEXEC, REDIRECT_FD_BASE);
+    close(fd);
+    return moved;
+}
+
+/**
+ * 判断描述符在计划中已有的步骤应用之后是否是打开的
+ */
+static int fd_is_open(const redirect_plan_t *plan, int fd) {
+    for (int i = plan->count - 1; i >= 0; i--) {
+        if (plan->steps[i].fd == fd) {
+            return plan->steps[i].source != -1;
+        }
+    }
+    return fcntl(fd, F_GETFD) != -1;
+}
+
+/**
+ * 追加一步重定向
+ */
+static void add_step(redirect_plan_t *plan, int fd, int source, int opened) {
+    redirect_step_t *step = &plan->steps[plan->count++];
+    step->fd = fd;
+    step->source = source;
+    step->opened = opened;
+    step->saved = -1;
+}
+
+/**
+ * 判断字符串是否全部由数字组成（描述符号）
+ */
+static int is_fd_number(const char *text) {
+    if (*text == '\0') {
+        return 0;
+    }
+    for (const char *c = text; *c; c++) {
+        if (!isdigit((unsigned char)*c)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * 把here-document的内容（以及可选的结尾换行）全部写入fd
+ */
+static int write_document(int fd, const char *data, size_t len, int newline) {
+    struct iovec iov[2] = { { (void *)data, len }, { "\n", newline ? 1 : 0 } };
+    int index = 0;
+    while (index < 2) {
+        ssize_t n = writev(fd, iov + index, 2 - index);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        while (index < 2 && (size_t)n >= iov[index].iov_len) {
+            n -= (ssize_t)iov[index].iov_len;
+            index++;
+        }
+        if (index < 2) {
+            iov[index].iov_base = (char *)iov[index].iov_base + n;
+            iov[index].iov_len -= (size_t)n;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 为here-document的内容创建可读的描述符，不使用临时文件：
+ * 内容放得进管道缓冲区时写入管道后关闭写端（读到结尾即EOF），否则写入memfd并回到开头
+ * 返回读取用的描述符（带O_CLOEXEC），失败返回-1
+ */
+static int open_document(const char *data, size_t len, int newline) {
+    size_t total = len + (newline ? 1 : 0);
+    int fds[2];
+    if (total <= DOCUMENT_PIPE_LIMIT && pipe2(fds, O_CLOEXEC) == 0) {
+        /* 管道缓冲区可能被系统限制得比默认值小，写入前确认放得下，避免阻塞 */
+        if (total <= PIPE_BUF || fcntl(fds[1], F_GETPIPE_SZ) >= (int)total) {
+            int result = write_document(fds[1], data, len, newline);
+            close(fds[1]);
+            if (result != 0) {
+                close(fds[0]);
+                return -1;
+            }
+            return fds[0];
+        }
+        close(fds[0]);
+        close(fds[1]);
+    }
+    
+    int fd = memfd_create("here-document", MFD_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    if (write_document(fd, data, len, newline) != 0 || lseek(fd, 0, SEEK_SET) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * 准备here-document和here-string：内容展开到一个缓冲区后交给open_document
+ */
+static int prepare_document(const redirection_t *r, redirect_plan_t *plan) {
+    char *expanded = NULL;
+    const char *data = r->word;
+    size_t len = strlen(r->word);
+    if (r->type == REDIR_HEREDOC) {
+        expanded = expand_heredoc(r->word, &len);
+    } else if (r->type == REDIR_HERESTRING) {
+        expanded = expand_single_word(r->word);
+        len = expanded ? strlen(expanded) : 0;
+    }
+    if (r->type != REDIR_HEREDOC_LITERAL) {
+        if (expanded == NULL) {
+            return take_expansion_error() ? 1 : -1;
+        }
+        data = expanded;
+    }
+    
+    int fd = open_document(data, len, r->type == REDIR_HERESTRING);
+    TRACKED_FREE(expanded);
+    if (fd == -1 || (fd = move_above_base(fd)) == -1) {
+        redirect_error("here-document", strerror(errno));
+        return 1;
+    }
+    add_step(plan, r->fd, fd, 1);
+    return 0;
+}
+
+/**
+ * 展开一个重定向并加入计划：文件在这里打开，出错时报告并返回1
+ */
+static int prepare_one(const redirection_t *r, const char *target, redirect_plan_t *plan) {
+    redirection_type_t type = r->type;
+    
+    if (type == REDIR_DUPLICATE) {
+        if (strcmp(target, "-") == 0) {
+            add_step(plan, r->fd, -1, 0);
+            return 0;
+        }
+        if (!is_fd_number(target)) {
+            /* >&file与&>file相同；其他情况下只能是描述符号 */
+            if (r->fd != STDOUT_FILENO) {
+                redirect_error(target, "ambiguous redirect");
+                return 1;
+            }
+            type = REDIR_OUTPUT_ALL;
+        } else {
+            long source = strtol(target, NULL, 10);
+            if (source > INT_MAX || !fd_is_open(plan, (int)source)) {
+                redirect_error(target, "Bad file descriptor");
+                return 1;
+            }
+            add_step(plan, r->fd, (int)source, 0);
+            return 0;
+        }
+    }
+    
+    int flags;
+    switch (type) {
+        case REDIR_INPUT:
+            flags = O_RDONLY;
+            break;
+        case REDIR_APPEND:
+        case REDIR_APPEND_ALL:
+            flags = O_WRONLY | O_CREAT | O_APPEND;
+            break;
+        default:
+            flags = O_WRONLY | O_CREAT | O_TRUNC;
+            break;
+    }
+    
+    int fd = open(target, flags | O_CLOEXEC, 0666);
+    if (fd == -1 || (fd = move_above_base(fd)) == -1) {
+        redirect_error(target, strerror(errno));
+        return 1;
+    }
+    add_step(plan, r->fd, fd, 1);
+    if (type == REDIR_OUTPUT_ALL || type == REDIR_APPEND_ALL) {
+        add_step(plan, STDERR_FILENO, STDOUT_FILENO, 0);
+    }
+    return 0;
+}
+
+/**
+ * 展开命令的重定向列表：扩展目标单词并打开文件，得到按顺序应用的步骤
+ * 文件描述符的复制（2>&1）记录为步骤，在应用时按顺序执行，因此与文件重定向的先后关系正确
+ * 返回0表示成功，1表示出错且已报告（计划已释放），-1表示内存分配失败
+ */
+int redirect_prepare(const redirection_t *list, redirect_plan_t *plan) {
+    plan->count = 0;
+    plan->applied = 0;
+    
+    /* &>（以及可能等同于它的>&）占两步 */
+    int capacity = 0;
+    for (const redirection_t *r = list; r != NULL; r = r->next) {
+        int both = (r->type == REDIR_DUPLICATE || r->type == REDIR_OUTPUT_ALL || r->type == REDIR_APPEND_ALL);
+        capacity += both ? 2 : 1;
+    }
+    plan->steps = safe_malloc((size_t)capacity * sizeof(redirect_step_t), "redirect_prepare: steps");
+    if (plan->steps == NULL) {
+        return -1;
+    }
+    
+    for (const redirection_t *r = list; r != NULL; r = r->next) {
+        if (r->type == REDIR_HEREDOC || r->type == REDIR_HEREDOC_LITERAL || r->type == REDIR_HERESTRING) {
+            int result = prepare_document(r, plan);
+            if (result != 0) {
+                redirect_release(plan);
+                return result;
+            }
+            continue;
+        }
+        
+        char *target = expand_single_word(r->word);
+        if (target == NULL) {
+            int reported = take_expansion_error();
+            redirect_release(plan);
+            return reported ? 1 : -1;
+        }
+        int result = prepare_one(r, target, plan);
+        TRACKED_FREE(target);
+        if (result != 0) {
+            redirect_release(plan);
+            return result;
+        }
+    }
+    return 0;
+}
+
+/**
+ * 在当前进程中应用重定向（用于内部命令和函数）：
+ * 原来的描述符用F_DUPFD_CLOEXEC保存，目标用dup3装到位，之后由redirect_restore换回
+ * 返回0表示成功；失败时已应用的部分被撤销，返回1
+ */
+int redirect_apply(redirect_plan_t *plan) {
+    /* 缓冲区中的内容属于重定向之前的目标 */
+    output_flush_all();
+    
+    for (int i = 0; i < plan->count; i++) {
+        redirect_step_t *step = &plan->steps[i];
+        step->saved = fcntl(step->fd, F_DUPFD_CLOEXEC, REDIRECT_FD_BASE);
+        if (step->saved == -1 && errno != EBADF) {
+            redirect_error("redirection", strerror(errno));
+            redirect_restore(plan);
+            return 1;
+        }
+        plan->applied = i + 1;
+        
+        int result;
+        if (step->source == -1) {
+            result = (close(step->fd) == -1 && errno != EBADF) ? -1 : 0;
+        } else if (step->source == step->fd) {
+            result = 0;
+        } else {
+            result = dup3(step->source, step->fd, 0);
+        }
+        if (result == -1) {
+            redirect_error("redirection", strerror(errno));
+            redirect_restore(plan);
+            return 1;
+        }
+    }
+    
+    output_reset_tty_cache();
+    return 0;
+}
+
+/**
+ * 撤销redirect_apply：按相反的顺序把保存的描述符换回原位
+ */
+void redirect_restore(redirect_plan_t *plan) {
+    if (plan->applied == 0) {
+        return;
+    }
+    output_flush_all();
+    
+    for (int i = plan->applied - 1; i >= 0; i--) {
+        redirect_step_t *step = &plan->steps[i];
+        if (step->saved != -1) {
+            dup3(step->saved, step->fd, 0);
+            close(step->saved);
+            step->saved = -1;
+        } else {
+            close(step->fd);
+        }
+    }
+    plan->applied = 0;
+    output_reset_tty_cache();
+}
+
+/**
+ * 关闭为重定向打开的文件并释放计划
+ */
+void redirect_release(redirect_plan_t *plan) {
+    for (int i = 0; i < plan->count; i++) {
+        if (plan->steps[i].opened) {
+            close(plan->steps[i].source);
+        }
+    }
+    free(plan->steps);
+    plan->steps = NULL;
+    plan->count = 0;
+}
@@ -0,0 +1,105 @@
+#include "shell.h"
+
+#include <sys/mman.h>
+
+/**
+ * 执行解析好的语法树并释放它
+ * exec_last为1时最后一条外部命令直接exec替换当前进程
+ * 返回最后一条命令的退出状态
+ */
+static int run_parsed_script(syntax_tree_t *tree, int exec_last) {
+    g_shell_state.last_exit_status = 0;
+    if (exec_last) {
+        execute_tree_in_place(tree->root);
+    } else {
+        execute_tree(tree->root);
+    }
+    
+    free_syntax_tree(tree);
+    return g_shell_state.last_exit_status;
+}
+
+/**
+ * 执行-c指定的命令字符串
+ * 最后一条命令若为外部命令，直接exec而不是fork后等待
+ */
+int run_command_string(char *command) {
+    if (command == NULL) {
+        handle_error(ERROR_INVALID_ARGUMENT, "run_command_string: command is NULL");
+        return -1;
+    }
+    
+    syntax_tree_t *tree = parse_input("-c", command, strlen(command));
+    if (tree == NULL) {
+        g_shell_state.last_exit_status = 2;
+        return 2;
+    }
+    
+    return run_parsed_script(tree, 1);
+}
+
+/**
+ * 执行脚本文件
+ * 整个文件通过mmap映射后一次性解析成语法树，有语法错误时不执行任何命令；
+ * 位置参数需在调用前通过set_positional_params设置
+ * 返回最后一条命令的退出状态
+ */
+int run_script_file(char *path) {
+    if (path == NULL) {
+        handle_error(ERROR_INVALID_ARGUMENT, "run_script_file: path is NULL");
+        return -1;
+    }
+    
+    char error_msg[MAX_PATH_SIZE + 128];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        snprintf(error_msg, sizeof(error_msg), "%s: %s", path, strerror(errno));
+        print_error(error_msg);
+        g_shell_state.last_exit_status = 127;
+        return 127;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        handle_syscall_error("fstat", "run_script_file");
+        close(fd);
+        g_shell_state.last_exit_status = 126;
+        return 126;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        snprintf(error_msg, sizeof(error_msg), "%s: %s", path,
+                 S_ISDIR(st.st_mode) ? "Is a directory" : "not a regular file");
+        print_error(error_msg);
+        close(fd);
+        g_shell_state.last_exit_status = 126;
+        return 126;
+    }
+    
+    size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        close(fd);
+        g_shell_state.last_exit_status = 0;
+        return 0;
+    }
+    
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        handle_syscall_error("mmap", "run_script_file");
+        g_shell_state.last_exit_status = 126;
+        return 126;
+    }
+    madvise(data, size, MADV_SEQUENTIAL);
+    
+    syntax_tree_t *tree = parse_input(path, data, size);
+    
+    /* 单词都已复制到语法树中，映射不再需要 */
+    munmap(data, size);
+    
+    if (tree == NULL) {
+        g_shell_state.last_exit_status = 2;
+        return 2;
+    }
+    
+    return run_parsed_script(tree, 0);
+}
@@ -16,15 +16,19 @@
 #include <stdarg.h>
 #include <termios.h>
 #include <sys/ioctl.h>
+#include <sys/sysmacros.h>
 #include <utime.h>
 #include <sys/time.h>
 #include <ctype.h>
+#include <pwd.h>
+#include <grp.h>
 
 /* 最大输入长度 */
 #define MAX_INPUT_SIZE 1024
 #define MAX_ARGS 64
 #define MAX_PATH_SIZE 1024
 #define MAX_ALLOCATION_SIZE (1024 * 1024 * 10)  /* 10MB 最大分配限制 */
+#define OUTPUT_BUFFER_SIZE 8192  /* 每个fd的输出缓冲区大小 */
 
 /* 错误代码枚举 - 增强版本 */
 typedef enum {
@@ -83,21 +87,106 @@ typedef struct {
     int error_count;
     int log_enabled;
     FILE *log_file;
+    int log_file_opened;        /* 是否已尝试打开日志文件（首次写日志时才打开） */
+    log_level_t log_threshold;  /* 低于该级别的日志不输出 */
 } error_state_t;
 
+/* 重定向类型 */
+typedef enum {
+    REDIR_INPUT,        /* [n]<word */
+    REDIR_OUTPUT,       /* [n]>word、[n]>|word */
+    REDIR_APPEND,       /* [n]>>word */
+    REDIR_DUPLICATE,    /* [n]>&word、[n]<&word：word为描述符号，或-表示关闭 */
+    REDIR_OUTPUT_ALL,   /* &>word：标准输出和标准错误写入同一个文件 */
+    REDIR_APPEND_ALL,   /* &>>word */
+    REDIR_HEREDOC,      /* [n]<<word、[n]<<-word：word为正文，执行时展开变量和命令替换 */
+    REDIR_HEREDOC_LITERAL,  /* 结束符带引号的here-document：正文按原样使用 */
+    REDIR_HERESTRING    /* [n]<<<word：word展开后加一个换行 */
+} redirection_type_t;
+
+/* 简单命令的一个重定向（目标单词在执行时才扩展） */
+typedef struct redirection {
+    redirection_type_t type;
+    int fd;                     /* 被重定向的描述符 */
+    char *word;                 /* 文件名、描述符号或here-document的正文 */
+    struct redirection *next;   /* 按出现顺序相连 */
+} redirection_t;
+
 /* 命令结构体 */
 typedef struct {
     char *command;      /* 命令名 */
     char **args;        /* 参数数组 */
     int argc;           /* 参数个数 */
-    char *input_file;   /* 输入重定向文件 */
-    char *output_file;  /* 输出重定向文件 */
+    char *input_file;   /* 输入重定向文件（parse_command的单条命令，语法树中不使用） */
+    char *output_file;  /* 输出重定向文件（parse_command的单条命令，语法树中不使用） */
+    redirection_t *redirections;  /* 重定向列表，没有时为NULL */
 } command_t;
 
+/* 语法树节点类型 */
+typedef enum {
+    NODE_COMMAND,   /* 简单命令 */
+    NODE_PIPELINE,  /* cmd1 | cmd2 | ... */
+    NODE_AND,       /* left && right */
+    NODE_OR,        /* left || right */
+    NODE_SEQUENCE,  /* 以;或换行分隔的命令列表 */
+    NODE_GROUP,     /* { list; } */
+    NODE_SUBSHELL,  /* ( list ) */
+    NODE_IF,        /* if left; then right; else else_part; fi */
+    NODE_WHILE,     /* while left; do right; done */
+    NODE_UNTIL,     /* until left; do right; done */
+    NODE_FOR,       /* for name in command->args; do right; done */
+    NODE_CASE,      /* case command->args[0] in children... esac */
+    NODE_CASE_ITEM, /* command->args为模式，right为命令列表 */
+    NODE_COND,      /* [[ command->args ]]，单词在求值时才扩展 */
+    NODE_FUNCTION,  /* name() right：定义函数 */
+    NODE_ARITH      /* (( command->args[0] )) */
+} node_type_t;
+
+/* 语法树节点 */
+typedef struct node {
+    node_type_t type;
+    int line;                   /* 节点开始处的行号 */
+    int negated;                /* 前面带有!，退出状态取反 */
+    command_t *command;         /* 简单命令；for的单词列表、case的单词和分支的模式 */
+    char *name;                 /* for的循环变量名；函数名 */
+    struct node *left;          /* NODE_AND/NODE_OR的左侧；if/while/until的条件列表 */
+    struct node *right;         /* NODE_AND/NODE_OR的右侧；复合命令的主体列表 */
+    struct node *else_part;     /* if的else列表或elif对应的嵌套NODE_IF */
+    struct node *children;      /* 管道、序列、{ }、( )和case分支中的第一项 */
+    struct node *next;          /* 同一列表中的下一项 */
+} node_t;
+
+/* 语法树：节点、参数数组和单词都分配在树自己的内存池中，整体释放 */
+typedef struct {
+    node_t *root;               /* 输入为空（只有空白或注释）时为NULL */
+    struct tree_chunk *chunks;
+    int refcount;               /* 引用计数（解析缓存与执行者共享同一棵树） */
+} syntax_tree_t;
+
+/* 编译后的glob模式（定义在glob.c中） */
+typedef struct glob_pattern glob_pattern_t;
+
+/* 花括号展开生成器（定义在brace.c中） */
+typedef struct brace_expansion brace_expansion_t;
+
+/* 路径名扩展的每个结果交给回调处理，返回非0时停止 */
+typedef int (*glob_path_callback_t)(const char *path, void *data);
+
+/* 路径名扩展选项（由shopt和GLOBSORT设置） */
+#define GLOB_OPT_NULLGLOB 0x1   /* 没有匹配的模式扩展为空，而不是保留原样 */
+#define GLOB_OPT_DOTGLOB  0x2   /* 通配符也匹配以.开头的文件 */
+#define GLOB_OPT_GLOBSTAR 0x4   /* **匹配任意层目录 */
+#define GLOB_OPT_NOSORT   0x8   /* 结果按目录顺序，不排序 */
+
+/* 下标数组和关联数组（定义在array.c中） */
+typedef struct shell_array shell_array_t;
+
 /* 环境变量结构体 */
 typedef struct env_var {
     char *name;
-    char *value;
+    char *value;                /* 数组变量为NULL */
+    shell_array_t *array;       /* 数组变量的元素，普通变量为NULL */
+    int exported;               /* 1表示传给子进程（export），0表示只属于Shell */
     struct env_var *next;
 } env_var_t;
 
@@ -107,8 +196,75 @@ typedef struct {
     env_var_t *env_vars;
     int last_exit_status;
     int running;
+    int interactive;    /* 1表示从终端交互读取，0表示批处理（管道、文件或-s） */
+    char *script_name;          /* $0：脚本名，交互模式下为NULL */
+    char **positional_params;   /* $1..$N */
+    int positional_count;       /* $# */
+    int loop_depth;             /* 当前嵌套的循环层数 */
+    int break_levels;           /* 待处理的break层数 */
+    int continue_levels;        /* 待处理的continue层数 */
+    int function_depth;         /* 当前嵌套的函数调用层数 */
+    int returning;              /* 函数中执行了return，尚未返回 */
+    pid_t shell_pid;            /* $$：Shell进程的PID（子Shell中不变） */
+    pid_t last_background_pid;  /* $!：最近的后台进程，0表示没有 */
+    int glob_options;           /* 路径名扩展选项（GLOB_OPT_*） */
 } shell_state_t;
 
+/* 特殊参数（$?、$#等）格式化数字用的缓冲区大小 */
+#define PARAM_SCRATCH_SIZE 24
+
+/* 保存的位置参数（函数调用期间替换，返回时恢复） */
+typedef struct {
+    char **params;
+    int count;
+} positional_save_t;
+
+/* local变量的一条绑定：变量在进入作用域之前的值 */
+typedef struct local_binding {
+    char *name;
+    char *saved_value;          /* NULL表示之前未设置 */
+    shell_array_t *saved_array; /* 之前是数组时保存整个数组 */
+    int saved_exported;         /* 之前是否导出 */
+    struct local_binding *next;
+} local_binding_t;
+
+/* local变量作用域（每次函数调用一个，分配在调用者的栈上） */
+typedef struct local_scope {
+    local_binding_t *bindings;
+    struct local_scope *parent;
+} local_scope_t;
+
+/* 批量元数据请求（见metadata.c） */
+typedef struct {
+    const char *name;   /* 相对于dirfd的路径 */
+    struct stat st;     /* 获取到的元数据 */
+    int error;          /* 0表示成功，否则为errno */
+} meta_request_t;
+
+/* 命令替换在当前进程中执行时的stdout捕获缓冲区（见io.c） */
+typedef struct output_capture {
+    char *data;
+    size_t len;
+    size_t capacity;
+    int failed;                     /* 内存不足，内容不完整 */
+    struct output_capture *parent;  /* 外层的捕获（嵌套的命令替换） */
+} output_capture_t;
+
+/* 展开后的一步重定向：把source复制到fd，source为-1时关闭fd（见redirect.c） */
+typedef struct {
+    int fd;
+    int source;
+    int opened;     /* source是为这次重定向打开的文件，用完后关闭 */
+    int saved;      /* 在当前进程中应用时fd原来的副本，-1表示原来没有打开 */
+} redirect_step_t;
+
+/* 一条命令的全部重定向，按顺序应用 */
+typedef struct {
+    redirect_step_t *steps;
+    int count;
+    int applied;    /* 已在当前进程中应用的步数 */
+} redirect_plan_t;
+
 /* 内部命令函数指针类型 */
 typedef int (*builtin_func_t)(char **args);
 
@@ -134,6 +290,12 @@ void setup_signal_handlers(void);
 command_t* parse_command(char *input);
 void free_command(command_t *cmd);
 char** tokenize_input(char *input, int *token_count);
+syntax_tree_t* parse_input(const char *name, const char *input, size_t len);
+syntax_tree_t* parse_input_partial(const char *input, size_t len, int *incomplete);
+syntax_tree_t* copy_syntax_tree(const node_t *node);
+void free_syntax_tree(syntax_tree_t *tree);
+size_t find_assignment(const char *word);
+size_t find_command_paren_end(const char *text, size_t len, size_t open);
 
 /* 函数声明 - builtin.c */
 int is_builtin(char *command);
@@ -145,24 +307,115 @@ int builtin_cat(char **args);
 int builtin_cp(char **args);
 int builtin_rm(char **args);
 int builtin_touch(char **args);
+int builtin_stat(char **args);
 int builtin_date(char **args);
 int builtin_pwd(char **args);
 int builtin_cd(char **args);
 int builtin_echo(char **args);
+int builtin_echo_unexpanded(char **args);
+int echo_args_are_simple(char **args, int argc);
 int builtin_export(char **args);
 int builtin_memstat(char **args);
 int builtin_exit(char **args);
+int builtin_break(char **args);
+int builtin_continue(char **args);
+int builtin_true(char **args);
+int builtin_false(char **args);
+int builtin_test(char **args);
+int builtin_bracket(char **args);
+int builtin_return(char **args);
+int builtin_local(char **args);
+int builtin_declare(char **args);
+int builtin_unset(char **args);
+int builtin_let(char **args);
+int builtin_shopt(char **args);
 int builtin_help(char **args);
 
 /* 函数声明 - external.c */
 int execute_external(char *command, char **args);
 char* find_executable(char *command);
 int fork_and_exec(char *path, char **args);
+int execute_external_redirected(char *command, char **args, const redirect_plan_t *plan);
+int spawn_and_wait(char *path, char **args, const redirect_plan_t *plan);
+
+/* 函数声明 - redirect.c */
+int redirect_prepare(const redirection_t *list, redirect_plan_t *plan);
+int redirect_apply(redirect_plan_t *plan);
+void redirect_restore(redirect_plan_t *plan);
+void redirect_release(redirect_plan_t *plan);
+
+/* 函数声明 - executor.c */
+int execute_command(command_t *cmd);
+int exit_status_from_result(int result);
+int execute_tree(node_t *root);
+int execute_tree_in_place(node_t *root);
+int command_substitute(const char *text, size_t len, char **output, size_t *out_len);
+int process_substitute(const char *text, size_t len, int writing, char *path, size_t path_size);
+
+/* 函数声明 - script.c */
+int run_script_file(char *path);
+int run_command_string(char *command);
+
+/* 函数声明 - parse_cache.c */
+syntax_tree_t* parse_line_cached(const char *line, size_t len, int *incomplete);
+void clear_parse_cache(void);
+void set_parse_cache_size(int size);
+void get_parse_cache_stats(unsigned long *hits, unsigned long *misses, int *entries);
+void print_parse_cache_stats(void);
+
+/* 函数声明 - function.c */
+int define_function(const char *name, const node_t *body);
+syntax_tree_t* find_function(const char *name);
+void clear_functions(void);
+
+/* 函数声明 - arith.c */
+int arith_evaluate(const char *expression, long long *result);
+void clear_arith_cache(void);
+
+/* 函数声明 - glob.c */
+const glob_pattern_t* glob_compile(const char *pattern);
+int glob_match(const glob_pattern_t *glob, const char *text, size_t len);
+size_t glob_match_prefix(const glob_pattern_t *glob, const char *text, size_t len, int longest);
+size_t glob_match_suffix(const glob_pattern_t *glob, const char *text, size_t len, int longest);
+int glob_find(const glob_pattern_t *glob, const char *text, size_t len, size_t start,
+              size_t *match_start, size_t *match_len);
+void clear_glob_cache(void);
+int glob_has_magic(const char *pattern);
+void glob_unescape(char *pattern);
+int glob_expand_path(const char *pattern, int options, glob_path_callback_t callback, void *data);
+
+/* 函数声明 - brace.c */
+int brace_compile(const char *word, brace_expansion_t **out);
+const char* brace_next(brace_expansion_t *b, int *failed);
+void brace_free(brace_expansion_t *b);
+
+/* 函数声明 - array.c */
+shell_array_t* array_create(int associative);
+void array_free(shell_array_t *array);
+int array_is_associative(const shell_array_t *array);
+size_t array_count(const shell_array_t *array);
+const char* array_get(const shell_array_t *array, long long index);
+int array_set(shell_array_t *array, long long index, const char *value);
+int array_unset(shell_array_t *array, long long index);
+long long array_max_index(const shell_array_t *array);
+const char* array_get_key(const shell_array_t *array, const char *key);
+int array_set_key(shell_array_t *array, const char *key, const char *value);
+int array_unset_key(shell_array_t *array, const char *key);
+int array_next(const shell_array_t *array, size_t *cursor, const char **key, long long *index, const char **value);
+
+/* 函数声明 - conditional.c */
+int evaluate_test(const char *name, char **args, int argc);
+int evaluate_conditional(char **words, int count);
+
+/* 函数声明 - metadata.c */
+int fetch_metadata_batch(int dirfd, meta_request_t *reqs, size_t count, int flags);
 
 /* 函数声明 - environment.c */
 void init_environment(void);
 char* get_env_var(char *name);
 int set_env_var(char *name, char *value);
+int export_env_var(char *name, char *value);
+char** get_exported_environment(void);
 char* expand_variables(char *input);
 char** get_path_dirs(void);
 void free_path_dirs(char **dirs);
@@ -170,10 +423,38 @@ void cleanup_environment(void);
 void print_all_env_vars(void);
 int env_var_exists(char *name);
 int unset_env_var(char *name);
+void set_positional_params(char *name, int count, char **values);
+void push_positional_params(int count, char **values, positional_save_t *save);
+void pop_positional_params(positional_save_t *save);
+void push_local_scope(local_scope_t *scope);
+void pop_local_scope(void);
+int declare_local_var(char *name, char *value);
+int push_temporary_assignments(char **words, int count, local_scope_t *scope);
+shell_array_t* get_array_var(const char *name);
+shell_array_t* make_array_var(const char *name, int associative);
+const char* get_array_element(const char *name, const char *subscript, int *failed);
+int set_array_element(const char *name, const char *subscript, const char *value, int append);
+int unset_array_element(const char *name, const char *subscript);
+const char* get_subscripted_var(const char *reference, int *failed);
+int set_subscripted_var(const char *reference, const char *value);
+int assign_shell_variable(const char *name, const char *subscript, const char *value, int append);
+int assign_compound(const char *name, int append, char **elements, int count);
+int perform_assignment(char **words, int count, int *used);
+int print_variable_declaration(const char *name);
+const char* get_shell_param(const char *name, char *scratch);
+int expand_arguments(char **args, int argc, char ***out_args, int *out_argc);
+char* expand_single_word(const char *word);
+char* expand_heredoc(const char *body, size_t *out_len);
+char* expand_pattern(const char *word);
+int take_expansion_error(void);
+void free_expanded_arguments(char **args);
 
 /* 函数声明 - io.c */
 void display_prompt(void);
+void display_continuation_prompt(void);
+int input_cancelled(void);
 char* read_input(void);
+void input_sync_stdin(void);
 void print_error(char *message);
 void print_output(char *message);
 void print_warning(char *message);
@@ -186,6 +467,19 @@ void clear_screen(void);
 void set_cursor_position(int row, int col);
 int get_terminal_size(int *rows, int *cols);
 void print_separator(char ch, int length);
+void output_write(int fd, const char *data, size_t len);
+void output_puts(int fd, const char *str);
+void output_putc(int fd, char ch);
+void output_printf(int fd, const char *format, ...);
+void output_vprintf(int fd, const char *format, va_list args);
+void output_flush(int fd);
+void output_flush_all(void);
+int output_take_error(void);
+int output_is_tty(int fd);
+void output_reset_tty_cache(void);
+void output_capture_begin(output_capture_t *capture);
+void output_capture_end(output_capture_t *capture);
+void output_capture_detach(void);
 
 /* 函数声明 - error.c */
 void init_error_system(void);
@@ -195,6 +489,7 @@ void handle_syscall_error(const char *syscall_name, const char *context);
 void handle_memory_error(const char *context, size_t size);
 void log_error(const char *message);
 void log_error_with_level(log_level_t level, const char *message);
+void set_log_threshold(log_level_t level);
 void log_debug(const char *message);
 void log_info(const char *message);
 void log_warning(const char *message);
@@ -309,10 +604,16 @@ int is_memory_tracking_enabled(void);
         } \
     } while(0)
 
+/* 函数进出跟踪只在调试版本（make debug）中启用，避免每条命令都写日志 */
+#ifdef DEBUG
 #define LOG_FUNCTION_ENTRY(func_name) \
     log_debug("Entering function: " func_name)
 
 #define LOG_FUNCTION_EXIT(func_name) \
     log_debug("Exiting function: " func_name)
+#else
+#define LOG_FUNCTION_ENTRY(func_name) ((void)0)
+#define LOG_FUNCTION_EXIT(func_name) ((void)0)
+#endif
 
 #endif /* SHELL_H */
@@ -8,6 +8,7 @@
 
 /* 包含Shell头文件进行测试 */
 #include "../src/shell.h"
+#include "test_helpers.h"
 
 /* 定义全局Shell状态用于测试 */
 shell_state_t g_shell_state;
@@ -37,23 +38,17 @@ int test_pwd_command(void) {
         return 0;
     }
     
-    /* 重定向stdout到缓冲区以捕获输出 */
-    FILE *original_stdout = stdout;
+    /* 捕获stdout的输出 */
     char output_buffer[MAX_PATH_SIZE + 10];
-    FILE *temp_stdout = fmemopen(output_buffer, sizeof(output_buffer), "w");
-    if (temp_stdout == NULL) {
-        printf("Failed to create temporary stdout\n");
-        return 0;
-    }
-    
-    stdout = temp_stdout;
+    output_capture_t capture;
+    output_capture_begin(&capture);
     
     /* 执行pwd命令 */
     int result = builtin_pwd(NULL);
     
-    /* 恢复stdout */
-    fclose(temp_stdout);
-    stdout = original_stdout;
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer));
     
     /* 检查返回值 */
     if (result != 0) {
@@ -91,23 +86,17 @@ int test_pwd_different_directory(void) {
         return 0;
     }
     
-    /* 重定向stdout */
-    FILE *original_stdout = stdout;
+    /* 捕获stdout的输出 */
     char output_buffer[MAX_PATH_SIZE + 10];
-    FILE *temp_stdout = fmemopen(output_buffer, sizeof(output_buffer), "w");
-    if (temp_stdout == NULL) {
-        chdir(original_cwd);  /* 恢复目录 */
-        return 0;
-    }
-    
-    stdout = temp_stdout;
+    output_capture_t capture;
+    output_capture_begin(&capture);
     
     /* 执行pwd命令 */
     int result = builtin_pwd(NULL);
     
-    /* 恢复stdout */
-    fclose(temp_stdout);
-    stdout = original_stdout;
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer));
     
     /* 恢复原目录 */
     chdir(original_cwd);
@@ -231,52 +220,42 @@ int test_cd_invalid_directory(void) {
 
 /* 测试ls命令基本功能 */
 int test_ls_command(void) {
-    /* 重定向stdout到缓冲区以捕获输出 */
-    FILE *original_stdout = stdout;
+    /* 捕获stdout的输出 */
     char output_buffer[4096];
-    FILE *temp_stdout = fmemopen(output_buffer, sizeof(output_buffer), "w");
-    if (temp_stdout == NULL) {
-        return 0;
-    }
-    
-    stdout = temp_stdout;
+    output_capture_t capture;
+    output_capture_begin(&capture);
     
     /* 执行ls命令（当前目录） */
     int result = builtin_ls(NULL);
     
-    /* 恢复stdout */
-    fclose(temp_stdout);
-    stdout = original_stdout;
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer));
     
     /* 检查返回值 */
     if (result != 0) {
         return 0;
     }
     
-    /* 检查输出是否包含一些预期的文件 */
-    /* 应该至少包含一些内容 */
-    return (strlen(output_buffer) > 0);
+    /* 每一行以类型和权限开头，当前目录显示为 ./ */
+    return (strlen(output_buffer) > 0 && output_buffer[0] == 'd' &&
+            strstr(output_buffer, "  ./\n") != NULL);
 }
 
 /* 测试ls命令指定目录 */
 int test_ls_specific_directory(void) {
-    /* 重定向stdout */
-    FILE *original_stdout = stdout;
+    /* 捕获stdout的输出 */
     char output_buffer[4096];
-    FILE *temp_stdout = fmemopen(output_buffer, sizeof(output_buffer), "w");
-    if (temp_stdout == NULL) {
-        return 0;
-    }
-    
-    stdout = temp_stdout;
+    output_capture_t capture;
+    output_capture_begin(&capture);
     
     /* 执行ls命令（根目录） */
     char *args[] = {"/", NULL};
     int result = builtin_ls(args);
     
-    /* 恢复stdout */
-    fclose(temp_stdout);
-    stdout = original_stdout;
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer));
     
     /* 检查返回值 */
     if (result != 0) {
@@ -299,25 +278,123 @@ int test_ls_invalid_directory(void) {
     return (result != 0);
 }
 
-/* 测试echo命令基本功能 */
-int test_echo_command(void) {
-    /* 重定向stdout */
-    FILE *original_stdout = stdout;
-    char output_buffer[1024];
-    FILE *temp_stdout = fmemopen(output_buffer, sizeof(output_buffer), "w");
-    if (temp_stdout == NULL) {
+/* 测试ls -l长格式输出 */
+int test_ls_long_format(void) {
+    /* 捕获stdout的输出 */
+    char output_buffer[8192];
+    memset(output_buffer, 0, sizeof(output_buffer));
+    output_capture_t capture;
+    output_capture_begin(&capture);
+    
+    /* 执行ls -l命令（根目录） */
+    char *args[] = {"-l", "/", NULL};
+    int result = builtin_ls(args);
+    
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer) - 1);
+    
+    if (result != 0) {
         return 0;
     }
     
-    stdout = temp_stdout;
+    /* 长格式应该包含目录的权限位，且按名字排序 */
+    char *dot = strstr(output_buffer, " ./\n");
+    char *dotdot = strstr(output_buffer, " ../\n");
+    return (strstr(output_buffer, "drwx") != NULL && dot != NULL && dotdot != NULL && dot < dotdot);
+}
+
+/* 测试ls合并的短选项（-la、-al）：长格式并列出隐藏文件 */
+int test_ls_combined_flags(void) {
+    char dir_template[] = "/tmp/ls_flags_XXXXXX";
+    char *dir = mkdtemp(dir_template);
+    if (dir == NULL) {
+        return 0;
+    }
+    char hidden[64];
+    snprintf(hidden, sizeof(hidden), "%s/.hidden_entry", dir);
+    FILE *file = fopen(hidden, "w");
+    if (file != NULL) {
+        fclose(file);
+    }
+    
+    int ok = (file != NULL);
+    const char *flags[] = {"-la", "-al"};
+    for (int i = 0; i < 2 && ok; i++) {
+        char output_buffer[4096];
+        memset(output_buffer, 0, sizeof(output_buffer));
+        output_capture_t capture;
+        output_capture_begin(&capture);
+        
+        char *args[] = {(char *)flags[i], dir, NULL};
+        int result = builtin_ls(args);
+        
+        output_capture_end(&capture);
+        take_captured_output(&capture, output_buffer, sizeof(output_buffer) - 1);
+        
+        ok = (result == 0 && strstr(output_buffer, "-rw") != NULL &&
+              strstr(output_buffer, " .hidden_entry\n") != NULL);
+    }
+    
+    /* 不认识的选项报错 */
+    char *bad_args[] = {"-lz", dir, NULL};
+    ok = ok && builtin_ls(bad_args) != 0;
+    
+    unlink(hidden);
+    rmdir(dir);
+    return ok;
+}
+
+/* 测试stat命令 */
+int test_stat_command(void) {
+    /* 捕获stdout的输出 */
+    char output_buffer[4096];
+    memset(output_buffer, 0, sizeof(output_buffer));
+    output_capture_t capture;
+    output_capture_begin(&capture);
+    
+    /* 一次查询多个文件 */
+    char *args[] = {"/", "/tmp", NULL};
+    int result = builtin_stat(args);
+    
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer) - 1);
+    
+    if (result != 0) {
+        return 0;
+    }
+    
+    /* 输出按参数顺序排列 */
+    char *first = strstr(output_buffer, "File: /\n");
+    char *second = strstr(output_buffer, "File: /tmp\n");
+    return (first != NULL && second != NULL && first < second &&
+            strstr(output_buffer, "directory") != NULL);
+}
+
+/* 测试stat命令处理不存在的文件 */
+int test_stat_nonexistent_file(void) {
+    char *args[] = {"/nonexistent_file_12345", NULL};
+    int result = builtin_stat(args);
+    
+    /* 应该返回错误 */
+    return (result != 0);
+}
+
+/* 测试echo命令基本功能 */
+int test_echo_command(void) {
+    /* 捕获stdout的输出 */
+    char output_buffer[1024];
+    output_capture_t capture;
+    output_capture_begin(&capture);
     
     /* 执行echo命令 */
     char *args[] = {"echo", "hello", "world", NULL};
     int result = builtin_echo(args);
     
-    /* 恢复stdout */
-    fclose(temp_stdout);
-    stdout = original_stdout;
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer));
     
     /* 检查返回值 */
     if (result != 0) {
@@ -330,51 +407,91 @@ int test_echo_command(void) {
 
 /* 测试echo命令无参数 */
 int test_echo_no_args(void) {
-    /* 重定向stdout */
-    FILE *original_stdout = stdout;
+    /* 捕获stdout的输出 */
     char output_buffer[1024];
-    FILE *temp_stdout = fmemopen(output_buffer, sizeof(output_buffer), "w");
-    if (temp_stdout == NULL) {
-        return 0;
-    }
-    
-    stdout = temp_stdout;
+    output_capture_t capture;
+    output_capture_begin(&capture);
     
     /* 执行echo命令（无参数） */
     char *args[] = {"echo", NULL};
     int result = builtin_echo(args);
     
-    /* 恢复stdout */
-    fclose(temp_stdout);
-    stdout = original_stdout;
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer));
     
     /* 应该成功执行并输出换行 */
     return (result == 0);
 }
 
-/* 测试date命令 */
-int test_date_command(void) {
-    /* 重定向stdout */
-    FILE *original_stdout = stdout;
+/* 测试echo转义处理 */
+int test_echo_escapes(void) {
+    /* 捕获stdout的输出 */
     char output_buffer[1024];
-    FILE *temp_stdout = fmemopen(output_buffer, sizeof(output_buffer), "w");
-    if (temp_stdout == NULL) {
+    memset(output_buffer, 0, sizeof(output_buffer));
+    output_capture_t capture;
+    output_capture_begin(&capture);
+    
+    /* -e解释转义，\c停止输出 */
+    char *args1[] = {"-e", "a\\tb", "v\\tal", "\\x41\\0102", NULL};
+    int result1 = builtin_echo(args1);
+    char *args2[] = {"-E", "raw\\n", NULL};
+    int result2 = builtin_echo(args2);
+    char *args3[] = {"-n", "stop\\cignored", "tail", NULL};
+    int result3 = builtin_echo(args3);
+    
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer));
+    
+    if (result1 != 0 || result2 != 0 || result3 != 0) {
         return 0;
     }
     
-    stdout = temp_stdout;
+    return (strcmp(output_buffer, "a\tb v\tal AB\nraw\\n\nstop") == 0);
+}
+
+/* 测试date命令 */
+int test_date_command(void) {
+    /* 捕获stdout的输出 */
+    char output_buffer[1024];
+    output_capture_t capture;
+    output_capture_begin(&capture);
     
     /* 执行date命令 */
     int result = builtin_date(NULL);
     
-    /* 恢复stdout */
-    fclose(temp_stdout);
-    stdout = original_stdout;
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer));
     
     /* 检查返回值和输出 */
     return (result == 0 && strlen(output_buffer) > 0);
 }
 
+/* 测试date命令格式串、纳秒与指定时间 */
+int test_date_format(void) {
+    /* 捕获stdout的输出 */
+    char output_buffer[1024];
+    memset(output_buffer, 0, sizeof(output_buffer));
+    output_capture_t capture;
+    output_capture_begin(&capture);
+    
+    /* 执行date命令 */
+    char *args[] = {"-u", "-d", "@86400.123456789", "+%Y-%m-%d %H:%M:%S.%N %3N %Z %%N", NULL};
+    int result = builtin_date(args);
+    char *bad_args[] = {"-d", "not-a-date", NULL};
+    int bad_result = builtin_date(bad_args);
+    
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer));
+    
+    /* 检查返回值和输出 */
+    return (result == 0 && bad_result != 0 &&
+            strcmp(output_buffer, "1970-01-02 00:00:00.123456789 123 UTC %N\n") == 0);
+}
+
 /* 测试touch命令创建文件 */
 int test_touch_command(void) {
     /* 创建测试文件名 */
@@ -402,6 +519,37 @@ int test_touch_command(void) {
     return file_exists;
 }
 
+/* 测试touch -d 设置纳秒精度时间戳 */
+int test_touch_explicit_time(void) {
+    char test_file[] = "test_touch_time.tmp";
+    unlink(test_file);
+    
+    /* 文件不存在时应该创建并设置指定时间 */
+    char *args[] = {"-d", "@1700000000.250000001", test_file, NULL};
+    int result = builtin_touch(args);
+    
+    struct stat st;
+    int ok = (result == 0 && stat(test_file, &st) == 0 &&
+              st.st_mtim.tv_sec == 1700000000 && st.st_mtim.tv_nsec == 250000001);
+    
+    /* 已存在的文件通过 -r 复制时间戳 */
+    if (ok) {
+        char ref_file[] = "test_touch_ref.tmp";
+        char *ref_args[] = {ref_file, NULL};
+        char *copy_args[] = {"-r", test_file, ref_file, NULL};
+        builtin_touch(ref_args);
+        result = builtin_touch(copy_args);
+        struct stat ref_st;
+        ok = (result == 0 && stat(ref_file, &ref_st) == 0 &&
+              ref_st.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+              ref_st.st_mtim.tv_nsec == st.st_mtim.tv_nsec);
+        unlink(ref_file);
+    }
+    
+    unlink(test_file);
+    return ok;
+}
+
 /* 测试touch命令无参数 */
 int test_touch_no_args(void) {
     /* 执行touch命令（无参数） */
@@ -467,24 +615,18 @@ int test_cat_command(void) {
     fprintf(fp, "%s", test_content);
     fclose(fp);
     
-    /* 重定向stdout */
-    FILE *original_stdout = stdout;
+    /* 捕获stdout的输出 */
     char output_buffer[1024];
-    FILE *temp_stdout = fmemopen(output_buffer, sizeof(output_buffer), "w");
-    if (temp_stdout == NULL) {
-        unlink(test_file);
-        return 0;
-    }
-    
-    stdout = temp_stdout;
+    output_capture_t capture;
+    output_capture_begin(&capture);
     
     /* 执行cat命令 */
     char *args[] = {"cat", test_file, NULL};
     int result = builtin_cat(args);
     
-    /* 恢复stdout */
-    fclose(temp_stdout);
-    stdout = original_stdout;
+    /* 结束捕获 */
+    output_capture_end(&capture);
+    take_captured_output(&capture, output_buffer, sizeof(output_buffer));
     
     /* 清理测试文件 */
     unlink(test_file);
@@ -554,6 +696,26 @@ int test_cp_command(void) {
     return (dst_exists && content_match);
 }
 
+/* 测试test和[命令：文件测试、字符串和整数比较、-a/-o/! */
+int test_test_command(void) {
+    char *dir_args[] = {"-d", "/tmp", NULL};
+    char *file_args[] = {"-f", "/tmp", NULL};
+    char *compare_args[] = {"abc", "=", "abc", "-a", "!", "2", "-gt", "10", NULL};
+    char *or_args[] = {"1", "-eq", "2", "-o", "-n", "x", "]", NULL};
+    char *bad_number[] = {"x", "-lt", "1", NULL};
+    char *missing_bracket[] = {"a", "=", "a", NULL};
+    
+    if (builtin_test(dir_args) != 0) return 0;
+    if (builtin_test(file_args) != 1) return 0;
+    if (builtin_test(compare_args) != 0) return 0;
+    if (builtin_test(NULL) != 1) return 0;  /* 没有参数为假 */
+    if (builtin_bracket(or_args) != 0) return 0;
+    if (builtin_test(bad_number) != 2) return 0;
+    if (builtin_bracket(missing_bracket) != 2) return 0;
+    
+    return 1;
+}
+
 /* 测试export命令设置环境变量 */
 int test_export_command(void) {
     /* 初始化环境变量系统 */
@@ -585,6 +747,7 @@ int test_builtin_recognition(void) {
     if (!is_builtin("rm")) return 0;
     if (!is_builtin("touch")) return 0;
     if (!is_builtin("date")) return 0;
+    if (!is_builtin("stat")) return 0;
     if (!is_builtin("export")) return 0;
     if (!is_builtin("exit")) return 0;
     
@@ -633,16 +796,24 @@ void run_builtin_tests(void) {
     TEST(test_ls_command);
     TEST(test_ls_specific_directory);
     TEST(test_ls_invalid_directory);
+    TEST(test_ls_long_format);
+    TEST(test_ls_combined_flags);
+    TEST(test_stat_command);
+    TEST(test_stat_nonexistent_file);
     TEST(test_echo_command);
     TEST(test_echo_no_args);
+    TEST(test_echo_escapes);
     TEST(test_date_command);
+    TEST(test_date_format);
     TEST(test_touch_command);
     TEST(test_touch_no_args);
+    TEST(test_touch_explicit_time);
     TEST(test_rm_command);
     TEST(test_rm_nonexistent_file);
     TEST(test_cat_command);
     TEST(test_cat_nonexistent_file);
     TEST(test_cp_command);
+    TEST(test_test_command);
     TEST(test_export_command);
     TEST(test_builtin_recognition);
     TEST(test_builtin_execution_interface);
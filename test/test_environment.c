@@ -297,6 +297,334 @@ void test_variable_expansion_boundary(void) {
     TEST_PASS();
 }
 
+/* 测试位置参数与参数数组扩展 */
+void test_positional_parameters(void) {
+    TEST_START("positional parameters expansion");
+    
+    static char *params[] = {"first", "second", "third"};
+    set_positional_params("script.sh", 3, params);
+    
+    char *result = expand_variables("$0:$1:${2}:$#:$*");
+    ASSERT_NOT_NULL(result, "Expansion result should not be NULL");
+    ASSERT_STR_EQUAL(result, "script.sh:first:second:3:first second third",
+                     "Positional parameters should be expanded");
+    TRACKED_FREE(result);
+    
+    /* "$@"单独作为参数时展开为多个参数 */
+    char *args[] = {"echo", "$@", "$4x", "plain", NULL};
+    char **expanded = NULL;
+    int argc = 0;
+    ASSERT_INT_EQUAL(expand_arguments(args, 4, &expanded, &argc), 0, "Argument expansion should succeed");
+    ASSERT_NOT_NULL(expanded, "Arguments containing $ should be expanded");
+    ASSERT_INT_EQUAL(argc, 6, "$@ should expand to one argument per parameter");
+    ASSERT_STR_EQUAL(expanded[1], "first", "First positional argument");
+    ASSERT_STR_EQUAL(expanded[3], "third", "Last positional argument");
+    ASSERT_STR_EQUAL(expanded[4], "x", "Unset positional parameter should expand to empty");
+    ASSERT_NULL(expanded[6], "Expanded argument array should be NULL-terminated");
+    free_expanded_arguments(expanded);
+    
+    /* 不含$的参数数组不需要复制 */
+    char *plain_args[] = {"ls", "-l", NULL};
+    ASSERT_INT_EQUAL(expand_arguments(plain_args, 2, &expanded, &argc), 0, "Plain expansion should succeed");
+    ASSERT_NULL(expanded, "Arguments without $ should be used as-is");
+    
+    set_positional_params(NULL, 0, NULL);
+    
+    TEST_PASS();
+}
+
+/* 测试特殊参数：$?、$$、$!直接取自Shell状态，"$@"在单词中间也展开为多个参数 */
+void test_special_parameters(void) {
+    TEST_START("special parameters");
+    
+    int saved_status = g_shell_state.last_exit_status;
+    g_shell_state.last_exit_status = 42;
+    char *result = expand_variables("$?:${?}:[$!]");
+    ASSERT_STR_EQUAL(result, "42:42:[]", "$? should come from the last exit status");
+    TRACKED_FREE(result);
+    g_shell_state.last_exit_status = saved_status;
+    
+    char pid[32];
+    snprintf(pid, sizeof(pid), "%ld", (long)getpid());
+    result = expand_variables("$$");
+    ASSERT_STR_EQUAL(result, pid, "$$ should be the shell's PID");
+    TRACKED_FREE(result);
+    
+    static char *params[] = {"a b", "c"};
+    set_positional_params("script.sh", 2, params);
+    char *args[] = {"echo", "\"<$@>\"", "\"$*\"", NULL};
+    char **expanded = NULL;
+    int argc = 0;
+    ASSERT_INT_EQUAL(expand_arguments(args, 3, &expanded, &argc), 0, "Argument expansion should succeed");
+    ASSERT_INT_EQUAL(argc, 4, "\"<$@>\" should produce one argument per parameter");
+    ASSERT_STR_EQUAL(expanded[1], "<a b", "Prefix joins the first parameter");
+    ASSERT_STR_EQUAL(expanded[2], "c>", "Suffix joins the last parameter");
+    ASSERT_STR_EQUAL(expanded[3], "a b c", "\"$*\" should be a single argument");
+    free_expanded_arguments(expanded);
+    
+    set_positional_params("script.sh", 0, NULL);
+    char *empty_args[] = {"echo", "\"$@\"", NULL};
+    ASSERT_INT_EQUAL(expand_arguments(empty_args, 2, &expanded, &argc), 0, "Empty expansion should succeed");
+    ASSERT_INT_EQUAL(argc, 1, "\"$@\" without parameters should produce no argument");
+    free_expanded_arguments(expanded);
+    
+    set_positional_params(NULL, 0, NULL);
+    TEST_PASS();
+}
+
+/* 测试参数展开运算符：默认值、长度、删除前后缀、替换和子串 */
+void test_parameter_operators(void) {
+    TEST_START("parameter expansion operators");
+    
+    set_env_var("PE_PATH", "/usr/src/main.tar.gz");
+    set_env_var("PE_EMPTY", "");
+    set_env_var("PE_AAA", "aaa");
+    unset_env_var("PE_NEW");
+    
+    static const struct {
+        const char *input;
+        const char *expected;
+    } cases[] = {
+        {"${PE_PATH##*/}", "main.tar.gz"},
+        {"${PE_PATH#*/}", "usr/src/main.tar.gz"},
+        {"${PE_PATH%.*}", "/usr/src/main.tar"},
+        {"${PE_PATH%%.*}", "/usr/src/main"},
+        {"${PE_PATH%/*}", "/usr/src"},
+        {"${#PE_PATH}", "20"},
+        {"${PE_EMPTY:-def}|${PE_EMPTY-def}|${PE_UNSET+set}|${PE_PATH:+set}", "def|||set"},
+        {"${PE_PATH/src/lib}", "/usr/lib/main.tar.gz"},
+        {"${PE_PATH//[.\\/]/_}", "_usr_src_main_tar_gz"},
+        {"${PE_AAA//*/x}|${PE_AAA//a*/x}|${PE_EMPTY//*/x}", "x|x|x"},
+        {"${PE_PATH/#\\/usr/~}|${PE_PATH/%gz/xz}", "~/src/main.tar.gz|/usr/src/main.tar.xz"},
+        {"${PE_PATH:5:3}|${PE_PATH: -2}|${PE_PATH:1:-7}", "src|gz|usr/src/main"},
+        {"${PE_UNSET:-${PE_PATH##*.}}", "gz"},
+        {"${PE_NEW:=assigned}", "assigned"},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        char *result = expand_variables((char *)cases[i].input);
+        ASSERT_NOT_NULL(result, "Parameter expansion should succeed");
+        ASSERT_STR_EQUAL(result, cases[i].expected, cases[i].input);
+        TRACKED_FREE(result);
+    }
+    ASSERT_STR_EQUAL(get_env_var("PE_NEW"), "assigned", "${VAR:=word} should assign the variable");
+    
+    /* 引号内的通配符只匹配自身 */
+    char *quoted = expand_single_word("\"${PE_PATH%\".*\"}\"");
+    ASSERT_STR_EQUAL(quoted, "/usr/src/main.tar.gz", "Quoted * in a pattern should be literal");
+    TRACKED_FREE(quoted);
+    
+    ASSERT_NULL(expand_variables("${PE_PATH!}"), "Bad substitution should fail");
+    
+    unset_env_var("PE_PATH");
+    unset_env_var("PE_EMPTY");
+    unset_env_var("PE_AAA");
+    unset_env_var("PE_NEW");
+    TEST_PASS();
+}
+
+/* 测试下标数组和关联数组：复合赋值、稀疏下标、按下标和键展开以及删除元素 */
+void test_array_variables(void) {
+    TEST_START("indexed and associative arrays");
+    
+    char *elements[] = {"a", "b c", "[10]=j", "k"};
+    ASSERT_INT_EQUAL(assign_compound("ARR_T", 0, elements, 4), 0, "Compound assignment should succeed");
+    ASSERT_INT_EQUAL(set_array_element("ARR_T", "1000000", "far", 0), 0, "Large subscript should switch to sparse storage");
+    ASSERT_STR_EQUAL(get_env_var("ARR_T"), "a", "$ARR_T should be element 0");
+    
+    char *args[] = {"echo", "\"${ARR_T[@]}\"", "${#ARR_T[@]}", "\"${!ARR_T[*]}\"", "${ARR_T[-1]}", "${ARR_T[1]}", NULL};
+    char **expanded = NULL;
+    int argc = 0;
+    ASSERT_INT_EQUAL(expand_arguments(args, 6, &expanded, &argc), 0, "Array expansion should succeed");
+    ASSERT_INT_EQUAL(argc, 10, "\"${ARR_T[@]}\" should produce one argument per element");
+    ASSERT_STR_EQUAL(expanded[2], "b c", "Elements should not be split");
+    ASSERT_STR_EQUAL(expanded[4], "k", "Element after [10]= should be at index 11");
+    ASSERT_STR_EQUAL(expanded[6], "5", "${#ARR_T[@]} should count set elements");
+    ASSERT_STR_EQUAL(expanded[7], "0 1 10 11 1000000", "Indices should be in ascending order");
+    ASSERT_STR_EQUAL(expanded[8], "far", "Negative subscripts count from the end");
+    free_expanded_arguments(expanded);
+    
+    ASSERT_INT_EQUAL(unset_array_element("ARR_T", "10"), 0, "Unsetting an element should succeed");
+    ASSERT_NULL(get_array_element("ARR_T", "10", &argc), "Unset element should be gone");
+    unset_env_var("ARR_T");
+    
+    ASSERT_NOT_NULL(make_array_var("MAP_T", 1), "declare -A should create an associative array");
+    set_array_element("MAP_T", "zeta", "1", 0);
+    set_array_element("MAP_T", "alpha", "2", 0);
+    set_array_element("MAP_T", "key with space", "3", 0);
+    set_array_element("MAP_T", "alpha", "+", 1);
+    unset_array_element("MAP_T", "zeta");
+    char *result = expand_variables("${!MAP_T[@]}=${MAP_T[@]}|${MAP_T[alpha]}|${#MAP_T[@]}");
+    ASSERT_STR_EQUAL(result, "alpha key with space=2+ 3|2+|2", "Keys should keep insertion order");
+    TRACKED_FREE(result);
+    ASSERT_NULL(make_array_var("MAP_T", 0), "An associative array cannot become indexed");
+    ASSERT_NULL(get_env_var("MAP_T"), "$MAP_T should be the (unset) key \"0\"");
+    unset_env_var("MAP_T");
+    
+    TEST_PASS();
+}
+
+/* 在子进程环境中查找NAME=value */
+static const char* find_exported(const char *name) {
+    size_t len = strlen(name);
+    for (char **entry = get_exported_environment(); entry != NULL && *entry != NULL; entry++) {
+        if (strncmp(*entry, name, len) == 0 && (*entry)[len] == '=') {
+            return *entry + len + 1;
+        }
+    }
+    return NULL;
+}
+
+/* 测试Shell变量与导出变量：赋值不写入进程环境，export和命令前的临时赋值只影响子进程的环境 */
+void test_exported_variables(void) {
+    TEST_START("shell-local and exported variables");
+    
+    ASSERT_INT_EQUAL(set_env_var("EXP_LOCAL", "1"), 0, "Assignment should succeed");
+    ASSERT_NULL(find_exported("EXP_LOCAL"), "Plain assignments stay in the shell");
+    ASSERT_NULL(getenv("EXP_LOCAL"), "The process environment should not change");
+    
+    ASSERT_INT_EQUAL(export_env_var("EXP_LOCAL", NULL), 0, "export should succeed");
+    ASSERT_STR_EQUAL(find_exported("EXP_LOCAL"), "1", "Exported variables reach child processes");
+    set_env_var("EXP_LOCAL", "2");
+    ASSERT_STR_EQUAL(find_exported("EXP_LOCAL"), "2", "Changing an exported variable updates the child environment");
+    ASSERT_NULL(getenv("EXP_LOCAL"), "Exporting should not touch environ either");
+    
+    char *words[] = {"EXP_LOCAL+=3", "EXP_TEMP=$EXP_LOCAL", NULL};
+    local_scope_t scope;
+    ASSERT_INT_EQUAL(push_temporary_assignments(words, 2, &scope), 0, "Prefix assignments should succeed");
+    ASSERT_STR_EQUAL(find_exported("EXP_TEMP"), "23", "Prefix assignments are exported for the command");
+    pop_local_scope();
+    ASSERT_NULL(get_env_var("EXP_TEMP"), "Prefix assignments end with the command");
+    ASSERT_STR_EQUAL(find_exported("EXP_LOCAL"), "2", "Previous value and export flag should be restored");
+    
+    unset_env_var("EXP_LOCAL");
+    ASSERT_NULL(find_exported("EXP_LOCAL"), "Unset variables leave the child environment");
+    TEST_PASS();
+}
+
+/* 测试路径名扩展：结果按字节排序，引号内的通配符不展开，没有匹配时保留原样 */
+void test_pathname_expansion(void) {
+    TEST_START("pathname expansion");
+    
+    char dir[] = "/tmp/myshell_glob_XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(dir), "Temporary directory should be created");
+    static const char *files[] = {"b.c", "a.c", "B.h", ".hidden.c", "sub/c.c", "sub/deep/d.c"};
+    char path[256];
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    mkdir(path, 0755);
+    snprintf(path, sizeof(path), "%s/sub/deep", dir);
+    mkdir(path, 0755);
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        close(open(path, O_WRONLY | O_CREAT, 0644));
+    }
+    
+    char pattern[256], quoted[256], none[256], star[256];
+    snprintf(pattern, sizeof(pattern), "%s/[a-z]*", dir);
+    snprintf(quoted, sizeof(quoted), "%s/\"*\".c", dir);
+    snprintf(none, sizeof(none), "%s/*.none", dir);
+    snprintf(star, sizeof(star), "%s/**/*.c", dir);
+    char *args[] = {"echo", pattern, quoted, none, NULL};
+    char **expanded = NULL;
+    int argc = 0;
+    ASSERT_INT_EQUAL(expand_arguments(args, 4, &expanded, &argc), 0, "Pathname expansion should succeed");
+    ASSERT_INT_EQUAL(argc, 6, "Each match becomes one argument");
+    snprintf(path, sizeof(path), "%s/a.c", dir);
+    ASSERT_STR_EQUAL(expanded[1], path, "Matches should be sorted byte-wise");
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    ASSERT_STR_EQUAL(expanded[3], path, "Hidden files are skipped and directories match");
+    snprintf(path, sizeof(path), "%s/*.c", dir);
+    ASSERT_STR_EQUAL(expanded[4], path, "Quoted wildcards match only themselves");
+    snprintf(path, sizeof(path), "%s/*.none", dir);
+    ASSERT_STR_EQUAL(expanded[5], path, "A pattern without matches is kept as-is");
+    free_expanded_arguments(expanded);
+    
+    int saved_options = g_shell_state.glob_options;
+    g_shell_state.glob_options = GLOB_OPT_GLOBSTAR | GLOB_OPT_NULLGLOB;
+    char *star_args[] = {"echo", star, none, NULL};
+    ASSERT_INT_EQUAL(expand_arguments(star_args, 3, &expanded, &argc), 0, "Globstar expansion should succeed");
+    ASSERT_INT_EQUAL(argc, 5, "** should match files in every subdirectory and nullglob drops the rest");
+    snprintf(path, sizeof(path), "%s/sub/deep/d.c", dir);
+    ASSERT_STR_EQUAL(expanded[4], path, "** should descend more than one level");
+    free_expanded_arguments(expanded);
+    g_shell_state.glob_options = saved_options;
+    
+    for (size_t i = sizeof(files) / sizeof(files[0]); i > 0; i--) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i - 1]);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/sub/deep", dir);
+    rmdir(path);
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    rmdir(path);
+    rmdir(dir);
+    TEST_PASS();
+}
+
+/* 测试花括号展开：候选和范围逐个生成，右边的花括号变化最快，引号内的花括号不展开 */
+void test_brace_expansion(void) {
+    TEST_START("brace expansion");
+    
+    set_env_var("BR_DIR", "src");
+    char *args[] = {"echo", "$BR_DIR/{a,b{1..2}}.c", "{08..10..2}", "'{x,y}'", "{z}", "{,-}", NULL};
+    char **expanded = NULL;
+    int argc = 0;
+    ASSERT_INT_EQUAL(expand_arguments(args, 6, &expanded, &argc), 0, "Brace expansion should succeed");
+    ASSERT_INT_EQUAL(argc, 9, "Each generated word becomes an argument and empty words are dropped");
+    ASSERT_STR_EQUAL(expanded[1], "src/a.c", "Generated words are expanded afterwards");
+    ASSERT_STR_EQUAL(expanded[3], "src/b2.c", "Nested ranges follow their alternative");
+    ASSERT_STR_EQUAL(expanded[4], "08", "Zero-padded ranges keep their width");
+    ASSERT_STR_EQUAL(expanded[5], "10", "Ranges honour the increment");
+    ASSERT_STR_EQUAL(expanded[6], "{x,y}", "Quoted braces are not expanded");
+    ASSERT_STR_EQUAL(expanded[7], "{z}", "Braces without a comma or range are literal");
+    ASSERT_STR_EQUAL(expanded[8], "-", "The empty alternative produces no argument");
+    free_expanded_arguments(expanded);
+    unset_env_var("BR_DIR");
+    
+    brace_expansion_t *braces = NULL;
+    ASSERT_INT_EQUAL(brace_compile("{1..3}{a,b}", &braces), 0, "Compiling should succeed");
+    ASSERT_NOT_NULL(braces, "The word has brace expansions");
+    int failed = 0;
+    ASSERT_STR_EQUAL(brace_next(braces, &failed), "1a", "First word");
+    ASSERT_STR_EQUAL(brace_next(braces, &failed), "1b", "The rightmost brace varies fastest");
+    for (int i = 0; i < 4; i++) {
+        brace_next(braces, &failed);
+    }
+    ASSERT_NULL(brace_next(braces, &failed), "The generator stops after the last word");
+    ASSERT_INT_EQUAL(failed, 0, "Stopping is not an error");
+    brace_free(braces);
+    
+    TEST_PASS();
+}
+
+/* 测试命令替换：只输出的内部命令在当前进程中执行，其他命令在子进程中执行；末尾的换行被去掉 */
+void test_command_substitution(void) {
+    TEST_START("command substitution");
+    
+    char *result = expand_single_word("[$(echo a  b)|`echo \\`echo nested\\``]");
+    ASSERT_STR_EQUAL(result, "[a b|nested]", "$(...) and nested backquotes should be replaced by the output");
+    TRACKED_FREE(result);
+    
+    result = expand_single_word("\"$(/bin/echo forked; /bin/echo)\"");
+    ASSERT_STR_EQUAL(result, "forked", "External commands run in a child and trailing newlines are trimmed");
+    TRACKED_FREE(result);
+    
+    result = expand_single_word("$(false)");
+    ASSERT_STR_EQUAL(result, "", "A command without output expands to nothing");
+    ASSERT_INT_EQUAL(g_shell_state.last_exit_status, 1, "The exit status of the substitution should be kept");
+    TRACKED_FREE(result);
+    
+    char *args[] = {"echo", "$(echo 1 2)x", "\"$(echo 3 4)\"", NULL};
+    char **expanded = NULL;
+    int argc = 0;
+    ASSERT_INT_EQUAL(expand_arguments(args, 3, &expanded, &argc), 0, "Argument expansion should succeed");
+    ASSERT_INT_EQUAL(argc, 4, "Unquoted output is split on whitespace, quoted output is not");
+    ASSERT_STR_EQUAL(expanded[2], "2x", "The last field joins the rest of the word");
+    ASSERT_STR_EQUAL(expanded[3], "3 4", "Quoted output stays one argument");
+    free_expanded_arguments(expanded);
+    
+    TEST_PASS();
+}
+
 /* 运行所有环境变量测试 */
 void run_environment_tests(void) {
     printf("=== Environment Variable Tests ===\n\n");
@@ -315,6 +643,14 @@ void run_environment_tests(void) {
     test_env_var_unset();
     test_variable_expansion();
     test_variable_expansion_boundary();
+    test_positional_parameters();
+    test_parameter_operators();
+    test_special_parameters();
+    test_array_variables();
+    test_exported_variables();
+    test_pathname_expansion();
+    test_brace_expansion();
+    test_command_substitution();
     test_path_dirs();
     test_path_search();
     
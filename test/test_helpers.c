@@ -0,0 +1,16 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "test_helpers.h"
+
+/**
+ * 把捕获到的输出复制到buffer（以'\0'结尾，超出部分截断）并释放捕获缓冲区
+ */
+void take_captured_output(output_capture_t *capture, char *buffer, size_t size) {
+    size_t len = (capture->len < size - 1) ? capture->len : size - 1;
+    if (len > 0) {
+        memcpy(buffer, capture->data, len);
+    }
+    buffer[len] = '\0';
+    free(capture->data);
+}
@@ -0,0 +1,9 @@
+#ifndef TEST_HELPERS_H
+#define TEST_HELPERS_H
+
+#include "../src/shell.h"
+
+/* 各测试文件共用的辅助函数 - test_helpers.c */
+void take_captured_output(output_capture_t *capture, char *buffer, size_t size);
+
+#endif /* TEST_HELPERS_H */
@@ -349,6 +349,305 @@ void test_command_structure_initialization(void) {
     TEST_PASS();
 }
 
+/* 测试命令列表、管道和分组的语法树结构 */
+void test_parse_command_lists(void) {
+    TEST_START("command list syntax tree");
+    
+    const char *input = "a 1 && b || c; d | e | f\n{ g; } && ( h )";
+    syntax_tree_t *tree = parse_input(NULL, input, strlen(input));
+    ASSERT_NOT_NULL(tree, "Valid input should parse");
+    ASSERT_NOT_NULL(tree->root, "Tree should have a root");
+    ASSERT_INT_EQUAL(tree->root->type, NODE_SEQUENCE, "Top level should be a sequence");
+    
+    /* (a 1 && b) || c：与或列表左结合 */
+    node_t *first = tree->root->children;
+    ASSERT_INT_EQUAL(first->type, NODE_OR, "First item should be ||");
+    ASSERT_INT_EQUAL(first->left->type, NODE_AND, "Left of || should be &&");
+    ASSERT_STR_EQUAL(first->left->left->command->args[1], "1", "Argument should be kept");
+    ASSERT_INT_EQUAL(first->left->left->command->argc, 2, "First command has two words");
+    
+    node_t *pipeline = first->next;
+    ASSERT_INT_EQUAL(pipeline->type, NODE_PIPELINE, "Second item should be a pipeline");
+    ASSERT_STR_EQUAL(pipeline->children->next->next->command->command, "f", "Pipeline should have three stages");
+    
+    node_t *last = pipeline->next;
+    ASSERT_INT_EQUAL(last->type, NODE_AND, "Third item should be &&");
+    ASSERT_INT_EQUAL(last->line, 2, "Third item starts on line 2");
+    ASSERT_INT_EQUAL(last->left->type, NODE_GROUP, "Left of && should be a group");
+    ASSERT_INT_EQUAL(last->right->type, NODE_SUBSHELL, "Right of && should be a subshell");
+    ASSERT_NULL(last->next, "Sequence should have three items");
+    
+    free_syntax_tree(tree);
+    TEST_PASS();
+}
+
+/* 测试引号内的运算符、注释和语法错误 */
+void test_parse_quotes_and_errors(void) {
+    TEST_START("quoting and syntax errors");
+    
+    const char *quoted = "echo \"a; b\" 'c|d' e\\;f # comment";
+    syntax_tree_t *tree = parse_input(NULL, quoted, strlen(quoted));
+    ASSERT_NOT_NULL(tree, "Quoted input should parse");
+    ASSERT_INT_EQUAL(tree->root->type, NODE_COMMAND, "Quoted operators do not split the command");
+    ASSERT_INT_EQUAL(tree->root->command->argc, 4, "Comment should be dropped");
+    ASSERT_STR_EQUAL(tree->root->command->args[1], "\"a; b\"", "Quotes are kept until expansion");
+    free_syntax_tree(tree);
+    
+    tree = parse_input(NULL, "  # only a comment", 18);
+    ASSERT_NOT_NULL(tree, "Comment-only input should parse");
+    ASSERT_NULL(tree->root, "Comment-only input has no commands");
+    free_syntax_tree(tree);
+    
+    const char *bad[] = { "a &&", "| a", "{ a }", "( )", "a ) b", "echo 'open" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        ASSERT_NULL(parse_input(NULL, bad[i], strlen(bad[i])), "Invalid syntax should be rejected");
+    }
+    
+    TEST_PASS();
+}
+
+/* 测试解析缓存：重复的行共享同一棵语法树，容量满时淘汰最久未使用的项 */
+void test_parse_cache(void) {
+    TEST_START("parse cache hits and LRU eviction");
+    
+    unsigned long hits, misses, base_hits, base_misses;
+    int entries;
+    int incomplete;
+    set_parse_cache_size(2);
+    get_parse_cache_stats(&base_hits, &base_misses, NULL);
+    
+    syntax_tree_t *first = parse_line_cached("echo a && echo b", 16, &incomplete);
+    syntax_tree_t *second = parse_line_cached("echo a && echo b", 16, &incomplete);
+    ASSERT_NOT_NULL(first, "Line should parse");
+    ASSERT_TRUE(first == second, "Repeated line should reuse the cached tree");
+    free_syntax_tree(first);
+    free_syntax_tree(second);
+    
+    free_syntax_tree(parse_line_cached("pwd", 3, &incomplete));
+    free_syntax_tree(parse_line_cached("echo a && echo b", 16, &incomplete));  /* 变为最近使用 */
+    free_syntax_tree(parse_line_cached("ls", 2, &incomplete));                 /* 淘汰pwd */
+    free_syntax_tree(parse_line_cached("pwd", 3, &incomplete));
+    
+    get_parse_cache_stats(&hits, &misses, &entries);
+    ASSERT_INT_EQUAL(hits - base_hits, 2, "Two lookups should hit");
+    ASSERT_INT_EQUAL(misses - base_misses, 4, "Evicted line should miss again");
+    ASSERT_INT_EQUAL(entries, 2, "Cache should hold at most two entries");
+    
+    ASSERT_NULL(parse_line_cached("echo (", 6, &incomplete), "Syntax errors should not be cached");
+    
+    set_parse_cache_size(0);
+    TEST_PASS();
+}
+
+/* 测试if/for/case的语法树结构 */
+void test_parse_compound_commands(void) {
+    TEST_START("compound command syntax tree");
+    
+    const char *input = "if a; then b; elif c; then d; else e; fi\n"
+                        "for x in 1 2; do f; done\n"
+                        "case $y in a|b) g;; *) ;; esac";
+    syntax_tree_t *tree = parse_input(NULL, input, strlen(input));
+    ASSERT_NOT_NULL(tree, "Compound commands should parse");
+    
+    node_t *if_node = tree->root->children;
+    ASSERT_INT_EQUAL(if_node->type, NODE_IF, "First item should be if");
+    ASSERT_STR_EQUAL(if_node->left->command->command, "a", "Condition should be a");
+    ASSERT_NOT_NULL(if_node->else_part, "elif should be kept");
+    ASSERT_INT_EQUAL(if_node->else_part->type, NODE_IF, "elif should be a nested if");
+    ASSERT_STR_EQUAL(if_node->else_part->else_part->command->command, "e", "else branch should be e");
+    
+    node_t *for_node = if_node->next;
+    ASSERT_INT_EQUAL(for_node->type, NODE_FOR, "Second item should be for");
+    ASSERT_STR_EQUAL(for_node->name, "x", "Loop variable should be x");
+    ASSERT_INT_EQUAL(for_node->command->argc, 2, "Loop should have two words");
+    
+    node_t *case_node = for_node->next;
+    ASSERT_INT_EQUAL(case_node->type, NODE_CASE, "Third item should be case");
+    ASSERT_STR_EQUAL(case_node->command->args[0], "$y", "Subject is expanded at run time");
+    ASSERT_INT_EQUAL(case_node->children->command->argc, 2, "First item should have two patterns");
+    ASSERT_NULL(case_node->children->next->right, "Empty case item has no commands");
+    free_syntax_tree(tree);
+    
+    const char *bad[] = { "if a; fi", "for 1 in x; do a; done", "then a", "while a; do done", "case a in b) c" };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        ASSERT_NULL(parse_input(NULL, bad[i], strlen(bad[i])), "Invalid compound command should be rejected");
+    }
+    
+    TEST_PASS();
+}
+
+/* 测试函数定义：函数体必须是复合命令，复制后的函数体不依赖原语法树 */
+void test_parse_function_definition(void) {
+    TEST_START("function definition syntax tree");
+    
+    const char *input = "greet () {\n  echo hi $1\n}";
+    syntax_tree_t *tree = parse_input(NULL, input, strlen(input));
+    ASSERT_NOT_NULL(tree, "Function definition should parse");
+    ASSERT_INT_EQUAL(tree->root->type, NODE_FUNCTION, "Root should be a function definition");
+    ASSERT_STR_EQUAL(tree->root->name, "greet", "Function name should be kept");
+    ASSERT_INT_EQUAL(tree->root->right->type, NODE_GROUP, "Body should be a group");
+    
+    syntax_tree_t *copy = copy_syntax_tree(tree->root->right);
+    free_syntax_tree(tree);
+    ASSERT_NOT_NULL(copy, "Body should be copied");
+    ASSERT_STR_EQUAL(copy->root->children->command->args[2], "$1", "Copied words outlive the original tree");
+    free_syntax_tree(copy);
+    
+    ASSERT_NULL(parse_input(NULL, "f() echo x", 10), "Simple command body should be rejected");
+    ASSERT_NULL(parse_input(NULL, "f( { :; }", 9), "Missing ) should be rejected");
+    
+    TEST_PASS();
+}
+
+/* 测试算术命令((...))和$((...))的解析 */
+void test_parse_arithmetic_command(void) {
+    TEST_START("arithmetic command syntax tree");
+    
+    const char *input = "(( i < 10 )) && echo $((i * 2))";
+    syntax_tree_t *tree = parse_input(NULL, input, strlen(input));
+    ASSERT_NOT_NULL(tree, "Arithmetic command should parse");
+    ASSERT_INT_EQUAL(tree->root->type, NODE_AND, "Root should be an AND list");
+    ASSERT_INT_EQUAL(tree->root->left->type, NODE_ARITH, "Left side should be an arithmetic command");
+    ASSERT_STR_EQUAL(tree->root->left->command->args[0], " i < 10 ", "Expression text should be kept");
+    ASSERT_STR_EQUAL(tree->root->right->command->args[1], "$((i * 2))", "Arithmetic expansion should stay one word");
+    free_syntax_tree(tree);
+    
+    ASSERT_NULL(parse_input(NULL, "(( 1 + 2 )", 10), "Unbalanced )) should be rejected");
+    
+    TEST_PASS();
+}
+
+/* 测试赋值单词和复合赋值name=(...)的解析 */
+void test_parse_compound_assignment(void) {
+    TEST_START("compound assignment syntax tree");
+    
+    const char *input = "arr=(one \"two words\"\n [5]=five) m[key]+=x";
+    syntax_tree_t *tree = parse_input(NULL, input, strlen(input));
+    ASSERT_NOT_NULL(tree, "Compound assignment should parse");
+    command_t *cmd = tree->root->command;
+    ASSERT_INT_EQUAL(cmd->argc, 6, "Elements should be kept between the opener and closer");
+    ASSERT_STR_EQUAL(cmd->args[0], "arr=(", "Opener should carry the variable name");
+    ASSERT_STR_EQUAL(cmd->args[2], "\"two words\"", "Quoted element should stay one word");
+    ASSERT_STR_EQUAL(cmd->args[4], ")", "Closer should follow the last element");
+    ASSERT_INT_EQUAL((int)find_assignment(cmd->args[5]), 7, "Subscripted += should be an assignment");
+    free_syntax_tree(tree);
+    
+    ASSERT_INT_EQUAL((int)find_assignment("1a=b"), 0, "Names cannot start with a digit");
+    ASSERT_NULL(parse_input(NULL, "echo a=(1)", 10), "( after an ordinary argument is a syntax error");
+    
+    TEST_PASS();
+}
+
+/* 测试重定向的解析：任意位置的重定向、描述符号和&>，以及[[ ]]中的<和> */
+void test_parse_redirections(void) {
+    TEST_START("redirection syntax tree");
+    
+    const char *input = "< in cmd a>out 2>&1 b 10>>log &> all";
+    syntax_tree_t *tree = parse_input(NULL, input, strlen(input));
+    ASSERT_NOT_NULL(tree, "Redirections should parse");
+    command_t *cmd = tree->root->command;
+    ASSERT_INT_EQUAL(cmd->argc, 3, "Redirections should not become arguments");
+    ASSERT_STR_EQUAL(cmd->args[1], "a", "Word before > should end at the operator");
+    
+    redirection_t *r = cmd->redirections;
+    ASSERT_TRUE(r != NULL && r->type == REDIR_INPUT && r->fd == 0, "< should redirect fd 0");
+    r = r->next;
+    ASSERT_TRUE(r != NULL && r->type == REDIR_OUTPUT && r->fd == 1, "> should redirect fd 1");
+    ASSERT_STR_EQUAL(r->word, "out", "Target should be the next word");
+    r = r->next;
+    ASSERT_TRUE(r != NULL && r->type == REDIR_DUPLICATE && r->fd == 2, "2>&1 should duplicate onto fd 2");
+    r = r->next;
+    ASSERT_TRUE(r != NULL && r->type == REDIR_APPEND && r->fd == 10, "10>> should append to fd 10");
+    r = r->next;
+    ASSERT_TRUE(r != NULL && r->type == REDIR_OUTPUT_ALL && r->next == NULL, "&> should redirect both outputs");
+    free_syntax_tree(tree);
+    
+    input = "[[ a < b ]]";
+    tree = parse_input(NULL, input, strlen(input));
+    ASSERT_NOT_NULL(tree, "< inside [[ ]] should parse");
+    ASSERT_STR_EQUAL(tree->root->command->args[1], "<", "< inside [[ ]] should stay a word");
+    free_syntax_tree(tree);
+    
+    ASSERT_NULL(parse_input(NULL, "echo >", 6), "Missing target should be rejected");
+    ASSERT_NULL(parse_input(NULL, "echo > ;", 8), "Operator as target should be rejected");
+    
+    TEST_PASS();
+}
+
+/* 测试命令替换中的case语句：模式的右括号不结束$(...) */
+void test_parse_case_in_substitution(void) {
+    TEST_START("case inside command substitution");
+    
+    const char *input = "echo $(case x in x) echo cx;; esac) \"$(case y in (y|z) echo cy;; esac)\" <(case a in a) :;; esac) end";
+    syntax_tree_t *tree = parse_input(NULL, input, strlen(input));
+    ASSERT_NOT_NULL(tree, "case inside $(...) should parse");
+    command_t *cmd = tree->root->command;
+    ASSERT_INT_EQUAL(cmd->argc, 5, "Each substitution should stay one word");
+    ASSERT_STR_EQUAL(cmd->args[1], "$(case x in x) echo cx;; esac)", "Pattern ) should not close the substitution");
+    ASSERT_STR_EQUAL(cmd->args[2], "\"$(case y in (y|z) echo cy;; esac)\"", "Parenthesized pattern should parse inside quotes");
+    ASSERT_STR_EQUAL(cmd->args[4], "end", "Parsing should continue after the substitution");
+    free_syntax_tree(tree);
+    
+    input = "echo $(case a in a) echo $(case b in b) echo n;; esac);; esac) $( (echo sub) )";
+    tree = parse_input(NULL, input, strlen(input));
+    ASSERT_NOT_NULL(tree, "Nested case and subshell should parse");
+    ASSERT_INT_EQUAL(tree->root->command->argc, 3, "Nested substitutions should stay one word each");
+    free_syntax_tree(tree);
+    
+    ASSERT_NULL(parse_input(NULL, "echo $(case x in x) echo;; esac", 31), "Unterminated substitution should be rejected");
+    
+    TEST_PASS();
+}
+
+/* 测试here-document的解析：正文在命令行之后读取，引号结束符、<<-和未完的输入 */
+void test_parse_heredoc(void) {
+    TEST_START("here-document syntax tree");
+    
+    const char *input = "cat <<A <<'B'; echo x\nbody $v\nA\n$lit\nB\n\tcat <<-C\n\t\ttabbed\n\tC\necho end";
+    syntax_tree_t *tree = parse_input(NULL, input, strlen(input));
+    ASSERT_NOT_NULL(tree, "Here-documents should parse");
+    node_t *first = tree->root->children;
+    redirection_t *r = first->command->redirections;
+    ASSERT_TRUE(r != NULL && r->type == REDIR_HEREDOC, "Unquoted delimiter should expand the body");
+    ASSERT_STR_EQUAL(r->word, "body $v\n", "Body should stop before the delimiter line");
+    ASSERT_TRUE(r->next != NULL && r->next->type == REDIR_HEREDOC_LITERAL, "Quoted delimiter should keep the body literal");
+    ASSERT_STR_EQUAL(r->next->word, "$lit\n", "Second body should follow the first");
+    ASSERT_STR_EQUAL(first->next->command->args[1], "x", "Rest of the command line should still parse");
+    ASSERT_STR_EQUAL(first->next->next->command->redirections->word, "tabbed\n", "<<- should strip all leading tabs");
+    ASSERT_STR_EQUAL(first->next->next->next->command->args[1], "end", "Parsing should resume after the delimiter");
+    ASSERT_INT_EQUAL(first->next->next->next->line, 9, "Line numbers should count the body lines");
+    free_syntax_tree(tree);
+    
+    int incomplete = 0;
+    input = "cat <<EOF\nno end yet\n";
+    ASSERT_NULL(parse_input_partial(input, strlen(input), &incomplete), "Unterminated body should need more input");
+    ASSERT_INT_EQUAL(incomplete, 1, "Missing delimiter should be reported as incomplete");
+    
+    TEST_PASS();
+}
+
+/* 测试不完整输入的识别：缺少结束关键字或引号时等待后续行 */
+void test_parse_incomplete_input(void) {
+    TEST_START("incomplete input detection");
+    
+    int incomplete = 0;
+    const char *open[] = { "if true; then", "for i in 1 2\ndo", "echo 'a", "a &&", "echo \\" };
+    for (size_t i = 0; i < sizeof(open) / sizeof(open[0]); i++) {
+        ASSERT_NULL(parse_input_partial(open[i], strlen(open[i]), &incomplete), "Incomplete input should not parse");
+        ASSERT_TRUE(incomplete, "Input should be reported as incomplete");
+    }
+    
+    ASSERT_NULL(parse_input_partial("fi", 2, &incomplete), "Stray fi is an error");
+    ASSERT_FALSE(incomplete, "Syntax errors are not incomplete input");
+    
+    syntax_tree_t *tree = parse_input_partial("if true; then\necho ok\nfi", 24, &incomplete);
+    ASSERT_NOT_NULL(tree, "Completed input should parse");
+    ASSERT_FALSE(incomplete, "Completed input is not incomplete");
+    free_syntax_tree(tree);
+    
+    TEST_PASS();
+}
+
 /* 运行所有解析器测试 */
 void run_parser_tests(void) {
     printf("=== Command Parser Tests ===\n\n");
@@ -374,6 +673,17 @@ void run_parser_tests(void) {
     test_argument_separation();
     test_tokenize_boundary_conditions();
     test_command_structure_initialization();
+    test_parse_command_lists();
+    test_parse_quotes_and_errors();
+    test_parse_compound_commands();
+    test_parse_incomplete_input();
+    test_parse_function_definition();
+    test_parse_arithmetic_command();
+    test_parse_compound_assignment();
+    test_parse_redirections();
+    test_parse_heredoc();
+    test_parse_case_in_substitution();
+    test_parse_cache();
     
     /* 打印测试结果 */
     printf("\n=== Test Results ===\n");